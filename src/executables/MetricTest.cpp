@@ -1,5 +1,8 @@
 #include "Metric.h"
+#include "MultiDArray.h"
+#include "Grid3DCart.h"
 #include <iostream>
+#include <ctime>
 
 using namespace std;
 
@@ -11,6 +14,166 @@ bool print_test(const double result, const double expected){
 	return pass;
 }
 
+#if NDIMS==3
+//------------------------------------------------------------
+// Schwarzschild (M=1) in isotropic Cartesian coordinates, where
+// g_ij = psi^4 delta_ij, alpha = (1-h)/(1+h), beta=0, with
+// h=1/(2r) and psi=1+h. Returns the metric and the exact
+// spatial derivatives of the three-metric and lapse.
+//------------------------------------------------------------
+void isotropic_schwarzschild(const double x[3], Metric* g, Tuple<Tuple<double,6>,3>* dg3_dx, Tuple<double,3>* da_dx){
+	const double r = sqrt(x[0]*x[0] + x[1]*x[1] + x[2]*x[2]);
+	const double h = 0.5/r;
+	const double psi = 1.+h;
+	g->alpha = (1.-h)/(1.+h);
+	g->betaup = 0;
+	g->gammalow.data = 0;
+	g->gammalow.data[ixx] = g->gammalow.data[iyy] = g->gammalow.data[izz] = pow(psi,4);
+	g->update();
+	for(size_t a=0; a<3; a++){
+		const double dh_dx = -x[a] / (2.*r*r*r);
+		(*dg3_dx)[a] = 0;
+		(*dg3_dx)[a][ixx] = (*dg3_dx)[a][iyy] = (*dg3_dx)[a][izz] = 4.*pow(psi,3) * dh_dx;
+		(*da_dx)[a] = -2./(psi*psi) * dh_dx;
+	}
+}
+
+//------------------------------------------------------------
+// Compare the two ways Grid3DCart gets Christoffel symbols
+// against the exact ones: differentiating the interpolated
+// metric every step, or interpolating symbols precomputed at
+// zone centers (Grid3DCart_precompute_christoffel=1). Returns
+// whether both stay within tolerance.
+//------------------------------------------------------------
+bool compare_christoffel(){
+	const size_t nzones = 32;
+	const double xmin=3, xmax=6;
+	vector<Axis> xAxes(3, Axis(xmin, xmax, nzones));
+
+	// the same fields Grid3DCart stores, sampled at zone centers
+	MultiDArray<double,6,3> g3;
+	ScalarMultiDArray<double,3> lapse;
+	MultiDArray<double,3,3> betaup;
+	MultiDArray<double,40,3> christoffel;
+	g3.set_axes(xAxes);
+	lapse.set_axes(xAxes);
+	betaup.set_axes(xAxes);
+	christoffel.set_axes(xAxes);
+	for(size_t z_ind=0; z_ind<g3.size(); z_ind++){
+		size_t dir_ind[3];
+		g3.indices(z_ind,dir_ind);
+		double x[3];
+		for(size_t d=0; d<3; d++) x[d] = xAxes[d].mid[dir_ind[d]];
+		Metric g;
+		Tuple<Tuple<double,6>,3> dg3_dx;
+		Tuple<double,3> da_dx;
+		isotropic_schwarzschild(x, &g, &dg3_dx, &da_dx);
+		g3[z_ind] = g.gammalow.data;
+		lapse[z_ind] = g.alpha;
+		betaup[z_ind] = g.betaup;
+	}
+
+	// precompute exactly as Grid3DCart::set_christoffel does
+	for(size_t z_ind=0; z_ind<christoffel.size(); z_ind++){
+		Metric g;
+		g.alpha = lapse[z_ind];
+		g.betaup = betaup[z_ind];
+		g.gammalow.data = g3[z_ind];
+		g.update();
+		Tuple<Tuple<double,6>,3> dg3_dx;
+		Tuple<double,3> da_dx;
+		Tuple<Tuple<double,3>,3> dbetaup_dx;
+		for(size_t d=0; d<3; d++){
+			dg3_dx[d] = g3.slope(z_ind,d);
+			da_dx[d] = lapse.slope(z_ind,d)[0];
+			dbetaup_dx[d] = betaup.slope(z_ind,d);
+		}
+		christoffel[z_ind] = Grid3DCart::christoffel_from_derivatives(g, dg3_dx, da_dx, dbetaup_dx).data;
+	}
+
+	// sample points between the outermost zone centers, where both
+	// methods interpolate rather than extrapolate
+	const size_t nsamples = 20000;
+	vector<InterpolationCube<3> > icube(nsamples);
+	vector<Metric> g(nsamples);
+	vector<Christoffel> exact(nsamples);
+	const double lo = xAxes[0].mid[0], hi = xAxes[0].mid[nzones-1];
+	const double r3[3] = {0.8191725133961645, 0.6710436067037893, 0.5497004779019703}; // low-discrepancy sequence
+	for(size_t n=0; n<nsamples; n++){
+		double x[3];
+		size_t dir_ind[3];
+		for(size_t d=0; d<3; d++){
+			x[d] = lo + (hi-lo) * fmod((n+1)*r3[d], 1.0);
+			dir_ind[d] = xAxes[d].bin(x[d]);
+		}
+		g3.set_InterpolationCube(&icube[n], x, dir_ind);
+		icube[n].set_slope_weights(x);
+
+		Tuple<Tuple<double,6>,3> dg3_dx;
+		Tuple<double,3> da_dx;
+		Tuple<Tuple<double,3>,3> dbetaup_dx;
+		for(size_t d=0; d<3; d++) dbetaup_dx[d] = 0;
+		isotropic_schwarzschild(x, &g[n], &dg3_dx, &da_dx);
+		exact[n] = Grid3DCart::christoffel_from_derivatives(g[n], dg3_dx, da_dx, dbetaup_dx);
+
+		// transport sees the interpolated metric, not the exact one
+		g[n].alpha = lapse.interpolate(icube[n]);
+		g[n].betaup = betaup.interpolate(icube[n]);
+		g[n].gammalow.data = g3.interpolate(icube[n]);
+		g[n].update();
+	}
+
+	// error relative to the largest exact symbol at each point
+	const string names[2] = {"derivatives ", "precomputed "};
+	double max_err[2] = {0,0}, mean_err[2] = {0,0}, elapsed[2];
+	const size_t nrepeat = 50;
+	for(int method=0; method<2; method++){
+		double checksum = 0;
+		clock_t start = clock();
+		for(size_t rep=0; rep<nrepeat; rep++){
+			for(size_t n=0; n<nsamples; n++){
+				Christoffel ch;
+				if(method==1) ch.data = christoffel.interpolate(icube[n]);
+				else{
+					Tuple<Tuple<double,6>,3> dg3_dx = g3.interpolate_slopes(icube[n]);
+					Tuple<double,3> da_dx = lapse.interpolate_slopes(icube[n]);
+					Tuple<Tuple<double,3>,3> dbetaup_dx = betaup.interpolate_slopes(icube[n]);
+					ch = Grid3DCart::christoffel_from_derivatives(g[n], dg3_dx, da_dx, dbetaup_dx);
+				}
+				checksum += ch.data[Christoffel::index(0,0,0)];
+
+				if(rep>0) continue;
+				double scale=0, err=0;
+				for(size_t i=0; i<40; i++){
+					scale = max(scale, fabs(exact[n].data[i]));
+					err = max(err, fabs(ch.data[i]-exact[n].data[i]));
+				}
+				max_err[method] = max(max_err[method], err/scale);
+				mean_err[method] += err/scale / nsamples;
+			}
+		}
+		elapsed[method] = (double)(clock()-start) / CLOCKS_PER_SEC;
+		cout << " * " << names[method] << nrepeat*nsamples/elapsed[method] << " evaluations/s, "
+		     << "relative error max " << max_err[method] << " mean " << mean_err[method]
+		     << " (checksum " << checksum << ")" << endl;
+	}
+	cout << " * precomputed is " << elapsed[0]/elapsed[1] << "x as fast as derivatives, "
+	     << mean_err[1]/mean_err[0] << "x the mean error" << endl;
+
+	// both are second order in the zone width; a loose bound catches a
+	// broken path without tying the test to the resolution
+	const double tolerance = 2e-2;
+	bool pass = true;
+	for(int method=0; method<2; method++){
+		if(not (max_err[method] < tolerance)){
+			cout << "\tFAIL: " << names[method] << "error exceeds " << tolerance << endl;
+			pass = false;
+		}
+	}
+	return pass;
+}
+#endif
+
 int main(){
 	bool pass = true;
 	cout << "|==================|" << endl;
@@ -93,51 +256,52 @@ int main(){
 	cout << " * g3inv[zz]=";
 	pass = (pass and print_test(g3inv.data[izz],1.0));
 
-// Cholesky decomposition requires a positive definite matrix
-//	cout << "|==============|" << endl;
-//	cout << "| 3 Weird Test |" << endl;
-//	cout << "|==============|" << endl;
-//	g3.data[ixx] = 0;
-//	g3.data[iyy] = 0;
-//	g3.data[izz] = 0;
-//	g3.data[ixy] = 1;
-//	g3.data[ixz] = 1;
-//	g3.data[iyz] = 1;
-//	cout << "kup={" << kup[0] << ","<<kup[1]<<","<<kup[2]<<"}" << endl;
-//
-//	det = g3.det();
-//	cout << " * Determinant=";
-//	pass = (pass and print_test(det,2.0);
-//
-//	klow = g3.lower(kup);
-//	cout << " * klow[0]=";
-//	pass = (pass and print_test(klow[0],5);
-//	cout << " * klow[1]=";
-//	pass = (pass and print_test(klow[1],4);
-//	cout << " * klow[2]=";
-//	pass = (pass and print_test(klow[2],3);
-//
-//	g3inv = g3.inverse();
-//	cout << " * g3inv[xx]=";
-//	pass = (pass and print_test(g3inv.data[ixx],-0.5);
-//	cout << " * g3inv[xy]=";
-//	pass = (pass and print_test(g3inv.data[ixy],0.5);
-//	cout << " * g3inv[xz]=";
-//	pass = (pass and print_test(g3inv.data[ixz],0.5);
-//	cout << " * g3inv[yy]=";
-//	pass = (pass and print_test(g3inv.data[iyy],-0.5);
-//	cout << " * g3inv[yz]=";
-//	pass = (pass and print_test(g3inv.data[iyz],0.5);
-//	cout << " * g3inv[zz]=";
-//	pass = (pass and print_test(g3inv.data[izz],-0.5);
-//
-//	kup = g3inv.lower(klow);
-//	cout << " * kup[0]=";
-//	pass = (pass and print_test(kup[0],1);
-//	cout << " * kup[1]=";
-//	pass = (pass and print_test(kup[1],2);
-//	cout << " * kup[2]=";
-//	pass = (pass and print_test(kup[2],3);
+	cout << "|=====================|" << endl;
+	cout << "| 3 Non-diagonal Test |" << endl;
+	cout << "|=====================|" << endl;
+	// indefinite (eigenvalues 2,-1,-1), so not a physical metric, but det=2>0
+	// and the closed-form inverse only checks the sign of the determinant
+	g3.data[ixx] = 0;
+	g3.data[iyy] = 0;
+	g3.data[izz] = 0;
+	g3.data[ixy] = 1;
+	g3.data[ixz] = 1;
+	g3.data[iyz] = 1;
+	cout << "kup={" << kup[0] << ","<<kup[1]<<","<<kup[2]<<"}" << endl;
+
+	det = g3.det();
+	cout << " * Determinant=";
+	pass = (pass and print_test(det,2.0));
+
+	klow = g3.lower(kup);
+	cout << " * klow[0]=";
+	pass = (pass and print_test(klow[0],5));
+	cout << " * klow[1]=";
+	pass = (pass and print_test(klow[1],4));
+	cout << " * klow[2]=";
+	pass = (pass and print_test(klow[2],3));
+
+	g3inv = g3.inverse();
+	cout << " * g3inv[xx]=";
+	pass = (pass and print_test(g3inv.data[ixx],-0.5));
+	cout << " * g3inv[xy]=";
+	pass = (pass and print_test(g3inv.data[ixy],0.5));
+	cout << " * g3inv[xz]=";
+	pass = (pass and print_test(g3inv.data[ixz],0.5));
+	cout << " * g3inv[yy]=";
+	pass = (pass and print_test(g3inv.data[iyy],-0.5));
+	cout << " * g3inv[yz]=";
+	pass = (pass and print_test(g3inv.data[iyz],0.5));
+	cout << " * g3inv[zz]=";
+	pass = (pass and print_test(g3inv.data[izz],-0.5));
+
+	kup = g3inv.lower(klow); // raise the index again
+	cout << " * kup[0]=";
+	pass = (pass and print_test(kup[0],1));
+	cout << " * kup[1]=";
+	pass = (pass and print_test(kup[1],2));
+	cout << " * kup[2]=";
+	pass = (pass and print_test(kup[2],3));
 
 	cout << "|==================|" << endl;
 	cout << "| 4 Minkowski Test |" << endl;
@@ -295,6 +459,26 @@ int main(){
 	for(size_t i=0; i<4; i++) cout << tmp[i] << " ";
 	cout << "}" << endl;
 
+	cout << "|======================|" << endl;
+	cout << "| Metric update timing |" << endl;
+	cout << "|======================|" << endl;
+	const size_t nupdates = 10000000;
+	double checksum = 0;
+	clock_t start = clock();
+	for(size_t n=0; n<nupdates; n++){
+		g.gammalow.data[ixy] = 1e-3 * (n%7);
+		g.update();
+		checksum += g.gammaup.data[ixx];
+	}
+	const double elapsed = (double)(clock()-start) / CLOCKS_PER_SEC;
+	cout << " * " << nupdates/elapsed << " updates/s (checksum " << checksum << ")" << endl;
+
+#if NDIMS==3
+	cout << "|========================================|" << endl;
+	cout << "| Christoffel precomputed vs derivatives |" << endl;
+	cout << "|========================================|" << endl;
+	pass = (pass and compare_christoffel());
+#endif
 
 	assert(pass);
 	return 0;
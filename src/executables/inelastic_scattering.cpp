@@ -65,6 +65,9 @@ int main(int argc, char **argv)
 	//transport loop 
 	class testiScatter : public Transport{
         public:
+		// particles are kept between iterations
+		vector<Particle> particles;
+
                 void testgrid(double tend){
 			//clear global radiation quantities and call set_eas
 			reset_radiation();
@@ -72,22 +75,29 @@ int main(int argc, char **argv)
 			//reset abs_opac to 1/c for emission
 			for(size_t s=0; s<species_list.size(); s++){
                                 for(size_t igin=0; igin<grid->nu_grid_axis.size(); igin++){
-                                        grid->abs_opac[s][igin] = 1./pc::c;	
+                                        grid->opac[s][igin][OPAC_ABS] = 1./pc::c;	
 				}
 			}
 
 			//emit from zones per bin (but thermal emission?)
 			if(particles.size()<1){
-				emit_particles();
+				particles.resize(n_emit_this_pass(MPI_myID));
+				#pragma omp parallel for
+				for(size_t i=0; i<particles.size(); i++){
+					EinsteinHelper eh;
+					emit_particle(i, &eh, MPI_myID);
+					particles[i] = eh.get_Particle();
+				}
 			}
 
 			//reset abs_opac to zero since we don't want any absorption
 			for(size_t s=0; s<species_list.size(); s++){
                                 for(size_t igin=0; igin<grid->nu_grid_axis.size(); igin++){
-					grid->scat_opac[s][igin] = 0;
-                                        grid->abs_opac[s][igin] = 0;	
+					grid->opac[s][igin][OPAC_SCAT] = 0;
+                                        grid->opac[s][igin][OPAC_ABS] = 0;	
 				}
 			}
+			invalidate_opacities(); // so the next reset_radiation restores them
 
 			//inelastic scattering loop over emitted particles
 			const size_t nparticles = particles.size();
@@ -137,8 +147,9 @@ int main(int argc, char **argv)
 			}
 			cout<<"done!";
 			//sum and normalize
-	        	if(MPI_nprocs>1) sum_to_proc0();
+	        	if(MPI_nprocs>1) reduce_radiation();
         		normalize_radiative_quantities();
+        		finish_reduction();
 		}
         };
 
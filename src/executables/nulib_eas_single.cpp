@@ -29,6 +29,7 @@
 #include "nulib_interface.h"
 #include "MultiDArray.h"
 #include <cstdlib>
+#include <cmath>
 
 namespace pc = physical_constants;
 
@@ -92,8 +93,7 @@ int main(int argc, char* argv[]){
 	scattering_phi0.set_axes(axes);
 
 	vector<double> tmp_absopac(ngroups), tmp_scatopac(ngroups);
-	vector< vector<double> > tmp_delta(ngroups, vector<double>(ngroups));
-	vector< vector<double> > tmp_phi0(ngroups, vector<double>(ngroups));
+	vector<double> tmp_delta(ngroups*ngroups), tmp_phi0(ngroups*ngroups); // [ig][og]
 	nulib_get_eas_arrays(rho, T, ye, nulibID,
 			tmp_absopac, tmp_scatopac, tmp_phi0, tmp_delta);
 
@@ -108,8 +108,8 @@ int main(int argc, char* argv[]){
 			for(size_t og=0; og<ngroups; og++){
 				dir_ind[1] = og;
 				global_index = scattering_delta.direct_index(dir_ind);
-				scattering_delta[nulibID] = tmp_delta[ig][og];
-				scattering_phi0[nulibID] = tmp_phi0[ig][og] * pc::h;
+				scattering_delta[nulibID] = tmp_delta[ig*ngroups + og];
+				scattering_phi0[nulibID] = tmp_phi0[ig*ngroups + og] * pc::h;
 			}
 	}
 
@@ -119,5 +119,83 @@ int main(int argc, char* argv[]){
 	cout << "a = " << abs_opac.interpolate(icube)   << " 1/cm" << endl;
 	cout << "s = " << scat_opac.interpolate(icube)  << " 1/cm" << endl;
 
+	//==============================================//
+	// validate the native interpolator against the //
+	// Fortran one at points spread over the table  //
+	//==============================================//
+	cout << "validating native interpolation" << endl;
+	nulib_native_init(filename);
+	const NuLibTable& table = nulib_native_table();
+	const size_t npoints = 1000;
+	vector<double> rho_points(npoints), T_points(npoints), ye_points(npoints); // g/ccm, MeV, 1
+	for(size_t i=0; i<npoints; i++){
+		double frho = fmod((i+0.5)*0.6180339887, 1.0);
+		double fT   = fmod((i+0.5)*0.7548776662, 1.0);
+		double fye  = (i+0.5)/npoints;
+		rho_points[i] = pow(10, table.logrho [0] + frho*(table.logrho [table.logrho.size() -1]-table.logrho [0]));
+		T_points[i]   = pow(10, table.logtemp[0] + fT  *(table.logtemp[table.logtemp.size()-1]-table.logtemp[0]));
+		ye_points[i]  = table.ye[0] + fye*(table.ye[table.ye.size()-1]-table.ye[0]);
+	}
+
+	// all species and points in one batch
+	vector<double> eas(npoints*table.record_size());
+	double start = MPI_Wtime();
+	table.interpolate_eas(npoints, &rho_points[0], &T_points[0], &ye_points[0], &eas[0]);
+	double native_time = MPI_Wtime() - start;
+
+	// one point and species at a time through both paths
+	double fortran_time = 0, max_error = 0, max_emis_error = 0;
+	size_t batch_mismatches = 0; // batch and single-point native lookups must agree
+	const int nspecies = nulib_get_nspecies();
+	vector<double> native_absopac(ngroups), native_scatopac(ngroups);
+	vector<double> fortran_record(table.record_size());
+	for(size_t i=0; i<npoints; i++){
+		// the emissivity never goes through nulib_get_eas_arrays,
+		// so compare the batch with NuLib's whole record
+		nulib_set_native(false);
+		nulib_get_eas_record(rho_points[i], T_points[i]/pc::k_MeV, ye_points[i], &fortran_record[0]);
+		for(size_t k=0; k<(size_t)nspecies*ngroups; k++){
+			const double fortran_emis = fortran_record[k]; // easvariable 0
+			const double batch_emis = eas[i*table.record_size() + k];
+			if(fortran_emis>0) max_emis_error = max(max_emis_error, fabs(batch_emis/fortran_emis - 1.0));
+			else if(batch_emis!=0) max_emis_error = max(max_emis_error, 1.0);
+		}
+
+		for(int s=0; s<nspecies; s++){
+			nulib_set_native(false);
+			start = MPI_Wtime();
+			nulib_get_eas_arrays(rho_points[i], T_points[i]/pc::k_MeV, ye_points[i], s,
+					tmp_absopac, tmp_scatopac, tmp_phi0, tmp_delta);
+			fortran_time += MPI_Wtime() - start;
+			nulib_set_native(true);
+			nulib_get_eas_arrays(rho_points[i], T_points[i]/pc::k_MeV, ye_points[i], s,
+					native_absopac, native_scatopac, tmp_phi0, tmp_delta);
+
+			for(size_t ig=0; ig<ngroups; ig++){
+				const double batch_absopac = eas[i*table.record_size() + (1*ngroups + ig)*nspecies + s];
+				if(fabs(batch_absopac - native_absopac[ig]) > 1e-12*fabs(native_absopac[ig])) batch_mismatches++;
+				if(tmp_absopac[ig]>0)  max_error = max(max_error, fabs(native_absopac[ig] /tmp_absopac[ig]  - 1.0));
+				if(tmp_scatopac[ig]>0) max_error = max(max_error, fabs(native_scatopac[ig]/tmp_scatopac[ig] - 1.0));
+			}
+		}
+	}
+	cout << "max relative difference: " << max_error << endl;
+	cout << "max relative emissivity difference: " << max_emis_error << endl;
+	cout << "batch/single mismatches: " << batch_mismatches << endl;
+	cout << "Fortran time: " << fortran_time << " s  native batch time: " << native_time << " s" << endl;
+	if(max_error > 1e-10){
+		cout << "ERROR: native interpolation does not match NuLib" << endl;
+		exit(1);
+	}
+	if(max_emis_error > 1e-10){
+		cout << "ERROR: native emissivity does not match NuLib" << endl;
+		exit(1);
+	}
+	if(batch_mismatches > 0){
+		cout << "ERROR: batch native interpolation does not match single-point native interpolation" << endl;
+		exit(1);
+	}
+
+	MPI_Finalize();
 	return 0;
 }
@@ -0,0 +1,203 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors 
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#include <mpi.h>
+#include <omp.h>
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "global_options.h"
+#include "MultiDArray.h"
+#include "BlockCache.h"
+#include "ThreadRNG.h"
+
+using namespace std;
+
+// Interpolates three opacity fields at random points in a 3D grid with
+// an energy axis, the way Transport::update_eh_k_opac does. Compares
+// three separate arrays (three gathers from the corners) with a single
+// array of interleaved records (one gather), and counts last-level and
+// L1 data cache misses for each where the kernel allows it.
+// Then reads per-zone opacity blocks through a BlockCache, the way
+// Transport does with opacity_cache_blocks>0, for particles stepping
+// 0.3 zone widths at a time, and reports its hits and misses.
+const size_t ndims = 4;
+const size_t nfields = 3;
+
+// counts one hardware event on the calling thread
+class EventCounter{
+public:
+	int fd;
+	EventCounter(const unsigned type, const unsigned long long config){
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if(fd>=0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	~EventCounter(){if(fd>=0) close(fd);}
+	// -1 if the event is not available
+	long long count() const{
+		long long result = -1;
+		if(fd<0 or ::read(fd, &result, sizeof(result))!=sizeof(result)) return -1;
+		return result;
+	}
+};
+const unsigned long long L1D_READ_MISS = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ<<8) | (PERF_COUNT_HW_CACHE_RESULT_MISS<<16);
+
+void print_misses(const char* name, const long long llc, const long long l1d, const size_t n){
+	cout << name << " cache misses per interpolation: ";
+	if(llc<0) cout << "LLC not available, ";
+	else      cout << "LLC " << (double)llc/n << ", ";
+	if(l1d<0) cout << "L1D not available" << endl;
+	else      cout << "L1D " << (double)l1d/n << endl;
+}
+
+int main(int argc, char **argv){
+	MPI_Init(&argc, &argv);
+	size_t nx = 64, ng = 16, n = 10000000, cache_blocks = 1000;
+	if(argc>1) nx = atol(argv[1]);
+	if(argc>2) n  = atol(argv[2]);
+	if(argc>3) cache_blocks = atol(argv[3]);
+	const int nthreads = omp_get_max_threads();
+
+	vector<Axis> axes;
+	for(size_t d=0; d<ndims-1; d++) axes.push_back(Axis(0, 1, nx));
+	axes.push_back(Axis(0, 1, ng));
+	vector< ScalarMultiDArray<double,ndims> > separate(nfields);
+	MultiDArray<double,nfields,ndims> interleaved;
+	interleaved.set_axes(axes);
+	for(size_t f=0; f<nfields; f++) separate[f].set_axes(axes);
+	for(size_t i=0; i<interleaved.size(); i++)
+		for(size_t f=0; f<nfields; f++)
+			separate[f][i] = interleaved[i][f] = sin((double)(i*(f+1)));
+	cout << "# " << interleaved.size() << " records, " << n << " interpolations per thread" << endl;
+
+	// the same random points for both layouts
+	ThreadRNG rangen;
+	rangen.init("philox", 1);
+	double sum_separate=0, sum_interleaved=0;
+	double time_separate=0, time_interleaved=0;
+	long long llc_misses[2], l1d_misses[2];
+	for(int layout=0; layout<2; layout++){
+		double sum = 0;
+		long long llc = 0, l1d = 0;
+		int counted = 1;
+		double start = MPI_Wtime();
+		#pragma omp parallel reduction(+:sum,llc,l1d) reduction(min:counted)
+		{
+			rangen.set_stream(omp_get_thread_num());
+			EventCounter llc_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+			EventCounter l1d_counter(PERF_TYPE_HW_CACHE, L1D_READ_MISS);
+			InterpolationCube<ndims> icube;
+			double x[ndims];
+			size_t dir_ind[ndims];
+			for(size_t i=0; i<n; i++){
+				for(size_t d=0; d<ndims; d++){
+					x[d] = rangen.uniform();
+					dir_ind[d] = axes[d].bin(x[d]);
+				}
+				interleaved.set_InterpolationCube(&icube, x, dir_ind);
+				if(layout==0){
+					for(size_t f=0; f<nfields; f++) sum += separate[f].interpolate(icube);
+				}
+				else{
+					const Tuple<double,nfields> result = interleaved.interpolate(icube);
+					for(size_t f=0; f<nfields; f++) sum += result[f];
+				}
+			}
+			const long long llc_count = llc_counter.count(), l1d_count = l1d_counter.count();
+			llc += llc_count;
+			l1d += l1d_count;
+			if(llc_count<0 or l1d_count<0) counted = 0;
+		}
+		const double elapsed = MPI_Wtime() - start;
+		if(layout==0){sum_separate    = sum; time_separate    = elapsed;}
+		else         {sum_interleaved = sum; time_interleaved = elapsed;}
+		llc_misses[layout] = (counted ? llc : -1);
+		l1d_misses[layout] = (counted ? l1d : -1);
+	}
+
+	cout << "separate arrays     " << n/time_separate    << " /s/core" << endl;
+	cout << "interleaved records " << n/time_interleaved << " /s/core" << endl;
+	print_misses("separate arrays    ", llc_misses[0], l1d_misses[0], n*nthreads);
+	print_misses("interleaved records", llc_misses[1], l1d_misses[1], n*nthreads);
+	const bool pass = fabs(sum_separate-sum_interleaved) <= 1e-10*fabs(sum_separate);
+	if(not pass) cout << "FAIL: results differ (" << sum_separate << " vs " << sum_interleaved << ")" << endl;
+
+	// lazily evaluated opacities. A miss copies the zone's records into
+	// the block, standing in for Species::get_eas.
+	size_t hits = 0, misses = 0;
+	const double start = MPI_Wtime();
+	#pragma omp parallel reduction(+:hits,misses)
+	{
+		rangen.set_stream(omp_get_thread_num());
+		BlockCache cache;
+		cache.init(cache_blocks, nfields*ng);
+		double x[ndims], k[ndims-1] = {0};
+		size_t dir_ind[ndims];
+		for(size_t d=0; d<ndims-1; d++) x[d] = -1; // launch on the first step
+		for(size_t i=0; i<n; i++){
+			bool outside = false;
+			for(size_t d=0; d<ndims-1; d++){
+				x[d] += 0.3 * k[d] / nx;
+				outside = outside or x[d]<0 or x[d]>=1;
+			}
+			if(outside) for(size_t d=0; d<ndims-1; d++){
+				x[d] = rangen.uniform();
+				k[d] = rangen.uniform(-1,1);
+			}
+			for(size_t d=0; d<ndims-1; d++) dir_ind[d] = axes[d].bin(x[d]);
+			dir_ind[ndims-1] = 0;
+			const size_t first = interleaved.direct_index(dir_ind);
+			bool hit;
+			double* block = cache.lookup(first/ng, 0, &hit);
+			if(not hit)
+				for(size_t g=0; g<ng; g++)
+					for(size_t f=0; f<nfields; f++) block[g*nfields+f] = interleaved[first+g][f];
+		}
+		hits = cache.hits;
+		misses = cache.misses;
+	}
+	const double elapsed = MPI_Wtime() - start;
+	cout << "BlockCache of " << cache_blocks << " zones " << n/elapsed << " /s/core, "
+	     << hits << " hits, " << misses << " misses (hit rate " << (double)hits/(double)(hits+misses) << ")" << endl;
+
+	MPI_Finalize();
+	assert(pass);
+	return 0;
+}
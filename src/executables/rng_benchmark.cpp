@@ -0,0 +1,138 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors 
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+
+#include <mpi.h>
+#include <omp.h>
+#include <iostream>
+#include <cmath>
+#include "global_options.h"
+#include "ThreadRNG.h"
+
+using namespace std;
+
+// Known-answer tests from the Random123 distribution (kat_vectors)
+bool philox_kat(const uint32_t ctr[4], const uint32_t key[2], const uint32_t expected[4]){
+	PhiloxStream p;
+	p.key[0] = key[0];
+	p.key[1] = key[1];
+	for(int i=0; i<4; i++) p.counter[i] = ctr[i];
+	uint32_t out[4];
+	p.next_block(out);
+	bool pass = true;
+	for(int i=0; i<4; i++) pass = pass and (out[i]==expected[i]);
+	cout << hex << out[0] << " " << out[1] << " " << out[2] << " " << out[3] << dec;
+	if(pass) cout << endl;
+	else cout << "\tFAIL" << endl;
+	return pass;
+}
+
+// time n draws on every thread, one at a time and in batches
+void benchmark(const string backend, const size_t n, bool* pass){
+	ThreadRNG rangen;
+	rangen.init(backend);
+	const int nthreads = omp_get_max_threads();
+	const size_t batch = 64;
+
+	// single calls
+	double sum=0, sum2=0;
+	double start = MPI_Wtime();
+	#pragma omp parallel for reduction(+:sum,sum2)
+	for(int t=0; t<nthreads; t++){
+		for(size_t i=0; i<n; i++){
+			double u = rangen.uniform();
+			sum += u;
+			sum2 += u*u;
+		}
+	}
+	double single_time = MPI_Wtime() - start;
+
+	// batched calls
+	double esum=0;
+	start = MPI_Wtime();
+	#pragma omp parallel for reduction(+:esum)
+	for(int t=0; t<nthreads; t++){
+		double buf[batch];
+		for(size_t i=0; i<n; i+=batch){
+			rangen.exponential(buf,batch);
+			for(size_t j=0; j<batch; j++) esum += buf[j];
+		}
+	}
+	double batch_time = MPI_Wtime() - start;
+
+	const double ntot = (double)n*nthreads;
+	const double mean = sum/ntot;
+	const double var = sum2/ntot - mean*mean;
+	const double emean = esum / ((double)((n+batch-1)/batch*batch)*nthreads);
+	cout << backend << ":" << endl;
+	cout << "  uniform()          " << n/single_time << " /s/core" << endl;
+	cout << "  exponential(batch) " << n/batch_time << " /s/core" << endl;
+	cout << "  uniform mean=" << mean << " (0.5)  variance=" << var << " (" << 1./12. << ")" << endl;
+	cout << "  exponential mean=" << emean << " (1)" << endl;
+
+	// 10 sigma is plenty for a sanity check
+	const double sigma = sqrt(1./12./ntot);
+	if(fabs(mean-0.5) > 10*sigma or fabs(emean-1.0) > 10*sqrt(1./ntot)){
+		cout << "  FAIL: moments out of range" << endl;
+		*pass = false;
+	}
+}
+
+int main(int argc, char **argv){
+	MPI_Init(&argc, &argv);
+	bool pass = true;
+
+	cout << "|===================|" << endl;
+	cout << "| Philox KAT Tests  |" << endl;
+	cout << "|===================|" << endl;
+	{
+		const uint32_t ctr[4] = {0,0,0,0}, key[2] = {0,0};
+		const uint32_t expected[4] = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+		pass = philox_kat(ctr,key,expected) and pass;
+	}
+	{
+		const uint32_t ctr[4] = {0xffffffff,0xffffffff,0xffffffff,0xffffffff}, key[2] = {0xffffffff,0xffffffff};
+		const uint32_t expected[4] = {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd};
+		pass = philox_kat(ctr,key,expected) and pass;
+	}
+	{
+		const uint32_t ctr[4] = {0x243f6a88,0x85a308d3,0x13198a2e,0x03707344}, key[2] = {0xa4093822,0x299f31d0};
+		const uint32_t expected[4] = {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1};
+		pass = philox_kat(ctr,key,expected) and pass;
+	}
+
+	cout << "|=====================|" << endl;
+	cout << "| Throughput per core |" << endl;
+	cout << "|=====================|" << endl;
+	size_t n = 10000000;
+	if(argc>1) n = atol(argv[1]);
+	benchmark("gsl", n, &pass);
+	benchmark("philox", n, &pass);
+
+	MPI_Finalize();
+	return pass ? 0 : 1;
+}
@@ -102,12 +102,17 @@ int main(int argc, char **argv)
 	sim.update_eh_background(&eh);
 	sim.update_eh_k_opac(&eh);
 	ParticleEvent event;
+	size_t nsteps = 0;
+	const double start = MPI_Wtime();
 	while(eh.fate==moving){
 	        double ds_com;
 	        sim.which_event(&eh,&event,&ds_com);
 	        eh.ds_com = ds_com;
 		sim.move(&eh);
+		nsteps++;
 	}
+	const double elapsed = MPI_Wtime() - start;
+	cout << "# " << nsteps << " steps in " << elapsed << " s (" << nsteps/elapsed << " steps/s)" << endl;
 
 	// read in time stepping parameters
 	lua.close();
@@ -0,0 +1,139 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors 
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#include <mpi.h>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include "global_options.h"
+#include "ThreadRNG.h"
+#include "Axis.h"
+#include "CDFArray.h"
+
+using namespace std;
+
+// time one bin lookup per query. Returns the sum of the indices so
+// the methods can be checked against each other.
+template<typename F>
+long time_lookups(const string name, const vector<double>& x, F lookup){
+	long sum = 0;
+	double start = MPI_Wtime();
+	for(size_t i=0; i<x.size(); i++) sum += lookup(x[i]);
+	double time = MPI_Wtime() - start;
+	cout << "  " << name << " " << time << " s  " << x.size()/time << " /s/core" << endl;
+	return sum;
+}
+
+// compare bin() against a plain search over top for queries spread over the axis
+void benchmark_axis(const string name, const Axis& axis, ThreadRNG* rangen, const size_t n, bool* pass){
+	vector<double> x(n);
+	const double max = axis.top.back();
+	for(size_t i=0; i<n; i++) x[i] = axis.min + rangen->uniform()*(max-axis.min);
+
+	cout << name << " (" << axis.size() << " bins):" << endl;
+	long ref = time_lookups("upper_bound", x, [&](double xval){return upper_bound(axis.top.begin(), axis.top.end(), xval) - axis.top.begin();});
+	long sum = time_lookups("bin()      ", x, [&](double xval){return axis.bin(xval);});
+	if(sum != ref){
+		cout << "  FAIL: bin() disagrees with upper_bound" << endl;
+		*pass = false;
+	}
+}
+
+int main(int argc, char **argv){
+	MPI_Init(&argc, &argv);
+	bool pass = true;
+	ThreadRNG rangen;
+	rangen.init();
+
+	size_t n = 4000000;
+	int nbins = 256;
+	if(argc>1) n = atol(argv[1]);
+	if(argc>2) nbins = atoi(argv[2]);
+
+	cout << "|=========================|" << endl;
+	cout << "| Lookups per core        |" << endl;
+	cout << "|=========================|" << endl;
+
+	// uniform bins
+	Axis uniform(0, 1, nbins);
+	benchmark_axis("uniform", uniform, &rangen, n, &pass);
+
+	// logarithmic bins, as in a neutrino energy grid
+	vector<double> top(nbins), mid(nbins);
+	const double emin = 1, emax = 1e3;
+	for(int i=0; i<nbins; i++){
+		top[i] = emin * pow(emax/emin, (double)(i+1)/(double)nbins);
+		mid[i] = emin * pow(emax/emin, ((double)i+0.5)/(double)nbins);
+	}
+	Axis logarithmic(emin, top, mid);
+	benchmark_axis("logarithmic", logarithmic, &rangen, n, &pass);
+
+	// neither uniform nor logarithmic, so bin() searches the Eytzinger copy
+	for(int i=0; i<nbins; i++){
+		top[i] = pow((double)(i+1)/(double)nbins, 2);
+		mid[i] = pow(((double)i+0.5)/(double)nbins, 2);
+	}
+	Axis general(0, top, mid);
+	benchmark_axis("general", general, &rangen, n, &pass);
+
+	// CDF lookups, with the search tree from normalize() and without it after set()
+	CDFArray cdf;
+	cdf.resize(nbins);
+	for(int i=0; i<nbins; i++) cdf.set_value(i, 1.0 + rangen.uniform());
+	cdf.normalize();
+	vector<double> y(n);
+	for(size_t i=0; i<n; i++) y[i] = rangen.uniform();
+	cout << "CDFArray (" << nbins << " bins):" << endl;
+	long ref = time_lookups("get_index (tree)   ", y, [&](double yval){return cdf.get_index(yval);});
+	cdf.set(0, cdf.get(0));
+	long sum = time_lookups("get_index (no tree)", y, [&](double yval){return cdf.get_index(yval);});
+	if(sum != ref){
+		cout << "  FAIL: get_index changes without the search tree" << endl;
+		pass = false;
+	}
+
+	// the tree only stores the values; the sorted index is computed
+	cout << "search tree memory: " << general.search_tree.tree.size()*sizeof(double) << " bytes for " << general.search_tree.size() << " values" << endl;
+
+	// every tree shape, including partially filled last levels
+	for(size_t size=1; size<=1024; size++){
+		vector<double> sorted(size);
+		for(size_t i=0; i<size; i++) sorted[i] = (double)(i/2); // with repeated values
+		EytzingerSearch tree;
+		tree.build(sorted);
+		for(double xval=-1; xval<=size/2+1; xval+=0.25)
+			if(tree.upper_bound(xval) != upper_bound(sorted.begin(), sorted.end(), xval) - sorted.begin()){
+				cout << "  FAIL: Eytzinger search of " << size << " values disagrees with upper_bound at " << xval << endl;
+				pass = false;
+				break;
+			}
+	}
+
+	MPI_Finalize();
+	assert(pass);
+	return 0;
+}
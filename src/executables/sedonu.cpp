@@ -42,8 +42,10 @@ int main(int argc, char **argv)
 	// INITIALIZE //
 	//============//
 	// initialize MPI parallelism
-	int MPI_myID;
-	MPI_Init( &argc, &argv );
+	// the master thread may call MPI inside parallel regions (see steal.cpp).
+	// Transport::init turns off work_stealing if MPI_thread_level is too low.
+	int MPI_myID, MPI_thread_level;
+	MPI_Init_thread( &argc, &argv, MPI_THREAD_FUNNELED, &MPI_thread_level );
 	MPI_Comm_rank( MPI_COMM_WORLD, &MPI_myID );
 	const int rank0 = (MPI_myID == 0);
 
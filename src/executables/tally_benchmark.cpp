@@ -0,0 +1,179 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+
+#include <mpi.h>
+#include <omp.h>
+#include <iostream>
+#include <cstring>
+#include "global_options.h"
+#include "MultiDArray.h"
+#include "ThreadTally.h"
+
+using namespace std;
+
+typedef MultiDArray<ATOMIC<double>,4,1> TallyField;
+typedef MultiDArray<ATOMIC<float>,4,1> FloatTallyField;
+
+// cheap stateless generator so every path is the same for any thread count
+inline uint64_t mix(uint64_t x){
+	x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+// nparticles random walks of nsteps zone hits each, tallied like
+// fourforce_abs. Returns the time spent in the propagation loop and
+// in stop_buffering separately.
+template<typename T>
+void run(MultiDArray<ATOMIC<T>,4,1>& field, ThreadTally<4>& tally, const int mode, const size_t nparticles, const size_t nsteps, double* t_prop, double* t_reduce){
+	const size_t nzones = field.size();
+	field.wipe();
+	if(mode>0) tally.start_buffering(field, mode==2);
+
+	double start = MPI_Wtime();
+	#pragma omp parallel for schedule(dynamic,64)
+	for(size_t p=0; p<nparticles; p++){
+		size_t z = mix(p) % nzones;
+		for(size_t s=0; s<nsteps; s++){
+			const uint64_t r = mix(p*nsteps + s + 1);
+			const double w = ldexp((double)(r>>11), -53);
+			Tuple<double,4> to_add;
+			to_add[0] = w;
+			to_add[1] = w*1e-3;
+			to_add[2] = -w*1e-3;
+			to_add[3] = w*w;
+			if(mode>0) tally.add(field, z, to_add);
+			else field.direct_add(z, to_add);
+			if(r & 1) z = (z+1<nzones ? z+1 : z);
+			else      z = (z>0 ? z-1 : z);
+		}
+	}
+	*t_prop = MPI_Wtime() - start;
+
+	start = MPI_Wtime();
+	if(mode>0) tally.stop_buffering(field);
+	*t_reduce = MPI_Wtime() - start;
+}
+
+// relative difference of each nonzero reference element
+template<typename T>
+void compare(const MultiDArray<ATOMIC<T>,4,1>& field, const vector<double>& reference, double* max_err, double* mean_err){
+	*max_err = *mean_err = 0;
+	size_t n=0;
+	for(size_t i=0; i<field.size(); i++) for(size_t k=0; k<4; k++){
+		const double ref = reference[i*4+k];
+		if(ref==0) continue;
+		const double err = fabs((double)field[i][k] - ref) / fabs(ref);
+		*max_err = max(*max_err, err);
+		*mean_err += err;
+		n++;
+	}
+	if(n>0) *mean_err /= n;
+}
+
+int main(int argc, char **argv){
+	MPI_Init(&argc, &argv);
+	bool pass = true;
+
+	size_t nzones = 10000;
+	size_t nparticles = 100000;
+	const size_t nsteps = 100;
+	if(argc>1) nzones = atol(argv[1]);
+	if(argc>2) nparticles = atol(argv[2]);
+	const int nthreads = omp_get_max_threads();
+
+	TallyField field;
+	field.set_axes(vector<Axis>(1, Axis(0, 1, nzones)));
+	ThreadTally<4> tally;
+
+	cout << "|=================|" << endl;
+	cout << "| Tally additions |" << endl;
+	cout << "|=================|" << endl;
+	cout << "  " << nthreads << " threads, " << nzones << " zones, " << nparticles*nsteps << " additions" << endl;
+	const string names[3] = {"direct atomic ", "thread buffers", "ExactSum      "};
+	double t_prop[3], t_reduce[3];
+	for(int mode=0; mode<3; mode++){
+		run(field, tally, mode, nparticles, nsteps, &t_prop[mode], &t_reduce[mode]);
+		cout << "  " << names[mode] << "  propagate " << t_prop[mode] << " s  reduce " << t_reduce[mode] << " s  "
+		     << (double)(nparticles*nsteps)/t_prop[mode] << " adds/s" << endl;
+	}
+	cout << "  ExactSum vs thread buffers: " << (t_prop[2]+t_reduce[2])/(t_prop[1]+t_reduce[1]) << "x the tally time" << endl;
+	cout << "  tally memory: " << field.size()*4*sizeof(double) << " bytes target, "
+	     << tally.exact.limbs.size()*sizeof(long long) << " bytes of ExactSum limbs ("
+	     << ExactSum::nlimbs << "x)" << endl;
+
+	// reproducible tallies must not depend on the thread count
+	vector<double> many(field.size()*4), one(field.size()*4);
+	run(field, tally, 2, nparticles, nsteps, &t_prop[2], &t_reduce[2]);
+	for(size_t i=0; i<field.size(); i++) for(size_t k=0; k<4; k++) many[i*4+k] = field[i][k];
+	omp_set_num_threads(1);
+	run(field, tally, 2, nparticles, nsteps, &t_prop[2], &t_reduce[2]);
+	for(size_t i=0; i<field.size(); i++) for(size_t k=0; k<4; k++) one[i*4+k] = field[i][k];
+	omp_set_num_threads(nthreads);
+	const bool same = (memcmp(&many.front(), &one.front(), many.size()*sizeof(double)) == 0);
+	cout << "  ExactSum 1 thread vs " << nthreads << " threads bitwise identical: " << same << endl;
+	pass = pass and same;
+
+	// what SINGLE_PRECISION=1 does to the same tallies. The reference is
+	// the correctly rounded ExactSum result from above.
+	cout << "|====================================|" << endl;
+	cout << "| Single vs double precision tallies |" << endl;
+	cout << "|====================================|" << endl;
+	FloatTallyField field_float;
+	field_float.set_axes(vector<Axis>(1, Axis(0, 1, nzones)));
+	const string precision_names[4] = {"double direct atomic ", "double thread buffers", "float direct atomic  ", "float thread buffers "};
+	double max_err[4], mean_err[4];
+	for(int i=0; i<4; i++){
+		const int mode = i%2;
+		double t_p, t_r;
+		if(i<2){
+			run(field, tally, mode, nparticles, nsteps, &t_p, &t_r);
+			compare(field, one, &max_err[i], &mean_err[i]);
+		}
+		else{
+			run(field_float, tally, mode, nparticles, nsteps, &t_p, &t_r);
+			compare(field_float, one, &max_err[i], &mean_err[i]);
+		}
+		cout << "  " << precision_names[i] << "  relative error max " << max_err[i] << " mean " << mean_err[i]
+		     << "  time " << t_p+t_r << " s" << endl;
+	}
+	cout << "  tally memory: " << field.size()*4*sizeof(double) << " bytes double, "
+	     << field_float.size()*4*sizeof(float) << " bytes float" << endl;
+
+	// buffered float tallies round about once per flush, so they should
+	// stay within a few float epsilons of the exact sum
+	const double float_tolerance = 1e-5;
+	if(not (max_err[3] < float_tolerance)){
+		cout << "  FAIL: buffered float tally error exceeds " << float_tolerance << endl;
+		pass = false;
+	}
+
+	MPI_Finalize();
+	return pass ? 0 : 1;
+}
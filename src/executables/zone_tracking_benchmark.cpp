@@ -0,0 +1,143 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors 
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#include <mpi.h>
+#include <omp.h>
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include "global_options.h"
+#include "EinsteinHelper.h"
+#include "ThreadRNG.h"
+#include "Grid1DSphere.h"
+#include "Grid2DSphere.h"
+#include "Grid3DCart.h"
+
+using namespace std;
+
+// Moves particles along straight lines in short steps through the grid
+// selected by NDIMS and finds the zone after every step, the way
+// Transport::update_eh_background does. Compares a full search with
+// zone_index() to Grid::advance_zone(), which only looks next to the
+// previous zone. Both must find the same zones. There is nothing to
+// track on the single zone of an NDIMS=0 grid.
+
+#if NDIMS>0
+
+// put the particle at a random spot in the grid moving in a random direction
+void launch(const Grid* grid, EinsteinHelper* eh, ThreadRNG* rangen){
+	const double R = grid->xAxes[0].max();
+	do{
+		for(size_t i=0; i<3; i++) eh->xup[i] = rangen->uniform(-R,R);
+	} while(grid->zone_index(eh->xup) < 0);
+	double k2 = 0;
+	for(size_t i=0; i<3; i++){
+		eh->kup[i] = rangen->uniform(-1,1);
+		k2 += eh->kup[i]*eh->kup[i];
+	}
+	for(size_t i=0; i<3; i++) eh->kup[i] /= sqrt(k2);
+	eh->z_ind = -1;
+}
+
+// full search, as before advance_zone existed
+void locate(const Grid* grid, EinsteinHelper* eh){
+	eh->z_ind = grid->zone_index(eh->xup);
+	if(eh->z_ind<0) return;
+	grid->grid_coordinates(eh->xup, eh->grid_coords);
+	grid->rho.indices(eh->z_ind, eh->dir_ind);
+}
+
+int main(int argc, char **argv){
+	MPI_Init(&argc, &argv);
+	size_t nx = 100, n = 10000000;
+	double step = 0.3; // in units of the zone width
+	if(argc>1) nx   = atol(argv[1]);
+	if(argc>2) n    = atol(argv[2]);
+	if(argc>3) step = atof(argv[3]);
+
+#if NDIMS==1
+	Grid1DSphere grid;
+	grid.xAxes[0] = Axis(0, 1, nx);
+#elif NDIMS==2
+	Grid2DSphere grid;
+	grid.xAxes[0] = Axis(0, 1, nx);
+	grid.xAxes[1] = Axis(0, pc::pi, nx);
+#elif NDIMS==3
+	Grid3DCart grid;
+	for(size_t d=0; d<3; d++) grid.xAxes[d] = Axis(-1, 1, nx);
+#endif
+	grid.rho.set_axes(grid.xAxes);
+	const double ds = step * grid.xAxes[0].delta(0);
+	cout << "# " << grid.grid_type << " with " << grid.rho.size() << " zones, "
+	     << n << " steps of " << step << " zones per thread" << endl;
+
+	ThreadRNG rangen;
+	rangen.init("philox", 1);
+	long sum_search=0, sum_advance=0;
+	double time_search=0, time_advance=0;
+	for(int mode=0; mode<2; mode++){
+		long sum = 0;
+		const double start = MPI_Wtime();
+		#pragma omp parallel reduction(+:sum)
+		{
+			rangen.set_stream(omp_get_thread_num());
+			EinsteinHelper eh;
+			launch(&grid, &eh, &rangen);
+			locate(&grid, &eh);
+			for(size_t i=0; i<n; i++){
+				for(size_t j=0; j<3; j++) eh.xup[j] += eh.kup[j]*ds;
+				if(mode==0 or not grid.advance_zone(&eh)) locate(&grid, &eh);
+				if(eh.z_ind<0){
+					launch(&grid, &eh, &rangen);
+					locate(&grid, &eh);
+				}
+				sum += eh.z_ind;
+			}
+		}
+		const double elapsed = MPI_Wtime() - start;
+		if(mode==0){sum_search  = sum; time_search  = elapsed;}
+		else       {sum_advance = sum; time_advance = elapsed;}
+	}
+
+	cout << "full search  " << n/time_search  << " steps/s/core" << endl;
+	cout << "advance_zone " << n/time_advance << " steps/s/core" << endl;
+	const bool pass = (sum_search == sum_advance);
+	if(not pass) cout << "FAIL: zones differ (" << sum_search << " vs " << sum_advance << ")" << endl;
+
+	MPI_Finalize();
+	assert(pass);
+	return 0;
+}
+
+#else
+int main(int argc, char **argv){
+	MPI_Init(&argc, &argv);
+	cout << "# zone_tracking_benchmark: nothing to track at NDIMS=0" << endl;
+	MPI_Finalize();
+	return 0;
+}
+#endif
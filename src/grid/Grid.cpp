@@ -46,7 +46,10 @@ namespace pc = physical_constants;
 Grid::Grid(){
 	xAxes.resize(NDIMS);
 	sim = NULL;
+	zone_partition = NULL;
 	do_annihilation=0;
+	inelastic_rank=0;
+	opacity_cache_blocks=0;
 	tetrad_rotation = cartesian;
 }
 //------------------------------------------------------------
@@ -92,8 +95,30 @@ void Grid::init(Lua* lua, Transport* insim)
 		}
 	}
 
+	const double geometry_start = MPI_Wtime();
+	set_zone_geometry();
+	if(rank0) cout << "#   zone geometry cache: " << 6*rho.size()*sizeof(double)/1024./1024. << " MB, "
+			<< MPI_Wtime()-geometry_start << " s" << endl;
+
+	// split the zones between the ranks. With zone ownership each
+	// rank drops the fluid state outside its owned and ghost zones.
+	sim->init_zone_ownership();
+	zone_partition = sim->zone_partition_or_null();
+	if(zone_partition!=NULL){
+		rho.crop(zone_partition);
+		T.crop(zone_partition);
+		Ye.crop(zone_partition);
+		munue.crop(zone_partition);
+	}
+
 	// read some parameters
 	do_annihilation = lua->scalar<int>("do_annihilation");
+	pair<int,bool> inelastic_rank_pair = lua->scalar_pair<int>("inelastic_rank");
+	inelastic_rank = inelastic_rank_pair.second ? inelastic_rank_pair.first : 0;
+	PRINT_ASSERT(inelastic_rank,>=,0);
+	pair<int,bool> opacity_cache_blocks_pair = lua->scalar_pair<int>("opacity_cache_blocks");
+	opacity_cache_blocks = opacity_cache_blocks_pair.second ? opacity_cache_blocks_pair.first : 0;
+	PRINT_ASSERT(opacity_cache_blocks,>=,0);
 
 	// complain if the grid is obviously not right
 	if(rho.size()==0){
@@ -107,8 +132,10 @@ void Grid::init(Lua* lua, Transport* insim)
 	double total_TE        = 0.0;
 	double Tbar            = 0.0;
 	double Yebar           = 0.0;
+	const size_t zone_start = rho.owned_start();
+	const size_t zone_end   = rho.owned_end();
     #pragma omp parallel for reduction(+:total_rest_mass,total_KE,total_TE,Tbar,Yebar)
-	for(size_t z_ind=0;z_ind<rho.size();z_ind++){
+	for(size_t z_ind=zone_start;z_ind<zone_end;z_ind++){
 		// calculate cell rest mass
 		double rest_mass   = zone_rest_mass(z_ind);
 
@@ -124,6 +151,15 @@ void Grid::init(Lua* lua, Transport* insim)
 		total_KE        += (zone_lorentz_factor(z_ind) - 1.0) * rest_mass * pc::c*pc::c;
 		total_TE        += rest_mass   / pc::m_n * pc::k * T[z_ind];
 	}
+	if(zone_partition!=NULL){
+		double totals[5] = {total_rest_mass, total_KE, total_TE, Tbar, Yebar};
+		MPI_Allreduce(MPI_IN_PLACE, totals, 5, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+		total_rest_mass = totals[0];
+		total_KE        = totals[1];
+		total_TE        = totals[2];
+		Tbar            = totals[3];
+		Yebar           = totals[4];
+	}
 
 	// write out useful info about the grid
 	if (rank0){
@@ -174,6 +210,10 @@ void Grid::init(Lua* lua, Transport* insim)
     //==================================//
     if(rank0) cout << "#   Setting up the distribution function..." << flush;
     string distribution_type = lua->scalar<string>("distribution_type");
+    if(zone_partition!=NULL and (distribution_type=="GR1D" or grid_type=="GridGR1D")){
+    	if(rank0) cout << "ERROR: zone_ownership cannot be used with GR1D" << endl;
+    	exit(5);
+    }
 
     double minval = 0;
     double trash, tmp=0;
@@ -231,19 +271,19 @@ void Grid::init(Lua* lua, Transport* insim)
     			tmp_phigrid = Axis(minval, bintops, binmid);
     		}
     		distribution[s] = new PolarSpectrumArray<NDIMS>;
-    		((PolarSpectrumArray<NDIMS>*)distribution[s])->init(xAxes,nu_grid_axis, tmp_mugrid, tmp_phigrid);
+    		((PolarSpectrumArray<NDIMS>*)distribution[s])->init(xAxes,nu_grid_axis, tmp_mugrid, tmp_phigrid, zone_partition);
     	}
 
     	//-- MOMENT SPECTRUM --------------------
     	else if(distribution_type == "Moments"){
     		distribution[s] = new MomentSpectrumArray<NDIMS>;
-    		((MomentSpectrumArray<NDIMS>*)distribution[s])->init(xAxes,nu_grid_axis);
+    		((MomentSpectrumArray<NDIMS>*)distribution[s])->init(xAxes,nu_grid_axis,zone_partition);
     	}
 
     	//-- RADIAL MOMENT SPECTRUM --------------------
     	else if(distribution_type == "RadialMoments"){
     		distribution[s] = new RadialMomentSpectrumArray<NDIMS>;
-    		((RadialMomentSpectrumArray<NDIMS>*)distribution[s])->init(xAxes,nu_grid_axis);
+    		((RadialMomentSpectrumArray<NDIMS>*)distribution[s])->init(xAxes,nu_grid_axis,zone_partition);
     	}
 
     	//-- RADIAL MOMENT SPECTRUM --------------------
@@ -263,26 +303,23 @@ void Grid::init(Lua* lua, Transport* insim)
     if(rank0) cout << "finished." << endl << flush;
 
 	// set up the data structures
-	abs_opac.resize(sim->species_list.size());
-	scat_opac.resize(sim->species_list.size());
+	opac.resize(sim->species_list.size());
 	fblock.resize(sim->species_list.size());
-	inelastic_scat_opac.resize(sim->species_list.size());
 	scattering_delta.resize(sim->species_list.size());
 	partial_scat_opac.resize(sim->species_list.size());
+	inelastic_alias.resize(sim->species_list.size());
 	spectrum.resize(sim->species_list.size());
 	vector<Axis> axes = xAxes;
-	if(do_annihilation) fourforce_annihil.set_axes(axes);
-	fourforce_abs.set_axes(axes);
-	fourforce_emit.set_axes(axes);
-	l_abs.set_axes(axes);
-	l_emit.set_axes(axes);
+	if(do_annihilation) fourforce_annihil.set_axes(axes, zone_partition);
+	fourforce_abs.set_axes(axes, zone_partition);
+	fourforce_emit.set_axes(axes, zone_partition);
+	l_abs.set_axes(axes, zone_partition);
+	l_emit.set_axes(axes, zone_partition);
 
 	axes.push_back(nu_grid_axis);
 	for(size_t s=0; s<sim->species_list.size(); s++){
-		abs_opac[s].set_axes(axes);
-		scat_opac[s].set_axes(axes);
-		fblock[s].set_axes(axes);
-		inelastic_scat_opac[s].set_axes(axes);
+		fblock[s].set_axes(axes, zone_partition);
+		if(opacity_cache_blocks==0) opac[s].set_axes(axes, zone_partition);
 
 	    //===========================//
 		// intialize output spectrum // only if child didn't
@@ -299,32 +336,205 @@ void Grid::init(Lua* lua, Transport* insim)
 		PRINT_ASSERT(spectrum[s].size(),>,0);
 	}
 
+	if(inelastic_rank>0){
+		inelastic_kernel0.resize(sim->species_list.size());
+		inelastic_kernel1.resize(sim->species_list.size());
+	}
 	for(size_t s=0; s<sim->species_list.size(); s++){
-		partial_scat_opac[s].resize(nu_grid_axis.size());
-		scattering_delta[s].resize(nu_grid_axis.size());
-		for(size_t igout=0; igout<nu_grid_axis.size(); igout++){
-			partial_scat_opac[s][igout].set_axes(axes);
-			scattering_delta[s][igout].set_axes(axes);
-		}
+		if(opacity_cache_blocks>0) continue; // opacities are evaluated lazily by Transport
+		if(sim->species_list[s]->has_inelastic_scattering()) allocate_inelastic(s);
 	}
 	
 	cout << "# Initializing fblock arrays to zero" << endl;
-	for(size_t s=0; s<sim->species_list.size(); s++){
-		for(size_t glob_ind=0;glob_ind<scat_opac[s].size();glob_ind++){
-			size_t dir_ind[NDIMS+1];
-			scat_opac[s].indices(glob_ind,dir_ind);
-			fblock[s][glob_ind]=0.0;
+	for(size_t s=0; s<sim->species_list.size(); s++) fblock[s].wipe();
+}
+
+//------------------------------------------------------------
+// storage for species s's inelastic kernels and samplers. It
+// takes zones*groups^2 values, so only species that scatter
+// inelastically get it (see Species::has_inelastic_scattering)
+//------------------------------------------------------------
+void Grid::allocate_inelastic(const size_t s){
+	const size_t ng = nu_grid_axis.size();
+	const size_t first_zone = rho.stored_start();
+	const size_t nzones = rho.stored_end() - first_zone;
+	partial_scat_opac[s].resize(ng);
+	scattering_delta[s].resize(ng);
+	if(inelastic_rank>0){
+		inelastic_kernel0[s].resize(nzones, ng, inelastic_rank, first_zone);
+		inelastic_kernel1[s].resize(nzones, ng, inelastic_rank, first_zone);
+		return;
+	}
+	vector<Axis> axes = xAxes;
+	axes.push_back(nu_grid_axis);
+	for(size_t igout=0; igout<ng; igout++){
+		partial_scat_opac[s][igout].set_axes(axes, zone_partition);
+		scattering_delta[s][igout].set_axes(axes, zone_partition);
+	}
+	inelastic_alias[s].resize(nzones*ng, ng, first_zone*ng);
+}
+bool Grid::has_inelastic(const size_t s) const{
+	return inelastic_rank>0 ? inelastic_kernel0[s].size()>0 : inelastic_alias[s].size()>0;
+}
+
+//------------------------------------------------------------
+// store a zone's inelastic kernels ([igin][igout]), either in
+// full or compressed, and set the total inelastic opacity.
+// Kernels are flat [igin*ng + igout]
+//------------------------------------------------------------
+void Grid::set_inelastic_kernel(const size_t s, const size_t z_ind, const Span<double>& partial_opac, const Span<double>& delta){
+	const size_t ng = nu_grid_axis.size();
+	PRINT_ASSERT(partial_opac.size(),==,ng*ng);
+	PRINT_ASSERT(delta.size(),==,ng*ng);
+	PRINT_ASSERT(has_inelastic(s),==,true);
+	size_t dir_ind[NDIMS+1];
+	rho.indices(z_ind,dir_ind);
+
+	if(inelastic_rank>0){
+		ScratchFrame scratch;
+		Span<double> phi1 = scratch.allocate(ng*ng);
+		for(size_t i=0; i<ng*ng; i++) phi1[i] = partial_opac[i] * delta[i];
+		inelastic_kernel0[s].compress(z_ind, partial_opac);
+		inelastic_kernel1[s].compress(z_ind, phi1);
+	}
+
+	for(size_t igin=0; igin<ng; igin++){
+		dir_ind[NDIMS] = igin;
+		const size_t global_index = opac[s].direct_index(dir_ind);
+		if(inelastic_rank>0){
+			PRINT_ASSERT(global_index,==,z_ind*ng + igin);
+			opac[s][global_index][OPAC_INELASTIC] = inelastic_kernel0[s].row_sum(global_index);
+			continue;
 		}
+		double inelastic_opac = 0;
+		for(size_t igout=0; igout<ng; igout++){
+			partial_scat_opac[s][igout][global_index] = partial_opac[igin*ng + igout];
+			inelastic_opac += partial_scat_opac[s][igout][global_index];
+			scattering_delta[s][igout][global_index] = delta[igin*ng + igout];
+		}
+		opac[s][global_index][OPAC_INELASTIC] = inelastic_opac;
 	}
 }
 
-void Grid::write_zones(const int iw)
+//------------------------------------------------------------
+// rebuild the outgoing energy samplers for every incoming
+// group in a zone after its inelastic kernels have been set
+// (compressed kernels are sampled directly)
+//------------------------------------------------------------
+void Grid::build_inelastic_samplers(const size_t s, const size_t z_ind){
+	PRINT_ASSERT(has_inelastic(s),==,true);
+	if(inelastic_rank>0) return;
+	const size_t ng = nu_grid_axis.size();
+	size_t dir_ind[NDIMS+1];
+	rho.indices(z_ind,dir_ind);
+	ScratchFrame scratch;
+	Span<double> weights = scratch.allocate(ng);
+	for(size_t igin=0; igin<ng; igin++){
+		dir_ind[NDIMS] = igin;
+		const size_t global_index = partial_scat_opac[s][0].direct_index(dir_ind);
+		for(size_t igout=0; igout<ng; igout++) weights[igout] = partial_scat_opac[s][igout][global_index];
+		inelastic_alias[s].build(global_index, weights.data());
+	}
+}
+
+//------------------------------------------------------------
+// Every rank calls this. Radiation quantities are only valid
+// on the rank that owns the zones (see Transport::reduce_radiation),
+// so each rank writes its own slab of them into the shared file.
+// Rank 0 creates the file and writes everything that is the same
+// on all ranks. With parallel HDF5 the ranks then write their
+// slabs of each dataset in one collective MPI-IO call. Otherwise
+// they take turns, rank 0 first.
+//------------------------------------------------------------
+void Grid::write_zones(const int iw, const vector<size_t>& zone_stop_list)
 {
 	PRINT_ASSERT(rho.size(),>,0);
+	int MPI_myID, MPI_nprocs;
+	MPI_Comm_rank(MPI_COMM_WORLD, &MPI_myID);
+	MPI_Comm_size(MPI_COMM_WORLD, &MPI_nprocs);
+	PRINT_ASSERT((int)zone_stop_list.size(),==,MPI_nprocs);
+	const size_t zone_start = (MPI_myID==0 ? 0 : zone_stop_list[MPI_myID-1]);
+	const size_t zone_end = zone_stop_list[MPI_myID];
+	const bool create = (MPI_myID==0);
+	string filename = Transport::filename("fluid",iw,".h5");
+	const size_t ng = nu_grid_axis.size();
+
+#ifdef H5_HAVE_PARALLEL
+	if(create){
+		H5::H5File file(filename, H5F_ACC_TRUNC);
+		write_global_zone_data(file);
+		file.close();
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+	H5Pset_fapl_mpio(fapl, MPI_COMM_WORLD, MPI_INFO_NULL);
+	hid_t file = H5Fopen(filename.c_str(), H5F_ACC_RDWR, fapl);
+	H5Pclose(fapl);
+	if(file<0){
+		if(MPI_myID==0) cout << "ERROR: could not open " << filename << " with the MPI-IO driver" << endl;
+		exit(5);
+	}
+
+	// the same datasets in the same order as the serial version below
+	if(zone_partition!=NULL){
+		rho.write_HDF5_slab_mpio(file,"rho(g|ccm,tet)", zone_start, zone_end);
+		T.write_HDF5_slab_mpio(file,"T_gas(K,tet)", zone_start, zone_end);
+		Ye.write_HDF5_slab_mpio(file,"Ye", zone_start, zone_end);
+	}
+	fourforce_abs.write_HDF5_slab_mpio(file,"four-force[abs](erg|ccm|s,tet)", zone_start, zone_end);
+	fourforce_emit.write_HDF5_slab_mpio(file,"four-force[emit](erg|ccm|s,tet)", zone_start, zone_end);
+	l_abs.write_HDF5_slab_mpio(file,"l_abs(1|s|ccm,tet)", zone_start, zone_end);
+	l_emit.write_HDF5_slab_mpio(file,"l_emit(1|s|ccm,tet)", zone_start, zone_end);
+	if(do_annihilation>0) fourforce_annihil.write_HDF5_slab_mpio(file,"annihilation_4force(erg|ccm|s,tet)", zone_start, zone_end);
+	for(size_t s=0; s<distribution.size(); s++){
+		distribution[s]->write_hdf5_data_slab_mpio(file, "distribution"+to_string(s)+"(erg|ccm,tet)", zone_start, zone_end);
+		if(opac[s].size()>0){
+			opac[s].write_HDF5_slab_mpio(file, "abs_opac"+to_string(s)+"(1|cm)", zone_start*ng, zone_end*ng, OPAC_ABS);
+			opac[s].write_HDF5_slab_mpio(file, "scat_opac"+to_string(s)+"(1|cm)", zone_start*ng, zone_end*ng, OPAC_SCAT);
+		}
+		fblock[s].write_HDF5_slab_mpio(file,"fblock"+to_string(s), zone_start*ng, zone_end*ng);
+	}
+	H5Fclose(file);
+#else
+	// wait for the previous rank to finish writing
+	int token = 0;
+	if(MPI_myID>0) MPI_Recv(&token, 1, MPI_INT, MPI_myID-1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
 	// output all zone data in hdf5 format
-	string filename = Transport::filename("fluid",iw,".h5");
-	H5::H5File file(filename, H5F_ACC_TRUNC);
+	H5::H5File file(filename, create ? H5F_ACC_TRUNC : H5F_ACC_RDWR);
+	if(create) write_global_zone_data(file);
+
+	// write this rank's radiation quantities
+	// (and fluid quantities, if this rank only has its own zones)
+	if(zone_partition!=NULL){
+		rho.write_HDF5_slab(file,"rho(g|ccm,tet)", zone_start, zone_end, create);
+		T.write_HDF5_slab(file,"T_gas(K,tet)", zone_start, zone_end, create);
+		Ye.write_HDF5_slab(file,"Ye", zone_start, zone_end, create);
+	}
+	fourforce_abs.write_HDF5_slab(file,"four-force[abs](erg|ccm|s,tet)", zone_start, zone_end, create);
+	fourforce_emit.write_HDF5_slab(file,"four-force[emit](erg|ccm|s,tet)", zone_start, zone_end, create);
+	l_abs.write_HDF5_slab(file,"l_abs(1|s|ccm,tet)", zone_start, zone_end, create);
+	l_emit.write_HDF5_slab(file,"l_emit(1|s|ccm,tet)", zone_start, zone_end, create);
+	if(do_annihilation>0) fourforce_annihil.write_HDF5_slab(file,"annihilation_4force(erg|ccm|s,tet)", zone_start, zone_end, create);
+	for(size_t s=0; s<distribution.size(); s++){
+		distribution[s]->write_hdf5_data_slab(file, "distribution"+to_string(s)+"(erg|ccm,tet)", zone_start, zone_end, create);
+		if(opac[s].size()>0){
+			opac[s].write_HDF5_element_slab(file, "abs_opac"+to_string(s)+"(1|cm)", OPAC_ABS, zone_start*ng, zone_end*ng, create);
+			opac[s].write_HDF5_element_slab(file, "scat_opac"+to_string(s)+"(1|cm)", OPAC_SCAT, zone_start*ng, zone_end*ng, create);
+		}
+		fblock[s].write_HDF5_slab(file,"fblock"+to_string(s), zone_start*ng, zone_end*ng, create);
+	}
+	file.close();
+
+	// pass the file on to the next rank
+	if(MPI_myID<MPI_nprocs-1) MPI_Send(&token, 1, MPI_INT, MPI_myID+1, 0, MPI_COMM_WORLD);
+#endif
+}
+
+// quantities that every rank has in full
+void Grid::write_global_zone_data(H5::H5File file)
+{
 	file.createGroup("/axes");
 
 	// axes
@@ -337,24 +547,16 @@ void Grid::write_zones(const int iw)
 	spectrum[0].write_hdf5_coordinates(file,"/axes/spectrum");
 
 	// write fluid quantities
-	rho.write_HDF5(file,"rho(g|ccm,tet)");
-	T.write_HDF5(file,"T_gas(K,tet)");
-	Ye.write_HDF5(file,"Ye");
-	fourforce_abs.write_HDF5(file,"four-force[abs](erg|ccm|s,tet)");
-	fourforce_emit.write_HDF5(file,"four-force[emit](erg|ccm|s,tet)");
-	l_abs.write_HDF5(file,"l_abs(1|s|ccm,tet)");
-	l_emit.write_HDF5(file,"l_emit(1|s|ccm,tet)");
+	if(zone_partition==NULL){
+		rho.write_HDF5(file,"rho(g|ccm,tet)");
+		T.write_HDF5(file,"T_gas(K,tet)");
+		Ye.write_HDF5(file,"Ye");
+	}
 	if(DO_GR){
 		lapse.write_HDF5(file,"lapse");
 	}
-	if(do_annihilation>0) fourforce_annihil.write_HDF5(file,"annihilation_4force(erg|ccm|s,tet)");
-	for(size_t s=0; s<distribution.size(); s++){
-		distribution[s]->write_hdf5_data(file, "distribution"+to_string(s)+"(erg|ccm,tet)");
+	for(size_t s=0; s<spectrum.size(); s++)
 		spectrum[s].write_hdf5_data(file,"spectrum"+to_string(s)+"(erg|s)");
-		abs_opac[s].write_HDF5(file, "abs_opac"+to_string(s)+"(1|cm)");
-		scat_opac[s].write_HDF5(file, "scat_opac"+to_string(s)+"(1|cm)");
-		fblock[s].write_HDF5(file,"fblock"+to_string(s));
-	}
 
 	write_child_zones(file);
 }
@@ -388,48 +590,76 @@ void Grid::read_zones(string filename)
 	}
 
 	read_child_zones(file);
+	set_zone_geometry();
 }
 
 double Grid::zone_rest_mass(const int z_ind) const{
 	return rho[z_ind] * zone_com_3volume(z_ind);
 }
 
-double Grid::zone_com_3volume(const int z_ind) const{
-	// assumes v is orthonormal in cm/s
-	PRINT_ASSERT(z_ind,>=,0);
-	double result = zone_lab_3volume(z_ind) * zone_lorentz_factor(z_ind);
-	PRINT_ASSERT(result,>,0);
-	return result;
+//------------------------------------------------------------
+// fill the zone geometry cache from the grid-specific functions
+//------------------------------------------------------------
+void Grid::set_zone_geometry(){
+	const size_t nzones = rho.size();
+	zone_geometry.coord_volume.resize(nzones);
+	zone_geometry.lab_3volume.resize(nzones);
+	zone_geometry.com_3volume.resize(nzones);
+	zone_geometry.fourvolume.resize(nzones);
+	zone_geometry.min_length.resize(nzones);
+	zone_geometry.lorentz_factor.resize(nzones);
+
+	#pragma omp parallel for
+	for(size_t z_ind=0; z_ind<nzones; z_ind++){
+		const double lab_3volume = compute_zone_lab_3volume(z_ind);
+		const double lorentz_factor = compute_zone_lorentz_factor(z_ind);
+		zone_geometry.coord_volume[z_ind] = compute_zone_coord_volume(z_ind);
+		zone_geometry.lab_3volume[z_ind] = lab_3volume;
+		zone_geometry.com_3volume[z_ind] = lab_3volume * lorentz_factor; // assumes v is orthonormal in cm/s
+		zone_geometry.fourvolume[z_ind] = lab_3volume * (DO_GR ? lapse[z_ind] : 1.0);
+		zone_geometry.min_length[z_ind] = compute_zone_min_length(z_ind);
+		zone_geometry.lorentz_factor[z_ind] = lorentz_factor;
+		PRINT_ASSERT(zone_geometry.com_3volume[z_ind],>,0);
+	}
 }
 
 
 double Grid::total_rest_mass() const{
 	double mass = 0;
+	const size_t zone_start = rho.owned_start();
+	const size_t zone_end   = rho.owned_end();
 	#pragma omp parallel for reduction(+:mass)
-	for(size_t z_ind=0; z_ind<rho.size(); z_ind++) mass += zone_rest_mass(z_ind);
+	for(size_t z_ind=zone_start; z_ind<zone_end; z_ind++) mass += zone_rest_mass(z_ind);
+	if(zone_partition!=NULL) MPI_Allreduce(MPI_IN_PLACE, &mass, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 	return mass;
 }
 
-// radius given coordinates
-// assumes deltat=1s
-double Grid::zone_4volume(const int z_ind) const{
-	return zone_lab_3volume(z_ind) * (DO_GR ? lapse[z_ind] : 1.0);
+//------------------------------------------------------------
+// switch every tally field over to thread-private buffers
+// (or exact accumulators if reproducible) for the duration
+// of the propagation loop
+//------------------------------------------------------------
+void Grid::start_tally_buffers(const bool reproducible){
+	fourforce_abs_tally.start_buffering(fourforce_abs, reproducible);
+	fourforce_emit_tally.start_buffering(fourforce_emit, reproducible);
+	l_abs_tally.start_buffering(l_abs, reproducible);
+	l_emit_tally.start_buffering(l_emit, reproducible);
+	for(size_t s=0; s<distribution.size(); s++){
+		distribution[s]->start_tally_buffers(reproducible);
+		spectrum[s].start_tally_buffers(reproducible);
+	}
 }
 
-void Grid::interpolate_metric(EinsteinHelper *eh) const{
-  assert(DO_GR);
-
-  // first, the lapse
-  eh->g.alpha = lapse.interpolate(eh->icube_vol);
-  PRINT_ASSERT(eh->g.alpha,>,0);
-
-  // second, the shift and three-metric
-  eh->g.betaup = interpolate_shift(*eh);
-  eh->g.gammalow.data = interpolate_3metric(*eh);
-
-  // fill in the rest of the metric values
-  eh->g.update();
-
-  // get the Christoffel symbols
-  eh->Gamma = interpolate_Christoffel(*eh);
+//------------------------------------------------------------
+// reduce the thread-private buffers into the shared fields
+//------------------------------------------------------------
+void Grid::stop_tally_buffers(){
+	fourforce_abs_tally.stop_buffering(fourforce_abs);
+	fourforce_emit_tally.stop_buffering(fourforce_emit);
+	l_abs_tally.stop_buffering(l_abs);
+	l_emit_tally.stop_buffering(l_emit);
+	for(size_t s=0; s<distribution.size(); s++){
+		distribution[s]->stop_tally_buffers();
+		spectrum[s].stop_tally_buffers();
+	}
 }
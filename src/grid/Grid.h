@@ -52,12 +52,24 @@
 #include "H5Cpp.h"
 #include "Axis.h"
 #include "MultiDArray.h"
+#include "ThreadTally.h"
+#include "AliasTable.h"
+#include "LowRankKernel.h"
+#include "ScratchArena.h"
 #include "SpectrumArray.h"
 #include "Metric.h"
 #include "EinsteinHelper.h"
 #include "CDFArray.h"
 #include "PolarSpectrumArray.h"
 
+// fields of the opacity record (see Grid::opac)
+enum OpacityField {
+	OPAC_ABS       = 0, // absorption opacity
+	OPAC_SCAT      = 1, // elastic scattering opacity (use the TRANSPORT opacity)
+	OPAC_INELASTIC = 2, // total inelastic scattering opacity
+	N_OPAC_FIELDS  = 3
+};
+
 class Transport;
 class SpectrumArray;
 
@@ -82,6 +94,11 @@ public:
 
 	Transport* sim;
 
+	// with zone ownership, rho, T, Ye, munue, the opacity, inelastic,
+	// distribution and tally arrays only hold this rank's owned and
+	// ghost zones (see ZonePartition). NULL when every zone is stored.
+	const ZonePartition* zone_partition;
+
 	string grid_type;
 	TetradRotation tetrad_rotation;
 	
@@ -89,31 +106,65 @@ public:
 	vector<Axis> xAxes;
 
 	// vectors over neutrino species
-	vector<ScalarMultiDArray<double,NDIMS+1> > abs_opac;  // 1/cm
-	vector<ScalarMultiDArray<double,NDIMS+1> > scat_opac; // 1/cm, use the TRANSPORT opacity
+	// one record of opacities per (zone,group) [s], so a single interpolation
+	// gathers all of them from adjacent memory. Fields are OpacityField (1/cm)
+	vector<MultiDArray<real,N_OPAC_FIELDS,NDIMS+1> > opac;
 	vector<ScalarMultiDArray<double,NDIMS+1> > fblock; //approx fermi blocking factor for neutrinos
 	vector<vector<ScalarMultiDArray<float,NDIMS+1> > > scattering_delta; // phi1/phi0 for sampling outgoing direction [s][Eout](Ein)
-	vector<ScalarMultiDArray<double,NDIMS+1> > inelastic_scat_opac; // 1/cm
 	vector<vector<ScalarMultiDArray<float,NDIMS+1> > > partial_scat_opac; // opacity integrated over outgoing frequency bin (1/cm) [s][Eout](Ein)
+	vector<AliasTable> inelastic_alias; // samplers of Eout for each [s] and (zone,Ein), built from partial_scat_opac
+
+	// only species with inelastic scattering have any of these (see allocate_inelastic).
+	// with inelastic_rank>0 scattering_delta and partial_scat_opac are not allocated.
+	// Instead the phi0 and phi1 (delta*phi0) partial opacities are stored compressed [s]
+	int inelastic_rank;
+	vector<LowRankKernel> inelastic_kernel0, inelastic_kernel1;
+	void allocate_inelastic(const size_t s);
+	bool has_inelastic(const size_t s) const;
+	void set_inelastic_kernel(const size_t s, const size_t z_ind, const Span<double>& partial_opac, const Span<double>& delta);
+	void build_inelastic_samplers(const size_t s, const size_t z_ind);
+
+	// with opacity_cache_blocks>0 neither opac nor the inelastic arrays are
+	// allocated. Transport evaluates them per zone and caches them instead.
+	int opacity_cache_blocks;
+
+	// one contiguous array per quantity, indexed by zone. Zone faces
+	// are already stored contiguously in xAxes.
+	struct ZoneGeometry{
+		vector<double> coord_volume;   // ccm
+		vector<double> lab_3volume;    // ccm
+		vector<double> com_3volume;    // ccm
+		vector<double> fourvolume;     // ccm*s, assumes dt=1s
+		vector<double> min_length;     // cm
+		vector<double> lorentz_factor;
+	} zone_geometry;
+
 	vector<PolarSpectrumArray<0> > spectrum;
 	vector<SpectrumArray*> distribution;  // radiation energy density for each species in lab frame (erg/ccm. Integrated over bin frequency and direction)
 
-	ScalarMultiDArray<double,NDIMS> munue; // chemical potential (erg)
+	ScalarMultiDArray<real,NDIMS> munue; // chemical potential (erg)
 	ScalarMultiDArray<double,NDIMS> lapse;
-	ScalarMultiDArray<double,NDIMS> rho;       // density (g/cm^3)
-	ScalarMultiDArray<double,NDIMS> T;         // gas temperature (K)
-	ScalarMultiDArray<double,NDIMS> Ye;        // electron fraction
+	ScalarMultiDArray<real,NDIMS> rho;         // density (g/cm^3)
+	ScalarMultiDArray<real,NDIMS> T;           // gas temperature (K)
+	ScalarMultiDArray<real,NDIMS> Ye;          // electron fraction
 
 	MultiDArray<ATOMIC<double>,4,NDIMS> fourforce_abs, fourforce_emit;
 	MultiDArray<double,4,NDIMS> fourforce_annihil;
 	ScalarMultiDArray<ATOMIC<double>,NDIMS> l_abs, l_emit; // lepton number emission rate (cm^-3 s^-1) (comoving frame)
 
+	// thread-private buffers for the tallies above (see ThreadTally.h)
+	ThreadTally<4> fourforce_abs_tally, fourforce_emit_tally;
+	ThreadTally<1> l_abs_tally, l_emit_tally;
+	void start_tally_buffers(const bool reproducible);
+	void stop_tally_buffers();
+
 
 	// set everything up
 	virtual void init(Lua* lua, Transport* insim);
 
 	// write out zone information
-	void write_zones(const int iw);
+	void write_zones(const int iw, const vector<size_t>& zone_stop_list);
+	void write_global_zone_data(H5::H5File file);
 	void read_zones(string filename);
 	virtual void write_child_zones(H5::H5File file) =0;
 	virtual void  read_child_zones(H5::H5File file) =0;
@@ -125,17 +176,28 @@ public:
 
 	// describe zone
 	virtual int    zone_index      (const Tuple<double,4>& xup)              const=0;
-	virtual double zone_coord_volume(int z_ind)                       const=0;
-	virtual double zone_lab_3volume(int z_ind)                        const=0;
-	virtual double zone_min_length (int z_ind)                        const=0;
+	template<class GridT=Grid> bool advance_zone(EinsteinHelper* eh)   const;
 	virtual double zone_radius     (int z_ind)                        const=0;
 	virtual double d_boundary  (const EinsteinHelper& eh) const=0;
 	virtual double d_randomwalk(const EinsteinHelper& eh) const=0;
-	virtual double zone_lorentz_factor(int z_ind                    ) const=0;
-	double         zone_com_3volume(int z_ind)                        const;
-	double         zone_4volume    (int z_ind)                        const;
 	double         zone_rest_mass  (int z_ind)                        const;
 
+	// static zone geometry. Each grid type computes it, and
+	// set_zone_geometry() stores it in zone_geometry so the accessors
+	// below are plain loads. It must be called again whenever the
+	// zones, fluid velocity, or lapse change.
+	virtual double compute_zone_coord_volume  (int z_ind) const=0;
+	virtual double compute_zone_lab_3volume   (int z_ind) const=0;
+	virtual double compute_zone_min_length    (int z_ind) const=0;
+	virtual double compute_zone_lorentz_factor(int z_ind) const=0;
+	void set_zone_geometry();
+	double zone_coord_volume  (int z_ind) const {PRINT_ASSERT(z_ind,<,(int)zone_geometry.coord_volume.size());   return zone_geometry.coord_volume[z_ind];}
+	double zone_lab_3volume   (int z_ind) const {PRINT_ASSERT(z_ind,<,(int)zone_geometry.lab_3volume.size());    return zone_geometry.lab_3volume[z_ind];}
+	double zone_com_3volume   (int z_ind) const {PRINT_ASSERT(z_ind,<,(int)zone_geometry.com_3volume.size());    return zone_geometry.com_3volume[z_ind];}
+	double zone_4volume       (int z_ind) const {PRINT_ASSERT(z_ind,<,(int)zone_geometry.fourvolume.size());     return zone_geometry.fourvolume[z_ind];}
+	double zone_min_length    (int z_ind) const {PRINT_ASSERT(z_ind,<,(int)zone_geometry.min_length.size());     return zone_geometry.min_length[z_ind];}
+	double zone_lorentz_factor(int z_ind) const {PRINT_ASSERT(z_ind,<,(int)zone_geometry.lorentz_factor.size()); return zone_geometry.lorentz_factor[z_ind];}
+
 	// global functions
 	double total_rest_mass() const;
 
@@ -153,9 +215,89 @@ public:
 	virtual Christoffel interpolate_Christoffel(const EinsteinHelper& eh) const=0; // Gamma^alhpa_mu_nu
 	virtual Tuple<double,3> interpolate_shift(const EinsteinHelper& eh) const=0;
 	virtual Tuple<double,6> interpolate_3metric(const EinsteinHelper& eh) const=0;
-	void interpolate_metric(EinsteinHelper* eh) const;
+	virtual double interpolate_sqrtdetg3(const EinsteinHelper& eh) const=0; // sqrt of determinant of three-metric
+	template<class GridT=Grid> void interpolate_metric(EinsteinHelper* eh) const;
 };
 
+//------------------------------------------------------------
+// The per-step helpers below are templates so that propagation
+// kernels specialized on a concrete (final) grid class call its
+// functions directly instead of through the vtable. GridT must
+// be the dynamic type of this grid, or Grid itself.
+//------------------------------------------------------------
+
+//------------------------------------------------------------
+// Find the zone containing eh->xup starting from the zone the
+// particle was in before it moved (eh->z_ind and eh->dir_ind).
+// Only the old bin and its neighbors along each axis are
+// checked, so staying in a zone or crossing a face (or an edge
+// or corner) costs O(1). Also sets eh->grid_coords. Returns
+// false if the particle left the grid or moved farther than
+// one zone, in which case the caller must use zone_index().
+//------------------------------------------------------------
+template<class GridT>
+bool Grid::advance_zone(EinsteinHelper* eh) const{
+	const GridT* grid = static_cast<const GridT*>(this);
+
+	// the old directional indices must belong to the old zone
+	if(eh->z_ind<0) return false;
+#if NDIMS>0
+	size_t dir_ind[NDIMS];
+	for(size_t d=0; d<NDIMS; d++){
+		dir_ind[d] = eh->dir_ind[d];
+		if(dir_ind[d] >= xAxes[d].size()) return false;
+	}
+	if(rho.direct_index(dir_ind) != (size_t)eh->z_ind) return false;
+
+	grid->grid_coordinates(eh->xup, eh->grid_coords);
+	for(size_t d=0; d<NDIMS; d++){
+		const Axis& axis = xAxes[d];
+		const double x = eh->grid_coords[d];
+		size_t i = dir_ind[d];
+		if(x < axis.bottom(i)){
+			if(i==0) return false;
+			i--;
+			if(x < axis.bottom(i)) return false;
+		}
+		else if(x >= axis.top[i]){
+			i++;
+			if(i >= axis.size()) return false;
+			if(x >= axis.top[i]) return false;
+		}
+		dir_ind[d] = i;
+	}
+
+	for(size_t d=0; d<NDIMS; d++) eh->dir_ind[d] = dir_ind[d];
+	eh->z_ind = rho.direct_index(dir_ind);
+	PRINT_ASSERT(eh->z_ind,==,grid->zone_index(eh->xup));
+	return true;
+#else
+	// a single zone, so there is nothing to step through
+	grid->grid_coordinates(eh->xup, eh->grid_coords);
+	return true;
+#endif
+}
+
+template<class GridT>
+void Grid::interpolate_metric(EinsteinHelper *eh) const{
+  assert(DO_GR);
+  const GridT* grid = static_cast<const GridT*>(this);
+
+  // first, the lapse
+  eh->g.alpha = lapse.interpolate(eh->icube_vol);
+  PRINT_ASSERT(eh->g.alpha,>,0);
+
+  // second, the shift and three-metric
+  eh->g.betaup = grid->interpolate_shift(*eh);
+  eh->g.gammalow.data = grid->interpolate_3metric(*eh);
+
+  // fill in the rest of the metric values
+  eh->g.update();
+
+  // get the Christoffel symbols
+  eh->Gamma = grid->interpolate_Christoffel(*eh);
+}
+
 
 #endif
 
@@ -78,17 +78,17 @@ int Grid0DIsotropic::zone_index(const Tuple<double,4>&) const{
 //------------------------------------------------------------
 // return volume of zone z_ind
 //------------------------------------------------------------
-double Grid0DIsotropic::zone_coord_volume(int) const{
+double Grid0DIsotropic::compute_zone_coord_volume(int) const{
 	return 1.0;
 }
-double Grid0DIsotropic::zone_lab_3volume(int z_ind) const{
-	return zone_coord_volume(z_ind);
+double Grid0DIsotropic::compute_zone_lab_3volume(int z_ind) const{
+	return compute_zone_coord_volume(z_ind);
 }
 
 //------------------------------------------------------------
 // return length of zone
 //------------------------------------------------------------
-double Grid0DIsotropic::zone_min_length(int) const{
+double Grid0DIsotropic::compute_zone_min_length(int) const{
 	return INFINITY;
 }
 
@@ -141,7 +141,7 @@ Tuple<hsize_t,NDIMS> Grid0DIsotropic::dims() const{
 	return Tuple<hsize_t,NDIMS>();
 }
 
-double Grid0DIsotropic::zone_lorentz_factor(int) const{
+double Grid0DIsotropic::compute_zone_lorentz_factor(int) const{
 	return 1.0;
 }
 // returning 0 causes the min distance to take over in propagate.cpp::which_event
@@ -167,6 +167,9 @@ Tuple<double,6> Grid0DIsotropic::interpolate_3metric(const EinsteinHelper&) cons
   gdata[izz] = 1.;
   return gdata;
 }
+double Grid0DIsotropic::interpolate_sqrtdetg3(const EinsteinHelper&) const{ // default Minkowski
+  return 1.;
+}
 
 void Grid0DIsotropic::grid_coordinates(const Tuple<double,4>&, double coords[NDIMS]) const{
 	coords[0] = 0;
@@ -33,7 +33,7 @@
 //*******************************************
 // 0-Dimensional Isotropic geometry
 //*******************************************
-class Grid0DIsotropic: public Grid
+class Grid0DIsotropic final : public Grid
 {
 
 public:
@@ -45,9 +45,9 @@ public:
 
 	// required functions
 	int  zone_index                (const Tuple<double,4>& x                                 ) const;
-	double zone_coord_volume       (int z_ind                                   ) const;
-	double zone_lab_3volume        (int z_ind                                   ) const;
-	double zone_min_length         (int z_ind                                   ) const;
+	double compute_zone_coord_volume       (int z_ind                                   ) const;
+	double compute_zone_lab_3volume(int z_ind                                   ) const;
+	double compute_zone_min_length (int z_ind                                   ) const;
 	double d_boundary(const EinsteinHelper& eh) const;
 	double d_randomwalk(const EinsteinHelper& eh) const;
 	Tuple<double,NDIMS> zone_coordinates(int z_ind                              ) const;
@@ -57,7 +57,7 @@ public:
 	void symmetry_boundaries       (EinsteinHelper *eh                                ) const;
 	double zone_radius             (int z_ind                                   ) const;
 	Tuple<hsize_t,NDIMS> dims() const;
-	double zone_lorentz_factor     (int z_ind                                   ) const;
+	double compute_zone_lorentz_factor     (int z_ind                                   ) const;
 	hsize_t dimensionality() const {return 0;};
 	void axis_vector(vector<Axis>& axes) const;
 	void write_child_zones(H5::H5File file);
@@ -67,6 +67,7 @@ public:
 	Christoffel interpolate_Christoffel(const EinsteinHelper& eh) const; // Gamma^alhpa_mu_nu
 	Tuple<double,3> interpolate_shift(const EinsteinHelper& eh) const;
 	Tuple<double,6> interpolate_3metric(const EinsteinHelper& eh) const;
+	double interpolate_sqrtdetg3(const EinsteinHelper& eh) const;
 	void grid_coordinates(const Tuple<double,4>& xup, double coords[NDIMS]) const;
 };
 
@@ -260,7 +260,7 @@ int Grid1DSphere::zone_index(const Tuple<double,4>& x) const
 //------------------------------------------------------------
 // return volume of zone z_ind
 //------------------------------------------------------------
-double Grid1DSphere::zone_coord_volume(int z_ind) const{
+double Grid1DSphere::compute_zone_coord_volume(int z_ind) const{
 	PRINT_ASSERT(z_ind,>=,0);
 	PRINT_ASSERT(z_ind,<,(int)rho.size());
 	double r0 = (z_ind==0 ? xAxes[0].min : xAxes[0].top[z_ind-1]);
@@ -268,9 +268,9 @@ double Grid1DSphere::zone_coord_volume(int z_ind) const{
 	PRINT_ASSERT(vol,>=,0);
 	return vol;
 }
-double  Grid1DSphere::zone_lab_3volume(int z_ind) const
+double  Grid1DSphere::compute_zone_lab_3volume(int z_ind) const
 {
-	double vol = zone_coord_volume(z_ind);
+	double vol = compute_zone_coord_volume(z_ind);
 	if(DO_GR) vol *= X[z_ind];
 	PRINT_ASSERT(vol,>,0);
 	return vol;
@@ -279,7 +279,7 @@ double  Grid1DSphere::zone_lab_3volume(int z_ind) const
 //------------------------------------------------------------
 // return length of zone
 //------------------------------------------------------------
-double  Grid1DSphere::zone_min_length(int z_ind) const
+double  Grid1DSphere::compute_zone_min_length(int z_ind) const
 {
 	PRINT_ASSERT(z_ind,>=,0);
 	PRINT_ASSERT(z_ind,<,(int)rho.size());
@@ -504,6 +504,10 @@ Tuple<double,6> Grid1DSphere::interpolate_3metric(const EinsteinHelper& eh) cons
 
 	return data;
 }
+// the metric above only stretches the radial direction by X, so det(g3)=X^2
+double Grid1DSphere::interpolate_sqrtdetg3(const EinsteinHelper& eh) const{
+	return X.interpolate(eh.icube_vol);
+}
 
 Christoffel Grid1DSphere::interpolate_Christoffel(const EinsteinHelper& eh) const{
 	const double r = radius(eh.xup);
@@ -538,7 +542,7 @@ Christoffel Grid1DSphere::interpolate_Christoffel(const EinsteinHelper& eh) cons
 	return ch;
 }
 
-double Grid1DSphere::zone_lorentz_factor(int z_ind) const{
+double Grid1DSphere::compute_zone_lorentz_factor(int z_ind) const{
 	double vdotv = vr[z_ind]*vr[z_ind] * X[z_ind] / (pc::c*pc::c);
 	return 1. / sqrt(1.-vdotv);
 }
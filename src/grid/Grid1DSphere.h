@@ -55,29 +55,31 @@ public:
 	void read_nagakura_model(Lua* lua);
 
 	// required functions
-	int  zone_index               (const Tuple<double,4>& x                                             ) const;
-	double zone_coord_volume       (int z_ind                                   ) const;
-	double zone_lab_3volume       (int z_ind                                               ) const;
-	double zone_min_length        (int z_ind                                               ) const;
+	// (the per-step ones are final so that GridGR1D propagation kernels can call them directly)
+	int  zone_index               (const Tuple<double,4>& x                                             ) const final;
+	double compute_zone_coord_volume       (int z_ind                                   ) const;
+	double compute_zone_lab_3volume       (int z_ind                                               ) const;
+	double compute_zone_min_length(int z_ind                                               ) const;
 	Tuple<double,NDIMS> zone_coordinates(int z_ind                              ) const;
 	Tuple<size_t,NDIMS> zone_directional_indices (int z_ind) const;
 	Tuple<double,4> sample_in_zone (int z_ind, ThreadRNG* rangen                ) const;
-	Tuple<double,3> interpolate_fluid_velocity(const EinsteinHelper& eh               ) const;
-	void symmetry_boundaries      (EinsteinHelper *eh                                            ) const;
-	double zone_lorentz_factor    (int z_ind                                               ) const;
+	Tuple<double,3> interpolate_fluid_velocity(const EinsteinHelper& eh               ) const final;
+	void symmetry_boundaries      (EinsteinHelper *eh                                            ) const final;
+	double compute_zone_lorentz_factor    (int z_ind                                               ) const;
 	double zone_radius            (int z_ind) const;
 	Tuple<hsize_t,NDIMS> dims() const;
 	hsize_t dimensionality() const {return 1;};
-	double d_boundary(const EinsteinHelper& eh) const;
-	double d_randomwalk(const EinsteinHelper& eh) const;
+	double d_boundary(const EinsteinHelper& eh) const final;
+	double d_randomwalk(const EinsteinHelper& eh) const final;
 	void write_child_zones(H5::H5File file);
 	void read_child_zones(H5::H5File file);
 
 	// GR functions
-	Christoffel interpolate_Christoffel(const EinsteinHelper& eh) const; // Gamma^alhpa_mu_nu
-	Tuple<double,3> interpolate_shift(const EinsteinHelper& eh) const;
-	Tuple<double,6> interpolate_3metric(const EinsteinHelper& eh) const;
-	void grid_coordinates(const Tuple<double,4>& xup, double coords[NDIMS]) const;
+	Christoffel interpolate_Christoffel(const EinsteinHelper& eh) const final; // Gamma^alhpa_mu_nu
+	Tuple<double,3> interpolate_shift(const EinsteinHelper& eh) const final;
+	Tuple<double,6> interpolate_3metric(const EinsteinHelper& eh) const final;
+	double interpolate_sqrtdetg3(const EinsteinHelper& eh) const final;
+	void grid_coordinates(const Tuple<double,4>& xup, double coords[NDIMS]) const final;
 };
 
 
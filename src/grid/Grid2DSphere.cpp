@@ -827,7 +827,7 @@ int Grid2DSphere::zone_index(int i, int j) const
 //------------------------------------------------------------
 // return volume of zone
 //------------------------------------------------------------
-double Grid2DSphere::zone_coord_volume(int z_ind) const{
+double Grid2DSphere::compute_zone_coord_volume(int z_ind) const{
 	PRINT_ASSERT(z_ind,>=,0);
 	PRINT_ASSERT(z_ind,<,(int)rho.size());
 	Tuple<size_t,NDIMS> dir_ind = zone_directional_indices(z_ind);
@@ -841,10 +841,10 @@ double Grid2DSphere::zone_coord_volume(int z_ind) const{
 	PRINT_ASSERT(vol,>=,0);
 	return vol;
 }
-double Grid2DSphere::zone_lab_3volume(int z_ind) const
+double Grid2DSphere::compute_zone_lab_3volume(int z_ind) const
 {
 	PRINT_ASSERT(DO_GR,==,false); // need to include sqrt(detg3)
-	return zone_coord_volume(z_ind);
+	return compute_zone_coord_volume(z_ind);
 }
 
 
@@ -938,7 +938,7 @@ double Grid2DSphere::d_randomwalk(const EinsteinHelper& eh) const{
 //------------------------------------------------------------
 // return length of zone
 //------------------------------------------------------------
-double Grid2DSphere::zone_min_length(int z_ind) const
+double Grid2DSphere::compute_zone_min_length(int z_ind) const
 {
 	Tuple<size_t,NDIMS> dir_ind = zone_directional_indices(z_ind);
 	const size_t i = dir_ind[0];
@@ -1112,7 +1112,7 @@ Tuple<hsize_t,NDIMS> Grid2DSphere::dims() const{
 	return dims;
 }
 
-double Grid2DSphere::zone_lorentz_factor(int z_ind) const{
+double Grid2DSphere::compute_zone_lorentz_factor(int z_ind) const{
 	PRINT_ASSERT(DO_GR,==,0);
 	double v2 = vr[z_ind]*vr[z_ind] + vtheta[z_ind]*vtheta[z_ind] + vphi[z_ind]*vphi[z_ind];
 	return 1. / sqrt(1. - v2/(physical_constants::c*physical_constants::c));
@@ -1129,6 +1129,9 @@ Tuple<double,3> Grid2DSphere::interpolate_shift(const EinsteinHelper&) const{ //
 Tuple<double,6> Grid2DSphere::interpolate_3metric(const EinsteinHelper&) const{ // default Minkowski
 	return Tuple<double,6>(NaN);
 }
+double Grid2DSphere::interpolate_sqrtdetg3(const EinsteinHelper&) const{ // default Minkowski
+	return 1.;
+}
 void Grid2DSphere::grid_coordinates(const Tuple<double,4>& xup, double coords[NDIMS]) const{
 	coords[0] = radius(xup);
 	coords[1] = Grid2DSphere_theta(xup);
@@ -39,7 +39,7 @@
 //*******************************************
 // 1-Dimensional Spherical geometry
 //*******************************************
-class Grid2DSphere: public Grid
+class Grid2DSphere final : public Grid
 {
 
 private:
@@ -60,12 +60,12 @@ public:
 	// required functions
 	int    zone_index             (const Tuple<double,4>& x                            ) const;
 	int    zone_index             (int i, const int j                                      ) const;
-	double zone_coord_volume       (int z_ind                                   ) const;
-	double zone_lab_3volume       (int z_ind                                               ) const;
-	double zone_min_length        (int z_ind                                               ) const;
+	double compute_zone_coord_volume       (int z_ind                                   ) const;
+	double compute_zone_lab_3volume       (int z_ind                                               ) const;
+	double compute_zone_min_length(int z_ind                                               ) const;
 	Tuple<double,NDIMS> zone_coordinates(int z_ind                              ) const;
 	Tuple<size_t,NDIMS> zone_directional_indices (int z_ind) const;
-	double zone_lorentz_factor    (int z_ind                                               ) const;
+	double compute_zone_lorentz_factor    (int z_ind                                               ) const;
 	Tuple<double,4> sample_in_zone (int z_ind, ThreadRNG* rangen                ) const;
 	Tuple<double,3> interpolate_fluid_velocity(const EinsteinHelper& eh               ) const;
 	void symmetry_boundaries      (EinsteinHelper *eh                                            ) const;
@@ -81,6 +81,7 @@ public:
 	Christoffel interpolate_Christoffel(const EinsteinHelper& eh) const; // Gamma^alhpa_mu_nu
 	Tuple<double,3> interpolate_shift(const EinsteinHelper& eh) const;
 	Tuple<double,6> interpolate_3metric(const EinsteinHelper& eh) const;
+	double interpolate_sqrtdetg3(const EinsteinHelper& eh) const;
 	void grid_coordinates(const Tuple<double,4>& xup, double coords[NDIMS]) const;
  };
 
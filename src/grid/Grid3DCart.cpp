@@ -62,6 +62,7 @@ void Grid3DCart::read_child_zones(H5::H5File file){
 		betaup.read_HDF5(file,"shiftup",xAxes);
 		g3.read_HDF5(file,"threemetric",xAxes);
 		sqrtdetg3.read_HDF5(file,"sqrtdetg3",xAxes);
+		if(christoffel.size()>0) set_christoffel();
 	}
 	v.read_HDF5(file,"threevelocity(cm|s)",xAxes);
 }
@@ -88,6 +89,9 @@ void Grid3DCart::read_model_file(Lua* lua)
 			g.update();
 			sqrtdetg3[z_ind] = sqrt(g.gammalow.det());
 		}
+
+		pair<int,bool> precompute_pair = lua->scalar_pair<int>("Grid3DCart_precompute_christoffel");
+		if(precompute_pair.second and precompute_pair.first!=0) set_christoffel();
 	}
 
 	if(rotate_quadrant!=0 || rotate_hemisphere[0]!=0 || rotate_hemisphere[1]!=0){
@@ -439,7 +443,7 @@ Tuple<size_t,NDIMS> Grid3DCart::zone_directional_indices(int z_ind) const
 //------------------------------------------------------------
 // return volume of zone (precomputed)
 //------------------------------------------------------------
-double Grid3DCart::zone_coord_volume(int z_ind) const
+double Grid3DCart::compute_zone_coord_volume(int z_ind) const
 {
 	PRINT_ASSERT(z_ind,>=,0);
 	PRINT_ASSERT(z_ind,<,(int)rho.size());
@@ -448,9 +452,9 @@ double Grid3DCart::zone_coord_volume(int z_ind) const
 	PRINT_ASSERT(result,>,0);
 	return result;
 }
-double Grid3DCart::zone_lab_3volume(int z_ind) const
+double Grid3DCart::compute_zone_lab_3volume(int z_ind) const
 {
-	double result = zone_coord_volume(z_ind);
+	double result = compute_zone_coord_volume(z_ind);
 	if(DO_GR) result *= sqrtdetg3[z_ind];
 	PRINT_ASSERT(result,>,0);
 	return result;
@@ -496,7 +500,7 @@ Tuple<double,4> Grid3DCart::sample_in_zone(int z_ind, ThreadRNG* rangen) const
 //------------------------------------------------------------
 // return length of zone
 //------------------------------------------------------------
-double  Grid3DCart::zone_min_length(int z_ind) const
+double  Grid3DCart::compute_zone_min_length(int z_ind) const
 {
 	PRINT_ASSERT(z_ind,>=,0);
 	PRINT_ASSERT(z_ind,<,(int)rho.size());
@@ -693,7 +697,7 @@ void Grid3DCart::symmetry_boundaries(EinsteinHelper *eh) const{
 	eh->xup = xup;
 }
 
-double Grid3DCart::zone_lorentz_factor(int z_ind) const{
+double Grid3DCart::compute_zone_lorentz_factor(int z_ind) const{
 	Metric g;
 	if(DO_GR) g.gammalow.data = g3[z_ind];
 	else g.gammalow.data = NaN;
@@ -707,19 +711,21 @@ double Grid3DCart::zone_lorentz_factor(int z_ind) const{
 	return result;
 }
 
-Christoffel Grid3DCart::interpolate_Christoffel(const EinsteinHelper& eh) const{
+//------------------------------------------------------------
+// Christoffel symbols from the metric and the spatial
+// derivatives of the three-metric, lapse, and shift
+//------------------------------------------------------------
+Christoffel Grid3DCart::christoffel_from_derivatives(const Metric& g, const Tuple<Tuple<double,6>,NDIMS>& dg3_dx,
+		const Tuple<double,NDIMS>& da_dx, const Tuple<Tuple<double,3>,NDIMS>& dbetaup_dx){
   double dg[4][4][4];
   for(size_t i=0; i<4; i++) for(size_t j=0; j<4; j++){ // no time derivatives
       dg[3][i][j] = 0;
     }
 
-  Tuple<Tuple<double,6>,NDIMS> dg3_dx = g3.interpolate_slopes(eh.icube_vol);
-  Tuple<double,NDIMS> da_dx = lapse.interpolate_slopes(eh.icube_vol);
-  Tuple<Tuple<double,3>,NDIMS> dbetaup_dx = betaup.interpolate_slopes(eh.icube_vol);
   Tuple<Tuple<double,3>,NDIMS> dbetalow_dx;
 
   for(size_t a=0; a<3; a++) 
-    dbetalow_dx[a] = eh.g.gammalow.lower(dbetaup_dx[a]);
+    dbetalow_dx[a] = g.gammalow.lower(dbetaup_dx[a]);
   
   #pragma omp simd
   for(size_t a=0; a<3; a++){
@@ -739,9 +745,9 @@ Christoffel Grid3DCart::interpolate_Christoffel(const EinsteinHelper& eh) const{
     dg[a][3][0] = dbetalow_dx[a][0];
     dg[a][3][1] = dbetalow_dx[a][1];
     dg[a][3][2] = dbetalow_dx[a][2];
-    dg[a][3][3] = -eh.g.alpha * da_dx[a];
+    dg[a][3][3] = -g.alpha * da_dx[a];
     for(size_t i=0; i<3; i++)
-      dg[a][3][3] += eh.g.betalow[i] * dbetaup_dx[a][i]; // [direction][element]
+      dg[a][3][3] += g.betalow[i] * dbetaup_dx[a][i]; // [direction][element]
     dg[a][3][3] *= 2.;
   }
 
@@ -749,7 +755,7 @@ Christoffel Grid3DCart::interpolate_Christoffel(const EinsteinHelper& eh) const{
   ch.data = 0;
   for(size_t a=0; a<4; a++){
 	  for(size_t b=0; b<4; b++){
-		  double gupab = eh.g.get_inverse(a,b);
+		  double gupab = g.get_inverse(a,b);
 		  for(size_t mu=0; mu<4; mu++){
 			  for(size_t nu=mu; nu<4; nu++){ // yes, intentionally only go from mu to 4
 				  ch.data[Christoffel::index(a,mu,nu)] += 0.5 * gupab * (dg[mu][b][nu] + dg[nu][mu][b] - dg[b][mu][nu]);
@@ -759,12 +765,63 @@ Christoffel Grid3DCart::interpolate_Christoffel(const EinsteinHelper& eh) const{
   }
   return ch;
 }
+
+//------------------------------------------------------------
+// Either interpolate the precomputed Christoffel symbols or
+// compute them from the interpolated metric derivatives
+//------------------------------------------------------------
+Christoffel Grid3DCart::interpolate_Christoffel(const EinsteinHelper& eh) const{
+	if(christoffel.size()>0){
+		Christoffel ch;
+		ch.data = christoffel.interpolate(eh.icube_vol);
+		return ch;
+	}
+
+	Tuple<Tuple<double,6>,NDIMS> dg3_dx = g3.interpolate_slopes(eh.icube_vol);
+	Tuple<double,NDIMS> da_dx = lapse.interpolate_slopes(eh.icube_vol);
+	Tuple<Tuple<double,3>,NDIMS> dbetaup_dx = betaup.interpolate_slopes(eh.icube_vol);
+	return christoffel_from_derivatives(eh.g, dg3_dx, da_dx, dbetaup_dx);
+}
+
+//------------------------------------------------------------
+// Christoffel symbols at every zone center from the metric
+// there and finite-difference slopes of its components
+//------------------------------------------------------------
+void Grid3DCart::set_christoffel(){
+	PRINT_ASSERT(DO_GR,==,true);
+	christoffel.set_axes(xAxes);
+
+	#pragma omp parallel for
+	for(size_t z_ind=0; z_ind<christoffel.size(); z_ind++){
+		Metric g;
+		g.alpha = lapse[z_ind];
+		g.betaup = betaup[z_ind];
+		g.gammalow.data = g3[z_ind];
+		g.update();
+
+		Tuple<Tuple<double,6>,NDIMS> dg3_dx;
+		Tuple<double,NDIMS> da_dx;
+		Tuple<Tuple<double,3>,NDIMS> dbetaup_dx;
+#if NDIMS>0
+		for(size_t d=0; d<NDIMS; d++){
+			dg3_dx[d] = g3.slope(z_ind,d);
+			da_dx[d] = lapse.slope(z_ind,d)[0];
+			dbetaup_dx[d] = betaup.slope(z_ind,d);
+		}
+#endif
+		christoffel[z_ind] = christoffel_from_derivatives(g, dg3_dx, da_dx, dbetaup_dx).data;
+	}
+}
+
 Tuple<double,3> Grid3DCart::interpolate_shift(const EinsteinHelper& eh) const{
 	return betaup.interpolate(eh.icube_vol);
 }
 Tuple<double,6> Grid3DCart::interpolate_3metric(const EinsteinHelper& eh) const{
 	return g3.interpolate(eh.icube_vol);
 }
+double Grid3DCart::interpolate_sqrtdetg3(const EinsteinHelper& eh) const{
+	return sqrtdetg3.interpolate(eh.icube_vol);
+}
 void Grid3DCart::grid_coordinates(const Tuple<double,4>& xup, double coords[NDIMS]) const{
 	coords[0] = xup[0];
 	coords[1] = xup[1];
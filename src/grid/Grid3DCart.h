@@ -35,11 +35,12 @@
 //    Grid3DCart_reflect_{x,y,z} -- reflect particles off the {x,y,z}=0 boundary. Also truncates the fluid grid there.
 //    Grid3DCart_rotate_hemisphere_{x,y} -- assume 180-degree rotational symmetry in hemispheres where everywhere {x,y}>0
 //    Grid3DCart_rotate_quadrant -- assume 90-degree rotational symmetry. x and y >0 everywhere.
+//    Grid3DCart_precompute_christoffel -- compute Christoffel symbols at zone centers once and interpolate them
 
 //*******************************************
 // 1-Dimensional Spherical geometry
 //*******************************************
-class Grid3DCart: public Grid
+class Grid3DCart final : public Grid
 {
 
 private:
@@ -52,6 +53,8 @@ private:
 	MultiDArray<double,3,NDIMS> betaup; // shift
 	MultiDArray<double,6,NDIMS> g3;  // three-metric
 	ScalarMultiDArray<double,NDIMS> sqrtdetg3; // sqrt of determinant of three-metric
+	MultiDArray<double,40,NDIMS> christoffel; // Gamma^alpha_mu_nu at zone centers (empty unless precomputed)
+	void set_christoffel();
 
 	MultiDArray<double,3,NDIMS> v;
 
@@ -71,15 +74,15 @@ public:
 	// required functions
 	int    zone_index               (const Tuple<double,4>& x                            ) const;
 	int    zone_index               (int i, const int j, const int k                         ) const;
-	double zone_coord_volume       (int z_ind                                   ) const;
-	double zone_lab_3volume         (int z_ind                                               ) const;
-	double zone_min_length          (int z_ind                                               ) const;
+	double compute_zone_coord_volume       (int z_ind                                   ) const;
+	double compute_zone_lab_3volume (int z_ind                                               ) const;
+	double compute_zone_min_length  (int z_ind                                               ) const;
 	Tuple<double,NDIMS> zone_coordinates(int z_ind                              ) const;
 	Tuple<size_t,NDIMS> zone_directional_indices (int z_ind) const;
 	Tuple<double,4> sample_in_zone (int z_ind, ThreadRNG* rangen                ) const;
 	Tuple<double,3> interpolate_fluid_velocity(const EinsteinHelper& eh               ) const;
 	void   symmetry_boundaries      (EinsteinHelper *eh                                            ) const;
-	double zone_lorentz_factor      (int z_ind                                               ) const;
+	double compute_zone_lorentz_factor      (int z_ind                                               ) const;
 	double zone_radius              (int z_ind) const;
 	Tuple<hsize_t,NDIMS> dims() const;
 	hsize_t dimensionality() const {return 3;};
@@ -89,9 +92,12 @@ public:
 	void read_child_zones(H5::H5File file);
 
 	// GR functions
+	static Christoffel christoffel_from_derivatives(const Metric& g, const Tuple<Tuple<double,6>,NDIMS>& dg3_dx,
+			const Tuple<double,NDIMS>& da_dx, const Tuple<Tuple<double,3>,NDIMS>& dbetaup_dx);
 	Christoffel interpolate_Christoffel(const EinsteinHelper& eh) const; // Gamma^alhpa_mu_nu
 	Tuple<double,3> interpolate_shift(const EinsteinHelper& eh) const;
 	Tuple<double,6> interpolate_3metric(const EinsteinHelper& eh) const;
+	double interpolate_sqrtdetg3(const EinsteinHelper& eh) const;
 	void grid_coordinates(const Tuple<double,4>& xup, double coords[NDIMS]) const;
 };
 
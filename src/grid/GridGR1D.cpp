@@ -38,6 +38,7 @@ GridGR1D::GridGR1D(){
 	PRINT_ASSERT(NDIMS,==,1);
 	grid_type = "GridGR1D";
 	ghosts1=-1;
+	reflect_outer = 0; // particles flow out of the outer boundary (see Grid1DSphere::symmetry_boundaries)
 }
 
 //------------------------------------------------------------
@@ -52,13 +53,6 @@ void GridGR1D::init(Lua* /*lua*/){
 	// DO NOTHING
 }
 
-//------------------------------------------------------------
-// Reflect off symmetry axis
-//------------------------------------------------------------
-void GridGR1D::symmetry_boundaries(EinsteinHelper* /*eh*/) const{
-	// NONE - just flow out of outer boundary
-}
-
 void GridGR1D::set_fluid(const double* rho_in, const double* T_in, const double* Ye_in, const double* vr_in, const double* X_in, const double* alp_in){
 	for(size_t z_ind=0; z_ind<rho.size(); z_ind++)
 	{
@@ -75,6 +69,7 @@ void GridGR1D::set_fluid(const double* rho_in, const double* T_in, const double*
 		PRINT_ASSERT(Ye[z_ind],>=,0);
 		PRINT_ASSERT(Ye[z_ind],<=,1.0);
 	}
+	set_zone_geometry();
 }
 
 void GridGR1D::initialize_grid(const double* rarray, const int n_zones, const int nghost){
@@ -33,7 +33,7 @@
 //*******************************************
 // 1-Dimensional Spherical geometry
 //*******************************************
-class GridGR1D: public Grid1DSphere
+class GridGR1D final : public Grid1DSphere
 {
 
 private:
@@ -48,7 +48,6 @@ public:
 
 	// required functions
 	void read_model_file(Lua* lua);
-	void symmetry_boundaries      (EinsteinHelper *eh) const;
 	void init(Lua* lua);
 
 	// GR1D-specific functions
@@ -0,0 +1,113 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#ifndef _ALIAS_TABLE_H
+#define _ALIAS_TABLE_H 1
+
+#include <vector>
+#include "global_options.h"
+
+using namespace std;
+
+//============//
+// AliasTable //
+//============//
+// Many Walker/Vose alias tables of the same length n stored back to
+// back. Sampling one of them takes a single uniform random number
+// and one memory access: the number picks an entry and, within
+// the entry, either the entry itself or its alias. Tables are
+// built in O(n) with Vose's method. Only tables [first, size())
+// are stored, so a rank can keep just the tables of its own zones.
+struct AliasEntry{
+	float prob;         // probability of keeping this entry
+	unsigned int alias; // index returned otherwise
+};
+
+class AliasTable{
+public:
+	size_t n, first;
+	vector<AliasEntry> entries; // [(table-first)*n + i]
+
+	AliasTable() : n(0), first(0) {}
+
+	void resize(const size_t ntables, const size_t n_in, const size_t first_in=0){
+		n = n_in;
+		first = first_in;
+		entries.resize(ntables*n);
+	}
+	size_t size() const {return n==0 ? 0 : first + entries.size()/n;}
+
+	// weights need not be normalized. A table with zero total
+	// weight samples uniformly; it should never be used.
+	template<typename T>
+	void build(const size_t table, const T* weights){
+		PRINT_ASSERT(table,>=,first);
+		PRINT_ASSERT(table,<,size());
+
+		// per-thread work space, so repeated builds do not allocate
+		static thread_local vector<double> q;
+		static thread_local vector<size_t> small, large;
+		AliasEntry* entry = &entries[(table-first)*n];
+		double sum = 0;
+		for(size_t i=0; i<n; i++){
+			PRINT_ASSERT(weights[i],>=,0);
+			sum += weights[i];
+		}
+		q.resize(n);
+		small.resize(0);
+		large.resize(0);
+		for(size_t i=0; i<n; i++){
+			q[i] = (sum>0 ? weights[i]*n/sum : 1.0);
+			if(q[i]<1.0) small.push_back(i);
+			else large.push_back(i);
+		}
+		while(small.size()>0 and large.size()>0){
+			const size_t l = small.back(); small.pop_back();
+			const size_t g = large.back(); large.pop_back();
+			entry[l].prob = q[l];
+			entry[l].alias = g;
+			q[g] = (q[g] + q[l]) - 1.0;
+			if(q[g]<1.0) small.push_back(g);
+			else large.push_back(g);
+		}
+		// leftovers are 1 up to roundoff
+		for(size_t i=0; i<large.size(); i++) entry[large[i]] = {1.0, (unsigned int)large[i]};
+		for(size_t i=0; i<small.size(); i++) entry[small[i]] = {1.0, (unsigned int)small[i]};
+	}
+
+	// U is uniform in [0,1)
+	size_t sample(const size_t table, const double U) const{
+		PRINT_ASSERT(table,>=,first);
+		PRINT_ASSERT(table,<,size());
+		const double x = U*n;
+		const size_t i = min((size_t)x, n-1);
+		const AliasEntry& entry = entries[(table-first)*n + i];
+		return (x-i < entry.prob ? i : entry.alias);
+	}
+};
+
+#endif
@@ -3,7 +3,9 @@
 
 #include <vector>
 #include <algorithm>
+#include <cmath>
 #include "global_options.h"
+#include "EytzingerSearch.h"
 #include "hdf5.h"
 #include <string>
 
@@ -18,6 +20,14 @@ public:
 	vector<double> top;
 	vector<double> mid;
 
+	// How bin() finds a bin. Uniform and logarithmic axes compute it
+	// directly, others search a cache-friendly copy of top. Set by
+	// set_search(), which must be called again if min or top change.
+	enum Spacing {general_spacing, uniform_spacing, log_spacing};
+	Spacing spacing;
+	double inv_delta; // 1/(bin width), or 1/log(bin top/bin bottom) if logarithmic
+	EytzingerSearch search_tree; // only built for general_spacing
+
 	Axis(const double min, vector<double>& top, vector<double>& mid){
 		PRINT_ASSERT(top.size(),==,mid.size());
 		this->min = min;
@@ -27,6 +37,7 @@ public:
 			PRINT_ASSERT(top[i],>,mid[i]);
 			PRINT_ASSERT(mid[i],>, ((i==0) ? min : top[i-1]));
 		}
+		set_search();
 	}
 	Axis(const double min, const double max, const size_t nbins){
 		this->min = min;
@@ -37,10 +48,47 @@ public:
 			top[i] = min + (i+1)*del;
 			mid[i] = min + ((double)i + 0.5)*del;
 		}
+		set_search();
 	}
 
 	Axis() {
 		min = NaN;
+		spacing = general_spacing;
+		inv_delta = NaN;
+	}
+
+	// detect uniform or logarithmic bins to within roundoff
+	void set_search(){
+		const double tolerance = 1e-6;
+		const size_t n = size();
+		spacing = general_spacing;
+		inv_delta = NaN;
+		search_tree.clear();
+		if(n==0) return;
+
+		const double del = (top[n-1]-min) / (double)n;
+		bool uniform = true;
+		for(size_t i=0; i<n and uniform; i++)
+			uniform = fabs(delta(i)-del) <= tolerance*del;
+		if(uniform){
+			spacing = uniform_spacing;
+			inv_delta = 1./del;
+			return;
+		}
+
+		if(min>0){
+			const double dlog = log(top[n-1]/min) / (double)n;
+			bool logarithmic = true;
+			for(size_t i=0; i<n and logarithmic; i++)
+				logarithmic = fabs(log(top[i]/bottom(i))-dlog) <= tolerance*dlog;
+			if(logarithmic){
+				spacing = log_spacing;
+				inv_delta = 1./dlog;
+				return;
+			}
+		}
+
+		search_tree.build(top);
 	}
 
 	size_t size() const {
@@ -48,16 +96,24 @@ public:
 		return top.size();
 	}
 
+	// index of the first bin top greater than x (size() if none)
 	int bin(const double x) const{
 		if(x<min) return -1;
+		int ind;
+		if(spacing==general_spacing) ind = search_tree.upper_bound(x);
 		else{
-			// upper_bound returns first element greater than xval
-			// values mark bin tops, so this is what we want
-			int ind = upper_bound(top.begin(), top.end(), x) - top.begin();
-			PRINT_ASSERT(ind,>=,0);
-			PRINT_ASSERT(ind,<=,(int)top.size());
-			return ind;
+			// guess from the spacing, then step past roundoff so the
+			// result is exactly that of a search over top
+			const double guess = (spacing==uniform_spacing ? (x-min)*inv_delta : log(x/min)*inv_delta);
+			const int n = top.size();
+			ind = (guess < n ? (int)guess : n);
+			while(ind<n && top[ind]<=x) ind++;
+			while(ind>0 && top[ind-1]>x) ind--;
 		}
+		PRINT_ASSERT(ind,>=,0);
+		PRINT_ASSERT(ind,<=,(int)top.size());
+		PRINT_ASSERT(ind,==,upper_bound(top.begin(), top.end(), x) - top.begin());
+		return ind;
 	}
 
 	double bottom(const size_t i) const{
@@ -127,6 +183,7 @@ public:
 		dataset.close();
 
 		PRINT_ASSERT(mid.size(),==,top.size());
+		set_search();
 	}
 };
 
@@ -0,0 +1,124 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+
+#ifndef _BLOCK_CACHE_H
+#define _BLOCK_CACHE_H 1
+
+#include <vector>
+#include <unordered_map>
+#include "global_options.h"
+
+using namespace std;
+
+//============//
+// BlockCache //
+//============//
+// Fixed-capacity least-recently-used cache of equal-sized blocks
+// of doubles owned by a single thread. Each block is labeled by a
+// key and a version number. Looking up a key whose stored version
+// differs from the requested one counts as a miss, so the owner can
+// invalidate entries by bumping the version instead of touching
+// every thread's cache.
+class BlockCache{
+public:
+	static const size_t none = (size_t)-1;
+
+	size_t block_size;
+	vector<double> data;          // [slot][block_size]
+	vector<size_t> key;           // key held by each slot
+	vector<unsigned> version;     // version of the data held by each slot
+	vector<size_t> prev, next;    // recency list, head is the most recent
+	size_t head, tail, nused;
+	unordered_map<size_t,size_t> slot_of; // key --> slot
+	size_t hits, misses;
+
+	BlockCache() : block_size(0), head(none), tail(none), nused(0), hits(0), misses(0) {}
+
+	void init(const size_t capacity, const size_t block_size_in){
+		PRINT_ASSERT(capacity,>,0);
+		PRINT_ASSERT(block_size_in,>,0);
+		block_size = block_size_in;
+		data.assign(capacity*block_size, NaN);
+		key.assign(capacity, (size_t)none);
+		version.assign(capacity, 0);
+		prev.assign(capacity, (size_t)none);
+		next.assign(capacity, (size_t)none);
+		head = tail = none;
+		nused = 0;
+		slot_of.clear();
+		slot_of.reserve(2*capacity);
+		hits = misses = 0;
+	}
+	size_t capacity() const {return key.size();}
+
+	// returns the block for the key. If *hit is false on return the
+	// block holds stale data and the caller must fill it.
+	double* lookup(const size_t k, const unsigned v, bool* hit){
+		size_t slot;
+		unordered_map<size_t,size_t>::iterator it = slot_of.find(k);
+		if(it != slot_of.end()){
+			slot = it->second;
+			*hit = (version[slot] == v);
+			unlink(slot);
+		}
+		else{
+			*hit = false;
+			if(nused < capacity()) slot = nused++;
+			else{
+				slot = tail; // evict the least recently used block
+				unlink(slot);
+				slot_of.erase(key[slot]);
+			}
+			key[slot] = k;
+			slot_of[k] = slot;
+		}
+		version[slot] = v;
+		push_front(slot);
+		if(*hit) hits++;
+		else misses++;
+		return &data[slot*block_size];
+	}
+
+private:
+	void unlink(const size_t slot){
+		if(prev[slot]!=none) next[prev[slot]] = next[slot];
+		else head = next[slot];
+		if(next[slot]!=none) prev[next[slot]] = prev[slot];
+		else tail = prev[slot];
+		prev[slot] = next[slot] = none;
+	}
+	void push_front(const size_t slot){
+		prev[slot] = none;
+		next[slot] = head;
+		if(head!=none) prev[head] = slot;
+		head = slot;
+		if(tail==none) tail = slot;
+	}
+};
+
+#endif
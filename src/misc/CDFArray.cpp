@@ -64,6 +64,7 @@ void CDFArray::set_value(const int i, const double f)
 	PRINT_ASSERT(i,>=,0);
 	PRINT_ASSERT(i,<,(int)size());
 	y[i] = ( i==0 ? f : y[i-1]+f );
+	search_tree.clear();
 }
 
 //------------------------------------------------------
@@ -83,6 +84,7 @@ void CDFArray::normalize()
 		double N_inv = 1.0/N;
 		for(size_t i=0;i<y.size();i++)   y[i] *= N_inv;
 	}
+	search_tree.build(y);
 }
 
 //---------------------------------------------------------
@@ -90,13 +92,17 @@ void CDFArray::normalize()
 // Pass a number betwen 0 and 1.
 // Returns the index of the first value larger than yval
 // if larger than largest element, returns size
+// Searches the copy built by normalize(), which must be called
+// after the values change anyway. Falls back to y if there isn't one.
 //---------------------------------------------------------
 int CDFArray::get_index(const double yval) const
 {
 	PRINT_ASSERT(yval,>=,0);
 	PRINT_ASSERT(yval,<=,1.0);
 	PRINT_ASSERT(fabs(y.back()-1.0),<,TINY);
-	int i = upper_bound(y.begin(), y.end(), yval) - y.begin();
+	int i = (search_tree.size()==y.size() ?
+			search_tree.upper_bound(yval) :
+			upper_bound(y.begin(), y.end(), yval) - y.begin());
 	PRINT_ASSERT(i,>=,0);
 	PRINT_ASSERT(i,<=,(int)size());
 	return i;
@@ -531,6 +537,7 @@ void CDFArray::print() const{
 void CDFArray::wipe()
 {
 	y.assign(y.size(), 1.0);
+	search_tree.clear();
 }
 
 //------------------------------------------------------------
@@ -30,13 +30,15 @@
 
 #include <vector>
 #include "Axis.h"
+#include "EytzingerSearch.h"
 
 //**********************************************************
 // CDF == Cumulative Distribution Function
 //
 // This simple class just holds a vector which should be
 // monitonically increasing and reaches unity
-// We can sample from it using a binary search.
+// We can sample from it using a binary search, which runs
+// over a copy in Eytzinger order built by normalize().
 // the CDF value at locate_array's "min" is assumed to be 0
 //**********************************************************
 
@@ -46,6 +48,7 @@ class CDFArray
 private:
 
 	std::vector<double> y;
+	EytzingerSearch search_tree; // copy of y for get_index(). Rebuilt by normalize(), cleared when y changes
 	double tangent(const int i, const Axis* xgrid) const;
 	double secant(const int i, const int j, const Axis* xgrid) const;
 	double inverse_tangent(const int i, const Axis* xgrid) const;
@@ -69,10 +72,10 @@ public:
 	int interpolation_order;
 
 	double N;
-	void resize(const int n)  {y.resize(n);}
+	void resize(const int n)  {y.resize(n); search_tree.clear();}
 
 	double get(const int i)const             {return y[i];}   // Get local CDF value
-	void   set(const int i, const double f)  {y[i] = f;}      // Set cell CDF value
+	void   set(const int i, const double f)  {y[i] = f; search_tree.clear();}  // Set cell CDF value
 
 	void   set_value(const int i, const double f);     // set the actual (not CDF) value
 	double get_value(const int i) const;               // Get the actual (not CDF) value
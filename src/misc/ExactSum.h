@@ -0,0 +1,134 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+
+#ifndef _EXACT_SUM_H
+#define _EXACT_SUM_H 1
+
+#include <mpi.h>
+#include <cmath>
+#include <vector>
+#include "global_options.h"
+
+using namespace std;
+
+//==========//
+// ExactSum //
+//==========//
+// Array of fixed-point accumulators whose result does not depend
+// on the order of the additions. Each element is a 384-bit integer
+// in units of 2^min_exponent, stored as nlimbs 32-bit digits held
+// in 64-bit atomic words. A double is split into (at most three)
+// digits that are added with integer fetch_add, so any thread or
+// rank count gives the same bits. Parts of a value below
+// 2^min_exponent are truncated (deterministically), and each limb
+// has room for ~2^31 additions before it could overflow.
+class ExactSum{
+public:
+	static const int nlimbs = 12;
+	static const int digit_bits = 32;
+	static const int min_exponent = -128; // covers [2^-128, 2^256)
+
+	vector< ATOMIC<long long> > limbs;
+
+	size_t size() const {return limbs.size()/nlimbs;}
+	void resize(const size_t n){
+		if(limbs.size() != n*nlimbs) limbs = vector< ATOMIC<long long> >(n*nlimbs, 0);
+	}
+	void clear(){
+		#pragma omp parallel for
+		for(size_t i=0; i<limbs.size(); i++) limbs[i] = 0;
+	}
+
+	// thread safe
+	void add(const size_t i, const double x){
+		PRINT_ASSERT(i,<,size());
+		PRINT_ASSERT(x,==,x);
+		PRINT_ASSERT(fabs(x),<,INFINITY);
+		if(x==0) return;
+
+		// start at the lowest limb that can hold the leading digit
+		int e;
+		frexp(x, &e);
+		int k = (int)ceil((double)(e - min_exponent - digit_bits) / (double)digit_bits);
+		if(k<0) k=0;
+		PRINT_ASSERT(k,<,nlimbs);
+		if(k>=nlimbs) k = nlimbs-1;
+
+		// peel off one digit at a time (each step is exact)
+		double r = ldexp(x, -min_exponent - digit_bits*k);
+		ATOMIC<long long>* element = &limbs[i*nlimbs];
+		for(; k>=0 and r!=0; k--){
+			const double d = trunc(r);
+			if(d!=0) element[k].fetch_add((long long)d, std::memory_order_relaxed);
+			r = ldexp(r-d, digit_bits);
+		}
+	}
+
+	// sum all ranks' limbs onto rank 0 (integer sums are exact)
+	void mpi_reduce(){
+		int MPI_myID;
+		MPI_Comm_rank(MPI_COMM_WORLD, &MPI_myID);
+		if(MPI_myID==0)
+			MPI_Reduce(MPI_IN_PLACE, &limbs.front(), limbs.size(), MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+		else
+			MPI_Reduce(&limbs.front(), NULL, limbs.size(), MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+	}
+
+	// the accumulated value rounded to a double
+	double value(const size_t i) const{
+		PRINT_ASSERT(i,<,size());
+		long long digits[nlimbs];
+		for(int k=0; k<nlimbs; k++) digits[k] = limbs[i*nlimbs+k].load(std::memory_order_relaxed);
+
+		// work with the magnitude so the conversion never cancels
+		normalize(digits);
+		const bool negative = (digits[nlimbs-1] < 0);
+		if(negative){
+			for(int k=0; k<nlimbs; k++) digits[k] = -digits[k];
+			normalize(digits);
+		}
+
+		double result = 0;
+		for(int k=nlimbs-1; k>=0; k--)
+			result += ldexp((double)digits[k], min_exponent + digit_bits*k);
+		return negative ? -result : result;
+	}
+
+private:
+	// carry so every digit but the last is in [0,2^32)
+	static void normalize(long long digits[nlimbs]){
+		const long long base = 1LL << digit_bits;
+		for(int k=0; k<nlimbs-1; k++){
+			const long long low = digits[k] & (base-1);
+			digits[k+1] += (digits[k] - low) / base;
+			digits[k] = low;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#ifndef _EYTZINGER_SEARCH_H
+#define _EYTZINGER_SEARCH_H 1
+
+#include <vector>
+#include "global_options.h"
+
+using namespace std;
+
+//=================//
+// EytzingerSearch //
+//=================//
+// Copy of a sorted array stored in breadth-first (Eytzinger) order.
+// A binary search walks down the implicit tree from the root, so the
+// first several levels it touches share a few cache lines, and the
+// only branch in the loop is its trip count. The copy must be rebuilt
+// whenever the sorted array changes. Only the values are stored; the
+// position of a tree node in the sorted array follows from its index.
+class EytzingerSearch{
+public:
+	vector<double> tree; // tree[k] for k=1..n. tree[0] is unused
+
+	void build(const vector<double>& sorted){
+		const size_t n = sorted.size();
+		tree.resize(n+1);
+		tree[0] = NaN;
+		size_t i = 0;
+		fill(sorted, &i, 1);
+		PRINT_ASSERT(i,==,n);
+	}
+
+	void clear(){
+		tree.resize(0);
+	}
+
+	size_t size() const{
+		return tree.size()==0 ? 0 : tree.size()-1;
+	}
+
+	// index of the first sorted value greater than x (n if none),
+	// the same as std::upper_bound on the sorted array
+	int upper_bound(const double x) const{
+		const size_t n = size();
+		unsigned long long k = 1;
+		while(k <= n) k = 2*k + !(x < tree[k]);
+
+		// strip the trailing right turns and the last left turn
+		k >>= __builtin_ffsll(~k);
+		return sorted_index(k);
+	}
+
+	// Index in the sorted array of tree[k] (n for k=0). Node k at depth d
+	// of a perfect tree with h levels is at (2(k-2^d)+1)*2^(h-1-d)-1.
+	// Only the first m slots of the last level exist, so subtract the
+	// missing ones before it (the last level holds the even positions).
+	size_t sorted_index(const unsigned long long k) const{
+		const size_t n = size();
+		if(k==0) return n;
+		const int h = 64 - __builtin_clzll(n);
+		const int d = 63 - __builtin_clzll(k);
+		const size_t j = ((2*(k - (1ULL<<d)) + 1) << (h-1-d)) - 1;
+		const size_t m = n - ((1ULL<<(h-1)) - 1);
+		const size_t last_level_before = (j+1)/2;
+		return last_level_before > m ? j - (last_level_before - m) : j;
+	}
+
+private:
+	// in-order traversal of the tree fills it with the sorted values
+	void fill(const vector<double>& sorted, size_t* i, const size_t k){
+		if(k >= tree.size()) return;
+		fill(sorted, i, 2*k);
+		tree[k] = sorted[*i];
+		(*i)++;
+		fill(sorted, i, 2*k+1);
+	}
+};
+
+#endif
@@ -247,6 +247,7 @@ void calculate_mc_closure_(
 	// set the GR1D quantities
 	for(size_t s=0; s<ns; s++){
 		GR1DSpectrumArray* tmpSpectrum = static_cast<GR1DSpectrumArray*>((*sim)->grid->distribution[s]);
+		if((*sim)->zone_stop_list().size()>1) tmpSpectrum->mpi_allgather((*sim)->zone_stop_list()); // each rank only has its own zones
         #pragma omp parallel for
 		for(size_t z_ind=0; z_ind<nr; z_ind++){
 			size_t dir_ind[2];
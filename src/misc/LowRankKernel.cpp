@@ -0,0 +1,111 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#include <cmath>
+#include "gsl/gsl_linalg.h"
+#include "global_options.h"
+#include "LowRankKernel.h"
+
+using namespace std;
+
+void LowRankKernel::resize(const size_t nzones, const size_t ng_in, const size_t rank_in, const size_t first_zone_in){
+	PRINT_ASSERT(rank_in,>,0);
+	ng = ng_in;
+	rank = min(rank_in, ng_in);
+	first_zone = first_zone_in;
+	left.assign(nzones*ng*rank, 0);
+	right.assign(nzones*rank*ng, 0);
+	error.assign(nzones, 0);
+}
+
+//------------------------------------------------------
+// K = U diag(S) V^T. Keep the largest singular values,
+// folding them into the left factors.
+//------------------------------------------------------
+double LowRankKernel::compress(const size_t z_ind, const Span<double>& K){
+	PRINT_ASSERT(K.size(),==,ng*ng);
+	PRINT_ASSERT(z_ind,>=,first_zone);
+	PRINT_ASSERT(z_ind,<,size());
+	const size_t z = z_ind - first_zone;
+
+	// the decomposition works in place on scratch memory
+	ScratchFrame scratch;
+	Span<double> Adata = scratch.allocate(ng*ng);
+	Span<double> Vdata = scratch.allocate(ng*ng);
+	Span<double> Sdata = scratch.allocate(ng);
+	for(size_t i=0; i<ng*ng; i++) Adata[i] = K[i];
+	gsl_matrix_view Aview = gsl_matrix_view_array(Adata.data(), ng, ng);
+	gsl_matrix_view Vview = gsl_matrix_view_array(Vdata.data(), ng, ng);
+	gsl_vector_view Sview = gsl_vector_view_array(Sdata.data(), ng);
+	gsl_matrix* A = &Aview.matrix;
+	gsl_matrix* V = &Vview.matrix;
+	gsl_vector* S = &Sview.vector;
+
+	// singular values come out in decreasing order
+	gsl_linalg_SV_decomp_jacobi(A,V,S);
+	for(size_t igin=0; igin<ng; igin++)
+		for(size_t r=0; r<rank; r++)
+			left[(z*ng + igin)*rank + r] = gsl_matrix_get(A,igin,r) * gsl_vector_get(S,r);
+	for(size_t r=0; r<rank; r++)
+		for(size_t igout=0; igout<ng; igout++)
+			right[(z*rank + r)*ng + igout] = gsl_matrix_get(V,igout,r);
+
+	double total=0, dropped=0;
+	for(size_t r=0; r<ng; r++){
+		const double s2 = gsl_vector_get(S,r) * gsl_vector_get(S,r);
+		total += s2;
+		if(r>=rank) dropped += s2;
+	}
+	error[z] = (total>0 ? sqrt(dropped/total) : 0);
+	return error[z];
+}
+
+double LowRankKernel::row_sum(const size_t row) const{
+	double sum = 0;
+	for(size_t igout=0; igout<ng; igout++) sum += evaluate_positive(row,igout);
+	return sum;
+}
+
+//------------------------------------------------------
+// invert the running sum of the row, evaluating it
+// twice rather than storing it
+//------------------------------------------------------
+size_t LowRankKernel::sample(const size_t row, const double U) const{
+	const double target = U * row_sum(row);
+	PRINT_ASSERT(target,>=,0);
+	double cumulative = 0;
+	size_t last_nonzero = ng;
+	for(size_t igout=0; igout<ng; igout++){
+		const double value = evaluate_positive(row,igout);
+		if(value<=0) continue;
+		last_nonzero = igout;
+		cumulative += value;
+		if(target < cumulative) return igout;
+	}
+	PRINT_ASSERT(last_nonzero,<,ng);
+	return last_nonzero;
+}
@@ -0,0 +1,84 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#ifndef _LOW_RANK_KERNEL_H
+#define _LOW_RANK_KERNEL_H 1
+
+#include <vector>
+#include "ScratchArena.h"
+
+using namespace std;
+
+//===============//
+// LowRankKernel //
+//===============//
+// Truncated SVD storage of one ng x ng kernel K[igin][igout] per zone:
+//     K[igin][igout] ~ sum_r left[igin][r] * right[r][igout]
+// which takes 2*ng*rank numbers instead of ng*ng. The rows of left
+// are indexed like the (zone,igin) opacity arrays, so any eas index
+// selects a row. The relative Frobenius error of each zone's kernel
+// (the norm of the dropped singular values over the norm of all of
+// them) is kept as a bound on the compression error. For kernels that
+// are non-negative, evaluate_positive() treats negative values from
+// the truncation as zero, which can only bring them closer to the
+// true kernel. Only zones [first_zone, size()) are stored.
+class LowRankKernel{
+public:
+	size_t ng, rank, first_zone;
+	vector<float> left;  // [(zone-first_zone)*ng + igin][r]
+	vector<float> right; // [zone-first_zone][r][igout]
+	vector<float> error; // [zone-first_zone] relative Frobenius error
+
+	LowRankKernel() : ng(0), rank(0), first_zone(0) {}
+
+	void resize(const size_t nzones, const size_t ng_in, const size_t rank_in, const size_t first_zone_in=0);
+	size_t size() const {return first_zone + error.size();}
+	double zone_error(const size_t z_ind) const {return error[z_ind-first_zone];}
+
+	// factor a zone's kernel K[igin*ng + igout] and return the relative error
+	double compress(const size_t z_ind, const Span<double>& K);
+
+	// row is the eas index (zone*ng + igin)
+	double evaluate(const size_t row, const size_t igout) const{
+		const size_t z_ind = row/ng - first_zone;
+		const float* L = &left[(row - first_zone*ng)*rank];
+		const float* R = &right[z_ind*rank*ng + igout];
+		double result = 0;
+		for(size_t r=0; r<rank; r++) result += L[r] * R[r*ng];
+		return result;
+	}
+	double evaluate_positive(const size_t row, const size_t igout) const{
+		const double result = evaluate(row,igout);
+		return result>0 ? result : 0;
+	}
+	double row_sum(const size_t row) const; // of evaluate_positive
+
+	// sample igout in proportion to evaluate_positive. U is uniform in [0,1)
+	size_t sample(const size_t row, const double U) const;
+};
+
+#endif
@@ -2,7 +2,6 @@
 #define _METRIC_H 1
 
 #include "global_options.h"
-#include "gsl/gsl_linalg.h"
 
 const size_t ixx=0,iyy=1,izz=2,ixy=3,ixz=4,iyz=5,itt=6,ixt=7,iyt=8,izt=9;
 
@@ -49,26 +48,25 @@ public:
 	  out[2] = in[0]*data[ixz] + in[1]*data[iyz] + in[2]*data[izz];
 	  return out;
 	}
+	// closed-form inverse of the symmetric matrix (adjugate over
+	// determinant). It allocates nothing, so it is cheap to call every step.
+	// A spatial metric is positive definite, so det<=0 (or NaN) means a
+	// bad metric and we stop even in release builds.
 	ThreeMetric inverse() const{
-		gsl_matrix* g = gsl_matrix_alloc(3,3);
-		for(size_t i=0; i<3; i++)
-		  for(size_t j=0; j<3; j++)
-		    gsl_matrix_set(g,i,j, data[index(i,j)]);
-
-		// invert and store
-		gsl_linalg_cholesky_decomp(g);
-		gsl_linalg_cholesky_invert(g);
 		ThreeMetric output;
-		output.data[ixx] = gsl_matrix_get(g, 0, 0);
-		output.data[ixy] = gsl_matrix_get(g, 0, 1);
-		output.data[ixz] = gsl_matrix_get(g, 0, 2);
-		output.data[iyy] = gsl_matrix_get(g, 1, 1);
-		output.data[iyz] = gsl_matrix_get(g, 1, 2);
-		output.data[izz] = gsl_matrix_get(g, 2, 2);
-
-		// free the memory
-		gsl_matrix_free(g);
-
+		output.data[ixx] = data[iyy]*data[izz] - data[iyz]*data[iyz];
+		output.data[ixy] = data[ixz]*data[iyz] - data[ixy]*data[izz];
+		output.data[ixz] = data[ixy]*data[iyz] - data[ixz]*data[iyy];
+		output.data[iyy] = data[ixx]*data[izz] - data[ixz]*data[ixz];
+		output.data[iyz] = data[ixy]*data[ixz] - data[ixx]*data[iyz];
+		output.data[izz] = data[ixx]*data[iyy] - data[ixy]*data[ixy];
+		const double det = data[ixx]*output.data[ixx] + data[ixy]*output.data[ixy] + data[ixz]*output.data[ixz];
+		if(not (det>0)){
+			std::cout << "ERROR: three-metric is not positive definite (det=" << det << ")" << std::endl;
+			exit(5);
+		}
+		const double inv_det = 1./det;
+		for(size_t i=0; i<6; i++) output.data[i] *= inv_det;
 		return output;
 	}
 
@@ -1,6 +1,7 @@
 #ifndef _MULTIDARRAY_H
 #define _MULTIDARRAY_H 1
 
+#include <algorithm>
 #include <vector>
 #include "global_options.h"
 #include "Axis.h"
@@ -110,6 +111,111 @@ public:
 };
 
 
+//=============//
+// StorageType //
+//=============//
+// MPI and HDF5 memory types of the values stored in a MultiDArray.
+// Files are always written as doubles regardless of the storage type.
+// Float arrays are summed over ranks in double (see sum_in_double),
+// never by MPI_SUM on MPI_FLOAT.
+template<typename T> struct StorageType{};
+template<> struct StorageType<double>{
+	typedef double value;
+	static const bool sum_in_place = true;
+	static MPI_Datatype mpi(){return MPI_DOUBLE;}
+	static const H5::PredType& hdf5(){return H5::PredType::NATIVE_DOUBLE;}
+};
+template<> struct StorageType<float>{
+	typedef float value;
+	static const bool sum_in_place = false;
+	static MPI_Datatype mpi(){return MPI_FLOAT;}
+	static const H5::PredType& hdf5(){return H5::PredType::NATIVE_FLOAT;}
+};
+template<typename T> struct StorageType< ATOMIC<T> > : public StorageType<T>{};
+
+
+//===============//
+// ZonePartition //
+//===============//
+// How the zones are split between ranks with zone_ownership (see
+// migrate.cpp). Rank p owns zones [zone_start(p), zone_end[p]) and
+// stores those plus up to ghost zones on either side. Zone-major
+// arrays set up with a partition only hold this rank's stored zones.
+// The exchanges move width values of MPI type "type" per zone and
+// only talk to the ranks whose ranges overlap this rank's.
+class ZonePartition{
+public:
+	vector<size_t> zone_end; // [rank]
+	size_t ghost;
+	int rank;
+
+	ZonePartition() : ghost(0), rank(0) {}
+
+	size_t nzones() const {return zone_end.back();}
+	size_t zone_start(const int p) const {return p==0 ? 0 : zone_end[p-1];}
+	size_t stored_start(const int p) const {return zone_start(p)>ghost ? zone_start(p)-ghost : 0;}
+	size_t stored_end(const int p) const {return min(zone_end[p]+ghost, nzones());}
+
+	// Add the values this rank holds for other ranks' zones to the owners'
+	// values. data starts at this rank's first stored zone. Afterwards only
+	// the owned zones are complete. V is the plain type of an S.
+	template<typename V, typename S>
+	void fold_ghosts(S* data, const size_t width, MPI_Datatype type) const{
+		const int nprocs = zone_end.size();
+		const size_t base = stored_start(rank);
+		vector< vector<V> > incoming(nprocs);
+		vector<MPI_Request> requests;
+		for(int p=0; p<nprocs; p++){
+			if(p==rank) continue;
+			const size_t start = max(stored_start(p), zone_start(rank));
+			const size_t end   = min(stored_end(p),   zone_end[rank]);
+			if(end<=start) continue;
+			incoming[p].resize((end-start)*width);
+			requests.push_back(MPI_REQUEST_NULL);
+			MPI_Irecv(incoming[p].data(), incoming[p].size(), type, p, 1, MPI_COMM_WORLD, &requests.back());
+		}
+		for(int p=0; p<nprocs; p++){
+			if(p==rank) continue;
+			const size_t start = max(stored_start(rank), zone_start(p));
+			const size_t end   = min(stored_end(rank),   zone_end[p]);
+			if(end<=start) continue;
+			requests.push_back(MPI_REQUEST_NULL);
+			MPI_Isend(data + (start-base)*width, (end-start)*width, type, p, 1, MPI_COMM_WORLD, &requests.back());
+		}
+		if(requests.size()>0) MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+		for(int p=0; p<nprocs; p++){
+			if(incoming[p].size()==0) continue;
+			S* owned = data + (max(stored_start(p), zone_start(rank)) - base)*width;
+			for(size_t i=0; i<incoming[p].size(); i++) owned[i] += incoming[p][i];
+		}
+	}
+
+	// copy each rank's owned values into the other ranks' ghost zones
+	template<typename S>
+	void fill_ghosts(S* data, const size_t width, MPI_Datatype type) const{
+		const int nprocs = zone_end.size();
+		const size_t base = stored_start(rank);
+		vector<MPI_Request> requests;
+		for(int p=0; p<nprocs; p++){
+			if(p==rank) continue;
+			size_t start = max(stored_start(rank), zone_start(p));
+			size_t end   = min(stored_end(rank),   zone_end[p]);
+			if(end>start){
+				requests.push_back(MPI_REQUEST_NULL);
+				MPI_Irecv(data + (start-base)*width, (end-start)*width, type, p, 2, MPI_COMM_WORLD, &requests.back());
+			}
+			start = max(stored_start(p), zone_start(rank));
+			end   = min(stored_end(p),   zone_end[rank]);
+			if(end>start){
+				requests.push_back(MPI_REQUEST_NULL);
+				MPI_Isend(data + (start-base)*width, (end-start)*width, type, p, 2, MPI_COMM_WORLD, &requests.back());
+			}
+		}
+		if(requests.size()>0) MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+	}
+};
+
+
 //=============//
 // MultiDArray //
 //=============//
@@ -120,10 +226,18 @@ public:
 	vector< Tuple<T,nelements> > y0;
 	vector<Axis> axes;
 	Tuple<size_t,ndims> stride;
+	vector<int> mpi_counts, mpi_displs; // must outlive non-blocking MPI calls
+	static const size_t mpi_stage_size = 1<<20; // doubles staged at once by the float sums
 
-	MultiDArray(){}
+	// With a partition only this rank's stored zones are kept: y0[0] is
+	// entry number offset of the whole array, which has nentries entries.
+	// Indices are always those of the whole array.
+	const ZonePartition* partition;
+	size_t offset, nentries;
 
-	void set_axes(const vector<Axis>& axes){
+	MultiDArray() : partition(NULL), offset(0), nentries(0) {}
+
+	void set_axes(const vector<Axis>& axes, const ZonePartition* partition=NULL){
 		this->axes = axes;
 		PRINT_ASSERT(axes.size(),==,ndims);
 		int size = 1;
@@ -133,18 +247,47 @@ public:
 			stride[i] = size;
 			size *= axes[i].size();
 		} while(i>0);
-		y0.resize(size);
-		if(ndims==0) y0.resize(1);
+		nentries = size;
+		offset = 0;
+		this->partition = NULL;
+		if(partition!=NULL) crop(partition);
+		else y0.resize(size);
 
 		// poison data
 		for(size_t i=0; i<y0.size(); i++) y0[i] = NaN;
 	}
 
+	// keep only this rank's stored zones
+	void crop(const ZonePartition* partition){
+		PRINT_ASSERT((this->partition==NULL),==,true);
+		PRINT_ASSERT(ndims,>,0);
+		PRINT_ASSERT(nentries % partition->nzones(),==,0);
+		const size_t per_zone = nentries / partition->nzones();
+		const size_t start = partition->stored_start(partition->rank) * per_zone;
+		const size_t end   = partition->stored_end(partition->rank)   * per_zone;
+		if(y0.size()==nentries) y0 = vector< Tuple<T,nelements> >(y0.begin()+start, y0.begin()+end);
+		else y0.resize(end-start);
+		offset = start;
+		this->partition = partition;
+	}
+
+	// range of entries held by this rank
+	size_t stored_start() const{return offset;}
+	size_t stored_end() const{return offset + y0.size();}
+
+	// range of entries this rank owns (everything without a partition)
+	size_t entries_per_zone() const{return partition==NULL ? nentries : nentries / partition->nzones();}
+	size_t owned_start() const{return partition==NULL ? 0 : partition->zone_start(partition->rank) * entries_per_zone();}
+	size_t owned_end() const{return partition==NULL ? nentries : partition->zone_end[partition->rank] * entries_per_zone();}
+
 	MultiDArray<T,nelements,ndims> operator =(const MultiDArray<T,nelements,ndims>& input){
 		PRINT_ASSERT(input.axes.size(),==,ndims);
 		this->axes = input.axes;
 		this->stride = input.stride;
 		this->y0 = input.y0;
+		this->partition = input.partition;
+		this->offset = input.offset;
+		this->nentries = input.nentries;
 		return *this;
 	}
 
@@ -155,12 +298,12 @@ public:
 			PRINT_ASSERT(ind[i],<,axes[i].size());
 			result += ind[i]*stride[i];
 		}
-		PRINT_ASSERT(result,<,y0.size());
+		PRINT_ASSERT(result,<,size());
 		return result;
 	}
 	void indices(const int z_ind, size_t ind[ndims]) const{
 		size_t leftover=z_ind;
-		PRINT_ASSERT(leftover,<,y0.size());
+		PRINT_ASSERT(leftover,<,size());
 		for(size_t i=0; i<ndims; i++){
 			ind[i] = leftover / stride[i];
 			leftover -= ind[i]*stride[i];
@@ -170,56 +313,57 @@ public:
 
 	// get center value based on grid index
 	const Tuple<T,nelements> operator[](const size_t i) const {
-	        PRINT_ASSERT(i,>=,0);
-	        PRINT_ASSERT(i,<,y0.size());
-		return y0[i];
+	        PRINT_ASSERT(i,>=,offset);
+	        PRINT_ASSERT(i,<,stored_end());
+		return y0[i-offset];
 	}
 	Tuple<T,nelements>& operator[](const size_t i){
-	        PRINT_ASSERT(i,>=,0);
-	        PRINT_ASSERT(i,<,y0.size());
-		return y0[i];
+	        PRINT_ASSERT(i,>=,offset);
+	        PRINT_ASSERT(i,<,stored_end());
+		return y0[i-offset];
 	}
 	const Tuple<T,nelements> get(size_t ind[ndims]) const{
-		return y0[direct_index(ind)];
+		return (*this)[direct_index(ind)];
 	}
 	void set(size_t ind[ndims], Tuple<T,nelements> setval) {
-		y0[direct_index(ind)] = setval;
+		(*this)[direct_index(ind)] = setval;
 	}
 
 	// dummy template allows it to compile with any value of NDIMS
+	// results are accumulated in double regardless of the storage type
 	template<size_t dummy>
-	Tuple<T,nelements> interpolate(const InterpolationCube<dummy>& icube) const{
+	Tuple<double,nelements> interpolate(const InterpolationCube<dummy>& icube) const{
 		PRINT_ASSERT(icube.ncorners,==,(1<<ndims));
 
-		Tuple<T,nelements> result(0);
+		Tuple<double,nelements> result(0);
 		for(size_t i=0; i<icube.ncorners; i++){
 			PRINT_ASSERT(icube.indices[i],>=,0);
 			PRINT_ASSERT(icube.indices[i],<,size());
 			PRINT_ASSERT(icube.weights[i],<=,1.0);
 			PRINT_ASSERT(icube.weights[i],>=,0.0);
-			result += y0[icube.indices[i]] * icube.weights[i];
+			result += Tuple<double,nelements>((*this)[icube.indices[i]]) * icube.weights[i];
 		}
 		return result;
 	}
 
 	// dummy template allows it to compile with any value of NDIMS
 	template<size_t dummy>
-	Tuple<Tuple<T,nelements>,ndims> interpolate_slopes(const InterpolationCube<dummy>& icube) const{
+	Tuple<Tuple<double,nelements>,ndims> interpolate_slopes(const InterpolationCube<dummy>& icube) const{
 		PRINT_ASSERT(icube.ncorners,==,(1<<ndims));
 
-		Tuple<Tuple<T,nelements>,ndims> result;
+		Tuple<Tuple<double,nelements>,ndims> result;
 		for(size_t d=0; d<ndims; d++){
-			result[d] = y0[icube.indices[0]] * icube.slope_weights[d][0];;
+			result[d] = Tuple<double,nelements>((*this)[icube.indices[0]]) * icube.slope_weights[d][0];;
 			for(size_t i=1; i<icube.ncorners; i++){
 				PRINT_ASSERT(icube.indices[i],>=,0);
-				result[d] += y0[icube.indices[i]] * icube.slope_weights[d][i];
+				result[d] += Tuple<double,nelements>((*this)[icube.indices[i]]) * icube.slope_weights[d][i];
 			}
 		}
 		return result;
 	}
 
 	Tuple<T,nelements> slope(const size_t z_ind, const size_t direction) const{
-		Tuple<T,nelements> result, yL, yR, y=y0[z_ind];
+		Tuple<T,nelements> result, yL, yR, y=(*this)[z_ind];
 		yL = yR = NaN;
 		double dxL=NaN, dxR=NaN;
 		size_t dir_ind[ndims];
@@ -231,11 +375,11 @@ public:
 		dir_indL[direction] = dir_ind[direction]-1;
 
 		if(dir_ind[direction] <= axes[direction].size()-2){
-			yR = y0[direct_index(dir_indR)];                 // value at z_ind+1
+			yR = (*this)[direct_index(dir_indR)];            // value at z_ind+1
 			dxR = axes[direction].delta(dir_ind[direction]); // (top-bottom) of z_ind
 		}
 		if(dir_ind[direction] >= 1){
-			yL = y0[direct_index(dir_indL)];                  // value at z_ind-1
+			yL = (*this)[direct_index(dir_indL)];             // value at z_ind-1
 			dxL = axes[direction].delta(dir_indL[direction]); // (top-bottom) of z_ind-1
 		}
 
@@ -299,7 +443,7 @@ public:
 	}
 
 	size_t size() const{
-		return y0.size();
+		return nentries;
 	}
 
 	size_t Ndims() const{
@@ -311,34 +455,166 @@ public:
 		direct_add(lin_ind, to_add);
 	}
 	void direct_add(const size_t lin_ind, const Tuple<T,nelements>& to_add){
-	        y0[lin_ind] += to_add;
+	        (*this)[lin_ind] += to_add;
 	}
 
-	void mpi_sum_scatter(vector<size_t>& stop_list){
+	//--------------------------------------------------------------
+	// Ghost zone exchanges for partitioned arrays (see ZonePartition).
+	// Blocking. Only neighboring ranks communicate.
+	//--------------------------------------------------------------
+	void mpi_fold_ghosts(){
+		PRINT_ASSERT((partition!=NULL),==,true);
+		partition->template fold_ghosts<typename StorageType<T>::value>((T*)y0.data(), entries_per_zone()*nelements, StorageType<T>::mpi());
+	}
+	void mpi_fill_ghosts(){
+		PRINT_ASSERT((partition!=NULL),==,true);
+		partition->fill_ghosts((T*)y0.data(), entries_per_zone()*nelements, StorageType<T>::mpi());
+	}
+
+	// each rank ends up with the sum over all ranks of its own
+	// slice [stop_list[rank-1], stop_list[rank]). Only that slice is
+	// valid afterwards. The in-place reduce-scatter leaves the rest of
+	// the buffer unspecified (on ranks>0 the front of the buffer still
+	// holds a copy of this rank's slice). Never read, or write to HDF5,
+	// outside the slice.
+	void mpi_sum_scatter(const vector<size_t>& stop_list){
+		MPI_Request request;
+		mpi_isum_scatter(stop_list, &request);
+		MPI_Wait(&request, MPI_STATUS_IGNORE);
+		finish_sum_scatter(stop_list);
+	}
+
+	// every rank gets every rank's slice
+	void mpi_allgather(const vector<size_t>& stop_list){
+		MPI_Request request;
+		mpi_iallgather(stop_list, &request);
+		MPI_Wait(&request, MPI_STATUS_IGNORE);
+	}
+
+	void mpi_sum(){
+		MPI_Request request;
+		mpi_isum(&request);
+		MPI_Wait(&request, MPI_STATUS_IGNORE);
+	}
+
+	//--------------------------------------------------------------
+	// Non-blocking versions of the above. The array must not be
+	// touched until the request completes. After an mpi_isum_scatter
+	// completes, finish_sum_scatter() moves this rank's slice into place.
+	// Float arrays are summed before these return and get MPI_REQUEST_NULL.
+	//--------------------------------------------------------------
+	void mpi_isum_scatter(const vector<size_t>& stop_list, MPI_Request* request){
 		PRINT_ASSERT(stop_list[stop_list.size()-1],==,y0.size());
-		int MPI_nprocs, MPI_myID;
+		int MPI_nprocs;
 		MPI_Comm_size(MPI_COMM_WORLD, &MPI_nprocs);
+		PRINT_ASSERT((int)stop_list.size(),==,MPI_nprocs);
+		if(not StorageType<T>::sum_in_place){
+			sum_scatter_in_double(stop_list);
+			*request = MPI_REQUEST_NULL;
+			return;
+		}
+
+		mpi_counts.resize(MPI_nprocs);
+		for(int p=0; p<MPI_nprocs; p++)
+			mpi_counts[p] = (stop_list[p] - (p==0 ? 0 : stop_list[p-1])) * nelements;
+		MPI_Ireduce_scatter(MPI_IN_PLACE, &y0.front(), &mpi_counts.front(), StorageType<T>::mpi(), MPI_SUM, MPI_COMM_WORLD, request);
+	}
+	void finish_sum_scatter(const vector<size_t>& stop_list){
+		if(not StorageType<T>::sum_in_place) return; // already in place
+		int MPI_myID;
 		MPI_Comm_rank(MPI_COMM_WORLD, &MPI_myID);
+
+		// in-place results land at the front of the buffer
+		const size_t istart = (MPI_myID==0 ? 0 : stop_list[MPI_myID-1]);
+		const size_t n = stop_list[MPI_myID] - istart;
+		if(istart>0) copy_backward(y0.begin(), y0.begin()+n, y0.begin()+istart+n);
+	}
+
+	void mpi_iallgather(const vector<size_t>& stop_list, MPI_Request* request){
+		int MPI_nprocs;
+		MPI_Comm_size(MPI_COMM_WORLD, &MPI_nprocs);
+		PRINT_ASSERT((int)stop_list.size(),==,MPI_nprocs);
+		PRINT_ASSERT(stop_list[stop_list.size()-1],==,y0.size());
+
+		mpi_counts.resize(MPI_nprocs);
+		mpi_displs.resize(MPI_nprocs);
 		for(int p=0; p<MPI_nprocs; p++){
-			const size_t istart = (p==0 ? 0 : stop_list[p-1]);
-			const size_t ndoubles = (stop_list[p]-istart) * nelements;
-			if(MPI_myID==p)
-				MPI_Reduce(MPI_IN_PLACE, &y0[istart], ndoubles, MPI_DOUBLE, MPI_SUM, p, MPI_COMM_WORLD);
-			else
-				MPI_Reduce(&y0[istart],         NULL, ndoubles, MPI_DOUBLE, MPI_SUM, p, MPI_COMM_WORLD);
+			mpi_displs[p] = (p==0 ? 0 : stop_list[p-1]) * nelements;
+			mpi_counts[p] = stop_list[p]*nelements - mpi_displs[p];
 		}
-
-		// and bring everything to proc0 as well
-		mpi_gather(stop_list);
+		MPI_Iallgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, &y0.front(), &mpi_counts.front(), &mpi_displs.front(), StorageType<T>::mpi(), MPI_COMM_WORLD, request);
 	}
 
-	void mpi_sum(){
+	void mpi_isum(MPI_Request* request){
+		if(not StorageType<T>::sum_in_place){
+			sum_in_double();
+			*request = MPI_REQUEST_NULL;
+			return;
+		}
 		int MPI_myID;
 		MPI_Comm_rank(MPI_COMM_WORLD, &MPI_myID);
 		if(MPI_myID==0)
-			MPI_Reduce(MPI_IN_PLACE, &y0.front(), y0.size()*nelements, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+			MPI_Ireduce(MPI_IN_PLACE, &y0.front(), y0.size()*nelements, StorageType<T>::mpi(), MPI_SUM, 0, MPI_COMM_WORLD, request);
 		else
-			MPI_Reduce(&y0.front(),         NULL, y0.size()*nelements, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+			MPI_Ireduce(&y0.front(),         NULL, y0.size()*nelements, StorageType<T>::mpi(), MPI_SUM, 0, MPI_COMM_WORLD, request);
+	}
+
+	//--------------------------------------------------------------
+	// Sum a single-precision array over ranks in double. Rounds of at
+	// most mpi_stage_size values are converted to double, summed, and
+	// rounded back to the storage type, so the result is as accurate as
+	// for a double array without making a full double copy. Blocking,
+	// so these arrays don't overlap their reduction with other work.
+	// sum_scatter_in_double leaves each rank its own slice in place
+	// (as mpi_sum_scatter does), sum_in_double gives rank 0 everything.
+	//--------------------------------------------------------------
+	void sum_scatter_in_double(const vector<size_t>& stop_list){
+		int MPI_nprocs, MPI_myID;
+		MPI_Comm_size(MPI_COMM_WORLD, &MPI_nprocs);
+		MPI_Comm_rank(MPI_COMM_WORLD, &MPI_myID);
+
+		// each round takes the next chunk of every rank's slice
+		const size_t chunk = max((size_t)1, mpi_stage_size/(nelements*MPI_nprocs));
+		size_t max_slice = 0;
+		for(int p=0; p<MPI_nprocs; p++) max_slice = max(max_slice, stop_list[p] - (p==0 ? 0 : stop_list[p-1]));
+		vector<double> stage;
+		vector<int> counts(MPI_nprocs);
+		for(size_t offset=0; offset<max_slice; offset+=chunk){
+			stage.resize(0);
+			for(int p=0; p<MPI_nprocs; p++){
+				const size_t pstart = (p==0 ? 0 : stop_list[p-1]) + offset;
+				const size_t n = (pstart < stop_list[p] ? min(chunk, stop_list[p]-pstart) : 0);
+				counts[p] = n*nelements;
+				for(size_t i=0; i<n; i++)
+					for(size_t k=0; k<nelements; k++) stage.push_back(y0[pstart+i][k]);
+			}
+			if(stage.empty()) stage.resize(1); // keep front() valid
+			MPI_Reduce_scatter(MPI_IN_PLACE, &stage.front(), &counts.front(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+			// in-place results land at the front of the buffer
+			const size_t mystart = (MPI_myID==0 ? 0 : stop_list[MPI_myID-1]) + offset;
+			const size_t n = counts[MPI_myID]/nelements;
+			for(size_t i=0; i<n; i++)
+				for(size_t k=0; k<nelements; k++) y0[mystart+i][k] = stage[i*nelements+k];
+		}
+	}
+	void sum_in_double(){
+		int MPI_myID;
+		MPI_Comm_rank(MPI_COMM_WORLD, &MPI_myID);
+		const size_t chunk = max((size_t)1, mpi_stage_size/nelements);
+		vector<double> stage;
+		for(size_t start=0; start<y0.size(); start+=chunk){
+			const size_t n = min(chunk, y0.size()-start);
+			stage.resize(n*nelements);
+			for(size_t i=0; i<n; i++)
+				for(size_t k=0; k<nelements; k++) stage[i*nelements+k] = y0[start+i][k];
+			if(MPI_myID==0){
+				MPI_Reduce(MPI_IN_PLACE, &stage.front(), n*nelements, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+				for(size_t i=0; i<n; i++)
+					for(size_t k=0; k<nelements; k++) y0[start+i][k] = stage[i*nelements+k];
+			}
+			else MPI_Reduce(&stage.front(), NULL, n*nelements, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+		}
 	}
 
 	void mpi_gather(vector<size_t>& stop_list){
@@ -356,9 +632,9 @@ public:
 			sendcounts[i] = stop_list[i] - stop_list[i-1];
 		}
 		if(MPI_myID==0)
-			MPI_Gatherv(MPI_IN_PLACE, -1, MPI_DOUBLE, &y0[0],&sendcounts.front(),&displs.front(), MPI_DOUBLE,0,MPI_COMM_WORLD);
+			MPI_Gatherv(MPI_IN_PLACE, -1, StorageType<T>::mpi(), &y0[0],&sendcounts.front(),&displs.front(), StorageType<T>::mpi(),0,MPI_COMM_WORLD);
 		else
-			MPI_Gatherv(&y0[displs[MPI_myID]], sendcounts[MPI_myID], MPI_DOUBLE, NULL, NULL, NULL, MPI_DOUBLE,0,MPI_COMM_WORLD);
+			MPI_Gatherv(&y0[displs[MPI_myID]], sendcounts[MPI_myID], StorageType<T>::mpi(), NULL, NULL, NULL, StorageType<T>::mpi(),0,MPI_COMM_WORLD);
 	}
 
 	void write_HDF5(H5::H5File file, const string name) {
@@ -373,11 +649,157 @@ public:
 		}
 		H5::DataSet dataset = file.createDataSet(name,H5::PredType::IEEE_F64LE,dataspace);
 
-		// write the data (converting to single precision)
+		// write the data (converting to double precision)
 		// assumes phi increases fastest, then mu, then nu
-		dataset.write(&y0.front(), H5::PredType::IEEE_F64LE);
+		PRINT_ASSERT((partition==NULL),==,true);
+		dataset.write(&y0.front(), StorageType<T>::hdf5());
+		dataset.close();
+	}
+
+	// write entries [start,end), which must be whole slabs of the first axis.
+	// Lets each rank write its own zones of a zone-major array into a shared
+	// file in turn; the first writer creates the full-size dataset.
+	void write_HDF5_slab(H5::H5File file, const string name, const size_t start, const size_t end, const bool create) {
+		PRINT_ASSERT(start,<=,end);
+		PRINT_ASSERT(start,>=,stored_start());
+		PRINT_ASSERT(end,<=,stored_end());
+		hsize_t dims[ndims+1];
+		for(size_t i=0; i<ndims; i++) dims[i] = axes[i].size(); // number of bins
+		const int h5ndims = (nelements==1 ? ndims : ndims+1);
+		if(nelements>1) dims[ndims] = nelements;
+		H5::DataSet dataset = create ?
+				file.createDataSet(name,H5::PredType::IEEE_F64LE,H5::DataSpace(h5ndims,dims)) :
+				file.openDataSet(name);
+
+		if(end>start){
+			if(ndims==0){
+				PRINT_ASSERT(end-start,==,size());
+				dataset.write(&y0.front(), StorageType<T>::hdf5());
+			}
+			else{
+				PRINT_ASSERT(start % stride[0],==,0);
+				PRINT_ASSERT(end   % stride[0],==,0);
+				hsize_t file_offset[ndims+1], count[ndims+1];
+				for(int i=0; i<h5ndims; i++){
+					file_offset[i] = 0;
+					count[i] = dims[i];
+				}
+				file_offset[0] = start / stride[0];
+				count[0] = (end-start) / stride[0];
+				H5::DataSpace filespace = dataset.getSpace();
+				filespace.selectHyperslab(H5S_SELECT_SET, count, file_offset);
+				H5::DataSpace memspace(h5ndims, count);
+				dataset.write(&y0[start-this->offset], StorageType<T>::hdf5(), memspace, filespace);
+			}
+		}
 		dataset.close();
 	}
+
+	// same as write_HDF5_slab, but only one element of each record,
+	// written as a dataset without the element dimension
+	void write_HDF5_element_slab(H5::H5File file, const string name, const size_t element, const size_t start, const size_t end, const bool create) {
+		PRINT_ASSERT(element,<,nelements);
+		PRINT_ASSERT(ndims,>,0);
+		PRINT_ASSERT(start,<=,end);
+		PRINT_ASSERT(start,>=,stored_start());
+		PRINT_ASSERT(end,<=,stored_end());
+		hsize_t dims[ndims+1];
+		for(size_t i=0; i<ndims; i++) dims[i] = axes[i].size(); // number of bins
+		H5::DataSet dataset = create ?
+				file.createDataSet(name,H5::PredType::IEEE_F64LE,H5::DataSpace(ndims,dims)) :
+				file.openDataSet(name);
+
+		if(end>start){
+			PRINT_ASSERT(start % stride[0],==,0);
+			PRINT_ASSERT(end   % stride[0],==,0);
+			hsize_t file_offset[ndims+1], count[ndims+1];
+			for(size_t i=0; i<ndims; i++){
+				file_offset[i] = 0;
+				count[i] = dims[i];
+			}
+			file_offset[0] = start / stride[0];
+			count[0] = (end-start) / stride[0];
+			H5::DataSpace filespace = dataset.getSpace();
+			filespace.selectHyperslab(H5S_SELECT_SET, count, file_offset);
+
+			// records in memory are rows. Pick out one column.
+			hsize_t mem_dims[2]   = {end-start, nelements};
+			hsize_t mem_count[2]  = {end-start, 1};
+			hsize_t mem_offset[2] = {0, element};
+			H5::DataSpace memspace(2, mem_dims);
+			memspace.selectHyperslab(H5S_SELECT_SET, mem_count, mem_offset);
+			dataset.write(&y0[start-this->offset], StorageType<T>::hdf5(), memspace, filespace);
+		}
+		dataset.close();
+	}
+
+#ifdef H5_HAVE_PARALLEL
+	// Collective counterpart of write_HDF5_slab (and of write_HDF5_element_slab
+	// if element<nelements) for a file opened with the MPI-IO driver. Every rank
+	// must call this in the same order. The dataset is created collectively and
+	// all slabs go to disk in a single collective write.
+	void write_HDF5_slab_mpio(const hid_t file, const string name, const size_t start, const size_t end, const size_t element=nelements) {
+		PRINT_ASSERT(start,<=,end);
+		PRINT_ASSERT(start,>=,stored_start());
+		PRINT_ASSERT(end,<=,stored_end());
+		const bool one_element = (element<nelements);
+		hsize_t dims[ndims+1];
+		for(size_t i=0; i<ndims; i++) dims[i] = axes[i].size(); // number of bins
+		const int h5ndims = (nelements==1 or one_element ? ndims : ndims+1);
+		if(h5ndims>(int)ndims) dims[ndims] = nelements;
+		hid_t filespace = (h5ndims==0 ? H5Screate(H5S_SCALAR) : H5Screate_simple(h5ndims, dims, NULL));
+		hid_t dataset = H5Dcreate2(file, name.c_str(), H5T_IEEE_F64LE, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+
+		// each rank selects its own slab of the file and of memory
+		hid_t memspace;
+		if(end==start){
+			const hsize_t one = 1;
+			memspace = H5Screate_simple(1, &one, NULL);
+			H5Sselect_none(memspace);
+			H5Sselect_none(filespace);
+		}
+		else if(ndims==0){
+			PRINT_ASSERT(end-start,==,size());
+			PRINT_ASSERT(one_element,==,false);
+			memspace = H5Scopy(filespace);
+		}
+		else{
+			PRINT_ASSERT(start % stride[0],==,0);
+			PRINT_ASSERT(end   % stride[0],==,0);
+			hsize_t file_offset[ndims+1], count[ndims+1];
+			for(int i=0; i<h5ndims; i++){
+				file_offset[i] = 0;
+				count[i] = dims[i];
+			}
+			file_offset[0] = start / stride[0];
+			count[0] = (end-start) / stride[0];
+			H5Sselect_hyperslab(filespace, H5S_SELECT_SET, file_offset, NULL, count, NULL);
+			if(one_element){
+				// records in memory are rows. Pick out one column.
+				hsize_t mem_dims[2]   = {end-start, nelements};
+				hsize_t mem_count[2]  = {end-start, 1};
+				hsize_t mem_offset[2] = {0, element};
+				memspace = H5Screate_simple(2, mem_dims, NULL);
+				H5Sselect_hyperslab(memspace, H5S_SELECT_SET, mem_offset, NULL, mem_count, NULL);
+			}
+			else memspace = H5Screate_simple(h5ndims, count, NULL);
+		}
+
+		hid_t xfer = H5Pcreate(H5P_DATASET_XFER);
+		H5Pset_dxpl_mpio(xfer, H5FD_MPIO_COLLECTIVE);
+		const void* buf = (end>start ? (const void*)&y0[start-this->offset] : (const void*)y0.data());
+		const herr_t status = H5Dwrite(dataset, StorageType<T>::hdf5().getId(), memspace, filespace, xfer, buf);
+		if(status<0){
+			cout << "ERROR: collective HDF5 write of " << name << " failed" << endl;
+			exit(5);
+		}
+		H5Pclose(xfer);
+		H5Sclose(memspace);
+		H5Sclose(filespace);
+		H5Dclose(dataset);
+	}
+#endif
+
 	void read_HDF5(H5::H5File file, const string name, const vector<Axis>& axes_in) {
 		cout << "# Reading " << name << endl;
 		H5::DataSet dataset = file.openDataSet(name);
@@ -399,7 +821,7 @@ public:
 
 		// read the data
 		y0.resize(ntot);
-		dataset.read(&y0.front(), H5::PredType::IEEE_F64LE);
+		dataset.read(&y0.front(), StorageType<T>::hdf5());
 		dataset.close();
 	}
 };
@@ -416,27 +838,29 @@ public:
 		direct_add(lin_ind, to_add);
 	}
 	void direct_add(const size_t lin_ind, const T to_add){
-		this->y0[lin_ind][0] += to_add;
+		this->y0[lin_ind-this->offset][0] += to_add;
 	}
 
 	// get center value based on grid index
 	const T operator[](const size_t i) const {
-		return this->y0[i][0];
+		PRINT_ASSERT(i,>=,this->offset);
+		return this->y0[i-this->offset][0];
 	}
 	T& operator[](const size_t i){
-		return this->y0[i][0];
+		PRINT_ASSERT(i,>=,this->offset);
+		return this->y0[i-this->offset][0];
 	}
 
 	template<size_t dummy>
-	T interpolate(const InterpolationCube<dummy>& icube) const{
+	double interpolate(const InterpolationCube<dummy>& icube) const{
 		return MultiDArray<T,1,ndims>::interpolate(icube)[0];
 	}
 	template<size_t dummy>
 	Tuple<double,ndims> interpolate_slopes(const InterpolationCube<dummy>& icube) const{
-		Tuple<Tuple<T,1>,ndims> result;
+		Tuple<Tuple<double,1>,ndims> result;
 		result = MultiDArray<T,1,ndims>::interpolate_slopes(icube);
 
-		Tuple<T,ndims> return_value;
+		Tuple<double,ndims> return_value;
 		for(size_t i=0; i<ndims; i++) return_value[i] = result[i][0];
 		return return_value;
 	}
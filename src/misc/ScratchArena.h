@@ -0,0 +1,131 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+
+#ifndef _SCRATCH_ARENA_H
+#define _SCRATCH_ARENA_H 1
+
+#include <vector>
+#include "global_options.h"
+
+using namespace std;
+
+//======//
+// Span //
+//======//
+// Non-owning view of n contiguous values. Multi-dimensional
+// kernels are passed as flat spans, e.g. [order][igin][igout]
+// is phi[(order*ng + igin)*ng + igout].
+template<typename T>
+class Span{
+public:
+	T* ptr;
+	size_t n;
+
+	Span() : ptr(NULL), n(0) {}
+	Span(T* ptr_in, const size_t n_in) : ptr(ptr_in), n(n_in) {}
+	Span(vector<T>& v) : ptr(v.empty() ? NULL : &v[0]), n(v.size()) {}
+
+	T& operator[](const size_t i) const{
+		PRINT_ASSERT(i,<,n);
+		return ptr[i];
+	}
+	size_t size() const {return n;}
+	T* data() const {return ptr;}
+	Span<T> sub(const size_t offset, const size_t count) const{
+		PRINT_ASSERT(offset+count,<=,n);
+		return Span<T>(ptr+offset, count);
+	}
+	void fill(const T value) const{
+		for(size_t i=0; i<n; i++) ptr[i] = value;
+	}
+};
+
+
+//==============//
+// ScratchArena //
+//==============//
+// Bump allocator for temporary buffers that only live while one
+// zone is being worked on. Memory comes from chunks that are kept
+// between zones, so after the first few zones nothing is allocated.
+// Chunks never move, so a span stays valid until its frame ends.
+// Each thread has its own arena (see ScratchFrame).
+class ScratchArena{
+public:
+	static const size_t min_chunk = 1<<16; // doubles
+
+	struct Mark{
+		size_t chunk, offset;
+	};
+
+	vector< vector<double> > chunks;
+	Mark top;
+
+	ScratchArena(){
+		top.chunk = top.offset = 0;
+	}
+
+	// the calling thread's arena
+	static ScratchArena& thread_arena(){
+		static thread_local ScratchArena arena;
+		return arena;
+	}
+
+	Span<double> allocate(const size_t n){
+		while(top.chunk<chunks.size() and top.offset+n > chunks[top.chunk].size()){
+			top.chunk++;
+			top.offset = 0;
+		}
+		if(top.chunk==chunks.size()) chunks.push_back(vector<double>(max(n,(size_t)min_chunk)));
+		double* result = &chunks[top.chunk][top.offset];
+		top.offset += n;
+		return Span<double>(result, n);
+	}
+
+	Mark mark() const {return top;}
+	void release(const Mark m) {top = m;}
+};
+
+
+//==============//
+// ScratchFrame //
+//==============//
+// Hands out scratch buffers from the calling thread's arena and
+// gives all of them back when it goes out of scope. Contents are
+// not initialized.
+class ScratchFrame{
+public:
+	ScratchArena& arena;
+	const ScratchArena::Mark start;
+
+	ScratchFrame() : arena(ScratchArena::thread_arena()), start(arena.mark()) {}
+	~ScratchFrame() {arena.release(start);}
+
+	Span<double> allocate(const size_t n) {return arena.allocate(n);}
+};
+
+#endif
@@ -26,6 +26,8 @@
 */
 
 #include <ctime>
+#include <cmath>
+#include <iostream>
 #include <mpi.h>
 #include <omp.h>
 #include "ThreadRNG.h"
@@ -33,12 +35,20 @@
 
 //-----------------------------------------------------------------
 // initialize the RNG system
+// backend is "gsl" (gsl_rng_default) or "philox" (counter-based)
 //-----------------------------------------------------------------
 // ASSUMES the number of threads remains constant so it only has to be initialized once
-void ThreadRNG::init(){
+void ThreadRNG::init(const std::string backend, const long seed){
 	int my_mpiID;
 	MPI_Comm_rank(MPI_COMM_WORLD, &my_mpiID);
 
+	if(backend!="gsl" and backend!="philox"){
+		if(my_mpiID==0) std::cout << "ERROR: unknown RNG backend " << backend << std::endl;
+		exit(6);
+	}
+	use_philox = (backend=="philox");
+	key = (seed>=0 ? (uint64_t)seed : (uint64_t)time(NULL));
+
 	// set up the stuff that creates the random number generators
 	const gsl_rng_type* TypeR = gsl_rng_default;
 	gsl_rng_env_setup();
@@ -55,26 +65,50 @@ void ThreadRNG::init(){
 	}
 
 	// assign a unique RNG to each thread
-	generators.resize(nthreads);
-	for(int i=0; i<nthreads; i++){
-		gsl_rng_default_seed = (size_t)time(NULL) + my_mpiID*nthreads + i;
-		generators[i] = gsl_rng_alloc (TypeR);
+	if(use_philox){
+		// same key everywhere, distinct stream (high counter words) per thread
+		philox.resize(nthreads);
+		for(int i=0; i<nthreads; i++)
+			philox[i].value.seed(key, (uint64_t)my_mpiID*nthreads + i);
+	}
+	else{
+		generators.resize(nthreads);
+		for(int i=0; i<nthreads; i++){
+			gsl_rng_default_seed = (size_t)key + my_mpiID*nthreads + i;
+			generators[i] = gsl_rng_alloc (TypeR);
+		}
 	}
 }
 
-
-
 //-----------------------------------------------------------------
-// return a uniformily distributed random number (thread safe)
+// per-particle streams (reproducible mode, Philox only)
+// each step gets its own key so streams are not reused
 //-----------------------------------------------------------------
-double ThreadRNG::uniform(){
+void ThreadRNG::set_stream(const uint64_t stream, const uint64_t step){
+	PRINT_ASSERT(use_philox,==,true);
+	philox[thread_id()].value.seed(key + step*0x9E3779B97F4A7C15ULL, stream);
+}
+
+PhiloxStream& ThreadRNG::thread_stream(){
+	PRINT_ASSERT(use_philox,==,true);
+	return philox[thread_id()].value;
+}
+
+int ThreadRNG::thread_id() const{
     #ifdef _OPENMP
-	const int my_ompID = omp_get_thread_num();
+	return omp_get_thread_num();
     #else
-	const int my_ompID = 0;
+	return 0;
     #endif
+}
+
 
-	return gsl_rng_uniform(generators[my_ompID]);
+//-----------------------------------------------------------------
+// return a uniformily distributed random number (thread safe)
+//-----------------------------------------------------------------
+double ThreadRNG::uniform(){
+	if(use_philox) return philox[thread_id()].value.uniform();
+	return gsl_rng_uniform(generators[thread_id()]);
 }
 
 double ThreadRNG::uniform(const double min, const double max){
@@ -88,3 +122,30 @@ int ThreadRNG::uniform_discrete(const int min, const int max){
 	PRINT_ASSERT(result,<=,max);
 	return result;
 }
+
+void ThreadRNG::uniform(double* out, const size_t n){
+	if(use_philox) philox[thread_id()].value.uniform(out, n);
+	else{
+		gsl_rng* r = generators[thread_id()];
+		for(size_t i=0; i<n; i++) out[i] = gsl_rng_uniform(r);
+	}
+}
+
+//-----------------------------------------------------------------
+// exponentially distributed numbers with unit mean (e.g. optical depths)
+//-----------------------------------------------------------------
+double ThreadRNG::exponential(){
+	double u;
+	do{
+		u = uniform();
+	} while(u==0);
+	return -log(u);
+}
+
+void ThreadRNG::exponential(double* out, const size_t n){
+	uniform(out, n);
+	for(size_t i=0; i<n; i++){
+		while(out[i]==0) out[i] = uniform();
+		out[i] = -log(out[i]);
+	}
+}
@@ -29,23 +29,123 @@
 #define _THREAD_RNG_H
 
 #include <gsl/gsl_rng.h>
+#include <stdint.h>
 #include <vector>
+#include <string>
+#include "global_options.h"
 
+//===============//
+// PhiloxStream  //
+//===============//
+// Philox4x32-10 counter-based generator (Salmon et al. 2011).
+// Each block encrypts a 128-bit counter with a 64-bit key, so the
+// whole state is six words and there is no shared table to fetch.
+class PhiloxStream{
+public:
+	uint32_t key[2];
+	uint32_t counter[4];
+	double spare;     // second uniform from the last block
+	bool have_spare;
+
+	void seed(const uint64_t key_in, const uint64_t stream=0){
+		key[0] = (uint32_t)key_in;
+		key[1] = (uint32_t)(key_in >> 32);
+		counter[0] = counter[1] = 0;
+		counter[2] = (uint32_t)stream;
+		counter[3] = (uint32_t)(stream >> 32);
+		have_spare = false;
+	}
+
+	// encrypt the current counter into out, then advance the counter
+	void next_block(uint32_t out[4]){
+		const uint32_t M0=0xD2511F53, M1=0xCD9E8D57, W0=0x9E3779B9, W1=0xBB67AE85;
+		uint32_t c0=counter[0], c1=counter[1], c2=counter[2], c3=counter[3];
+		uint32_t k0=key[0], k1=key[1];
+		for(int round=0; round<10; round++){
+			const uint64_t p0 = (uint64_t)M0 * c0;
+			const uint64_t p1 = (uint64_t)M1 * c2;
+			const uint32_t hi0 = p0>>32, lo0 = (uint32_t)p0;
+			const uint32_t hi1 = p1>>32, lo1 = (uint32_t)p1;
+			c0 = hi1 ^ c1 ^ k0;
+			c1 = lo1;
+			c2 = hi0 ^ c3 ^ k1;
+			c3 = lo0;
+			k0 += W0;
+			k1 += W1;
+		}
+		out[0]=c0; out[1]=c1; out[2]=c2; out[3]=c3;
+		if(++counter[0]==0) if(++counter[1]==0) if(++counter[2]==0) ++counter[3];
+	}
+
+	// two 53-bit uniforms in [0,1) from one block
+	void next_pair(double u[2]){
+		uint32_t out[4];
+		next_block(out);
+		const double inv_2_53 = 1.0/9007199254740992.0;
+		u[0] = (double)((((uint64_t)out[0]<<32) | out[1]) >> 11) * inv_2_53;
+		u[1] = (double)((((uint64_t)out[2]<<32) | out[3]) >> 11) * inv_2_53;
+	}
+
+	double uniform(){
+		if(have_spare){
+			have_spare = false;
+			return spare;
+		}
+		double u[2];
+		next_pair(u);
+		spare = u[1];
+		have_spare = true;
+		return u[0];
+	}
+
+	void uniform(double* out, const size_t n){
+		size_t i=0;
+		if(have_spare and n>0){
+			out[i++] = spare;
+			have_spare = false;
+		}
+		for(; i+1<n; i+=2) next_pair(&out[i]);
+		if(i<n) out[i] = uniform();
+	}
+};
+
+
+//===========//
+// ThreadRNG //
+//===========//
 class ThreadRNG
 {
 
 protected:
 
-	// OPTIMIZE - to prevent false sharing, make sure all the RNG's are on different cache lines
 	// vector of generators
 	std::vector<gsl_rng*> generators;
 
+	// counter-based alternative (one padded stream per thread)
+	std::vector< Padded<PhiloxStream> > philox;
+	bool use_philox;
+	uint64_t key;
+
+	int thread_id() const;
+
 public:
 
-	void   init();
+	ThreadRNG() : use_philox(false), key(0) {}
+
+	void   init(const std::string backend="gsl", const long seed=-1); // seed<0 uses the clock
 	double uniform();
 	double uniform(const double min, const double max);
 	int    uniform_discrete(const int    min, const int    max);
+	double exponential();
+
+	// fill arrays with n samples at once
+	void uniform(double* out, const size_t n);     // [0,1)
+	void exponential(double* out, const size_t n); // unit mean, always >0 and finite
+
+	// restart the calling thread's Philox stream so the numbers it produces
+	// depend only on the seed, the step, and the stream (e.g. a particle ID)
+	void set_stream(const uint64_t stream, const uint64_t step=0);
+	PhiloxStream& thread_stream(); // for saving/restoring a particle's stream
 };
 
 #endif
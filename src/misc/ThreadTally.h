@@ -0,0 +1,204 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#ifndef _THREAD_TALLY_H
+#define _THREAD_TALLY_H 1
+
+#include <omp.h>
+#include <vector>
+#include "global_options.h"
+#include "MultiDArray.h"
+#include "ExactSum.h"
+
+using namespace std;
+
+//=============//
+// TallyBuffer //
+//=============//
+// Sparse private accumulator owned by a single thread. Records
+// (linear indices into the shared array) are kept in an
+// open-addressing hash table so repeated hits on the same zone
+// are summed locally. The list of touched slots makes a flush
+// cost proportional to the number of distinct records hit.
+template<size_t nelements>
+class TallyBuffer{
+public:
+	static const size_t empty = (size_t)-1;
+
+	vector<size_t> keys;
+	vector< Tuple<double,nelements> > values;
+	vector<size_t> touched; // occupied slots
+	size_t mask;
+	unsigned shift;         // 64 - log2(capacity)
+
+	TallyBuffer() : mask(0), shift(64) {}
+
+	void init(const size_t capacity){
+		PRINT_ASSERT(capacity,>,1);
+		PRINT_ASSERT((capacity & (capacity-1)),==,0); // power of two
+		keys.assign(capacity, empty);
+		values.resize(capacity);
+		touched.reserve(capacity/2);
+		mask = capacity-1;
+		shift = 64 - __builtin_ctzll(capacity);
+	}
+
+	// returns false if the buffer is too full to take a new record
+	bool add(const size_t record, const Tuple<double,nelements>& to_add){
+		// Fibonacci hashing: the top bits of the product depend on every bit of
+		// the record, so records that are equal modulo the capacity still spread
+		size_t slot = (size_t)((record * 0x9E3779B97F4A7C15ULL) >> shift);
+		while(true){
+			if(keys[slot] == record){
+				values[slot] += to_add;
+				return true;
+			}
+			if(keys[slot] == empty){
+				if(2*touched.size() >= keys.size()) return false;
+				keys[slot] = record;
+				values[slot] = to_add;
+				touched.push_back(slot);
+				return true;
+			}
+			slot = (slot+1) & mask;
+		}
+	}
+
+	// move everything into the shared array and empty the buffer
+	template<typename T, size_t ndims>
+	void flush(MultiDArray<T,nelements,ndims>& target){
+		for(size_t i=0; i<touched.size(); i++){
+			const size_t slot = touched[i];
+			target[keys[slot]] += values[slot];
+			keys[slot] = empty;
+		}
+		touched.resize(0);
+	}
+};
+template<size_t nelements> const size_t TallyBuffer<nelements>::empty; // odr-used by keys.assign()
+
+
+//=============//
+// ThreadTally //
+//=============//
+// Thread-private buffering for a shared MultiDArray tally field.
+// While buffering is on, add() accumulates into the calling
+// thread's TallyBuffer. Full buffers are flushed by their owning
+// thread on the fly, and stop_buffering() reduces all buffers into
+// the target in parallel. When buffering is off, add() goes
+// straight to the target, so code outside the propagation loop is
+// unaffected. The target must use ATOMIC elements because buffers
+// are flushed concurrently. Buffers always accumulate in double, so
+// a single-precision target only sees rounding once per flush.
+// In reproducible mode the buffers are bypassed and every addition
+// goes into an ExactSum, which stop_buffering() sums onto rank 0 and
+// adds to rank 0's target. The other ranks' targets are untouched,
+// so a later mpi_sum() or mpi_sum_scatter() leaves the bits unchanged.
+// If the target only stores some zones (see ZonePartition) the ghost
+// zones' sums are folded onto their owners instead, and each rank adds
+// the sums for the zones it owns.
+template<size_t nelements>
+class ThreadTally{
+public:
+	static const size_t default_capacity = 1<<12;
+
+	vector< Padded< TallyBuffer<nelements> > > buffers;
+	ExactSum exact;
+	bool buffering;
+	bool reproducible;
+
+	ThreadTally() : buffering(false), reproducible(false) {}
+
+	template<typename T, size_t ndims>
+	void start_buffering(const MultiDArray<ATOMIC<T>,nelements,ndims>& target, const bool reproducible_in=false, const size_t capacity=default_capacity){
+		PRINT_ASSERT(buffering,==,false);
+		buffering = true;
+		reproducible = reproducible_in;
+		if(reproducible){
+			exact.resize((target.stored_end()-target.stored_start())*nelements);
+			return;
+		}
+		const size_t nthreads = omp_get_max_threads();
+		if(buffers.size() != nthreads){
+			buffers.resize(nthreads);
+			#pragma omp parallel for
+			for(size_t t=0; t<nthreads; t++) buffers[t].value.init(capacity);
+		}
+	}
+
+	template<typename T, size_t ndims>
+	void stop_buffering(MultiDArray<ATOMIC<T>,nelements,ndims>& target){
+		if(not buffering) return;
+		buffering = false;
+		if(reproducible and target.partition!=NULL){
+			target.partition->template fold_ghosts<long long>(&exact.limbs.front(), target.entries_per_zone()*nelements*ExactSum::nlimbs, MPI_LONG_LONG);
+			const size_t base = target.stored_start();
+			#pragma omp parallel for
+			for(size_t i=target.owned_start(); i<target.owned_end(); i++)
+				for(size_t k=0; k<nelements; k++)
+					target[i][k] += exact.value((i-base)*nelements+k);
+			exact.clear();
+			return;
+		}
+		if(reproducible){
+			int MPI_myID;
+			MPI_Comm_rank(MPI_COMM_WORLD, &MPI_myID);
+			exact.mpi_reduce();
+			if(MPI_myID==0){
+				#pragma omp parallel for
+				for(size_t i=0; i<target.size(); i++)
+					for(size_t k=0; k<nelements; k++)
+						target[i][k] += exact.value(i*nelements+k);
+			}
+			exact.clear();
+			return;
+		}
+		#pragma omp parallel for schedule(dynamic)
+		for(size_t t=0; t<buffers.size(); t++) buffers[t].value.flush(target);
+	}
+
+	template<typename T, size_t ndims>
+	void add(MultiDArray<ATOMIC<T>,nelements,ndims>& target, const size_t lin_ind, const Tuple<double,nelements>& to_add){
+		PRINT_ASSERT(lin_ind,<,target.size());
+		if(not buffering){
+			target.direct_add(lin_ind, to_add);
+			return;
+		}
+		if(reproducible){
+			const size_t i = lin_ind - target.stored_start();
+			for(size_t k=0; k<nelements; k++) exact.add(i*nelements+k, to_add[k]);
+			return;
+		}
+		TallyBuffer<nelements>& buffer = buffers[omp_get_thread_num()].value;
+		if(not buffer.add(lin_ind, to_add)){
+			buffer.flush(target);
+			buffer.add(lin_ind, to_add);
+		}
+	}
+};
+
+#endif
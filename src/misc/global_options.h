@@ -46,8 +46,19 @@
 #include <execinfo.h>
 #include <cxxabi.h>
 
-//using real = float; // or float
-//const MPI_Datatype MPI_real = ( sizeof(real)==4 ? MPI_FLOAT : MPI_DOUBLE );
+// Storage type of the big per-zone arrays (fluid state, opacities,
+// and the distribution and spectrum tallies). Compile with
+// -DSINGLE_PRECISION=1 to halve their memory. Arithmetic, tally
+// buffers, and sums over ranks are still done in double, and output
+// files are still written in double.
+#ifndef SINGLE_PRECISION
+#define SINGLE_PRECISION 0
+#endif
+#if SINGLE_PRECISION==1
+typedef float real;
+#else
+typedef double real;
+#endif
 #define NaN std::numeric_limits<double>::quiet_NaN()
 #define MAXLIM std::numeric_limits<int>::max()
 #define TINY 1e-6
@@ -224,6 +235,20 @@ class ATOMIC : public std::atomic<T>
   }
 };
 
+//========//
+// PADDED //
+//========//
+// Element of a per-thread vector. The trailing padding keeps the
+// data of neighboring threads at least a cache line apart even when
+// the vector's storage is not cache-line aligned (alignas is not
+// honored by C++11 allocators), and it stays out of the value type,
+// so copies of the value don't carry it around.
+template<typename T>
+struct Padded{
+	T value;
+	char padding[64];
+};
+
 
 //=======//
 // TUPLE //
@@ -46,7 +46,7 @@ Neutrino_GR1D::Neutrino_GR1D(){
 //----------------------------------------------------------------
 // called from species_general::init (neutrino-specific stuff)
 //----------------------------------------------------------------
-void Neutrino_GR1D::myInit(Lua* /*lua*/)
+void Neutrino_GR1D::myInit(Lua* /*lua*/, Grid* /*grid*/)
 {
 // do nothing
 }
@@ -108,7 +108,7 @@ void Neutrino_GR1D::set_eas_external(const double* easarray, bool* /*extract_MC*
 			size_t dir_ind[NDIMS+1];
 			sim->grid->rho.indices(z_ind,dir_ind);
 			dir_ind[NDIMS] = inu;
-			size_t global_index = sim->grid->abs_opac[ID].direct_index(dir_ind);
+			size_t global_index = sim->grid->opac[ID].direct_index(dir_ind);
 
 			// indexed as eas(zone,species,group,e/a/s). The leftmost one varies fastest.
 			int aind = (z_ind+ghosts1) + ID*n_GR1D_zones + inu*nspecies*n_GR1D_zones + 1*ngroups*nspecies*n_GR1D_zones;
@@ -119,9 +119,9 @@ void Neutrino_GR1D::set_eas_external(const double* easarray, bool* /*extract_MC*
 			PRINT_ASSERT(easarray[sind],>=,0);
 
 			// set opacities
-			sim->grid->abs_opac[ID][global_index] = easarray[aind] / nulib_opacity_gf; // 1/cm
-			sim->grid->scat_opac[ID][global_index] = easarray[sind] / nulib_opacity_gf; // 1/cm
-			sim->grid->inelastic_scat_opac[ID][global_index] = 0; // 1/cm
+			sim->grid->opac[ID][global_index][OPAC_ABS]       = easarray[aind] / nulib_opacity_gf; // 1/cm
+			sim->grid->opac[ID][global_index][OPAC_SCAT]      = easarray[sind] / nulib_opacity_gf; // 1/cm
+			sim->grid->opac[ID][global_index][OPAC_INELASTIC] = 0; // 1/cm
 		}
 	}
 }
@@ -49,7 +49,7 @@ public:
 	int n_GR1D_zones;
 	Neutrino_GR1D();
 
-	void myInit(Lua* lua);
+	void myInit(Lua* lua, Grid* grid);
 	void set_eas(const size_t z_ind, Grid* grid) const;
 	void set_eas_external(const double* easarray, bool* extract_MC, const double rshock);
 	static void set_nu_grid(Lua* lua, Axis* nu_grid);
@@ -30,14 +30,19 @@
 #include "Transport.h"
 #include "Grid.h"
 #include "nulib_interface.h"
+#include <mpi.h>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include "H5Cpp.h"
 
 using namespace std;
 namespace pc = physical_constants;
 
 
+vector<double> Neutrino_Nagakura::eas_table;
+string Neutrino_Nagakura::eas_table_dir;
+
 // constructor
 Neutrino_Nagakura::Neutrino_Nagakura(){
 }
@@ -45,34 +50,28 @@ Neutrino_Nagakura::Neutrino_Nagakura(){
 //----------------------------------------------------------------
 // called from species_general::init (neutrino-specific stuff)
 //----------------------------------------------------------------
-void Neutrino_Nagakura::myInit(Lua* lua)
+void Neutrino_Nagakura::myInit(Lua* lua, Grid* grid)
 {
     // set up the frequency table
     opacity_dir   = lua->scalar<string>("opacity_dir");
+
+    // the first species reads the opacities for everyone
+    if(eas_table_dir != opacity_dir) load_eas_table(lua, grid);
 }
 
 
 //-----------------------------------------------------------------
-// set emissivity, abs. opacity, and scat. opacity in zones
+// name of the ASCII opacity file for a zone
 //-----------------------------------------------------------------
-void Neutrino_Nagakura::set_eas(const size_t zone_index, Grid* grid) const
+string Neutrino_Nagakura::opacity_filename(const size_t zone_index, const Grid* grid) const
 {
-	size_t dir_ind[NDIMS+2];
-	grid->rho.indices(zone_index,dir_ind);
-
-
-	//=======================//
-    // Open the opacity file //
-	//=======================//
 	stringstream filename;
 	if(grid->grid_type == "Grid1DSphere"){
-		filename.str("");
 	    filename << opacity_dir << "/opac_r" << zone_index << "_theta0.dat";
 	}
 	else if(grid->grid_type == "Grid2DSphere"){
 		Tuple<size_t,NDIMS> dir_ind = grid->zone_directional_indices(zone_index);
 		Tuple<hsize_t,NDIMS> dims = grid->dims();
-		filename.str("");
 		filename << opacity_dir << "/opac_r" << dir_ind[0] << "_theta" << (dims[1]-dir_ind[1]-1) << ".dat"; // Hiroki's theta is backwards
 	}
 	else{
@@ -80,88 +79,153 @@ void Neutrino_Nagakura::set_eas(const size_t zone_index, Grid* grid) const
 		cout << grid->grid_type << endl;
 		assert(false);
 	}
+	return filename.str();
+}
+
+
+//-----------------------------------------------------------------
+// parse one zone's ASCII file into eas[species][group][e/a/s]
+//-----------------------------------------------------------------
+void Neutrino_Nagakura::read_opacity_file(const size_t zone_index, const Grid* grid, double* eas) const
+{
     ifstream opac_file;
-    opac_file.open(filename.str().c_str());
+    opac_file.open(opacity_filename(zone_index, grid).c_str());
 
-    //====================//
-    // read the opacities //
-    //====================//
     // ignore the first line
     string line;
     getline(opac_file,line);
 
-    for(size_t inu=0; inu<grid->nu_grid_axis.size(); inu++){
-    	dir_ind[NDIMS] = inu;
-    	size_t global_index = grid->abs_opac[ID].direct_index(dir_ind);
-
+    // each line has the group number followed by
+    // emissivity (erg/ccm/s), absorption, and scattering opacity (1/cm)
+    // for electron, anti-electron, and heavy lepton neutrinos
+    const size_t ngroups = grid->nu_grid_axis.size();
+    for(size_t inu=0; inu<ngroups; inu++){
     	int itmp;
-    	double a=0, s=0;
-
     	opac_file >> itmp; // group number
     	PRINT_ASSERT((int)inu,==,itmp);
+    	for(size_t s=0; s<n_file_species; s++)
+    		for(size_t k=0; k<3; k++)
+    			opac_file >> eas[(s*ngroups + inu)*3 + k];
+    }
+    PRINT_ASSERT(opac_file.fail(),==,false);
+    opac_file.close();
+}
+
+
+//-----------------------------------------------------------------
+// Was the cache written from this opacity_dir for this grid?
+// Both are recorded as attributes of the eas dataset.
+//-----------------------------------------------------------------
+bool Neutrino_Nagakura::cache_is_current(const string cache_filename, const hsize_t dims[4]) const
+{
+	if(not hdf5_dataset_exists(cache_filename.c_str(), "eas")) return false;
+	H5::H5File file(cache_filename, H5F_ACC_RDONLY);
+	H5::DataSet dataset = file.openDataSet("eas");
+	if(not dataset.attrExists("opacity_dir") or not dataset.attrExists("dims")) return false;
+
+	string cache_dir;
+	H5::StrType string_type(H5::PredType::C_S1, H5T_VARIABLE);
+	dataset.openAttribute("opacity_dir").read(string_type, cache_dir);
+
+	hsize_t cache_dims[4], file_dims[4];
+	H5::Attribute dims_attribute = dataset.openAttribute("dims");
+	if(dims_attribute.getSpace().getSimpleExtentNpoints() != 4) return false;
+	dims_attribute.read(H5::PredType::NATIVE_HSIZE, cache_dims);
+	H5::DataSpace dataspace = dataset.getSpace();
+	if(dataspace.getSimpleExtentNdims() != 4) return false;
+	dataspace.getSimpleExtentDims(file_dims);
+
+	bool current = (cache_dir == opacity_dir);
+	for(size_t d=0; d<4; d++) current = current and cache_dims[d]==dims[d] and file_dims[d]==dims[d];
+	file.close();
+	return current;
+}
 
-    	double dtmp;
-    	if(ID==0){
-    		// electron type
-    		opac_file >> dtmp; // emissivity (erg/ccm/s)
-    		opac_file >> a;
-    		opac_file >> s;
-
-    		// anti-electron type
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-
-    		// heavy lepton type
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-    	}
-    	else if(ID==1){
-    		// electron type
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-
-    		// anti-electron type
-    		opac_file >> dtmp; // emissivity (erg/ccm/s)
-    		opac_file >> a;
-    		opac_file >> s;
-
-    		// heavy lepton type
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-    	}
-    	else if(ID==2){
-    		// electron type
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-
-    		// electron type
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-    		opac_file >> dtmp;
-
-    		// heavy lepton type
-    		opac_file >> dtmp; // emissivity (erg/ccm/s)
-    		opac_file >> a;
-    		opac_file >> s;
-    	}
-    	else{
-    		cout << "ERROR: Neutrino ID not recognized!" << endl;
-    		assert(false);
-    	}
-    	grid->abs_opac[ID][global_index] = a;
-    	grid->scat_opac[ID][global_index] = s;
-
-    	// fill in the scattering kernel if used
-		if(grid->inelastic_scat_opac[ID].size()>0){
-	    	grid->inelastic_scat_opac[ID][global_index] = 0;
-			grid->scattering_delta[ID][inu].wipe();
-			grid->partial_scat_opac[ID][inu].wipe();
+//-----------------------------------------------------------------
+// Read every zone's opacity file into eas_table on rank 0 and send
+// it to the other ranks. If opacity_cache is set, the table is read
+// from that HDF5 file instead, or written to it if it does not exist
+// or was made from a different opacity_dir or grid.
+//-----------------------------------------------------------------
+void Neutrino_Nagakura::load_eas_table(Lua* lua, const Grid* grid)
+{
+	int MPI_myID;
+	MPI_Comm_rank(MPI_COMM_WORLD, &MPI_myID);
+	pair<string,bool> cache_pair = lua->scalar_pair<string>("opacity_cache");
+	const bool use_cache = cache_pair.second;
+	const bool cache_exists = use_cache and ifstream(cache_pair.first.c_str()).good();
+
+	const hsize_t dims[4] = {grid->rho.size(), n_file_species, grid->nu_grid_axis.size(), 3};
+	const size_t zone_size = dims[1]*dims[2]*dims[3];
+	eas_table.resize(dims[0]*zone_size);
+
+	if(MPI_myID==0){
+		const bool cache_current = cache_exists and cache_is_current(cache_pair.first, dims);
+		if(cache_exists and not cache_current)
+			cout << "#   Nagakura opacity cache " << cache_pair.first << " does not match " << opacity_dir << " and this grid. Rewriting it." << endl;
+		if(cache_current){
+			cout << "#   Reading Nagakura opacities from " << cache_pair.first << endl;
+			H5::H5File file(cache_pair.first, H5F_ACC_RDONLY);
+			H5::DataSet dataset = file.openDataSet("eas");
+			dataset.read(&eas_table[0], H5::PredType::NATIVE_DOUBLE);
+			file.close();
 		}
+		else{
+			cout << "#   Reading Nagakura opacities from " << opacity_dir << endl;
+			#pragma omp parallel for schedule(dynamic)
+			for(size_t z_ind=0; z_ind<dims[0]; z_ind++)
+				read_opacity_file(z_ind, grid, &eas_table[z_ind*zone_size]);
+			if(use_cache){
+				cout << "#   Writing Nagakura opacities to " << cache_pair.first << endl;
+				H5::H5File file(cache_pair.first, H5F_ACC_TRUNC);
+				H5::DataSpace dataspace(4,dims);
+				H5::DataSet dataset = file.createDataSet("eas",H5::PredType::IEEE_F64LE,dataspace);
+				dataset.write(&eas_table[0], H5::PredType::NATIVE_DOUBLE);
+
+				// record where the table came from so a stale cache is noticed
+				H5::StrType string_type(H5::PredType::C_S1, H5T_VARIABLE);
+				dataset.createAttribute("opacity_dir", string_type, H5::DataSpace(H5S_SCALAR)).write(string_type, opacity_dir);
+				const hsize_t ndims = 4;
+				dataset.createAttribute("dims", H5::PredType::STD_U64LE, H5::DataSpace(1,&ndims)).write(H5::PredType::NATIVE_HSIZE, dims);
+				file.close();
+			}
+		}
+	}
+	MPI_Bcast(&eas_table[0], eas_table.size(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	eas_table_dir = opacity_dir;
+}
+
+
+//-----------------------------------------------------------------
+// set emissivity, abs. opacity, and scat. opacity in zones
+//-----------------------------------------------------------------
+void Neutrino_Nagakura::set_eas(const size_t zone_index, Grid* grid) const
+{
+	size_t dir_ind[NDIMS+2];
+	grid->rho.indices(zone_index,dir_ind);
+	if(ID>=n_file_species){
+		cout << "ERROR: Neutrino ID not recognized!" << endl;
+		assert(false);
+	}
+
+	const size_t ngroups = grid->nu_grid_axis.size();
+	const double* eas = &eas_table[((zone_index*n_file_species + ID)*ngroups)*3];
+    for(size_t inu=0; inu<ngroups; inu++){
+    	dir_ind[NDIMS] = inu;
+    	size_t global_index = grid->opac[ID].direct_index(dir_ind);
+    	grid->opac[ID][global_index][OPAC_ABS]  = eas[inu*3 + 1];
+    	grid->opac[ID][global_index][OPAC_SCAT] = eas[inu*3 + 2];
+    	grid->opac[ID][global_index][OPAC_INELASTIC] = 0; // the opacity files have no inelastic scattering
     }
-    opac_file.close();
+}
+
+void Neutrino_Nagakura::get_eas(const size_t zone_index, const Grid* grid, double* absopac, double* scatopac) const
+{
+	PRINT_ASSERT(ID,<,n_file_species);
+	const size_t ngroups = grid->nu_grid_axis.size();
+	const double* eas = &eas_table[((zone_index*n_file_species + ID)*ngroups)*3];
+	for(size_t inu=0; inu<ngroups; inu++){
+		absopac[inu]  = eas[inu*3 + 1];
+		scatopac[inu] = eas[inu*3 + 2];
+	}
 }
@@ -37,12 +37,23 @@ protected:
 
 	std::string opacity_dir;
 
+	// all of the opacity files, read once and shared by the species
+	// [zone][species][group][emissivity/absorption/scattering]
+	static const size_t n_file_species = 3;
+	static std::vector<double> eas_table;
+	static std::string eas_table_dir;
+	std::string opacity_filename(const size_t zone_index, const Grid* grid) const;
+	void read_opacity_file(const size_t zone_index, const Grid* grid, double* eas) const;
+	void load_eas_table(Lua* lua, const Grid* grid);
+	bool cache_is_current(const std::string cache_filename, const hsize_t dims[4]) const;
+
 public:
 
 	Neutrino_Nagakura();
 
-	void myInit(Lua* lua);
+	void myInit(Lua* lua, Grid* grid);
 	void set_eas(const size_t z_ind, Grid* grid) const;
+	void get_eas(const size_t z_ind, const Grid* grid, double* absopac, double* scatopac) const;
 };
 
 #endif
@@ -42,7 +42,7 @@ Neutrino_NuLib::Neutrino_NuLib(){
 //----------------------------------------------------------------
 // called from species_general::init (neutrino-specific stuff)
 //----------------------------------------------------------------
-void Neutrino_NuLib::myInit(Lua* /*lua*/)
+void Neutrino_NuLib::myInit(Lua* /*lua*/, Grid* /*grid*/)
 {
 // do nothing
 }
@@ -57,30 +57,49 @@ void Neutrino_NuLib::set_eas(const size_t z_ind, Grid* grid) const
 	size_t dir_ind[NDIMS+1];
 	grid->rho.indices(z_ind,dir_ind);
 
-	vector<double> tmp_absopac(ngroups), tmp_scatopac(ngroups);
-	vector< vector<double> > tmp_delta(ngroups, vector<double>(ngroups)); //[igin][igout]
-	vector< vector<double> > tmp_partial_opac(ngroups, vector<double>(ngroups));  //[igin][igout]
+	// inelastic kernels only if the grid stores them
+	const bool inelastic = grid->has_inelastic(ID);
+	ScratchFrame scratch;
+	Span<double> tmp_absopac  = scratch.allocate(ngroups);
+	Span<double> tmp_scatopac = scratch.allocate(ngroups);
+	Span<double> tmp_delta, tmp_partial_opac; //[igin][igout]
+	if(inelastic){
+		tmp_delta        = scratch.allocate(ngroups*ngroups);
+		tmp_partial_opac = scratch.allocate(ngroups*ngroups);
+	}
 	nulib_get_eas_arrays(grid->rho[z_ind], grid->T[z_ind], grid->Ye[z_ind], ID,
 			tmp_absopac, tmp_scatopac, tmp_partial_opac, tmp_delta);
 
-	if(ID==0) grid->munue[z_ind] = nulib_eos_munue(grid->rho[z_ind], grid->T[z_ind], grid->Ye[z_ind]);
+	set_munue(z_ind, grid);
 	for(size_t igin=0; igin<ngroups; igin++){
 		dir_ind[NDIMS] = igin;
-		size_t global_index = grid->abs_opac[ID].direct_index(dir_ind);
-		grid->abs_opac[ID][global_index] = tmp_absopac[igin];
-		grid->scat_opac[ID][global_index] = tmp_scatopac[igin];
-
-		if(grid->inelastic_scat_opac[ID].size()>0){
-			grid->inelastic_scat_opac[ID][global_index] = 0;
-			for(size_t igout=0; igout<ngroups; igout++){
-				grid->partial_scat_opac[ID][igout][global_index] = tmp_partial_opac[igin][igout];
-				grid->inelastic_scat_opac[ID][global_index] += grid->partial_scat_opac[ID][igout][global_index];
-				grid->scattering_delta[ID][igout][global_index] = tmp_delta[igin][igout];
-			}
-		}
+		size_t global_index = grid->opac[ID].direct_index(dir_ind);
+		grid->opac[ID][global_index][OPAC_ABS]  = tmp_absopac[igin];
+		grid->opac[ID][global_index][OPAC_SCAT] = tmp_scatopac[igin];
+		grid->opac[ID][global_index][OPAC_INELASTIC] = 0;
 	}
+	if(inelastic) grid->set_inelastic_kernel(ID, z_ind, tmp_partial_opac, tmp_delta);
+}
+
+//-----------------------------------------------------------------
+// abs. and scat. opacity in one zone without touching the grid.
+// Inelastic kernels are not supported here (see Transport::init)
+//-----------------------------------------------------------------
+void Neutrino_NuLib::get_eas(const size_t z_ind, const Grid* grid, double* absopac, double* scatopac) const
+{
+	size_t ngroups = grid->nu_grid_axis.size();
+	nulib_get_eas_arrays(grid->rho[z_ind], grid->T[z_ind], grid->Ye[z_ind], ID,
+			Span<double>(absopac,ngroups), Span<double>(scatopac,ngroups), Span<double>(), Span<double>());
+}
+
+bool Neutrino_NuLib::has_inelastic_scattering() const{
+	return nulib_has_inelastic_kernels();
+}
+
+void Neutrino_NuLib::set_munue(const size_t z_ind, Grid* grid) const{
+	if(ID==0) grid->munue[z_ind] = nulib_eos_munue(grid->rho[z_ind], grid->T[z_ind], grid->Ye[z_ind]);
 }
 
-void Neutrino_NuLib::get_annihil_kernels(const double rho, const double T, const double Ye, const Axis& /*nuAxis*/, vector< vector< vector<double> > >& phi) const{
+void Neutrino_NuLib::get_annihil_kernels(const double rho, const double T, const double Ye, const Axis& /*nuAxis*/, const Span<double>& phi) const{
 	nulib_get_epannihil_kernels(rho, T, Ye, ID, phi);
 }
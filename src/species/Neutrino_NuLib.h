@@ -39,9 +39,12 @@ public:
 
 	Neutrino_NuLib();
 
-	void myInit(Lua* lua);
+	void myInit(Lua* lua, Grid* grid);
 	void set_eas(const size_t z_ind, Grid* grid) const;
-	void get_annihil_kernels(const double rho, const double T, const double Ye, const Axis& nuAxis, vector< vector< vector<double> > >& phi) const;
+	void get_eas(const size_t z_ind, const Grid* grid, double* absopac, double* scatopac) const;
+	bool has_inelastic_scattering() const;
+	void set_munue(const size_t z_ind, Grid* grid) const;
+	void get_annihil_kernels(const double rho, const double T, const double Ye, const Axis& nuAxis, const Span<double>& phi) const;
 };
 
 #endif
@@ -43,7 +43,7 @@ Neutrino_grey::Neutrino_grey(){
 //----------------------------------------------------------------
 // called from species_general::init (neutrino-specific stuff)
 //----------------------------------------------------------------
-void Neutrino_grey::myInit(Lua* lua)
+void Neutrino_grey::myInit(Lua* lua, Grid* /*grid*/)
 {
 	Neutrino_grey_abs_frac = lua->scalar<double>("Neutrino_grey_abs_frac");
 	Neutrino_grey_opac     = lua->scalar<double>("Neutrino_grey_opac");
@@ -62,25 +62,35 @@ void Neutrino_grey::set_eas(const size_t z_ind, Grid* grid) const
 
 	PRINT_ASSERT(Neutrino_grey_abs_frac,>=,0);
 	PRINT_ASSERT(Neutrino_grey_abs_frac,<=,1.0);
-	grid->munue[z_ind] = Neutrino_grey_chempot;
+	set_munue(z_ind, grid);
 	for(size_t j=0;j<grid->nu_grid_axis.size();j++)
 	{
 		dir_ind[NDIMS] = j;
-		size_t global_index = grid->abs_opac[ID].direct_index(dir_ind);
+		size_t global_index = grid->opac[ID].direct_index(dir_ind);
 
 		double a = Neutrino_grey_opac*grid->rho[z_ind]*Neutrino_grey_abs_frac;
 		double s = Neutrino_grey_opac*grid->rho[z_ind]*(1.0-Neutrino_grey_abs_frac);
 		PRINT_ASSERT(a,>=,0);
 		PRINT_ASSERT(s,>=,0);
 
-		grid->abs_opac[ID][global_index] = a;        // (1/cm)
-		grid->scat_opac[ID][global_index] = s;        // (1/cm)
+		grid->opac[ID][global_index][OPAC_ABS]  = a;        // (1/cm)
+		grid->opac[ID][global_index][OPAC_SCAT] = s;        // (1/cm)
+		grid->opac[ID][global_index][OPAC_INELASTIC] = 0;   // no inelastic scattering
+	}
+}
 
-		if(grid->inelastic_scat_opac[ID].size()>0){
-			grid->inelastic_scat_opac[ID][global_index] = 0;
-			grid->scattering_delta[ID][j].wipe();
-			grid->partial_scat_opac[ID][j].wipe();
-		}
+void Neutrino_grey::get_eas(const size_t z_ind, const Grid* grid, double* absopac, double* scatopac) const
+{
+	const double a = Neutrino_grey_opac*grid->rho[z_ind]*Neutrino_grey_abs_frac;
+	const double s = Neutrino_grey_opac*grid->rho[z_ind]*(1.0-Neutrino_grey_abs_frac);
+	PRINT_ASSERT(a,>=,0);
+	PRINT_ASSERT(s,>=,0);
+	for(size_t j=0;j<grid->nu_grid_axis.size();j++){
+		absopac[j]  = a; // (1/cm)
+		scatopac[j] = s; // (1/cm)
 	}
 }
 
+void Neutrino_grey::set_munue(const size_t z_ind, Grid* grid) const{
+	grid->munue[z_ind] = Neutrino_grey_chempot;
+}
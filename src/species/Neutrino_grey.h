@@ -44,8 +44,10 @@ public:
 
 	Neutrino_grey();
 
-	void myInit(Lua* lua);
+	void myInit(Lua* lua, Grid* grid);
 	void set_eas(const size_t z_ind, Grid* grid) const;
+	void get_eas(const size_t z_ind, const Grid* grid, double* absopac, double* scatopac) const;
+	void set_munue(const size_t z_ind, Grid* grid) const;
 };
 
 #endif
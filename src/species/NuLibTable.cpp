@@ -0,0 +1,307 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors 
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "H5Cpp.h"
+#include "global_options.h"
+#include "NuLibTable.h"
+
+using namespace std;
+
+// the emissivities and opacities are interpolated in log space
+static const char* eas_dataset_names[4] = {"emissivities", "absorption_opacity", "scattering_opacity", "scattering_delta"};
+static const int n_log_eas_variables = 3;
+
+// binary files start with this header, followed by energies, ewidths,
+// ebottom, etop, logrho, logtemp, ye, and data as native doubles
+struct NuLibTableHeader{
+	char magic[8];
+	int32_t nspecies, ngroups, nvars;
+	int32_t nrho, ntemp, nye;
+	int64_t source_size, source_mtime;
+};
+static const char binary_magic[8] = {'S','N','U','L','I','B','2','\0'};
+
+// size of a binary file with the dimensions in the header
+static size_t binary_size(const NuLibTableHeader& h){
+	const size_t naxis = 4*(size_t)h.ngroups + h.nrho + h.ntemp + h.nye;
+	const size_t ndata = (size_t)h.nrho*h.ntemp*h.nye * h.nvars*h.ngroups*h.nspecies;
+	return sizeof(NuLibTableHeader) + (naxis+ndata)*sizeof(double);
+}
+static bool header_is_valid(const NuLibTableHeader& h){
+	return memcmp(h.magic, binary_magic, sizeof(binary_magic))==0
+			and h.nspecies>0 and h.ngroups>0 and (h.nvars==3 or h.nvars==4)
+			and h.nrho>1 and h.ntemp>1 and h.nye>1;
+}
+static bool stat_file(const string filename, int64_t* size, int64_t* mtime){
+	struct stat st;
+	if(stat(filename.c_str(), &st)!=0) return false;
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+	return true;
+}
+
+NuLibTable::~NuLibTable(){
+	unmap();
+}
+void NuLibTable::unmap(){
+	if(mapping!=NULL) munmap(mapping, mapping_size);
+	mapping = NULL;
+	mapping_size = 0;
+}
+
+//---------------------------------------------------------
+// read one dataset into a vector, checking its dimensions
+//---------------------------------------------------------
+template<typename T>
+void read_nulib_dataset(H5::H5File& file, const char* name, const H5::PredType& type,
+		const vector<hsize_t>& expected_dims, vector<T>& result){
+	H5::DataSet dataset = file.openDataSet(name);
+	H5::DataSpace dataspace = dataset.getSpace();
+	PRINT_ASSERT(dataspace.getSimpleExtentNdims(),==,(int)expected_dims.size());
+	vector<hsize_t> dims(expected_dims.size());
+	dataspace.getSimpleExtentDims(&dims[0]);
+	size_t n = 1;
+	for(size_t d=0; d<dims.size(); d++){
+		PRINT_ASSERT(dims[d],==,expected_dims[d]);
+		n *= dims[d];
+	}
+	result.resize(n);
+	dataset.read(&result[0], type);
+	dataset.close();
+}
+
+//------------------------------------------------------------------
+// Read the table points and eas variables and transpose the eas
+// variables so each (rho,T,Ye) point has one contiguous record.
+// NuLib writes them from Fortran with dimensions
+// (rho,T,Ye,species,group), which appear reversed from C.
+//------------------------------------------------------------------
+void NuLibTable::read(const string filename){
+	H5::H5File file(filename, H5F_ACC_RDONLY);
+	vector<int> itmp;
+	vector<hsize_t> scalar(1,1);
+	read_nulib_dataset(file, "number_species", H5::PredType::NATIVE_INT, scalar, itmp); nspecies = itmp[0];
+	read_nulib_dataset(file, "number_groups",  H5::PredType::NATIVE_INT, scalar, itmp); ngroups  = itmp[0];
+	read_nulib_dataset(file, "nrho",           H5::PredType::NATIVE_INT, scalar, itmp); const size_t nrho  = itmp[0];
+	read_nulib_dataset(file, "ntemp",          H5::PredType::NATIVE_INT, scalar, itmp); const size_t ntemp = itmp[0];
+	read_nulib_dataset(file, "nye",            H5::PredType::NATIVE_INT, scalar, itmp); const size_t nye   = itmp[0];
+	PRINT_ASSERT(nspecies,>,0);
+	PRINT_ASSERT(ngroups,>,0);
+	PRINT_ASSERT(nrho,>,1);
+	PRINT_ASSERT(ntemp,>,1);
+	PRINT_ASSERT(nye,>,1);
+
+	const vector<hsize_t> group_dims(1,ngroups);
+	read_nulib_dataset(file, "neutrino_energies", H5::PredType::NATIVE_DOUBLE, group_dims, energies);
+	read_nulib_dataset(file, "bin_widths",        H5::PredType::NATIVE_DOUBLE, group_dims, ewidths);
+	read_nulib_dataset(file, "bin_bottom",        H5::PredType::NATIVE_DOUBLE, group_dims, ebottom);
+	read_nulib_dataset(file, "bin_top",           H5::PredType::NATIVE_DOUBLE, group_dims, etop);
+	read_nulib_dataset(file, "rho_points",  H5::PredType::NATIVE_DOUBLE, vector<hsize_t>(1,nrho),  logrho);
+	read_nulib_dataset(file, "temp_points", H5::PredType::NATIVE_DOUBLE, vector<hsize_t>(1,ntemp), logtemp);
+	read_nulib_dataset(file, "ye_points",   H5::PredType::NATIVE_DOUBLE, vector<hsize_t>(1,nye),   ye);
+	for(size_t i=0; i<nrho;  i++) logrho[i]  = log10(logrho[i]);
+	for(size_t i=0; i<ntemp; i++) logtemp[i] = log10(logtemp[i]);
+
+	nvars = hdf5_dataset_exists(filename.c_str(), "/scattering_delta") ? 4 : 3;
+	unmap();
+	storage.resize(data_size());
+	vector<hsize_t> dims = {(hsize_t)ngroups, (hsize_t)nspecies, (hsize_t)nye, (hsize_t)ntemp, (hsize_t)nrho};
+	vector<double> buffer;
+	for(int v=0; v<nvars; v++){
+		read_nulib_dataset(file, eas_dataset_names[v], H5::PredType::NATIVE_DOUBLE, dims, buffer);
+		#pragma omp parallel for collapse(2)
+		for(int g=0; g<ngroups; g++)
+			for(int s=0; s<nspecies; s++)
+				for(size_t iye=0; iye<nye; iye++)
+					for(size_t itemp=0; itemp<ntemp; itemp++)
+						for(size_t irho=0; irho<nrho; irho++){
+							double value = buffer[(((g*nspecies + s)*nye + iye)*ntemp + itemp)*nrho + irho];
+							if(v<n_log_eas_variables) value = log10(max(value, numeric_limits<double>::min()));
+							storage[record_index(irho,itemp,iye) + (v*ngroups + g)*nspecies + s] = value;
+						}
+	}
+	file.close();
+	data = &storage[0];
+	if(not stat_file(filename, &source_size, &source_mtime)) source_size = source_mtime = -1;
+}
+
+//-----------------------------------------------------------
+// Save the transposed table. It is written to a temporary
+// file and renamed so other ranks never map a partial file.
+//-----------------------------------------------------------
+void NuLibTable::write_binary(const string filename) const{
+	PRINT_ASSERT(loaded(),==,true);
+	NuLibTableHeader header;
+	memcpy(header.magic, binary_magic, sizeof(binary_magic));
+	header.nspecies = nspecies;
+	header.ngroups  = ngroups;
+	header.nvars    = nvars;
+	header.nrho     = logrho.size();
+	header.ntemp    = logtemp.size();
+	header.nye      = ye.size();
+	header.source_size  = source_size;
+	header.source_mtime = source_mtime;
+
+	const string tmp_filename = filename + ".tmp" + to_string(getpid());
+	ofstream outf(tmp_filename.c_str(), ios::binary);
+	outf.write((const char*)&header, sizeof(header));
+	outf.write((const char*)&energies[0], ngroups*sizeof(double));
+	outf.write((const char*)&ewidths[0],  ngroups*sizeof(double));
+	outf.write((const char*)&ebottom[0],  ngroups*sizeof(double));
+	outf.write((const char*)&etop[0],     ngroups*sizeof(double));
+	outf.write((const char*)&logrho[0],  logrho.size() *sizeof(double));
+	outf.write((const char*)&logtemp[0], logtemp.size()*sizeof(double));
+	outf.write((const char*)&ye[0],      ye.size()     *sizeof(double));
+	outf.write((const char*)data,        data_size()   *sizeof(double));
+	outf.close();
+	if(not outf or rename(tmp_filename.c_str(), filename.c_str())!=0){
+		cout << "ERROR: could not write NuLib binary table " << filename << endl;
+		exit(5);
+	}
+}
+
+//-----------------------------------------------------------
+// Map a file written by write_binary. The table data are used
+// in place; only the small axes are copied.
+//-----------------------------------------------------------
+void NuLibTable::map_binary(const string filename){
+	unmap();
+	storage.clear();
+	const int fd = open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if(fd<0 or fstat(fd,&st)!=0 or (size_t)st.st_size<sizeof(NuLibTableHeader)){
+		cout << "ERROR: could not open NuLib binary table " << filename << endl;
+		exit(5);
+	}
+	mapping_size = st.st_size;
+	mapping = mmap(NULL, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mapping==MAP_FAILED){
+		mapping = NULL;
+		cout << "ERROR: could not map NuLib binary table " << filename << endl;
+		exit(5);
+	}
+
+	const NuLibTableHeader* header = (const NuLibTableHeader*)mapping;
+	if(not header_is_valid(*header)){
+		cout << "ERROR: " << filename << " is not a NuLib binary table of this version" << endl;
+		exit(5);
+	}
+	if(binary_size(*header)!=mapping_size){
+		cout << "ERROR: NuLib binary table " << filename << " has " << mapping_size << " bytes but its header describes " << binary_size(*header) << endl;
+		exit(5);
+	}
+	nspecies = header->nspecies;
+	ngroups  = header->ngroups;
+	nvars    = header->nvars;
+	source_size  = header->source_size;
+	source_mtime = header->source_mtime;
+	const double* p = (const double*)(header+1);
+	energies.assign(p, p+ngroups); p += ngroups;
+	ewidths.assign( p, p+ngroups); p += ngroups;
+	ebottom.assign( p, p+ngroups); p += ngroups;
+	etop.assign(    p, p+ngroups); p += ngroups;
+	logrho.assign( p, p+header->nrho);  p += header->nrho;
+	logtemp.assign(p, p+header->ntemp); p += header->ntemp;
+	ye.assign(     p, p+header->nye);   p += header->nye;
+	data = p;
+}
+
+//-----------------------------------------------------------
+// Whether binary_filename is a complete binary table made
+// from source_filename as it is now. Only the header is read.
+//-----------------------------------------------------------
+bool NuLibTable::binary_is_current(const string binary_filename, const string source_filename){
+	NuLibTableHeader header;
+	int64_t binary_bytes, binary_mtime, source_bytes, mtime;
+	if(not stat_file(binary_filename, &binary_bytes, &binary_mtime)) return false;
+	if(not stat_file(source_filename, &source_bytes, &mtime)) return false;
+	ifstream inf(binary_filename.c_str(), ios::binary);
+	if(not inf.read((char*)&header, sizeof(header))) return false;
+	return header_is_valid(header)
+			and (int64_t)binary_size(header)==binary_bytes
+			and header.source_size==source_bytes
+			and header.source_mtime==mtime;
+}
+
+//-----------------------------------------------------------
+// lower table index and weight of the upper point, clamped
+// to the table edges
+//-----------------------------------------------------------
+void NuLibTable::locate(const vector<double>& x, const double val, size_t* i, double* w){
+	const size_t upper = upper_bound(x.begin(), x.end(), val) - x.begin();
+	*i = min(max(upper,(size_t)1), x.size()-1) - 1;
+	*w = (val - x[*i]) / (x[*i+1] - x[*i]);
+	*w = min(1.0, max(0.0, *w));
+}
+
+//--------------------------------------------
+// trilinear interpolation of many points
+//--------------------------------------------
+void NuLibTable::interpolate_eas(const size_t n, const double* rho, const double* temp,
+		const double* ye_in, double* eas) const{
+	PRINT_ASSERT(loaded(),==,true);
+	const size_t nrec = record_size();
+	const size_t nlog = (size_t)n_log_eas_variables*ngroups*nspecies;
+
+	for(size_t p=0; p<n; p++){
+		size_t irho, itemp, iye;
+		double wrho, wtemp, wye;
+		locate(logrho,  log10(rho[p]),  &irho,  &wrho);
+		locate(logtemp, log10(temp[p]), &itemp, &wtemp);
+		locate(ye,      ye_in[p],       &iye,   &wye);
+
+		// the eight corners of the cube and their weights
+		const double* corner[8];
+		double weight[8];
+		for(size_t c=0; c<8; c++){
+			const size_t dr = c&1, dt = (c>>1)&1, dy = (c>>2)&1;
+			corner[c] = &data[record_index(irho+dr, itemp+dt, iye+dy)];
+			weight[c] = (dr ? wrho : 1.-wrho) * (dt ? wtemp : 1.-wtemp) * (dy ? wye : 1.-wye);
+		}
+
+		double* result = eas + p*nrec;
+		#pragma omp simd
+		for(size_t k=0; k<nrec; k++){
+			result[k] = weight[0]*corner[0][k] + weight[1]*corner[1][k]
+			          + weight[2]*corner[2][k] + weight[3]*corner[3][k]
+			          + weight[4]*corner[4][k] + weight[5]*corner[5][k]
+			          + weight[6]*corner[6][k] + weight[7]*corner[7][k];
+		}
+		for(size_t k=0; k<nlog; k++) result[k] = pow(10.0, result[k]);
+	}
+}
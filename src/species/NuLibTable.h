@@ -0,0 +1,88 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors 
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#ifndef _NULIB_TABLE_H
+#define _NULIB_TABLE_H 1
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+//===========//
+// NuLibTable //
+//===========//
+// Native reader and interpolator for the eas part of a NuLib HDF5
+// table. Interpolation is trilinear in (log10 rho, log10 T, Ye) on
+// log10 of the emissivities and opacities (and linear on scattering
+// delta), the same scheme as NuLib's Fortran routines. Every
+// (rho,T,Ye) table point holds one contiguous record of all
+// variables, groups, and species, so a lookup is eight streaming
+// passes over neighboring memory that vectorize across groups.
+// The transposed table can be saved in a flat binary file that is
+// memory-mapped read-only, so all ranks on a node share the one
+// copy in the page cache and nothing has to be transposed again.
+// The binary file records the size and modification time of the
+// HDF5 table it came from so a stale copy can be detected.
+class NuLibTable{
+public:
+	int nspecies, ngroups, nvars;
+	std::vector<double> energies, ewidths, ebottom, etop; // energy groups (MeV)
+	std::vector<double> logrho, logtemp, ye; // table points (log10 g/ccm, log10 MeV, 1)
+	const double* data;                      // [irho][itemp][iye][var][group][species]
+	int64_t source_size, source_mtime;       // stat of the HDF5 table (bytes, s)
+
+	NuLibTable() : nspecies(0), ngroups(0), nvars(0), data(NULL), source_size(-1), source_mtime(-1), mapping(NULL), mapping_size(0) {}
+	~NuLibTable();
+
+	void read(const std::string filename);
+	void write_binary(const std::string filename) const;
+	void map_binary(const std::string filename);
+	static bool binary_is_current(const std::string binary_filename, const std::string source_filename);
+	bool loaded() const {return data!=NULL;}
+	size_t record_size() const {return (size_t)nvars*ngroups*nspecies;}
+	size_t data_size() const {return logrho.size()*logtemp.size()*ye.size()*record_size();}
+
+	// fill eas[i*record_size() + (var*ngroups + group)*nspecies + species]
+	// for n points. Points outside the table use the nearest table edge.
+	void interpolate_eas(const size_t n, const double* rho /*g/ccm*/, const double* temp /*MeV*/,
+			const double* ye_in, double* eas) const;
+
+private:
+	std::vector<double> storage; // data read from HDF5
+	void* mapping;               // data mapped from a binary file
+	size_t mapping_size;
+	NuLibTable(const NuLibTable&);
+	NuLibTable& operator=(const NuLibTable&);
+	void unmap();
+
+	size_t record_index(const size_t irho, const size_t itemp, const size_t iye) const{
+		return ((irho*logtemp.size() + itemp)*ye.size() + iye) * record_size();
+	}
+	static void locate(const std::vector<double>& x, const double val, size_t* i, double* w);
+};
+
+#endif
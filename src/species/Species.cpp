@@ -50,7 +50,7 @@ Species::Species(){
 	core_lum_multiplier = NaN;
 }
 
-void Species::init(Lua* lua)
+void Species::init(Lua* lua, Grid* grid)
 {
 	// set lepton number
 	if(ID == 0)   lepton_number =  1;
@@ -82,11 +82,17 @@ void Species::init(Lua* lua)
 	//============================//
 	// CALL CHILD'S INIT FUNCTION //
 	//============================//
-	myInit(lua);
+	myInit(lua, grid);
+}
+
+// species that can only fill the grid arrays don't support lazy opacities
+void Species::get_eas(const size_t /*z_ind*/, const Grid* /*grid*/, double* /*absopac*/, double* /*scatopac*/) const{
+	cout << "ERROR: " << name << " cannot evaluate opacities one zone at a time. Set opacity_cache_blocks=0." << endl;
+	exit(5);
 }
 
 // cm^3/s
-void Species::get_annihil_kernels(const double /*rho*/, const double /*T*/, const double /*Ye*/, const Axis& nuAxis, vector< vector< vector<double> > >& phi) const{
+void Species::get_annihil_kernels(const double /*rho*/, const double /*T*/, const double /*Ye*/, const Axis& nuAxis, const Span<double>& phi) const{
 	// constants
 	using namespace pc;
 	double mec2 = m_e*c*c; // erg
@@ -104,13 +110,11 @@ void Species::get_annihil_kernels(const double /*rho*/, const double /*T*/, cons
 	double C1pC2_3 = C1pC2/3.0;
 	double mec22 = mec2*mec2;
 	size_t nnu = nuAxis.size();
-
-	phi.resize(3);
-	for(size_t k=0; k<3; k++) phi[k].resize(nnu);
+	PRINT_ASSERT(phi.size(),==,2*nnu*nnu);
+	phi.fill(0);
 
 	for(size_t inu=0; inu<nnu; inu++){
 		double avg_e = nuAxis.mid[inu]*pc::h; // erg
-		for(size_t k=0; k<3; k++) phi[k][inu].resize(nnu);
 
 		for(size_t inubar=0; inubar<nnu; inubar++){
 			double avg_ebar = nuAxis.mid[inubar]*pc::h; // erg
@@ -122,14 +126,19 @@ void Species::get_annihil_kernels(const double /*rho*/, const double /*T*/, cons
 			double B = C1pC2_3;
 			double C = C3mec4_eebar;
 			if(eebar > mec22){
-				phi[0][inu][inubar] =  2.*A*(4.*B/3. + C);
-				phi[1][inu][inubar] = -2./3.*A*(2.*B + C);
-				phi[2][inu][inubar] =  4./15.*A*B;
-				PRINT_ASSERT(phi[0][inu][inubar],>=,0);
+				// phi2 is not stored. Users recompute it as -(phi0+3*phi1)/5
+				const double phi0 =  2.*A*(4.*B/3. + C);
+				const double phi1 = -2./3.*A*(2.*B + C);
+				phi[        inu*nnu+inubar] = phi0;
+				phi[nnu*nnu+inu*nnu+inubar] = phi1;
+				PRINT_ASSERT(phi0,>=,0);
+#if DEBUG==1
 				// sanity checks. format: coeff*phi*P(n,x)
-				PRINT_ASSERT((1./2.*phi[0][inu][inubar] + 3./2.*phi[1][inu][inubar]*( 1  ) + 5./2.*phi[2][inu][inubar]*(1   ))/phi[0][inu][inubar],>=,-TINY); // x= 1
-				PRINT_ASSERT((1./2.*phi[0][inu][inubar] + 3./2.*phi[1][inu][inubar]*(-1  ) + 5./2.*phi[2][inu][inubar]*(1   ))/phi[0][inu][inubar],>=,-TINY); // x=-1
-				PRINT_ASSERT((1./2.*phi[0][inu][inubar] + 3./2.*phi[1][inu][inubar]*( 0  ) + 5./2.*phi[2][inu][inubar]*(-0.5))/phi[0][inu][inubar],>=,-TINY); // x= 0
+				const double phi2 =  4./15.*A*B;
+				PRINT_ASSERT((1./2.*phi0 + 3./2.*phi1*( 1  ) + 5./2.*phi2*(1   ))/phi0,>=,-TINY); // x= 1
+				PRINT_ASSERT((1./2.*phi0 + 3./2.*phi1*(-1  ) + 5./2.*phi2*(1   ))/phi0,>=,-TINY); // x=-1
+				PRINT_ASSERT((1./2.*phi0 + 3./2.*phi1*( 0  ) + 5./2.*phi2*(-0.5))/phi0,>=,-TINY); // x= 0
+#endif
 
 			}
 		}
@@ -31,6 +31,7 @@
 #include <vector>
 #include "LuaRead.h"
 #include "MultiDArray.h"
+#include "ScratchArena.h"
 #include "Grid.h"
 
 class Transport;
@@ -41,7 +42,7 @@ class Species
 public:
 
 	// species-specific initialization stuff
-	virtual void myInit(Lua* lua) = 0;
+	virtual void myInit(Lua* lua, Grid* grid) = 0;
 
 public:
 
@@ -64,11 +65,24 @@ public:
 	double core_lum_multiplier;
 
 	// set everything up
-	void init(Lua* lua);
+	void init(Lua* lua, Grid* grid);
 
 	// set the emissivity, absorption opacity, and scattering opacity
 	virtual void set_eas(const size_t z_ind, Grid* grid) const = 0;
-	virtual void get_annihil_kernels(const double rho, const double T, const double Ye, const Axis& nuAxis, vector< vector< vector<double> > >& phi) const;
+
+	// absorption and scattering opacity of every group in one zone, without
+	// touching the grid arrays (used when opacities are evaluated lazily)
+	virtual void get_eas(const size_t z_ind, const Grid* grid, double* absopac, double* scatopac) const;
+
+	// whether set_eas can give nonzero inelastic scattering kernels.
+	// The grid only stores kernels for species that do.
+	virtual bool has_inelastic_scattering() const {return false;}
+
+	// set the electron neutrino chemical potential if this species provides it
+	virtual void set_munue(const size_t /*z_ind*/, Grid* /*grid*/) const {}
+
+	// Legendre moments 0 and 1 of the annihilation kernel, [order][inu][inubar] (cm^3/s)
+	virtual void get_annihil_kernels(const double rho, const double T, const double Ye, const Axis& nuAxis, const Span<double>& phi) const;
 };
 
 
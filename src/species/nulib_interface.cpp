@@ -29,10 +29,12 @@
 #include <cmath>
 #include <string>
 #include <cstdlib>
+#include <fstream>
 #include "nulib_interface.h"
 #include "global_options.h"
 #include "H5Cpp.h"
 #include "Axis.h"
+#include "NuLibTable.h"
 
 using namespace std;
 namespace pc = physical_constants;
@@ -113,6 +115,11 @@ int     read_Ielectron;
 int     read_epannihil;
 int     read_delta;
 
+// the native C++ interpolator, used for eas lookups if it has been read
+static NuLibTable native_table;
+static bool use_native = false;
+static bool fortran_loaded = false;
+
 // The format of the fortran variables the fortran compiler provides
 // assumes C and Fortran compilers are the same
 // To be copied into the universal globals if intel compiler
@@ -269,6 +276,59 @@ int nulib_get_nspecies(){
 	return nulibtable_number_species;
 }
 
+bool nulib_has_inelastic_kernels(){
+	return read_Ielectron;
+}
+
+// output some facts about the table
+static void nulib_print_table_info(){
+	int my_rank=-1;
+	MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
+	if(my_rank==0){
+		cout << "#   rho range: {" << nulib_get_rhomin() << "," << nulib_get_rhomax() << "} g/ccm" << endl;
+		cout << "#   T   range: {" << nulib_get_Tmin()*pc::k_MeV << "," << nulib_get_Tmax()*pc::k_MeV << "} MeV" << endl;
+		cout << "#   Ye  range: {" << nulib_get_Yemin() << "," << nulib_get_Yemax() << "}" << endl;
+		cout << "#   E   range: {" << nulibtable_ebottom[0] << "," << nulibtable_etop[nulibtable_number_groups-1] << "} MeV" << endl;
+		cout << "#   n_rho   = " << nulibtable_nrho << endl;
+		cout << "#   n_T     = " << nulibtable_ntemp << endl;
+		cout << "#   n_Ye    = " << nulibtable_nye << endl;
+		cout << "#   n_E     = " << nulibtable_number_groups << endl;
+		cout << "#   n_Ieta  = " << nulibtable_nIeta << endl;
+		cout << "#   n_Itemp = " << nulibtable_nItemp << endl;
+	}
+}
+
+// point the universal globals at the native table when
+// the Fortran module does not hold a copy
+static void nulib_set_globals_native(){
+	nulibtable_number_species      = native_table.nspecies;
+	nulibtable_number_easvariables = native_table.nvars;
+	nulibtable_number_groups       = native_table.ngroups;
+	nulibtable_nrho                = native_table.logrho.size();
+	nulibtable_ntemp               = native_table.logtemp.size();
+	nulibtable_nye                 = native_table.ye.size();
+	nulibtable_nItemp              = 0;
+	nulibtable_nIeta               = 0;
+	nulibtable_energies            = &native_table.energies[0];
+	nulibtable_ewidths             = &native_table.ewidths[0];
+	nulibtable_ebottom             = &native_table.ebottom[0];
+	nulibtable_etop                = &native_table.etop[0];
+	nulibtable_logrho              = &native_table.logrho[0];
+	nulibtable_logtemp             = &native_table.logtemp[0];
+	nulibtable_ye                  = &native_table.ye[0];
+	nulibtable_logItemp            = NULL;
+	nulibtable_logIeta             = NULL;
+	nulibtable_logrho_min          = native_table.logrho.front();
+	nulibtable_logrho_max          = native_table.logrho.back();
+	nulibtable_logtemp_min         = native_table.logtemp.front();
+	nulibtable_logtemp_max         = native_table.logtemp.back();
+	nulibtable_ye_min              = native_table.ye.front();
+	nulibtable_ye_max              = native_table.ye.back();
+	read_Ielectron = 0;
+	read_epannihil = 0;
+	read_delta = (native_table.nvars==4);
+}
+
 /**************/
 /* nulib_init */
 /**************/
@@ -283,22 +343,67 @@ void nulib_init(string filename){
 
 	nulibtable_reader_((char*)filename.c_str(), &read_Ielectron, &read_epannihil, &read_delta, filename.length());
 	nulibtable_set_globals();
+	fortran_loaded = true;
+	nulib_print_table_info();
+}
 
-	// output some facts about the table
-	int my_rank=-1;
-	MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
-	if(my_rank==0){
-		cout << "#   rho range: {" << nulib_get_rhomin() << "," << nulib_get_rhomax() << "} g/ccm" << endl;
-		cout << "#   T   range: {" << nulib_get_Tmin()*pc::k_MeV << "," << nulib_get_Tmax()*pc::k_MeV << "} MeV" << endl;
-		cout << "#   Ye  range: {" << nulib_get_Yemin() << "," << nulib_get_Yemax() << "}" << endl;
-		cout << "#   E   range: {" << nulibtable_ebottom[0] << "," << nulibtable_etop[nulibtable_number_groups-1] << "} MeV" << endl;
-		cout << "#   n_rho   = " << nulibtable_nrho << endl;
-		cout << "#   n_T     = " << nulibtable_ntemp << endl;
-		cout << "#   n_Ye    = " << nulibtable_nye << endl;
-		cout << "#   n_E     = " << nulibtable_number_groups << endl;
-		cout << "#   n_Ieta  = " << nulibtable_nIeta << endl;
-		cout << "#   n_Itemp = " << nulibtable_nItemp << endl;
+// Whether the Fortran module has to hold the table. The native
+// interpolator covers everything but the inelastic and pair kernels.
+bool nulib_needs_fortran(string filename){
+	return hdf5_dataset_exists(filename.c_str(),"/inelastic_phi0")
+			or hdf5_dataset_exists(filename.c_str(),"/epannihil_phi0")
+			or hdf5_dataset_exists(filename.c_str(),"/bremsstrahlung_phi0");
+}
+
+/*******************************************/
+/* native C++ interpolation of eas tables  */
+/*******************************************/
+// read the table a second time into the native interpolator
+// and use it for all eas lookups from now on.
+// With a binary filename, all ranks map the preprocessed table,
+// which one rank creates from the HDF5 table if it does not exist.
+void nulib_native_init(string filename, string binary_filename){
+	if(binary_filename.empty()) native_table.read(filename);
+	else{
+		int my_rank=-1;
+		MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
+		if(my_rank==0 and not NuLibTable::binary_is_current(binary_filename, filename)){
+			if(ifstream(binary_filename.c_str()).good())
+				cout << "#   NuLib binary table " << binary_filename << " does not match " << filename << ". Rewriting it." << endl;
+			else cout << "#   Writing NuLib binary table " << binary_filename << endl;
+			NuLibTable table;
+			table.read(filename);
+			table.write_binary(binary_filename);
+		}
+		MPI_Barrier(MPI_COMM_WORLD);
+		if(not NuLibTable::binary_is_current(binary_filename, filename)){
+			cout << "ERROR: NuLib binary table " << binary_filename << " is out of date with " << filename << " on rank " << my_rank << endl;
+			exit(5);
+		}
+		native_table.map_binary(binary_filename);
 	}
+
+	if(fortran_loaded){
+		if(native_table.nspecies!=nulibtable_number_species or native_table.ngroups!=nulibtable_number_groups
+				or native_table.nvars!=nulibtable_number_easvariables or (int)native_table.logrho.size()!=nulibtable_nrho
+				or (int)native_table.logtemp.size()!=nulibtable_ntemp or (int)native_table.ye.size()!=nulibtable_nye){
+			cout << "ERROR: the native NuLib table does not have the dimensions of the table NuLib read" << endl;
+			exit(5);
+		}
+	}
+	else{
+		nulib_set_globals_native();
+		nulib_print_table_info();
+	}
+	use_native = true;
+}
+void nulib_set_native(const bool native){
+	PRINT_ASSERT(native_table.loaded() or not native,==,true);
+	PRINT_ASSERT(fortran_loaded or native,==,true);
+	use_native = native;
+}
+const NuLibTable& nulib_native_table(){
+	return native_table;
 }
 
 
@@ -310,8 +415,8 @@ void nulib_get_iscatter_kernels(
 		const double temp, // K
 		const double ye,
 		const int nulibID,
-		vector< vector<double> >& partial_opac,       // 2pi h^-3 c^-4 phi0 delta(E^3/3)/deltaE [group in][group out] units 1/cm
-		vector< vector<double> >& scattering_delta){  // 3.*phi1/phi0   [group_in][group_out]
+		const Span<double>& partial_opac,       // 2pi h^-3 c^-4 phi0 delta(E^3/3)/deltaE [group in][group out] units 1/cm
+		const Span<double>& scattering_delta){  // 3.*phi1/phi0   [group_in][group_out]
 
 	// fetch the relevant table from nulib. NuLib only accepts doubles.
 	double temp_MeV = temp * pc::k_MeV; // MeV
@@ -357,10 +462,11 @@ void nulib_get_iscatter_kernels(
 				PRINT_ASSERT(inelastic_partial_opac0,>=,0);
 				PRINT_ASSERT(abs(inelastic_partial_opac1),<=,3.*inelastic_partial_opac0);
 			}
-			partial_opac[igin][igout] = inelastic_partial_opac0;
-			scattering_delta[igin][igout] = (inelastic_partial_opac0==0 ? 0 : inelastic_partial_opac1 / inelastic_partial_opac0);
-			PRINT_ASSERT(abs(scattering_delta[igin][igout]),<=,3.0+TINY);
-			scattering_delta[igin][igout] = min(3., max(-3., scattering_delta[igin][igout]));
+			const size_t k = igin*nulibtable_number_groups + igout;
+			partial_opac[k] = inelastic_partial_opac0;
+			scattering_delta[k] = (inelastic_partial_opac0==0 ? 0 : inelastic_partial_opac1 / inelastic_partial_opac0);
+			PRINT_ASSERT(abs(scattering_delta[k]),<=,3.0+TINY);
+			scattering_delta[k] = min(3., max(-3., scattering_delta[k]));
 		}
 	}
 }
@@ -373,12 +479,10 @@ void nulib_get_epannihil_kernels(
 		const double temp, // K
 		const double ye,
 		const int nulibID,
-		vector< vector< vector<double> > >& phi){ // 2pi h^-3 c^-4 phi0 delta(E^3/3)/deltaE [group in][group out] units 1/cm/erg
-
-	// set up phi vector
-	phi.resize(2);
-	for(size_t i=0; i<2; i++)
-		phi[i] = vector< vector<double> >(nulibtable_number_groups, vector<double>(nulibtable_number_groups,0));
+		const Span<double>& phi){ // 2pi h^-3 c^-4 phi0 delta(E^3/3)/deltaE [order][group in][group out] units 1/cm/erg
+	const size_t ng = nulibtable_number_groups;
+	PRINT_ASSERT(phi.size(),==,2*ng*ng);
+	phi.fill(0);
 
 	// fetch the relevant table from nulib. NuLib only accepts doubles.
 	double temp_MeV = temp * pc::k_MeV; // MeV
@@ -410,14 +514,107 @@ void nulib_get_epannihil_kernels(
 	// set the arrays.
 	for(int igin=0; igin<nulibtable_number_groups; igin++){
 		for(int igout=0; igout<nulibtable_number_groups; igout++){
-			phi[0][igin][igout] = phi_tmp[1][igout][igin];
-			phi[1][igin][igout] = phi_tmp[3][igout][igin];
-			PRINT_ASSERT(phi[0][igin][igout],>=,0);
-			PRINT_ASSERT(abs(phi[1][igin][igout]),<=,phi[0][igin][igout]); // mathematically impossible to have phi1/phi0>9
+			const size_t k = igin*ng + igout;
+			phi[     k] = phi_tmp[1][igout][igin];
+			phi[ng*ng+k] = phi_tmp[3][igout][igin];
+			PRINT_ASSERT(phi[k],>=,0);
+			PRINT_ASSERT(abs(phi[ng*ng+k]),<=,phi[k]); // mathematically impossible to have phi1/phi0>9
 		}
 	}
 }
 
+/****************************/
+/* all-species eas lookups  */
+/****************************/
+// Every species in a zone needs the same interpolation, so the first
+// lookup at a (rho,T,Ye) gets all species from NuLib in one call and
+// keeps them for the rest. Each thread remembers its own last lookup.
+// The lookup goes through the native interpolator if it is in use.
+struct NuLibEASMemo{
+	double rho, temp_MeV, ye;
+	bool native;
+	vector<double> eas; // [easvariable][group][species]
+	NuLibEASMemo() : rho(-1), temp_MeV(-1), ye(-1), native(false) {}
+};
+static thread_local NuLibEASMemo eas_memo;
+
+// A thread that knows several fluid states up front (see
+// Transport::reset_radiation) interpolates them all in one
+// native interpolate_eas call, then selects each point in turn.
+// Lookups at the selected point are served from the batch.
+struct NuLibEASBatch{
+	vector<double> rho, temp_MeV, ye; // clamped the same way as nulib_get_eas_arrays
+	vector<double> eas;               // [point][easvariable][group][species]
+	long point;
+	NuLibEASBatch() : point(-1) {}
+};
+static thread_local NuLibEASBatch eas_batch;
+
+bool nulib_batch_available(){
+	return use_native;
+}
+void nulib_batch_eas(const size_t n, const double* rho, const double* temp, const double* ye){
+	PRINT_ASSERT(use_native,==,true);
+	eas_batch.rho.resize(n);
+	eas_batch.temp_MeV.resize(n);
+	eas_batch.ye.resize(n);
+	for(size_t i=0; i<n; i++){
+		eas_batch.rho[i] = rho[i];
+		eas_batch.temp_MeV[i] = temp[i] * pc::k_MeV;
+		eas_batch.ye[i] = max(nulibtable_ye_min, min(nulibtable_ye_max, ye[i]));
+	}
+	eas_batch.eas.resize(n*native_table.record_size());
+	if(n>0) native_table.interpolate_eas(n, &eas_batch.rho[0], &eas_batch.temp_MeV[0], &eas_batch.ye[0], &eas_batch.eas[0]);
+	eas_batch.point = -1;
+}
+void nulib_select_eas_point(const long i){
+	PRINT_ASSERT(i,<,(long)eas_batch.rho.size());
+	eas_batch.point = i;
+}
+
+// fill eas_energy[easvariable][group] for species lns (fortran index)
+static void nulib_get_eas_all_species(double rho, double temp_MeV, double ye, const int lns, double* eas_energy){
+	int nspecies = nulibtable_number_species;
+	int nvars    = nulibtable_number_easvariables;
+	int ngroups  = nulibtable_number_groups;
+	const long p = eas_batch.point;
+	if(use_native and p>=0 and rho==eas_batch.rho[p] and temp_MeV==eas_batch.temp_MeV[p] and ye==eas_batch.ye[p]){
+		const double* record = &eas_batch.eas[p*native_table.record_size()];
+		for(int v=0; v<nvars; v++)
+			for(int j=0; j<ngroups; j++)
+				eas_energy[v*ngroups + j] = record[(v*ngroups + j)*nspecies + lns-1];
+		return;
+	}
+	if(rho!=eas_memo.rho or temp_MeV!=eas_memo.temp_MeV or ye!=eas_memo.ye or use_native!=eas_memo.native){
+		eas_memo.eas.resize(nvars*ngroups*nspecies);
+		if(use_native) native_table.interpolate_eas(1, &rho, &temp_MeV, &ye, &eas_memo.eas[0]);
+		else nulibtable_range_species_range_energy_(&rho, &temp_MeV, &ye, &eas_memo.eas[0],
+				&nspecies, &ngroups, &nvars);
+		eas_memo.rho = rho;
+		eas_memo.temp_MeV = temp_MeV;
+		eas_memo.ye = ye;
+		eas_memo.native = use_native;
+	}
+	for(int v=0; v<nvars; v++)
+		for(int j=0; j<ngroups; j++)
+			eas_energy[v*ngroups + j] = eas_memo.eas[(v*ngroups + j)*nspecies + lns-1];
+}
+
+// every variable, group, and species at one point from the
+// interpolator currently in use, without the memo
+void nulib_get_eas_record(const double rho, const double temp, double ye, double* eas){
+	double rho_tmp = rho;
+	double temp_MeV = temp * pc::k_MeV;
+	ye = max(nulibtable_ye_min, min(nulibtable_ye_max, ye));
+	if(use_native) native_table.interpolate_eas(1, &rho_tmp, &temp_MeV, &ye, eas);
+	else{
+		int nspecies = nulibtable_number_species;
+		int nvars    = nulibtable_number_easvariables;
+		int ngroups  = nulibtable_number_groups;
+		nulibtable_range_species_range_energy_(&rho_tmp, &temp_MeV, &ye, eas, &nspecies, &ngroups, &nvars);
+	}
+}
+
 /**********************/
 /* get_nut_eas_arrays */
 /**********************/
@@ -426,10 +623,10 @@ void nulib_get_eas_arrays(
 		double rho,                     // g/cm^3
 		double temp,                    // K
 		double ye, int nulibID,
-		vector<double>& nut_absopac,    // cm^-1
-		vector<double>& nut_scatopac,   // cm^-1
-		vector< vector<double> >& scattering_phi0, // 2pi h^-3 c^-4 phi0 delta(E^3/3)/deltaE [group in][group out] units 1/cm Output.
-		vector< vector<double> >& scattering_delta){
+		const Span<double>& nut_absopac,    // cm^-1
+		const Span<double>& nut_scatopac,   // cm^-1
+		const Span<double>& scattering_phi0, // 2pi h^-3 c^-4 phi0 delta(E^3/3)/deltaE [group in][group out] units 1/cm Output. May be empty.
+		const Span<double>& scattering_delta){
 
 	PRINT_ASSERT(rho,>=,0);
 	PRINT_ASSERT(temp,>=,0);
@@ -471,8 +668,7 @@ void nulib_get_eas_arrays(
 	else{
 		// nulib's emis is bin integrated. Summing these values would correspond to our intended nut_emiss value at the bin top.
 		// must rebin to get the integrated value to be at the same location as the opacities. (CDF value corresponds to emission rate at or below that energy)
-		nulibtable_single_species_range_energy_(&rho, &temp_MeV, &ye, &lns,
-				(double*)eas_energy, &ngroups, &nvars);
+		nulib_get_eas_all_species(rho, temp_MeV, ye, lns, (double*)eas_energy);
 		for(int j=0; j<ngroups; j++){
 			nut_absopac [j] = eas_energy[1][j];
 			nut_scatopac[j] = eas_energy[2][j];
@@ -481,9 +677,15 @@ void nulib_get_eas_arrays(
  		}
 
 		// set inelastic kernels if they exist in the table
-		if(read_Ielectron)
+		if(read_Ielectron and scattering_phi0.size()>0){
 			nulib_get_iscatter_kernels(rho,temp,ye,nulibID,scattering_phi0,scattering_delta);
+			return;
+		}
 	}
+
+	// otherwise there is no inelastic scattering
+	scattering_phi0.fill(0);
+	scattering_delta.fill(0);
 }
 
 
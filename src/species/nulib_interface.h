@@ -31,20 +31,31 @@
 #include <vector>
 #include "CDFArray.h"
 #include "Axis.h"
+#include "NuLibTable.h"
+#include "ScratchArena.h"
 
 using namespace std;
 //
 // returns everything in standard CGS units (i.e. ergs, s, cm, K, Hz)
 
 void nulib_init(string filename);
+bool nulib_needs_fortran(string filename);
+void nulib_native_init(string filename, string binary_filename="");
+void nulib_set_native(const bool native);
+const NuLibTable& nulib_native_table();
 void nulib_get_eas_arrays(double rho, double temp, double ye, int nulibID,
-		vector<double>& nut_absopac, vector<double>& nut_scatopac,
-		vector< vector<double> >& phi0, vector< vector<double> >& phi1_phi0);
+		const Span<double>& nut_absopac, const Span<double>& nut_scatopac,
+		const Span<double>& phi0, const Span<double>& phi1_phi0);
+void nulib_get_eas_record(const double rho, const double temp, double ye, double* eas);
+bool nulib_batch_available();
+void nulib_batch_eas(const size_t n, const double* rho, const double* temp, const double* ye);
+void nulib_select_eas_point(const long i);
 void nulib_get_epannihil_kernels(
 		const double rho, const double temp, const double ye, const int nulibID,
-		vector< vector< vector<double> > >& phi);
+		const Span<double>& phi);
 void nulib_get_nu_grid(Axis& nut_nu_grid);
 int nulib_get_nspecies();
+bool nulib_has_inelastic_kernels();
 
 double nulib_get_Tmin();
 double nulib_get_Tmax();
@@ -38,7 +38,7 @@
 
 using namespace std;
 
-class GR1DSpectrumArray : public SpectrumArray {
+class GR1DSpectrumArray final : public SpectrumArray {
 
 private:
 
@@ -50,7 +50,8 @@ private:
 public:
 
 	static const size_t nelements = 6;
-	MultiDArray<double,nelements,2> data;
+	MultiDArray<ATOMIC<real>,nelements,2> data;
+	ThreadTally<nelements> tally;
 
 	//--------------------------------------------------------------
 	// Initialization and Allocation
@@ -73,6 +74,16 @@ public:
 		data.wipe();
 	}
 
+	//--------------------------------------------------------------
+	// Thread-private tally buffering
+	//--------------------------------------------------------------
+	void start_tally_buffers(const bool reproducible){
+		tally.start_buffering(data, reproducible);
+	}
+	void stop_tally_buffers(){
+		tally.stop_buffering(data);
+	}
+
 
 	//--------------------------------------------------------------
 	// count a particle
@@ -92,12 +103,12 @@ public:
 		tmp[3] =  E * (D[0]*D[0] + D[1]*D[1])*0.5; // average of P^tt and P^pp
 		tmp[4] =  E * D[2]*D[2]*D[2]; // W^rrr
 		tmp[5] =  E * D[2]*(D[0]*D[0] + D[1]*D[1])*0.5; // average of W^rtt and W^rpp
-		data.add(dir_ind,tmp);
+		tally.add(data, data.direct_index(dir_ind), tmp);
 	}
 
 
 	void rescale(double r) {
-		for(size_t i=0;i<data.size();i++) data.y0[i] *= r;
+		for(size_t i=0;i<data.y0.size();i++) data.y0[i] *= r;
 	}
 	void rescale_spatial_point(const size_t dir_ind[1], const double r){
 		size_t all_indices[1+1];
@@ -106,7 +117,7 @@ public:
 		size_t base_ind = data.direct_index(all_indices);
 		size_t nbins = data.axes[1].size();
 		for(size_t i=0; i<nbins; i++){
-			data.y0[base_ind+i] *= r;
+			data[base_ind+i] *= r;
 		}
 	}
 
@@ -115,7 +126,7 @@ public:
 	// MPI scatter the spectrum contents.
 	// Must rescale zone stop list to account for number of groups
 	//--------------------------------------------------------------
-	void mpi_sum_scatter(vector<size_t>& zone_stop_list){
+	void mpi_sum_scatter(const vector<size_t>& zone_stop_list){
 		size_t ngroups = data.axes[1].size();
 		vector<size_t> stop_list = zone_stop_list;
 		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
@@ -124,6 +135,30 @@ public:
 	void mpi_sum(){
 		data.mpi_sum();
 	}
+	void mpi_isum_scatter(const vector<size_t>& zone_stop_list, MPI_Request* request){
+		size_t ngroups = data.axes[1].size();
+		vector<size_t> stop_list = zone_stop_list;
+		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
+		data.mpi_isum_scatter(stop_list, request);
+	}
+	void finish_sum_scatter(const vector<size_t>& zone_stop_list){
+		size_t ngroups = data.axes[1].size();
+		vector<size_t> stop_list = zone_stop_list;
+		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
+		data.finish_sum_scatter(stop_list);
+	}
+	void mpi_isum(MPI_Request* request){
+		data.mpi_isum(request);
+	}
+	void mpi_fold_ghosts(){
+		data.mpi_fold_ghosts();
+	}
+	void mpi_allgather(const vector<size_t>& zone_stop_list){
+		size_t ngroups = data.axes[1].size();
+		vector<size_t> stop_list = zone_stop_list;
+		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
+		data.mpi_allgather(stop_list);
+	}
 
 	//--------------------------------------------------------------
 	// Write data to specified location in an HDF5 file
@@ -131,6 +166,16 @@ public:
 	void write_hdf5_data(H5::H5File file, const string name) {
 		data.write_HDF5(file, name);
 	}
+	void write_hdf5_data_slab(H5::H5File file, const string name, const size_t zone_start, const size_t zone_end, const bool create) {
+		size_t ngroups = data.axes[1].size();
+		data.write_HDF5_slab(file, name, zone_start*ngroups, zone_end*ngroups, create);
+	}
+#ifdef H5_HAVE_PARALLEL
+	void write_hdf5_data_slab_mpio(const hid_t file, const string name, const size_t zone_start, const size_t zone_end) {
+		size_t ngroups = data.axes[1].size();
+		data.write_HDF5_slab_mpio(file, name, zone_start*ngroups, zone_end*ngroups);
+	}
+#endif
 	void read_hdf5_data(H5::H5File file, const string name, const string /*axis_base*/) {
 		vector<Axis> axes(2);
 		axes[0].read_HDF5("/axes/x0(cm)",file);
@@ -157,11 +202,11 @@ public:
 		tmp[0] =  E;      // E		indices[momGridIndex] = 0;
 		tmp[2] =  E/3.; // P^rr
 		tmp[3] =  E/3.; // average of P^tt and P^pp
-		data.add(dir_ind,tmp);
+		tally.add(data, data.direct_index(dir_ind), tmp);
 	}
 	double total() const{
 		double result=0;
-		for(size_t i=0; i<data.size(); i++)
+		for(size_t i=data.owned_start(); i<data.owned_end(); i++)
 			result += data[i][0];
 		return result;
 	}
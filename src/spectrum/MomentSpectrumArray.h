@@ -37,7 +37,7 @@ using namespace std;
 namespace pc = physical_constants;
 
 template<size_t ndims_spatial>
-class MomentSpectrumArray : public SpectrumArray {
+class MomentSpectrumArray final : public SpectrumArray {
 
 private:
 
@@ -52,7 +52,8 @@ private:
 	// values represent bin upper walls (the single locate_array.min value is the leftmost wall)
 	// underflow is combined into leftmost bin (right of the locate_array.min)
 	// overflow is combined into the rightmost bin (left of locate_array[size-1])
-	MultiDArray<ATOMIC<double>,n_total_elements, ndims_spatial+1> data;
+	MultiDArray<ATOMIC<real>,n_total_elements, ndims_spatial+1> data;
+	ThreadTally<n_total_elements> tally;
 
 public:
 
@@ -157,7 +158,7 @@ public:
 	// Initialization and Allocation
 	//--------------------------------------------------------------
 
-	void init(const vector<Axis>& spatial_axes, const Axis& nu_grid) {
+	void init(const vector<Axis>& spatial_axes, const Axis& nu_grid, const ZonePartition* partition=NULL) {
 		PRINT_ASSERT(spatial_axes.size(),==,ndims_spatial);
 		vector<Axis> axes(ndims_spatial+1);
 
@@ -168,7 +169,7 @@ public:
 		axes[nuGridIndex] = nu_grid;
 
 		// initialize the moments
-		data.set_axes(axes);
+		data.set_axes(axes, partition);
 		wipe();
 	}
 
@@ -179,6 +180,16 @@ public:
 		data.wipe();
 	}
 
+	//--------------------------------------------------------------
+	// Thread-private tally buffering
+	//--------------------------------------------------------------
+	void start_tally_buffers(const bool reproducible){
+		tally.start_buffering(data, reproducible);
+	}
+	void stop_tally_buffers(){
+		tally.stop_buffering(data);
+	}
+
 	//--------------------------------------------------------------
 	// count a particle
 	////--------------------------------------------------------------
@@ -225,7 +236,7 @@ public:
 		/* 		tuple_index++; */
 		/* 	} */
 		/* } */
-		data.add(dir_ind, tmp);
+		tally.add(data, data.direct_index(dir_ind), tmp);
 	}
 
 	double reconstruct_f(const size_t dir_ind[ndims_spatial+1], const double k[3]) const{
@@ -267,7 +278,7 @@ public:
 	}
 
 	void rescale(const double r) {
-		for(size_t i=0; i<data.size(); i++) data[i] *= r;
+		for(size_t i=0; i<data.y0.size(); i++) data.y0[i] *= r;
 	}
 	void rescale_spatial_point(const size_t dir_ind[ndims_spatial], const double r){
 		size_t all_indices[ndims_spatial+1];
@@ -276,7 +287,7 @@ public:
 		size_t base_ind = data.direct_index(all_indices);
 		size_t nbins = data.axes[ndims_spatial].size();
 		for(size_t i=0; i<nbins; i++){
-			data.y0[base_ind+i] *= r;
+			data[base_ind+i] *= r;
 		}
 	}
 
@@ -284,7 +295,7 @@ public:
 	// MPI scatter the spectrum contents.
 	// Must rescale zone stop list to account for number of groups
 	//--------------------------------------------------------------
-	void mpi_sum_scatter(vector<size_t>& zone_stop_list){
+	void mpi_sum_scatter(const vector<size_t>& zone_stop_list){
 		size_t ngroups = data.axes[nuGridIndex].size();
 		vector<size_t> stop_list = zone_stop_list;
 		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
@@ -293,6 +304,24 @@ public:
 	void mpi_sum(){
 		data.mpi_sum();
 	}
+	void mpi_isum_scatter(const vector<size_t>& zone_stop_list, MPI_Request* request){
+		size_t ngroups = data.axes[nuGridIndex].size();
+		vector<size_t> stop_list = zone_stop_list;
+		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
+		data.mpi_isum_scatter(stop_list, request);
+	}
+	void finish_sum_scatter(const vector<size_t>& zone_stop_list){
+		size_t ngroups = data.axes[nuGridIndex].size();
+		vector<size_t> stop_list = zone_stop_list;
+		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
+		data.finish_sum_scatter(stop_list);
+	}
+	void mpi_isum(MPI_Request* request){
+		data.mpi_isum(request);
+	}
+	void mpi_fold_ghosts(){
+		data.mpi_fold_ghosts();
+	}
 
 	//--------------------------------------------------------------
 	// Write data to specified location in an HDF5 file
@@ -300,6 +329,16 @@ public:
 	void write_hdf5_data(H5::H5File file,const string name) {
 		data.write_HDF5(file, name);
 	}
+	void write_hdf5_data_slab(H5::H5File file,const string name, const size_t zone_start, const size_t zone_end, const bool create) {
+		size_t ngroups = data.axes[nuGridIndex].size();
+		data.write_HDF5_slab(file, name, zone_start*ngroups, zone_end*ngroups, create);
+	}
+#ifdef H5_HAVE_PARALLEL
+	void write_hdf5_data_slab_mpio(const hid_t file,const string name, const size_t zone_start, const size_t zone_end) {
+		size_t ngroups = data.axes[nuGridIndex].size();
+		data.write_HDF5_slab_mpio(file, name, zone_start*ngroups, zone_end*ngroups);
+	}
+#endif
 	void read_hdf5_data(H5::H5File file,const string name, const string /*axis_base*/) {
 		vector<Axis> axes(ndims_spatial+1);
 		for(hsize_t dir=0; dir<ndims_spatial; dir++)
@@ -362,12 +401,12 @@ public:
 		tmp[4] = E/3.; // xx
 		tmp[7] = E/3.; // yy
 		tmp[9] = E/3.; // zz
-		data.add(indices, tmp);
+		tally.add(data, data.direct_index(indices), tmp);
 	}
 
 	double total() const{
 		double result=0;
-		for(size_t i=0; i<data.size(); i++)
+		for(size_t i=data.owned_start(); i<data.owned_end(); i++)
 			result += data[i][0];
 		return result;
 	}
@@ -375,12 +414,11 @@ public:
 	void annihilation_rate(
 			const size_t dir_ind[NDIMS],       // spatial directional indices for the zone we're getting the rate at
 			const SpectrumArray* in_dist,  // erg/ccm (integrated over angular bin and energy bin)
-			const vector< vector<vector<double> > >& phi, // cm^3/s [order][igin][igout]
+			const Span<double>& phi, // cm^3/s [order][igin][igout], orders 0 and 1
 			const size_t weight,
 			Tuple<double,4>& fourforce) const{
 
 		const MomentSpectrumArray<NDIMS>* nubar_dist = (MomentSpectrumArray<NDIMS>*)in_dist;
-		PRINT_ASSERT(phi.size(),>=,2);
 
 		size_t tmp_ind[NDIMS+1];
 		for(size_t i=0; i<NDIMS; i++) tmp_ind[i] = dir_ind[i];
@@ -388,13 +426,16 @@ public:
 		const size_t base_ind = direct_index(tmp_ind);
 		const Axis* nu_axis = &(data.axes[nuGridIndex]);
 		const size_t nnu = nu_axis->size();
+		PRINT_ASSERT(phi.size(),==,2*nnu*nnu);
 
 		for(size_t i=0; i<nnu; i++){
 			double avg_e = pc::h * nu_axis->mid[i];
 			for(size_t j=0; j<nnu; j++){
 				double avg_ebar = pc::h * nu_axis->mid[j];
 				double eebar = avg_e*avg_ebar;
-				double phi2 = -1./5. * (phi[0][i][j] + 3.*phi[1][i][j]);
+				const double phi0 = phi[        i*nnu+j];
+				const double phi1 = phi[nnu*nnu+i*nnu+j];
+				double phi2 = -1./5. * (phi0 + 3.*phi1);
 
 				// basic spherically symmetric
 				double tmp0 = getE(i+base_ind)*nubar_dist->getE(j+base_ind) / eebar; // #/cm^6
@@ -408,7 +449,7 @@ public:
 					PRINT_ASSERT(abs(getF(i+base_ind,k)),<=,getE(i+base_ind));
 					PRINT_ASSERT(abs(nubar_dist->getF(i+base_ind,k)),<=,nubar_dist->getE(i+base_ind));
 				}
-				double this_dep = (avg_e + avg_ebar) * (0.5*phi[0][i][j]*tmp0 + 1.5*phi[1][i][j]*tmp1 + 2.5*phi2*tmp2); // erg/cm^3/s
+				double this_dep = (avg_e + avg_ebar) * (0.5*phi0*tmp0 + 1.5*phi1*tmp1 + 2.5*phi2*tmp2); // erg/cm^3/s
 				fourforce[3] += this_dep;
 
 				// space components
@@ -427,7 +468,7 @@ public:
 						tmp2 -= tmp0;
 						tmp2 *= 0.5;
 					}
-					fourforce[a] += 0.5*phi[0][i][j]*tmp0 + 1.5*phi[1][i][j]*tmp1 + 2.5*phi2*tmp2; // erg/ccm/s
+					fourforce[a] += 0.5*phi0*tmp0 + 1.5*phi1*tmp1 + 2.5*phi2*tmp2; // erg/ccm/s
 				}
 			}
 		}
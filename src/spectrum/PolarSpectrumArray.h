@@ -41,7 +41,7 @@ using namespace std;
 namespace pc = physical_constants;
 
 template<size_t ndims_spatial>
-class PolarSpectrumArray : public SpectrumArray {
+class PolarSpectrumArray final : public SpectrumArray {
 
 private:
 
@@ -53,7 +53,8 @@ private:
 
 public:
 
-	ScalarMultiDArray<ATOMIC<double>,ndims_spatial+3> data;
+	ScalarMultiDArray<ATOMIC<real>,ndims_spatial+3> data;
+	ThreadTally<1> tally;
 	size_t phiGridIndex, nuGridIndex, muGridIndex;
 	size_t nphi, nnu, nmu;
 
@@ -108,7 +109,7 @@ public:
 	//--------------------------------------------------------------
 	// Initialization and Allocation
 	//--------------------------------------------------------------
-	void init(const vector<Axis>& spatial_axes, const Axis& wg,	const Axis& mg, const Axis& pg){
+	void init(const vector<Axis>& spatial_axes, const Axis& wg,	const Axis& mg, const Axis& pg, const ZonePartition* partition=NULL){
 		vector<Axis> axes;
 
 		// spatial axes
@@ -125,7 +126,7 @@ public:
 		nphi = pg.size();
 
 		// set up the data structure
-		data.set_axes(axes);
+		data.set_axes(axes, partition);
 		data.wipe();
 	}
 
@@ -137,6 +138,16 @@ public:
 		data.wipe();
 	}
 
+	//--------------------------------------------------------------
+	// Thread-private tally buffering
+	//--------------------------------------------------------------
+	void start_tally_buffers(const bool reproducible){
+		tally.start_buffering(data, reproducible);
+	}
+	void stop_tally_buffers(){
+		tally.stop_buffering(data);
+	}
+
 
 	//--------------------------------------------------------------
 	// count a particle
@@ -165,11 +176,11 @@ public:
 		phi_bin = min(phi_bin, (int)data.axes[phiGridIndex].size()-1);
 		indices[phiGridIndex] = phi_bin;
 
-		data.add(indices, E);
+		tally.add(data, data.direct_index(indices), E);
 	}
 
 	void rescale(double r){
-		for(size_t i=0;i<data.size();i++) data.y0[i] *= r;
+		for(size_t i=0;i<data.y0.size();i++) data.y0[i] *= r;
 	}
 	void rescale_spatial_point(const size_t dir_ind[ndims_spatial], const double r){
 		size_t all_indices[ndims_spatial+3];
@@ -180,7 +191,7 @@ public:
 		size_t base_ind = data.direct_index(all_indices);
 		size_t nbins = data.axes[ndims_spatial].size() * data.axes[ndims_spatial+1].size() * data.axes[ndims_spatial+2].size();
 		for(size_t i=0; i<nbins; i++){
-			data.y0[base_ind+i] *= r;
+			data[base_ind+i] *= r;
 		}
 	}
 
@@ -188,7 +199,7 @@ public:
 	// MPI scatter the spectrum contents.
 	// Must rescale zone stop list to account for number of groups
 	//--------------------------------------------------------------
-	void mpi_sum_scatter(vector<size_t>& zone_stop_list){
+	void mpi_sum_scatter(const vector<size_t>& zone_stop_list){
 		size_t nperzone = data.axes[nuGridIndex].size() * data.axes[phiGridIndex].size() * data.axes[muGridIndex].size();
 		vector<size_t> stop_list = zone_stop_list;
 		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= nperzone;
@@ -197,6 +208,24 @@ public:
 	void mpi_sum(){
 		data.mpi_sum();
 	}
+	void mpi_isum_scatter(const vector<size_t>& zone_stop_list, MPI_Request* request){
+		size_t nperzone = data.axes[nuGridIndex].size() * data.axes[phiGridIndex].size() * data.axes[muGridIndex].size();
+		vector<size_t> stop_list = zone_stop_list;
+		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= nperzone;
+		data.mpi_isum_scatter(stop_list, request);
+	}
+	void finish_sum_scatter(const vector<size_t>& zone_stop_list){
+		size_t nperzone = data.axes[nuGridIndex].size() * data.axes[phiGridIndex].size() * data.axes[muGridIndex].size();
+		vector<size_t> stop_list = zone_stop_list;
+		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= nperzone;
+		data.finish_sum_scatter(stop_list);
+	}
+	void mpi_isum(MPI_Request* request){
+		data.mpi_isum(request);
+	}
+	void mpi_fold_ghosts(){
+		data.mpi_fold_ghosts();
+	}
 
 	//--------------------------------------------------------------
 	// Write data to specified location in an HDF5 file
@@ -204,6 +233,16 @@ public:
 	void write_hdf5_data(H5::H5File file, const string name) {
 		data.write_HDF5(file, name);
 	}
+	void write_hdf5_data_slab(H5::H5File file, const string name, const size_t zone_start, const size_t zone_end, const bool create) {
+		size_t nperzone = data.axes[nuGridIndex].size() * data.axes[phiGridIndex].size() * data.axes[muGridIndex].size();
+		data.write_HDF5_slab(file, name, zone_start*nperzone, zone_end*nperzone, create);
+	}
+#ifdef H5_HAVE_PARALLEL
+	void write_hdf5_data_slab_mpio(const hid_t file, const string name, const size_t zone_start, const size_t zone_end) {
+		size_t nperzone = data.axes[nuGridIndex].size() * data.axes[phiGridIndex].size() * data.axes[muGridIndex].size();
+		data.write_HDF5_slab_mpio(file, name, zone_start*nperzone, zone_end*nperzone);
+	}
+#endif
 	void read_hdf5_data(H5::H5File file, const string name, const string axis_base) {
 		vector<Axis> axes(ndims_spatial+3);
 		for(hsize_t dir=0; dir<ndims_spatial; dir++)
@@ -238,12 +277,11 @@ public:
 		size_t stop = start + nphi*nmu;
 		double tmp = E / (double)(nphi*nmu);
 
-		#pragma omp critical
-		for(size_t i=start; i<stop; i++) data[i] += tmp;
+		for(size_t i=start; i<stop; i++) tally.add(data, i, tmp);
 	}
 	double total() const{
 		double result=0;
-		for(size_t i=0; i<data.size(); i++)
+		for(size_t i=data.owned_start(); i<data.owned_end(); i++)
 			result += data[i];
 		return result;
 	}
@@ -263,12 +301,12 @@ public:
 	void annihilation_rate(
 			const size_t dir_ind[NDIMS],       // directional indices for the zone we're getting the rate at
 			const SpectrumArray* in_dist,  // erg/ccm (integrated over angular bin and energy bin)
-			const vector< vector<vector<double> > >& phi, // cm^3/s [order][igin][igout]
+			const Span<double>& phi, // cm^3/s [order][igin][igout], orders 0 and 1
 			const size_t weight,
 			Tuple<double,4>& fourforce) const{
 
 		const PolarSpectrumArray<NDIMS>* nubar_dist = (PolarSpectrumArray<NDIMS>*)in_dist;
-		PRINT_ASSERT(phi.size(),==,3);
+		PRINT_ASSERT(phi.size(),==,2*nnu*nnu);
 
 		PRINT_ASSERT(size(),==,nubar_dist->size());
 		PRINT_ASSERT(nnu,==,nubar_dist->nnu);
@@ -317,7 +355,9 @@ public:
 				indexbar[nuGridIndex] = inubar;
 
 				double eebar = avg_e * avg_ebar;
-				double phi2 = -1./5. * (phi[0][inu][inubar] + 3.*phi[1][inu][inubar]);
+				const double phi0 = phi[        inu*nnu+inubar];
+				const double phi1 = phi[nnu*nnu+inu*nnu+inubar];
+				double phi2 = -1./5. * (phi0 + 3.*phi1);
 
 				// neutrino direction loops
 				for(size_t imu=0; imu<nmu; imu++){
@@ -345,8 +385,8 @@ public:
 								double nudist_edens    = get(ind); // erg/ccm
 								double nubardist_edens = nubar_dist->get(indbar); // erg/ccm
 
-								double Q = 0.5*phi[0][inu][inubar] +
-										1.5*phi[1][inu][inubar] * cost +
+								double Q = 0.5*phi0 +
+										1.5*phi1 * cost +
 										2.5*phi2 * 0.5*(3.*cost*cost-1.); // ccm/s
 								Q *= nudist_edens * nubardist_edens / eebar; // #/ccm/s
 								//PRINT_ASSERT(Q,>=,0);
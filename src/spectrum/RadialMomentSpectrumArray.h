@@ -35,7 +35,7 @@
 using namespace std;
 
 template<size_t ndims_spatial>
-class RadialMomentSpectrumArray : public SpectrumArray {
+class RadialMomentSpectrumArray final : public SpectrumArray {
 
 private:
 
@@ -43,7 +43,8 @@ private:
 	// values represent bin upper walls (the single locate_array.min value is the leftmost wall)
 	// underflow is combined into leftmost bin (right of the locate_array.min)
 	// overflow is combined into the rightmost bin (left of locate_array[size-1])
-	MultiDArray<ATOMIC<double>,4,ndims_spatial+1> data; // 0, r, rr, rrr
+	MultiDArray<ATOMIC<real>,4,ndims_spatial+1> data; // 0, r, rr, rrr
+	ThreadTally<4> tally;
 
 	static const size_t nranks = 4;
 	static const size_t nuGridIndex = ndims_spatial;
@@ -53,14 +54,14 @@ public:
 	//--------------------------------------------------------------
 	// Initialization and Allocation
 	//--------------------------------------------------------------
-	void init(const vector<Axis>& spatial_axes, const Axis& nu_grid) {
+	void init(const vector<Axis>& spatial_axes, const Axis& nu_grid, const ZonePartition* partition=NULL) {
 		vector<Axis> axes;
 		for(size_t i=0; i<spatial_axes.size(); i++) axes.push_back(spatial_axes[i]);
 
 		axes.push_back(nu_grid);
 
 		// set up the data structure
-		data.set_axes(axes);
+		data.set_axes(axes, partition);
 		data.wipe();
 	}
 
@@ -71,6 +72,16 @@ public:
 		data.wipe();
 	}
 
+	//--------------------------------------------------------------
+	// Thread-private tally buffering
+	//--------------------------------------------------------------
+	void start_tally_buffers(const bool reproducible){
+		tally.start_buffering(data, reproducible);
+	}
+	void stop_tally_buffers(){
+		tally.stop_buffering(data);
+	}
+
 	//--------------------------------------------------------------
 	// count a particle
 	////--------------------------------------------------------------
@@ -91,11 +102,11 @@ public:
 		for (size_t rank = 1; rank<nranks; rank++) {
 			tmp[rank] = tmp[rank-1]*D[2];
 		}
-		data.add(indices, tmp);
+		tally.add(data, data.direct_index(indices), tmp);
 	}
 
 	void rescale(double r) {
-		for(size_t i=0;i<data.size();i++) data.y0[i] *= r;
+		for(size_t i=0;i<data.y0.size();i++) data.y0[i] *= r;
 	}
 	void rescale_spatial_point(const size_t dir_ind[ndims_spatial], const double r){
 		size_t all_indices[ndims_spatial+1];
@@ -104,7 +115,7 @@ public:
 		size_t base_ind = data.direct_index(all_indices);
 		size_t nbins = data.axes[ndims_spatial].size();
 		for(size_t i=0; i<nbins; i++){
-			data.y0[base_ind+i] *= r;
+			data[base_ind+i] *= r;
 		}
 	}
 
@@ -112,7 +123,7 @@ public:
 	// MPI scatter the spectrum contents.
 	// Must rescale zone stop list to account for number of groups
 	//--------------------------------------------------------------
-	void mpi_sum_scatter(vector<size_t>& zone_stop_list){
+	void mpi_sum_scatter(const vector<size_t>& zone_stop_list){
 		size_t ngroups = data.axes[nuGridIndex].size();
 		vector<size_t> stop_list = zone_stop_list;
 		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
@@ -121,6 +132,24 @@ public:
 	void mpi_sum(){
 		data.mpi_sum();
 	}
+	void mpi_isum_scatter(const vector<size_t>& zone_stop_list, MPI_Request* request){
+		size_t ngroups = data.axes[nuGridIndex].size();
+		vector<size_t> stop_list = zone_stop_list;
+		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
+		data.mpi_isum_scatter(stop_list, request);
+	}
+	void finish_sum_scatter(const vector<size_t>& zone_stop_list){
+		size_t ngroups = data.axes[nuGridIndex].size();
+		vector<size_t> stop_list = zone_stop_list;
+		for(size_t i=0; i<stop_list.size(); i++) stop_list[i] *= ngroups;
+		data.finish_sum_scatter(stop_list);
+	}
+	void mpi_isum(MPI_Request* request){
+		data.mpi_isum(request);
+	}
+	void mpi_fold_ghosts(){
+		data.mpi_fold_ghosts();
+	}
 
 
 	//--------------------------------------------------------------
@@ -129,6 +158,16 @@ public:
 	void write_hdf5_data(H5::H5File file, const string name) {
 		data.write_HDF5(file, name);
 	}
+	void write_hdf5_data_slab(H5::H5File file, const string name, const size_t zone_start, const size_t zone_end, const bool create) {
+		size_t ngroups = data.axes[nuGridIndex].size();
+		data.write_HDF5_slab(file, name, zone_start*ngroups, zone_end*ngroups, create);
+	}
+#ifdef H5_HAVE_PARALLEL
+	void write_hdf5_data_slab_mpio(const hid_t file, const string name, const size_t zone_start, const size_t zone_end) {
+		size_t ngroups = data.axes[nuGridIndex].size();
+		data.write_HDF5_slab_mpio(file, name, zone_start*ngroups, zone_end*ngroups);
+	}
+#endif
 	void read_hdf5_data(H5::H5File file, const string name, const string /*axis_base*/) {
 		vector<Axis> axes(ndims_spatial+1);
 		for(hsize_t dir=0; dir<ndims_spatial; dir++)
@@ -156,12 +195,12 @@ public:
 		tmp[1] = 0;
 		tmp[2] = E/3.;
 		tmp[3] = 0;
-		data.add(indices, tmp);
+		tally.add(data, data.direct_index(indices), tmp);
 	}
 
 	double total() const{
 		double result=0;
-		for(size_t i=0; i<data.size(); i++)
+		for(size_t i=data.owned_start(); i<data.owned_end(); i++)
 			result += data[i][0];
 		return result;
 	}
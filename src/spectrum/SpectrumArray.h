@@ -33,6 +33,8 @@
 #include <fstream>
 #include <vector>
 #include "EinsteinHelper.h"
+#include "ThreadTally.h"
+#include "ScratchArena.h"
 
 using namespace std;
 
@@ -52,9 +54,19 @@ public:
 	/* 	  count_single(kup_tet, icube.corner_dir_ind[corner], E*icube.weights[corner]); */
 	/* } */
 
+	// thread-private tally buffering during propagation (see ThreadTally.h)
+	virtual void start_tally_buffers(const bool reproducible) = 0;
+	virtual void stop_tally_buffers() = 0;
+
 	// MPI functions
-	virtual void mpi_sum_scatter(vector<size_t>& zone_stop_list) = 0;
+	// after mpi_sum_scatter only this rank's zone slice is valid (see MultiDArray::mpi_sum_scatter)
+	virtual void mpi_sum_scatter(const vector<size_t>& zone_stop_list) = 0;
 	virtual void mpi_sum() = 0;
+	virtual void mpi_isum_scatter(const vector<size_t>& zone_stop_list, MPI_Request* request) = 0;
+	virtual void finish_sum_scatter(const vector<size_t>& zone_stop_list) = 0;
+	virtual void mpi_isum(MPI_Request* request) = 0;
+	// add the ghost zones onto their owners (zone ownership, see ZonePartition)
+	virtual void mpi_fold_ghosts() = 0;
 
 	// Count a packets
 	virtual void add_isotropic_single(const size_t dir_ind[NDIMS+1], const double E) = 0;
@@ -72,10 +84,14 @@ public:
 
 	// Print out
 	virtual void write_hdf5_data(H5::H5File file, const string name) = 0;
+	virtual void write_hdf5_data_slab(H5::H5File file, const string name, const size_t zone_start, const size_t zone_end, const bool create) = 0;
+#ifdef H5_HAVE_PARALLEL
+	virtual void write_hdf5_data_slab_mpio(const hid_t file, const string name, const size_t zone_start, const size_t zone_end) = 0;
+#endif
 	virtual void  read_hdf5_data(H5::H5File file, const string name, const string axis_base) = 0;
 	virtual void write_hdf5_coordinates(H5::H5File file, const string name) const = 0;
 	virtual void annihilation_rate(const size_t[] /*dir_ind[NDIMS]*/, const SpectrumArray* /*in_dist*/,
-			const vector< vector<vector<double> > >& /*phi*/, const size_t /*weight*/, Tuple<double,4>& /*fourforce*/) const{
+			const Span<double>& /*phi*/, const size_t /*weight*/, Tuple<double,4>& /*fourforce*/) const{
 		cout << "annihilation_rate is not implemented for this spectrum type!" << endl;
 		assert(0);
 	}
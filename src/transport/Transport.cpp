@@ -53,6 +53,8 @@ namespace pc = physical_constants;
 // constructor
 Transport::Transport(){
 	verbose = -MAXLIM;
+	propagate_kernel = NULL;
+	event_kernel = NULL;
 	MPI_nprocs = -MAXLIM;
 	MPI_myID = -MAXLIM;
 	T_min = NaN;
@@ -66,6 +68,25 @@ Transport::Transport(){
 	do_randomwalk = -MAXLIM;
 	min_packet_weight = NaN;
 	do_annihilation = -MAXLIM;
+	transport_mode = "";
+	event_bank_size = -MAXLIM;
+	reproducible = -MAXLIM;
+	zone_ownership = -MAXLIM;
+	ownership_ghost_layers = -MAXLIM;
+	load_balance = -MAXLIM;
+	work_stealing = -MAXLIM;
+	work_steal_chunk = -MAXLIM;
+	work_progress = false;
+	work_next = 0;
+	work_victim_offset = 0;
+	n_stolen = 0;
+	opacity_zone_start = 0;
+	opacity_zone_end = 0;
+	opacity_tolerance = NaN;
+	n_emission_passes = 0;
+	scalar_request = MPI_REQUEST_NULL;
+	reduce_start_time = NaN;
+	reduce_wait_time = NaN;
 	grid = NULL;
 	r_core = NaN;
 	n_emit_core_per_bin = -MAXLIM;
@@ -122,6 +143,57 @@ void Transport::init(Lua* lua)
 	}
 	min_packet_weight = lua->scalar<double>("min_packet_weight");
 
+	// history-based (default) or event-based particle propagation
+	pair<string,bool> transport_mode_pair = lua->scalar_pair<string>("transport_mode");
+	transport_mode = transport_mode_pair.second ? transport_mode_pair.first : "history";
+	if(transport_mode!="history" and transport_mode!="event"){
+		if(MPI_myID==0) cout << "ERROR: transport_mode must be \"history\" or \"event\"" << endl;
+		exit(5);
+	}
+	pair<int,bool> event_bank_size_pair = lua->scalar_pair<int>("event_bank_size");
+	event_bank_size = event_bank_size_pair.second ? event_bank_size_pair.first : 256;
+	if(event_bank_size<=0){
+		if(MPI_myID==0) cout << "ERROR: event_bank_size must be positive" << endl;
+		exit(5);
+	}
+	if(verbose) cout << "#   Using " << transport_mode << "-based particle propagation" << endl;
+	pair<int,bool> zone_ownership_pair = lua->scalar_pair<int>("zone_ownership");
+	zone_ownership = zone_ownership_pair.second ? zone_ownership_pair.first : 0;
+	pair<int,bool> ownership_ghost_layers_pair = lua->scalar_pair<int>("ownership_ghost_layers");
+	ownership_ghost_layers = ownership_ghost_layers_pair.second ? ownership_ghost_layers_pair.first : 2;
+	if(zone_ownership and transport_mode!="history"){
+		if(MPI_myID==0) cout << "ERROR: zone_ownership requires transport_mode=\"history\"" << endl;
+		exit(5);
+	}
+	pair<double,bool> opacity_tolerance_pair = lua->scalar_pair<double>("opacity_tolerance");
+	opacity_tolerance = opacity_tolerance_pair.second ? opacity_tolerance_pair.first : 0;
+	PRINT_ASSERT(opacity_tolerance,>=,0);
+	pair<int,bool> load_balance_pair = lua->scalar_pair<int>("load_balance");
+	load_balance = load_balance_pair.second ? load_balance_pair.first : 0;
+	if(load_balance and zone_ownership){
+		if(MPI_myID==0) cout << "ERROR: load_balance cannot be used with zone_ownership" << endl;
+		exit(5);
+	}
+	pair<int,bool> work_stealing_pair = lua->scalar_pair<int>("work_stealing");
+	work_stealing = work_stealing_pair.second ? work_stealing_pair.first : 0;
+	pair<int,bool> work_steal_chunk_pair = lua->scalar_pair<int>("work_steal_chunk");
+	work_steal_chunk = work_steal_chunk_pair.second ? work_steal_chunk_pair.first : 16*omp_get_max_threads();
+	if(work_stealing and zone_ownership){
+		if(MPI_myID==0) cout << "ERROR: work_stealing cannot be used with zone_ownership" << endl;
+		exit(5);
+	}
+	if(work_stealing){
+		// the work queue's RMA calls and MPI_Iprobe run while OpenMP
+		// threads are alive, which MPI only allows from FUNNELED up
+		int MPI_thread_level;
+		MPI_Query_thread(&MPI_thread_level);
+		if(MPI_thread_level < MPI_THREAD_FUNNELED){
+			if(MPI_myID==0) cout << "WARNING: MPI does not provide MPI_THREAD_FUNNELED. Disabling work_stealing." << endl;
+			work_stealing = 0;
+		}
+		work_progress = work_stealing;
+	}
+
 	// output parameters
 	write_zones_every   = lua->scalar<double>("write_zones_every");
 
@@ -142,7 +214,22 @@ void Transport::init(Lua* lua)
 		// read the fortran module into memory
 	        if(verbose) cout << "# Initializing NuLib..." << endl << flush;
 		string nulib_table = lua->scalar<string>("nulib_table");
-		nulib_init(nulib_table);
+		pair<int,bool> nulib_native_pair = lua->scalar_pair<int>("nulib_native");
+		const bool nulib_native = nulib_native_pair.second and nulib_native_pair.first;
+		pair<string,bool> nulib_binary_pair = lua->scalar_pair<string>("nulib_binary_table");
+		const bool needs_fortran = nulib_needs_fortran(nulib_table);
+		// a shared binary table only saves memory if no rank also needs its own Fortran copy
+		if(nulib_native and nulib_binary_pair.second and needs_fortran){
+			if(MPI_myID==0) cout << "ERROR: nulib_binary_table cannot be used with a NuLib table that has inelastic or pair kernels, since NuLib must then load the whole table on every rank" << endl;
+			exit(5);
+		}
+		// the native interpolator replaces the Fortran copy unless the table has kernels only NuLib reads
+		if(not nulib_native or needs_fortran) nulib_init(nulib_table);
+		else if(verbose) cout << "#   Not loading the NuLib Fortran table (no inelastic or pair kernels)" << endl;
+		if(nulib_native){
+			if(verbose) cout << "#   Using native interpolation of NuLib eas tables" << endl;
+			nulib_native_init(nulib_table, nulib_binary_pair.second ? nulib_binary_pair.first : "");
+		}
 
 		// eos
 		string eos_filename = lua->scalar<string>("nulib_eos");
@@ -200,6 +287,11 @@ void Transport::init(Lua* lua)
 	//=================//
 	// SET UP THE GRID //
 	//=================//
+	// check the parameters (before the grid allocates anything with them)
+	if(verbose) cout << "# Checking parameters..." << flush;
+	check_parameters();
+	if(verbose) cout << "finished." << endl << flush;
+
 	// read the grid type
 	string grid_type = lua->scalar<string>("grid_type");
 
@@ -213,37 +305,50 @@ void Transport::init(Lua* lua)
 		if(verbose) std::cout << "# ERROR: the requested grid type is not implemented." << std::endl;
 		exit(3);}
 	grid->init(lua, this);
+	select_propagate_kernel();
+	if(grid->opacity_cache_blocks>0){
+		if(grid->inelastic_rank>0 or (neutrino_type=="NuLib" and nulib_has_inelastic_kernels())){
+			if(MPI_myID==0) cout << "ERROR: opacity_cache_blocks cannot be used with inelastic scattering kernels" << endl;
+			exit(5);
+		}
+		if(verbose) cout << "#   Evaluating opacities lazily with " << grid->opacity_cache_blocks << " cached zones per thread" << endl;
+		opacity_cache.resize(omp_get_max_threads());
+		for(size_t t=0; t<opacity_cache.size(); t++)
+			opacity_cache[t].value.init(grid->opacity_cache_blocks*species_list.size(), 2*grid->nu_grid_axis.size());
+	}
 
 	//===============//
 	// GENERAL SETUP //
 	//===============//
-	// figure out which zones are in this processors work load
-	// a processor will do work in range [start,end)
-	my_zone_end.resize(MPI_nprocs);
-	for(int proc=0; proc<MPI_nprocs; proc++){
-		// how much work does this processor do?
-		int my_job = (int)(grid->rho.size()/(1.0*MPI_nprocs));
-		if(my_job < 1) my_job = 1;
-
-		// where does this processor start and stop its work? (only the end needs to be stored)
-		int my_zone_start = proc*my_job;
-		my_zone_end[proc] = my_zone_start + my_job;
-
-		// make sure last guy finishes it all
-		if(proc == MPI_nprocs-1) my_zone_end[proc] = grid->rho.size();
-
-		// make sure nobody goes overboard
-		if(my_zone_end[proc] >= grid->rho.size()) my_zone_end[proc] = grid->rho.size();
-	}
+	// the zones in this processor's work load were set by
+	// init_zone_ownership(), called from grid->init()
+	PRINT_ASSERT(my_zone_end.size(),==,(size_t)MPI_nprocs);
+	opacity_version.assign(opacity_zone_end-opacity_zone_start, 0);
+	invalidate_opacities();
+	zone_requests.assign(4, MPI_REQUEST_NULL);
+	distribution_requests.assign(species_list.size(), MPI_REQUEST_NULL);
+	spectrum_requests.assign(species_list.size(), MPI_REQUEST_NULL);
+	fblock_requests.assign(species_list.size(), MPI_REQUEST_NULL);
 
 	// setup and seed random number generator(s)
-	rangen.init();
+	// reproducible mode gives every particle its own Philox stream
+	pair<int,bool> reproducible_pair = lua->scalar_pair<int>("reproducible");
+	reproducible = reproducible_pair.second ? reproducible_pair.first : 0;
+	pair<string,bool> rng_backend = lua->scalar_pair<string>("rng_backend");
+	string backend = rng_backend.second ? rng_backend.first : (reproducible ? "philox" : "gsl");
+	if(reproducible and backend!="philox"){
+		if(MPI_myID==0) cout << "ERROR: reproducible mode requires rng_backend=\"philox\"" << endl;
+		exit(6);
+	}
+	pair<int,bool> rng_seed = lua->scalar_pair<int>("rng_seed");
+	rangen.init(backend, rng_seed.second ? rng_seed.first : (reproducible ? 0 : -1));
+	if(verbose) cout << "#   Using " << backend << " random number generator" << (reproducible ? " (reproducible mode)" : "") << endl;
 
 
 	//==========================//
 	// INITIALIZE THE NEUTRINOS //
 	//==========================//
-	for(size_t i=0; i<species_list.size(); i++) species_list[i]->init(lua);
+	for(size_t i=0; i<species_list.size(); i++) species_list[i]->init(lua, grid);
 
 	// complain if we're not simulating anything
 	n_active.resize(species_list.size(),0);
@@ -280,11 +385,6 @@ void Transport::init(Lua* lua)
 	}
 	if(verbose) cout << "finished." << endl << flush;
 
-	// check the parameters
-	if(verbose) cout << "# Checking parameters..." << flush;
-	check_parameters();
-	if(verbose) cout << "finished." << endl << flush;
-
 	// explicitly set global radiation quantities to 0
 	N_core_emit.resize(species_list.size());
 	L_net_esc.resize(species_list.size());
@@ -296,11 +396,68 @@ void Transport::init(Lua* lua)
 		N_net_emit[s] = 0;
 		N_net_esc[s] = 0;
 	}
+
+	// in the order of ScalarTally
+	scalar_tally_targets.push_back(&particle_rouletted_energy);
+	scalar_tally_targets.push_back(&particle_core_abs_energy);
+	scalar_tally_targets.push_back(&particle_escape_energy);
+	for(size_t s=0; s<species_list.size(); s++) scalar_tally_targets.push_back(&N_core_emit[s]);
+	for(size_t s=0; s<species_list.size(); s++) scalar_tally_targets.push_back(&N_net_emit[s]);
+	for(size_t s=0; s<species_list.size(); s++) scalar_tally_targets.push_back(&N_net_esc[s]);
+	for(size_t s=0; s<species_list.size(); s++) scalar_tally_targets.push_back(&L_net_esc[s]);
+	PRINT_ASSERT(scalar_tally_targets.size(),==,scalar_tally_index(L_net_esc_tally,species_list.size()));
+}
+
+//------------------------------------------------------------
+// global radiation quantities
+//------------------------------------------------------------
+size_t Transport::scalar_tally_index(const ScalarTally which, const size_t s) const{
+	if(which < N_core_emit_tally) return which;
+	return N_core_emit_tally + (which-N_core_emit_tally)*species_list.size() + s;
+}
+void Transport::tally_scalar(const ScalarTally which, const size_t s, const double value){
+	const size_t i = scalar_tally_index(which,s);
+	if(reproducible) scalar_tallies.add(i, value);
+	else *scalar_tally_targets[i] += value;
+}
+
+//------------------------------------------------------------
+// bracket each emission/propagation pass. In reproducible mode
+// all floating-point tallies go through exact (integer) sums
+// that are reduced onto rank 0 at the end of the pass.
+//------------------------------------------------------------
+void Transport::start_tallies(){
+	grid->start_tally_buffers(reproducible);
+	if(reproducible) scalar_tallies.resize(scalar_tally_targets.size());
+}
+void Transport::stop_tallies(){
+	double start = MPI_Wtime();
+	grid->stop_tally_buffers();
+	if(reproducible){
+		scalar_tallies.mpi_reduce();
+		if(MPI_myID==0)
+			for(size_t i=0; i<scalar_tally_targets.size(); i++)
+				*scalar_tally_targets[i] += scalar_tallies.value(i);
+		scalar_tallies.clear();
+	}
+	if(verbose) cout << "#   Tally reduction took " << MPI_Wtime()-start << " seconds" << endl;
+	n_emission_passes++;
 }
 
 void Transport::check_parameters() const{
 	if(verbose && do_randomwalk)
 		cout << "WARNING: Assumptions in random walk approximation are incompatible with inelastic scattering." << endl;
+
+	// a particle scatters in the zone it steps into, and the
+	// interpolation there reaches one layer further
+	if(zone_ownership and ownership_ghost_layers<2){
+		if(MPI_myID==0) cout << "ERROR: zone_ownership requires ownership_ghost_layers>=2" << endl;
+		exit(5);
+	}
+	if(zone_ownership and NDIMS==0){
+		if(MPI_myID==0) cout << "ERROR: zone_ownership requires a grid with at least one dimension" << endl;
+		exit(5);
+	}
 }
 
 //------------------------------------------------------------
@@ -311,18 +468,23 @@ void Transport::step()
 	// reset radiation quantities
 	if(verbose) cout << "# Clearing radiation..." << endl;
 	reset_radiation();
+	if(load_balance) balance_emission();
 
 	// emit, propagate, and normalize. steady_state means no propagation time limit.
 	for(int i=0; i<n_subcycles; i++){
 	  if(verbose) cout << "# === Subcycle " << i+1 << "/" << n_subcycles << " ===" << endl;
-		emit_particles();
-		propagate_particles();
+		double propagate_start = MPI_Wtime();
+		if(transport_mode=="event") emit_and_propagate_event();
+		else emit_and_propagate();
+		if(verbose) cout << "#   Emission and propagation took " << MPI_Wtime()-propagate_start << " seconds" << endl;
 	}
-	if(MPI_nprocs>1) sum_to_proc0();      // so each processor has necessary info to solve its zones
+	if(grid->opacity_cache_blocks>0) report_opacity_cache();
+	if(MPI_nprocs>1) reduce_radiation();  // so each processor has necessary info to solve its zones
 	normalize_radiative_quantities();
 
 	// calculate annihilation rates
 	if(do_annihilation) calculate_annihilation();
+	finish_reduction();
 }
 
 
@@ -330,12 +492,13 @@ void Transport::step()
 // write all the necessary output
 //---------------------------------
 void Transport::write(const int it) const{
-	if(MPI_myID==0){
-		// write zone state when appropriate
-		if(write_zones_every>0) if(it%write_zones_every==0 && write_zones_every>0 && it>0){
-			if(verbose) cout << "# writing zone file " << it << endl;
-			grid->write_zones(it);
-		}
+	const bool write_zones_now = (write_zones_every>0 && it%write_zones_every==0 && it>0);
+
+	// write zone state when appropriate
+	// each rank writes the zones it owns
+	if(write_zones_now){
+		if(verbose) cout << "# writing zone file " << it << endl;
+		grid->write_zones(it, my_zone_end);
 	}
 }
 
@@ -365,31 +528,153 @@ void Transport::reset_radiation(){
 	particle_rouletted_energy = 0;
 	particle_escape_energy = 0;
 
+	// only zones whose fluid state has changed need new opacities.
+	// All species are done together so NuLib can look them up in one call.
+	// With the native NuLib interpolator each thread also interpolates a
+	// whole block of zones in one batch before setting them.
 	if(verbose) cout << "# Setting zone transport quantities" << endl << flush;
-	for(size_t s=0; s<species_list.size(); s++){
-		#pragma omp parallel for
-		for(size_t z_ind=0;z_ind<grid->rho.size();z_ind++)
-			species_list[s]->set_eas(z_ind,grid);
+	double set_eas_start = MPI_Wtime();
+	vector<size_t> changed;
+	for(size_t z_ind=opacity_zone_start;z_ind<opacity_zone_end;z_ind++)
+		if(opacity_state_changed(z_ind)) changed.push_back(z_ind);
+	const size_t n_recomputed = changed.size();
+	const bool batch = (grid->opacity_cache_blocks==0 and nulib_batch_available());
+	const size_t block = (batch ? 64 : 1); // zones per batch
+	#pragma omp parallel for schedule(dynamic)
+	for(size_t first=0; first<n_recomputed; first+=block){
+		const size_t last = min(first+block, n_recomputed);
+		if(batch){
+			ScratchFrame scratch;
+			Span<double> rho = scratch.allocate(last-first);
+			Span<double> T   = scratch.allocate(last-first);
+			Span<double> Ye  = scratch.allocate(last-first);
+			for(size_t k=first; k<last; k++){
+				rho[k-first] = grid->rho[changed[k]];
+				T[k-first]   = grid->T[changed[k]];
+				Ye[k-first]  = grid->Ye[changed[k]];
+			}
+			nulib_batch_eas(last-first, rho.data(), T.data(), Ye.data());
+		}
+		for(size_t k=first; k<last; k++){
+			const size_t z_ind = changed[k];
+			if(grid->opacity_cache_blocks>0){
+				for(size_t s=0; s<species_list.size(); s++) species_list[s]->set_munue(z_ind,grid);
+				opacity_version[z_ind-opacity_zone_start]++; // cached opacities are recomputed on their next use
+			}
+			else{
+				if(batch) nulib_select_eas_point(k-first);
+				for(size_t s=0; s<species_list.size(); s++){
+					species_list[s]->set_eas(z_ind,grid);
+					if(grid->has_inelastic(s)) grid->build_inelastic_samplers(s,z_ind);
+				}
+			}
+			opacity_rho[z_ind-opacity_zone_start] = grid->rho[z_ind];
+			opacity_T[z_ind-opacity_zone_start]   = grid->T[z_ind];
+			opacity_Ye[z_ind-opacity_zone_start]  = grid->Ye[z_ind];
+		}
+		if(batch) nulib_select_eas_point(-1);
+	}
+	if(verbose) cout << (grid->opacity_cache_blocks>0 ? "#   invalidated opacities in " : "#   recomputed opacities in ") << n_recomputed << "/" << opacity_zone_end-opacity_zone_start
+			<< " zones in " << MPI_Wtime()-set_eas_start << " seconds" << endl;
+	if(verbose and grid->inelastic_rank>0 and n_recomputed>0){
+		double max_error = 0;
+		for(size_t s=0; s<species_list.size(); s++)
+			if(grid->has_inelastic(s)) for(size_t z_ind=opacity_zone_start;z_ind<opacity_zone_end;z_ind++)
+				max_error = max(max_error, (double)max(grid->inelastic_kernel0[s].zone_error(z_ind), grid->inelastic_kernel1[s].zone_error(z_ind)));
+		cout << "#   rank " << grid->inelastic_rank << " inelastic kernels have relative error <= " << max_error << endl;
+	}
+}
+
+// has the zone's fluid state moved past the tolerance since its opacities were set?
+// rho and T are compared relative to their old values, Ye absolutely.
+// Uninitialized (NaN) states always compare as changed.
+bool Transport::opacity_state_changed(const size_t z_ind) const{
+	const double rho = grid->rho[z_ind];
+	const double T   = grid->T[z_ind];
+	const double Ye  = grid->Ye[z_ind];
+	const size_t i = z_ind - opacity_zone_start;
+	bool unchanged = abs(rho-opacity_rho[i]) <= opacity_tolerance*opacity_rho[i]
+			and abs(T-opacity_T[i]) <= opacity_tolerance*opacity_T[i]
+			and abs(Ye-opacity_Ye[i]) <= opacity_tolerance;
+	return not unchanged;
+}
+
+// a zone's [abs][scat] opacities for species s, from the calling
+// thread's cache if they are there and still current
+const double* Transport::cached_opacities(const size_t s, const size_t z_ind) const{
+	const size_t ng = grid->nu_grid_axis.size();
+	bool hit;
+	double* block = opacity_cache[omp_get_thread_num()].value.lookup(z_ind*species_list.size()+s, opacity_version[z_ind-opacity_zone_start], &hit);
+	if(not hit) species_list[s]->get_eas(z_ind, grid, block, block+ng);
+	return block;
+}
+
+// print the fraction of lookups that hit the cache since the last report
+void Transport::report_opacity_cache(){
+	size_t hits=0, misses=0;
+	for(size_t t=0; t<opacity_cache.size(); t++){
+		hits   += opacity_cache[t].value.hits;
+		misses += opacity_cache[t].value.misses;
+		opacity_cache[t].value.hits = opacity_cache[t].value.misses = 0;
 	}
+	if(verbose and hits+misses>0)
+		cout << "#   opacity cache hit rate " << (double)hits/(double)(hits+misses)
+			<< " (" << misses << " zone evaluations)" << endl;
+}
+
+// force set_eas in every zone at the next reset_radiation
+// (for code that writes the opacity arrays directly)
+void Transport::invalidate_opacities(){
+	opacity_rho.assign(opacity_zone_end-opacity_zone_start, NaN);
+	opacity_T.assign(opacity_zone_end-opacity_zone_start, NaN);
+	opacity_Ye.assign(opacity_zone_end-opacity_zone_start, NaN);
 }
 
 //-----------------------------
 // calculate annihilation rates
 //-----------------------------
 void Transport::calculate_annihilation(){
-	grid->fourforce_annihil.mpi_gather(my_zone_end);
 	if(verbose) cout << "# Calculating annihilation rates..." << flush;
 
 	// remember what zones I'm responsible for
-	if(MPI_myID != 0) return; // fast enough not to have to parallelize
-	int start = 0;//( MPI_myID==0 ? 0 : my_zone_end[MPI_myID - 1] );
-	int end = grid->rho.size();//my_zone_end[MPI_myID];
+	// only these have the full distribution function after reduce_radiation
+	int start = my_zone_start();
+	int end = my_zone_end[MPI_myID];
 	PRINT_ASSERT(end,>=,start);
 	PRINT_ASSERT(start,>=,0);
 	PRINT_ASSERT(end,<=,(int)grid->rho.size());
 
 	double H_nunu_tet = 0;
 
+	// get the list of species
+	vector<Tuple<size_t,2> > pairs;
+	switch(species_list.size()){
+	case 2:
+		pairs.resize(1);
+		pairs[0][0]=0; pairs[0][1]=1;
+		break;
+	case 3:
+		pairs.resize(2);
+		pairs[0][0]=0; pairs[0][1]=1;
+		pairs[1][0]=2; pairs[1][1]=2;
+		break;
+	case 4:
+		pairs.resize(2);
+		pairs[0][0]=0; pairs[0][1]=1;
+		pairs[1][0]=2; pairs[1][1]=3;
+		break;
+	case 6:
+		pairs.resize(3);
+		pairs[0][0]=0; pairs[0][1]=1;
+		pairs[1][0]=2; pairs[1][1]=3;
+		pairs[2][0]=4; pairs[2][1]=5;
+		break;
+	default:
+		assert(0); // these should be the only options
+	}
+	const size_t ng = grid->nu_grid_axis.size();
+	const size_t kernel_size = 2*ng*ng; // [order][gin][gout]
+
     #pragma omp parallel for reduction(+:H_nunu_tet)
 	for(int z_ind=start; z_ind<end; z_ind++){
 
@@ -397,55 +682,26 @@ void Transport::calculate_annihilation(){
 		size_t dir_ind[NDIMS];
 		grid->rho.indices(z_ind,dir_ind);
 
-		// get the kernels
-		vector< vector< vector< vector<double> > > > phi; // [s][order][gin][gout]
-		phi.resize(species_list.size());
-		for(size_t s=0; s<species_list.size(); s++)
-			species_list[s]->get_annihil_kernels(grid->rho[z_ind], grid->T[z_ind], grid->Ye[z_ind], grid->nu_grid_axis, phi[s]);
-
-		// get the list of species
-		vector<Tuple<size_t,2> > pairs;
-		switch(species_list.size()){
-		case 2:
-			pairs.resize(1);
-			pairs[0][0]=0; pairs[0][1]=1;
-			break;
-		case 3:
-			pairs.resize(2);
-			pairs[0][0]=0; pairs[0][1]=1;
-			pairs[1][0]=2; pairs[1][1]=2;
-			break;
-		case 4:
-			pairs.resize(2);
-			pairs[0][0]=0; pairs[0][1]=1;
-			pairs[1][0]=2; pairs[1][1]=3;
-			break;
-		case 6:
-			pairs.resize(3);
-			pairs[0][0]=0; pairs[0][1]=1;
-			pairs[1][0]=2; pairs[1][1]=3;
-			pairs[2][0]=4; pairs[2][1]=5;
-			break;
-		default:
-			assert(0); // these should be the only options
-		}
-
+		// get the kernels of the species that are needed
+		ScratchFrame scratch;
 		for(size_t p=0; p<pairs.size(); p++){
 			size_t s0=pairs[p][0], s1=pairs[p][1];
 			PRINT_ASSERT(species_list[s0]->weight,==,species_list[s1]->weight);
 
+			Span<double> phi = scratch.allocate(kernel_size);
+			species_list[s0]->get_annihil_kernels(grid->rho[z_ind], grid->T[z_ind], grid->Ye[z_ind], grid->nu_grid_axis, phi);
 			grid->distribution[s0]->annihilation_rate(dir_ind,
 					grid->distribution[s1],
-					phi[s0], species_list[s0]->weight,
+					phi, species_list[s0]->weight,
 					grid->fourforce_annihil[z_ind]);
 		}
 		H_nunu_tet += grid->fourforce_annihil[z_ind][3] * grid->zone_4volume(z_ind);
 	}
 
 	// synchronize global quantities between processors
-	// If this gets parallelized, should make mpi_sum more efficient by not transmitting entire array
-	//grid->fourforce_annihil.mpi_sum();
-	//MPI_Allreduce(MPI_IN_PLACE, &H_nunu_tet, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+	// fourforce_annihil stays with the zone owners (see Grid::write_zones)
+	if(MPI_myID==0) MPI_Reduce(MPI_IN_PLACE, &H_nunu_tet, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+	else            MPI_Reduce(&H_nunu_tet,        NULL, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
 
 	// write to screen
 	if(verbose) {
@@ -462,9 +718,19 @@ void Transport::normalize_radiative_quantities(){
 	if(verbose) cout << "# Normalizing Radiative Quantities" << endl;
 
 	// normalize zone quantities
+	// only this rank's zones hold the summed tallies
 	double inv_multiplier = 1.0/(double)n_subcycles;
+	const size_t zone_start = my_zone_start();
+	const size_t zone_end = my_zone_end[MPI_myID];
+	for(size_t i=0; i<zone_requests.size(); i++) wait_reduction(&zone_requests[i]);
+	if(not zone_ownership){
+		grid->fourforce_abs.finish_sum_scatter(my_zone_end);
+		grid->fourforce_emit.finish_sum_scatter(my_zone_end);
+		grid->l_abs.finish_sum_scatter(my_zone_end);
+		grid->l_emit.finish_sum_scatter(my_zone_end);
+	}
     #pragma omp parallel for
-	for(size_t z_ind=0;z_ind<grid->rho.size();z_ind++)
+	for(size_t z_ind=zone_start;z_ind<zone_end;z_ind++)
 	{
 	  //double inv_mult_four_vol = inv_multiplier / grid->zone_4volume(z_ind); // Lorentz invariant - same in lab and comoving frames. Assume lab_dt=1.0
 	  //PRINT_ASSERT(inv_mult_four_vol,>=,0);
@@ -473,18 +739,12 @@ void Transport::normalize_radiative_quantities(){
 		grid->fourforce_emit[z_ind] *= inv_multiplier;
 		grid->l_abs[z_ind] *= inv_multiplier;
 		grid->l_emit[z_ind] *= inv_multiplier;
-
-		// represents *all* species if nux
-		size_t dir_ind[NDIMS];
-		grid->rho.indices(z_ind,dir_ind);
-		for(size_t s=0; s<species_list.size(); s++){
-		  grid->distribution[s]->rescale_spatial_point(dir_ind, inv_multiplier);
-		}
 	}
 
 	// normalize global quantities
+	wait_reduction(&scalar_request);
+	if(MPI_nprocs>1) unpack_scalar_reduction();
 	for(size_t s=0; s<species_list.size(); s++){
-		grid->spectrum[s].rescale(inv_multiplier);
 		N_core_emit[s] *= inv_multiplier;
 		L_net_esc[s] *= inv_multiplier;
 		N_net_emit[s] *= inv_multiplier;
@@ -533,59 +793,134 @@ void Transport::normalize_radiative_quantities(){
 		for(size_t s=0; s<N_net_esc.size(); s++) cout << setw(12) << N_net_esc[s] << "  ";
 		cout << "} 1/s N_esc (lab)" << endl;
 	}
-	//calculate blocking factors
+	// normalize the distribution functions and calculate blocking factors
+	// one species at a time, so the next species is still being reduced.
+	// Each rank does its own zones, then everyone gets all of the blocking
+	// factors for set_eas (finished in finish_reduction). With zone
+	// ownership the owners only fill the other ranks' ghost zones.
+	const size_t ng = grid->nu_grid_axis.size();
+	vector<size_t> stop_list = my_zone_end;
+	for(size_t p=0; p<stop_list.size(); p++) stop_list[p] *= ng;
 	for(size_t s=0; s<species_list.size(); s++){
+		wait_reduction(&distribution_requests[s]);
+		if(not zone_ownership) grid->distribution[s]->finish_sum_scatter(my_zone_end);
+		if(s+1<species_list.size() and distribution_requests[s+1]!=MPI_REQUEST_NULL){
+			int done; // give MPI a chance to progress the next one
+			MPI_Test(&distribution_requests[s+1], &done, MPI_STATUS_IGNORE);
+		}
+
+		// represents *all* species if nux
+		#pragma omp parallel for
+		for(size_t z_ind=zone_start;z_ind<zone_end;z_ind++){
+			size_t dir_ind[NDIMS];
+			grid->rho.indices(z_ind,dir_ind);
+			grid->distribution[s]->rescale_spatial_point(dir_ind, inv_multiplier);
+		}
+
 		if(verbose) cout << "#     Working on fblock for species " << s << endl;
-		for(size_t glob_ind=0;glob_ind<grid->scat_opac[s].size();glob_ind++){
+		for(size_t glob_ind=zone_start*ng;glob_ind<zone_end*ng;glob_ind++){
 			size_t dir_ind[NDIMS+1];
-			grid->scat_opac[s].indices(glob_ind,dir_ind);
+			grid->fblock[s].indices(glob_ind,dir_ind);
 			grid->fblock[s][glob_ind]=0.5*(grid->fblock[s][glob_ind]+grid->distribution[s]->return_blocking(dir_ind, species_list[s]->weight));
 		}
+		if(zone_ownership) grid->fblock[s].mpi_fill_ghosts(); // only the ghost zones are stored
+		else if(MPI_nprocs>1) grid->fblock[s].mpi_iallgather(stop_list, &fblock_requests[s]);
+
+		wait_reduction(&spectrum_requests[s]);
+		grid->spectrum[s].rescale(inv_multiplier);
 	}
 }
 
 
-void Transport::sum_to_proc0()
+//----------------------------------------------------------------------------
+// Start summing the tallies from all ranks. Global scalars are packed into a
+// single reduction onto rank 0. Zone quantities are reduce-scattered, so each
+// rank ends up with the full sums only for the zones it owns (my_zone_end).
+// With zone ownership each rank only stores its own and ghost zones, so the
+// ghost zones are just added onto their owners' instead (blocking, but only
+// between neighbors). Everything else is posted as non-blocking collectives
+// in the order normalize_radiative_quantities() consumes them, so later
+// species are still in flight while earlier ones are being normalized. A
+// tally must not be touched until wait_reduction() on its request returns.
+//----------------------------------------------------------------------------
+void Transport::reduce_radiation()
 {
 	if(verbose) cout << "# Reducing Radiation" << endl;
+	reduce_start_time = MPI_Wtime();
+	reduce_wait_time = 0;
 
 	// scalars
-	if(verbose) cout << "#   Summing scalars" << endl;
-	if(MPI_myID==0){
-		MPI_Reduce(MPI_IN_PLACE, &particle_rouletted_energy, 1,                  MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(MPI_IN_PLACE, &particle_core_abs_energy,  1,                  MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(MPI_IN_PLACE, &particle_escape_energy,    1,                  MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(MPI_IN_PLACE, &L_net_esc.front(),         L_net_esc.size(),   MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(MPI_IN_PLACE, &N_net_esc.front(),         N_net_esc.size(),   MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(MPI_IN_PLACE, &N_net_emit.front(),        N_net_emit.size(),  MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(MPI_IN_PLACE, &N_core_emit.front(),       N_core_emit.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(MPI_IN_PLACE, &n_escape.front(),          n_escape.size(),    MPI_LONG,   MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(MPI_IN_PLACE, &n_active.front(),          n_active.size(),    MPI_LONG,   MPI_SUM, 0, MPI_COMM_WORLD);
+	const size_t ns = species_list.size();
+	scalar_reduce_buffer.resize(0);
+	scalar_reduce_buffer.push_back(particle_rouletted_energy);
+	scalar_reduce_buffer.push_back(particle_core_abs_energy);
+	scalar_reduce_buffer.push_back(particle_escape_energy);
+	for(size_t s=0; s<ns; s++){
+		scalar_reduce_buffer.push_back(L_net_esc[s]);
+		scalar_reduce_buffer.push_back(N_net_esc[s]);
+		scalar_reduce_buffer.push_back(N_net_emit[s]);
+		scalar_reduce_buffer.push_back(N_core_emit[s]);
+		scalar_reduce_buffer.push_back(n_escape[s]); // exact below 2^53
+		scalar_reduce_buffer.push_back(n_active[s]);
+	}
+	if(MPI_myID==0) MPI_Ireduce(MPI_IN_PLACE, &scalar_reduce_buffer.front(), scalar_reduce_buffer.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD, &scalar_request);
+	else            MPI_Ireduce(&scalar_reduce_buffer.front(),         NULL, scalar_reduce_buffer.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD, &scalar_request);
+
+	// volumetric quantities
+	if(zone_ownership){
+		grid->fourforce_abs.mpi_fold_ghosts();
+		grid->fourforce_emit.mpi_fold_ghosts();
+		grid->l_abs.mpi_fold_ghosts();
+		grid->l_emit.mpi_fold_ghosts();
 	}
 	else{
-		MPI_Reduce(&particle_rouletted_energy, NULL,                  1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(&particle_core_abs_energy,  NULL,                  1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(&particle_escape_energy,    NULL,                  1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(&L_net_esc.front(),         NULL,   L_net_esc.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(&N_net_esc.front(),         NULL,   N_net_esc.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(&N_net_emit.front(),        NULL,  N_net_emit.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(&N_core_emit.front(),       NULL, N_core_emit.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(&n_escape.front(),          NULL,    n_escape.size(), MPI_LONG,   MPI_SUM, 0, MPI_COMM_WORLD);
-		MPI_Reduce(&n_active.front(),          NULL,    n_active.size(), MPI_LONG,   MPI_SUM, 0, MPI_COMM_WORLD);
+		grid->fourforce_abs.mpi_isum_scatter(my_zone_end, &zone_requests[0]);
+		grid->fourforce_emit.mpi_isum_scatter(my_zone_end, &zone_requests[1]);
+		grid->l_abs.mpi_isum_scatter(my_zone_end, &zone_requests[2]);
+		grid->l_emit.mpi_isum_scatter(my_zone_end, &zone_requests[3]);
 	}
-	// volumetric quantities
-	if(verbose) cout << "#   Summing interaction rates" << endl;
-	grid->fourforce_abs.mpi_sum(); // mpi_sum_scatter(my_zone_end)
-	grid->fourforce_emit.mpi_sum();// mpi_sum_scatter(my_zone_end)
-	grid->l_abs.mpi_sum();// mpi_sum_scatter(my_zone_end)
-	grid->l_emit.mpi_sum();// mpi_sum_scatter(my_zone_end)
-
-	// reduce the spectra and distribution functions
-	if(verbose) cout << "#   Summing distribution function & spectra to needed proc and 0" << endl;
-	for(size_t i=0; i<species_list.size(); i++){
-		if(verbose) cout << "#     Working on species " << i << endl;
-		grid->spectrum[i].mpi_sum();
-		grid->distribution[i]->mpi_sum();
+
+	// distribution functions to the owning procs, spectra to proc 0
+	for(size_t s=0; s<ns; s++){
+		if(zone_ownership) grid->distribution[s]->mpi_fold_ghosts();
+		else grid->distribution[s]->mpi_isum_scatter(my_zone_end, &distribution_requests[s]);
+		grid->spectrum[s].mpi_isum(&spectrum_requests[s]);
+	}
+}
+
+void Transport::unpack_scalar_reduction(){
+	size_t i=0;
+	particle_rouletted_energy = scalar_reduce_buffer[i++];
+	particle_core_abs_energy  = scalar_reduce_buffer[i++];
+	particle_escape_energy    = scalar_reduce_buffer[i++];
+	for(size_t s=0; s<species_list.size(); s++){
+		L_net_esc[s]   = scalar_reduce_buffer[i++];
+		N_net_esc[s]   = scalar_reduce_buffer[i++];
+		N_net_emit[s]  = scalar_reduce_buffer[i++];
+		N_core_emit[s] = scalar_reduce_buffer[i++];
+		n_escape[s]    = (long)scalar_reduce_buffer[i++];
+		n_active[s]    = (long)scalar_reduce_buffer[i++];
+	}
+	PRINT_ASSERT(i,==,scalar_reduce_buffer.size());
+}
+
+// block until a reduction is done, keeping track of the time not hidden by computation
+void Transport::wait_reduction(MPI_Request* request){
+	if(*request==MPI_REQUEST_NULL) return;
+	double wait_start = MPI_Wtime();
+	MPI_Wait(request, MPI_STATUS_IGNORE);
+	reduce_wait_time += MPI_Wtime() - wait_start;
+}
+
+// the fblock exchange is only needed by set_eas at the start of the next step,
+// so it stays in flight through the annihilation calculation
+void Transport::finish_reduction(){
+	if(MPI_nprocs==1) return;
+	for(size_t s=0; s<fblock_requests.size(); s++) wait_reduction(&fblock_requests[s]);
+	if(verbose){
+		double total = MPI_Wtime() - reduce_start_time;
+		cout << "#   MPI reduction took " << total << " seconds (" << reduce_wait_time << " blocked waiting, "
+				<< total-reduce_wait_time << " hidden behind normalization)" << endl;
 	}
 }
 
@@ -638,68 +973,50 @@ void Transport::set_cdf_to_BB(const double T, const double chempot, CDFArray& em
 	emis.normalize();
 }
 
-void Transport::update_eh_background(EinsteinHelper* eh) const{ // things that depend only on particle position
-	// zone index
-	eh->z_ind = grid->zone_index(eh->xup);
-
-	// boundary conditions
-	if(r_core>0 && radius(eh->xup)<r_core){
-	  eh->fate = absorbed;
-	  return;
-	}
-	else if(eh->z_ind<0){
-		grid->symmetry_boundaries(eh);
-		eh->z_ind = grid->zone_index(eh->xup);
-		if(eh->z_ind < 0){
-			eh->fate = escaped;
-			return;
-		}
-	}
-	grid->grid_coordinates(eh->xup,eh->grid_coords);
-
-	// spatial indices
-	grid->rho.indices(eh->z_ind, eh->dir_ind);
-	for(size_t i=0; i<NDIMS; i++)	PRINT_ASSERT(eh->dir_ind[i],<,grid->rho.axes[i].size());
-	grid->rho.set_InterpolationCube(&(eh->icube_vol),eh->grid_coords,eh->dir_ind);
-	eh->icube_vol.set_slope_weights(eh->grid_coords);
-
-	// metric and its derivatives
-	if(DO_GR){
-		grid->interpolate_metric(eh);
-		if(eh->g.gtt >= 0){
-			eh->z_ind = -1;
-			eh->fate = absorbed;
-			return;
-		}
-	}
-	eh->zone_fourvolume = grid->zone_coord_volume(eh->z_ind) * (DO_GR ? eh->g.alpha*sqrt(eh->g.gammalow.det()) : 1.); // ccm*s, assumes dt=1s.
- 
-	// four-velocity
-	eh->v = grid->interpolate_fluid_velocity(*eh);
-	eh->set_fourvel();
-
-	// set tetrad
-	eh->set_tetrad_basis(grid->tetrad_rotation);
-}
-
 // make sure kup is consistent with the new background
 // interpolate reaction rates
-void Transport::update_eh_k_opac(EinsteinHelper* eh) const{
+// (renormalize=false trusts kup and kup_tet, e.g. for a particle that
+// was already renormalized at this position on another rank)
+void Transport::update_eh_k_opac(EinsteinHelper* eh, const bool renormalize) const{
 	if(eh->kup[3] <= 0){
 		eh->fate = absorbed;
 		eh->z_ind = -1;
 		return;
 	}
 
+	// no opacities here. Only happens for particles emitted from the
+	// core outside this rank's zones, which are about to be handed to
+	// the zone's owner. It repeats the lookup (see take_migrant)
+	if(zone_ownership and not has_opacities(eh->z_ind)){
+		eh->absopac = eh->scatopac = eh->inelastic_scatopac = NaN;
+		return;
+	}
+
 	PRINT_ASSERT(eh->kup,==,eh->kup);
-	eh->renormalize_kup();
+	if(renormalize) eh->renormalize_kup();
 	eh->grid_coords[NDIMS] = min(eh->nu(), grid->nu_grid_axis.max());
 	eh->dir_ind[NDIMS] = min(grid->nu_grid_axis.bin(eh->nu()), (int)grid->nu_grid_axis.size()-1);
-	eh->eas_ind = grid->abs_opac[eh->s].direct_index(eh->dir_ind);
-	grid->abs_opac[eh->s].set_InterpolationCube(&(eh->icube_spec),eh->grid_coords,eh->dir_ind);
-	eh->absopac  =  grid->abs_opac[eh->s].interpolate(eh->icube_spec);
-	eh->scatopac = grid->scat_opac[eh->s].interpolate(eh->icube_spec);
-	eh->inelastic_scatopac = grid->inelastic_scat_opac[eh->s].interpolate(eh->icube_spec);
+	// fblock has the same axes as the opacities and is always allocated
+	eh->eas_ind = grid->fblock[eh->s].direct_index(eh->dir_ind);
+	grid->fblock[eh->s].set_InterpolationCube(&(eh->icube_spec),eh->grid_coords,eh->dir_ind);
+	if(grid->opacity_cache_blocks>0){
+		// indices are zone-major, so each corner is (zone, group) = (i/ng, i%ng)
+		const size_t ng = grid->nu_grid_axis.size();
+		eh->absopac = eh->scatopac = eh->inelastic_scatopac = 0;
+		for(size_t c=0; c<eh->icube_spec.ncorners; c++){
+			const size_t i = eh->icube_spec.indices[c];
+			const double* block = cached_opacities(eh->s, i/ng);
+			eh->absopac  += block[     i%ng] * eh->icube_spec.weights[c];
+			eh->scatopac += block[ng + i%ng] * eh->icube_spec.weights[c];
+		}
+	}
+	else{
+		// one pass over the corners gathers every field of the opacity record
+		const Tuple<double,N_OPAC_FIELDS> opac = grid->opac[eh->s].interpolate(eh->icube_spec);
+		eh->absopac            = opac[OPAC_ABS];
+		eh->scatopac           = opac[OPAC_SCAT];
+		eh->inelastic_scatopac = opac[OPAC_INELASTIC];
+	}
 
 	PRINT_ASSERT(eh->absopac,>=,0);
 	PRINT_ASSERT(eh->scatopac,>=,0);
@@ -709,9 +1026,11 @@ void Transport::update_eh_k_opac(EinsteinHelper* eh) const{
 
 // Randomly generate new direction isotropically in comoving frame
 void Transport::isotropic_direction(Tuple<double,3>& D, ThreadRNG *rangen){
-	double costheta = 2.*rangen->uniform() - 1.;
+	double U[2];
+	rangen->uniform(U,2);
+	double costheta = 2.*U[0] - 1.;
 	double sintheta = sqrt(1. - costheta*costheta);
-	double phi = 2.*M_PI*rangen->uniform();
+	double phi = 2.*M_PI*U[1];
 	D[0] = sintheta * cos(phi);
 	D[1] = sintheta * sin(phi);
 	D[2] = costheta;
@@ -28,54 +28,251 @@
 #ifndef _TRANSPORT_H
 #define _TRANSPORT_H
 #include <vector>
+#include <deque>
 #include <atomic>
 #include "Particle.h"
 #include "LuaRead.h"
 #include "CDFArray.h"
 #include "ThreadRNG.h"
+#include "ExactSum.h"
+#include "MultiDArray.h"
 #include "EinsteinHelper.h"
+#include "BlockCache.h"
 
 class Species;
 class Grid;
 enum ParticleEvent {elastic_scatter, randomwalk, nothing, inelastic_scatter};
 
+// a particle in transit to the rank that owns its zone. Only the
+// state that cannot be recomputed from the position is sent. The
+// receiver rebuilds the rest of the EinsteinHelper from its own
+// grid. kup_tet is sent so the receiver need not renormalize kup
+// again unless the sender had no opacities (and so never did).
+// The stream is only meaningful in reproducible mode.
+struct MigratingParticle{
+	Tuple<double,4> xup, kup, kup_tet;
+	double N, N0;
+	size_t s;
+	bool renormalize;
+	PhiloxStream rng;
+};
+
+// the part of a particle's state at the start of a step that the
+// end of move() tallies with, so the particle need not be copied
+// whole before it drifts
+struct StepStart{
+	Tuple<double,4> kup_tet;
+	double N, ds_com, absopac, zone_fourvolume;
+	int z_ind;
+	size_t s;
+	size_t dir_ind[NDIMS+1];
+
+	StepStart() {}
+	StepStart(const EinsteinHelper& eh) : kup_tet(eh.kup_tet), N(eh.N), ds_com(eh.ds_com), absopac(eh.absopac),
+			zone_fourvolume(eh.zone_fourvolume), z_ind(eh.z_ind), s(eh.s){
+		for(size_t i=0; i<NDIMS+1; i++) dir_ind[i] = eh.dir_ind[i];
+	}
+};
+
+class EventBatch;
+
 class Transport
 {
 
 protected:
 
-	// this species' list of particles
-	vector<Particle> particles;
-
 	// MPI stuff
 	int MPI_nprocs;
 	int MPI_myID;
-	void sum_to_proc0();
+	void reduce_radiation();
+	void unpack_scalar_reduction();
+	void wait_reduction(MPI_Request* request);
+	void finish_reduction();
+
+	// non-blocking tally reduction, overlapped with normalization
+	std::vector<double> scalar_reduce_buffer;
+	MPI_Request scalar_request;
+	std::vector<MPI_Request> zone_requests;         // fourforce_abs/emit, l_abs/emit
+	std::vector<MPI_Request> distribution_requests; // [s]
+	std::vector<MPI_Request> spectrum_requests;     // [s]
+	std::vector<MPI_Request> fblock_requests;       // [s]
+	double reduce_start_time, reduce_wait_time;
 	std::vector<size_t> my_zone_end;
 
+	// zone ownership: each rank follows particles only in the zones it
+	// owns, and only stores and computes the fluid, opacity, and tally
+	// arrays for those plus ghost zones (see migrate.cpp). Particles are
+	// interpolated in [interp_zone_start, interp_zone_end), which leaves
+	// room for the interpolation stencil.
+	int    zone_ownership;
+	int    ownership_ghost_layers;
+	ZonePartition zone_partition;
+	size_t opacity_zone_start, opacity_zone_end;
+	size_t interp_zone_start, interp_zone_end;
+	size_t my_zone_start() const;
+	int  zone_owner(const int z_ind) const;
+	bool owns_zone(const int z_ind) const;
+	bool has_opacities(const int z_ind) const;
+	void check_ghost_reach(const EinsteinHelper* eh) const;
+
+	// the fluid state each zone's opacities were last computed from.
+	// set_eas is only called again once the state moves past the tolerance.
+	double opacity_tolerance;
+	std::vector<double> opacity_rho, opacity_T, opacity_Ye; // [z_ind - opacity_zone_start]
+	bool opacity_state_changed(const size_t z_ind) const;
+
+	// with opacity_cache_blocks>0 opacities are only evaluated when a particle
+	// first needs them. Each thread keeps the most recently used zones'
+	// [abs opacities][scat opacities] blocks, keyed by z_ind*nspecies+s.
+	// A zone's version is bumped whenever its fluid state changes.
+	mutable std::vector< Padded<BlockCache> > opacity_cache; // [thread]
+	std::vector<unsigned> opacity_version;         // [z_ind - opacity_zone_start]
+	const double* cached_opacities(const size_t s, const size_t z_ind) const;
+	void report_opacity_cache();
+
 	// subroutine for calculating timescales
 	void calculate_annihilation();
 
-	// main function to emit particles
-	void emit_particles();
-
-	// emit from where?
-	void emit_inner_source_by_bin();
-	void emit_zones_by_bin();
+	// how many particles does this rank emit?
+	size_t n_emit_on_rank(const size_t n_emit, const int rank) const;
+	size_t n_emit_core_on_rank(const int rank) const;
+	size_t n_emit_zones_on_rank(const int rank) const;
+	size_t n_emit_this_pass(const int rank) const;
+
+	// cost-model load balancing of emission (see emission.cpp)
+	int load_balance;
+	std::vector<ATOMIC<double> > emission_cost; // [bin] events counted on this rank this step
+	std::vector<double> predicted_cost;         // [bin] summed over ranks from the last step
+	std::vector<size_t> emission_bin_end;       // [rank] end of each rank's range of bins
+	std::vector<size_t> emission_bin_order;     // each rank's bins, most expensive first
+	std::vector<size_t> emission_offsets;       // number of particles before each entry of emission_bin_order
+	size_t n_core_emission_bins() const;
+	size_t n_zone_emission_bins() const;
+	size_t n_emit_per_bin(const size_t bin) const;
+	void balance_emission();
+
+	// cross-rank work stealing (see steal.cpp)
+	int work_stealing;
+	int work_steal_chunk;
+	bool work_progress;
+	MPI_Win work_window;
+	long work_next;                      // exposed in work_window
+	std::vector<size_t> work_queue_size; // [rank] particles each rank emits this pass
+	std::vector<size_t> work_known_next; // [rank] lower bound on each rank's next unclaimed ID
+	int work_victim_offset;
+	size_t n_stolen;
+	void start_work_queue();
+	bool claim_work(const size_t max_n, int* rank, size_t* start, size_t* n);
+	void stop_work_queue();
+	void progress_work_queue() const;
+
+	// particles this rank has claimed but not yet emitted, shared by the
+	// threads of one pass. Only the master thread claims (MPI_THREAD_FUNNELED),
+	// topping the pool up whenever it has fewer than low_water particles left.
+	struct WorkChunk{int rank; size_t next, end;};
+	struct WorkPool{
+		std::deque<WorkChunk> chunks;
+		size_t left, n_claimed;
+		bool empty; // every queue has been claimed
+		WorkPool() : left(0), n_claimed(0), empty(false) {}
+	};
+	void top_up_work(WorkPool* pool, const size_t low_water);
+	bool take_work(WorkPool* pool, int* rank, size_t* local_id, bool* done);
+
+	// particles moving between ranks during a pass with zone ownership
+	// (see migrate.cpp). The threads hand particles off into per-destination
+	// buffers and take arrived migrants, both under critical(migration).
+	// The master thread sends and receives them while the pass runs and
+	// decides when no particle is left anywhere.
+	struct MigrationSend{
+		std::vector<MigratingParticle> particles;
+		int rank;
+		MPI_Request request;
+	};
+	struct MigrationState{
+		std::vector< std::vector<MigratingParticle> > outgoing; // [destination] handed off, not yet sent
+		std::deque<MigratingParticle> arrived;  // received, not yet propagated
+		size_t n_finished;                      // particles and migrants done with on this rank
+		bool all_done;                          // no particle is left on any rank
+		std::vector<MigrationSend> sends;       // master thread only from here on
+		MPI_Datatype particle_type;
+		long n_sent, n_received;
+		MPI_Request wave_request;
+		bool wave_active, last_wave_quiet;
+		long wave_local[3], wave_global[3]; // sent, received, busy ranks
+		long last_wave_sent;
+		size_t n_waves;
+	};
+	void start_migration(MigrationState* m);
+	void progress_migration(MigrationState* m, const WorkPool& pool);
+	bool take_migrant(MigrationState* m, EinsteinHelper* eh, bool* done);
+	void finish_particle(MigrationState* m, const EinsteinHelper& eh);
+	void stop_migration(MigrationState* m);
+
+	// create the particle with a given local ID on a given rank
+	// returns the emission bin it came from
+	size_t emit_particle(const size_t local_id, EinsteinHelper* eh, const int rank);
 
 	// what kind of particle to create?
-	Particle create_surface_particle(const double Ep, const size_t s, const size_t g);
-	Particle create_thermal_particle(const int zone_index, const double weight, const size_t s, const size_t g);
-
-	// propagate the particles
-	void propagate_particles();
-	void propagate(EinsteinHelper* eh);
+	void create_surface_particle(EinsteinHelper* eh, const double weight, const size_t s, const size_t g);
+	void create_thermal_particle(EinsteinHelper* eh, const int zone_index, const double weight, const size_t s, const size_t g);
+
+	// emit and propagate the particles
+	void emit_and_propagate();
+	void emit_and_propagate_event();
+	size_t propagate(EinsteinHelper* eh); // returns the number of events
+	void tally_fate(const EinsteinHelper* eh);
+	void start_tallies();
+	void stop_tallies();
 	void move(EinsteinHelper *eh, bool do_absorption=true) const;
+
+	// propagation kernels specialized on the concrete grid and distribution
+	// types, so their per-step calls are resolved at compile time. The
+	// untemplated versions use <Grid,SpectrumArray> (virtual calls).
+	typedef size_t (Transport::*PropagateKernel)(EinsteinHelper* eh);
+	typedef void (Transport::*EventKernel)(EventBatch* batch);
+	PropagateKernel propagate_kernel; // what propagate() runs
+	EventKernel event_kernel;         // one round of emit_and_propagate_event()
+	void select_propagate_kernel();
+	template<class GridT> void select_propagate_kernel();
+	template<class GridT, class SpectrumT> void use_kernels();
+	template<class GridT, class SpectrumT> size_t propagate(EinsteinHelper* eh);
+	template<class GridT, class SpectrumT> void event_round(EventBatch* batch);
+	template<class GridT, class SpectrumT> void move(EinsteinHelper *eh, bool do_absorption=true) const;
+	template<class GridT, class SpectrumT> void end_move(EinsteinHelper *eh, const StepStart& start, const double dlambda, bool do_absorption=true) const;
+	template<class GridT> void which_event(const EinsteinHelper* eh, ParticleEvent *event, double* ds_com) const;
+	template<class GridT> double randomwalk_distance(const EinsteinHelper* eh, const double d_zone) const;
+	template<class GridT> void update_eh_background(EinsteinHelper* eh) const;
+	template<class GridT, class SpectrumT> void random_walk(EinsteinHelper *eh) const;
+	template<class GridT, class SpectrumT> void scatter(EinsteinHelper *eh, const ParticleEvent event) const;
 	void random_walk(EinsteinHelper *eh) const;
 	void init_randomwalk_cdf(Lua* lua);
 	void window(EinsteinHelper *eh) const;
 	void sample_scattering_final_state(EinsteinHelper* eh, const Tuple<double,4>& kup_tet_old) const;
 
+	// step-size arithmetic shared by which_event() and the array kernels of
+	// the event engine. Written with selects rather than std::min/max or
+	// branches so that loops over it vectorize.
+	static double zone_step(const double zone_min_length, const double k3, const double kup_tet_t, const double min_step, const double max_step){
+		const double d_zone = zone_min_length / k3 * kup_tet_t;
+		const double lo = d_zone*min_step, hi = d_zone*max_step;
+		const double d = (d_zone<lo ? lo : d_zone);
+		return (hi<d ? hi : d);
+	}
+	static double boundary_step(const double d_boundary, const double d_zone){
+		const double d_min = d_zone*(1.0+TINY);
+		double d = d_boundary*(1.0+TINY);
+		d = (d<d_min ? d_min : d);
+		return (d_zone<d ? d_zone : d);
+	}
+	// d_elastic and d_inelastic are the sampled optical depths divided by
+	// the opacities, and are ignored where the opacity is zero
+	static void choose_interaction(const double d_elastic, const double d_inelastic, const double scatopac,
+			const double inelastic_scatopac, double* ds_com, ParticleEvent* event){
+		if(scatopac>0           and d_elastic   < *ds_com){*ds_com = d_elastic;   *event = elastic_scatter;}
+		if(inelastic_scatopac>0 and d_inelastic < *ds_com){*ds_com = d_inelastic; *event = inelastic_scatter;}
+	}
+
 
 
 	// solve for temperature and Ye (if steady_state)
@@ -83,6 +280,10 @@ protected:
 
 	// simulation parameters
 	int    do_annihilation;
+	std::string transport_mode;
+	int    event_bank_size;
+	int    reproducible;
+	size_t n_emission_passes; // labels the random number streams in reproducible mode
 
 	// random walk parameters
 	CDFArray randomwalk_diffusion_time;
@@ -100,6 +301,15 @@ protected:
 	ATOMIC<double> particle_core_abs_energy;
 	ATOMIC<double> particle_escape_energy;
 
+	// global radiation quantities are added through tally_scalar so that
+	// reproducible mode can route them through an order-independent sum
+	enum ScalarTally {rouletted_energy_tally, core_abs_energy_tally, escape_energy_tally,
+		N_core_emit_tally, N_net_emit_tally, N_net_esc_tally, L_net_esc_tally};
+	std::vector<ATOMIC<double>*> scalar_tally_targets;
+	ExactSum scalar_tallies;
+	size_t scalar_tally_index(const ScalarTally which, const size_t s=0) const;
+	void tally_scalar(const ScalarTally which, const size_t s, const double value);
+
 	// check parameters
 	void check_parameters() const;
 
@@ -120,6 +330,16 @@ public:
 	// pointer to grid
 	Grid *grid;
 
+	// end of each rank's zone range. After a step, zone quantities
+	// are only valid on the rank that owns them.
+	const std::vector<size_t>& zone_stop_list() const {return my_zone_end;}
+
+	// called by Grid::init once the zones are known. Sets up the
+	// zone_stop_list and, with zone ownership, the zone partition
+	// that the grid's arrays are allocated with (NULL otherwise)
+	void init_zone_ownership();
+	const ZonePartition* zone_partition_or_null() const {return zone_ownership ? &zone_partition : NULL;}
+
 	// minimum neutrino packet energy
 	double min_packet_weight;
 	double min_step_size, max_step_size;
@@ -160,17 +380,45 @@ public:
 	// set things up
 	void init(Lua* lua);
 	void update_eh_background(EinsteinHelper* eh) const;
-	void update_eh_k_opac(EinsteinHelper* eh) const;
+	void update_eh_k_opac(EinsteinHelper* eh, const bool renormalize=true) const;
 
 	// in-simulation functions to be used by main
 	void step();
 	void which_event(const EinsteinHelper* eh, ParticleEvent *event, double* ds_com) const;
 	void reset_radiation();
+	void invalidate_opacities();
 	void write(const int it) const;
 	void write_rays(const int it);
 	static std::string filename(const char* filebase, const int iw, const char* suffix);
 	static double mean_mass(const double Ye);
 };
 
+//--------------------------------------------------------
+// The (grid, distribution) pairs select_propagate_kernel()
+// can pick. Kernel templates are explicitly instantiated
+// for each pair (or each grid, for those that depend only
+// on the grid) in the file that defines them, so kernels
+// defined in one file can be called from another.
+//--------------------------------------------------------
+#define TRANSPORT_KERNEL_SPECTRA(X,GridT)   \
+	X(GridT, PolarSpectrumArray<NDIMS>)        \
+	X(GridT, MomentSpectrumArray<NDIMS>)       \
+	X(GridT, RadialMomentSpectrumArray<NDIMS>) \
+	X(GridT, GR1DSpectrumArray)
+#define TRANSPORT_KERNEL_TYPES(X)                  \
+	X(Grid, SpectrumArray)                     \
+	TRANSPORT_KERNEL_SPECTRA(X, Grid0DIsotropic) \
+	TRANSPORT_KERNEL_SPECTRA(X, Grid1DSphere)    \
+	TRANSPORT_KERNEL_SPECTRA(X, Grid2DSphere)    \
+	TRANSPORT_KERNEL_SPECTRA(X, Grid3DCart)      \
+	TRANSPORT_KERNEL_SPECTRA(X, GridGR1D)
+#define TRANSPORT_KERNEL_GRIDS(X) \
+	X(Grid)                   \
+	X(Grid0DIsotropic)        \
+	X(Grid1DSphere)           \
+	X(Grid2DSphere)           \
+	X(Grid3DCart)             \
+	X(GridGR1D)
+
 #endif
 
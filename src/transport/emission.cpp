@@ -26,6 +26,8 @@
 */
 
 #include <omp.h>
+#include <algorithm>
+#include <numeric>
 #include "Transport.h"
 #include "Species.h"
 #include "Grid.h"
@@ -35,105 +37,195 @@ using namespace std;
 namespace pc = physical_constants;
 
 //------------------------------------------------------------
-// emit new particles
+// Rank p owns global particle IDs p, p+MPI_nprocs, ...
+// Core particles and zone particles have separate ID spaces. Local IDs
+// run over the rank's core particles first, then its zone particles.
+// With zone ownership a rank instead emits all zone particles
+// in the zones it owns, which is a contiguous block of global IDs.
+// With load balancing the IDs come from balance_emission() below.
+// Any rank can compute any other rank's particles, which is what
+// lets idle ranks steal work (see steal.cpp).
 //------------------------------------------------------------
-void Transport::emit_particles()
-{
-	// emit from the core and/or the zones
-	if(verbose) cout << "# Emitting particles..." << endl;
-	if(n_emit_core_per_bin>0 and r_core>0)  emit_inner_source_by_bin();
-	if(n_emit_zones_per_bin>0) emit_zones_by_bin();
-
-	// sanity checks
-	for(size_t i=0; i<particles.size(); i++){
-		if(particles[i].fate==moving){
-			for(size_t j=0; j<4; j++){
-				PRINT_ASSERT(particles[i].xup[j],==,particles[i].xup[j]);
-				PRINT_ASSERT(particles[i].kup[j],==,particles[i].kup[j]);
-			}
-			PRINT_ASSERT(particles[i].N,==,particles[i].N);
-		}
+size_t Transport::n_emit_on_rank(const size_t n_emit, const int rank) const{
+	size_t n_emit_on_rank = n_emit / MPI_nprocs;
+	if((int)(n_emit % MPI_nprocs) > rank) n_emit_on_rank++;
+	return n_emit_on_rank;
+}
+size_t Transport::n_emit_core_on_rank(const int rank) const{
+	if(n_emit_core_per_bin<=0 or r_core<=0) return 0;
+	return n_emit_on_rank(species_list.size() * grid->nu_grid_axis.size() * n_emit_core_per_bin, rank);
+}
+size_t Transport::n_emit_zones_on_rank(const int rank) const{
+	if(n_emit_zones_per_bin<=0) return 0;
+	const size_t n_per_zone = species_list.size() * grid->nu_grid_axis.size() * n_emit_zones_per_bin;
+	if(zone_ownership){
+		const size_t zone_start = (rank==0 ? 0 : my_zone_end[rank-1]);
+		return n_per_zone * (my_zone_end[rank] - zone_start);
+	}
+	return n_emit_on_rank(n_per_zone * grid->rho.size(), rank);
+}
+size_t Transport::n_emit_this_pass(const int rank) const{
+	if(load_balance){
+		PRINT_ASSERT(emission_offsets.size(),>,0);
+		const size_t bin_start = (rank==0 ? 0 : emission_bin_end[rank-1]);
+		return emission_offsets[emission_bin_end[rank]] - emission_offsets[bin_start];
 	}
+	return n_emit_core_on_rank(rank) + n_emit_zones_on_rank(rank);
 }
 
 //------------------------------------------------------------
-// inject particles from a central luminous source
-// Currently written to emit photons with 
-// blackblody spectrum based on T_core and L_core
+// Emission load balancing (load_balance=1)
+// Particles are grouped into emission bins, one per (species,group)
+// for the core and one per (zone,species,group) for the zones,
+// numbered in global ID order. The cost of propagating the particles
+// from each bin is measured every step as the number of events its
+// particles went through, and summed over ranks to predict the next
+// step. Event counts (unlike wall time) do not depend on the machine
+// or its load, so with a fixed seed the assignment is the same from
+// run to run. Each rank gets a contiguous range of bins with equal
+// predicted cost and emits its most expensive bins first, so the
+// dynamic thread schedule fills in the tail with cheap particles.
 //------------------------------------------------------------
-void Transport::emit_inner_source_by_bin(){
-	int size_before = particles.size();
-	double weight = 1./((double)n_emit_core_per_bin);
+size_t Transport::n_core_emission_bins() const{
+	if(n_emit_core_per_bin<=0 or r_core<=0) return 0;
+	return species_list.size() * grid->nu_grid_axis.size();
+}
+size_t Transport::n_zone_emission_bins() const{
+	if(n_emit_zones_per_bin<=0) return 0;
+	return species_list.size() * grid->nu_grid_axis.size() * grid->rho.size();
+}
+size_t Transport::n_emit_per_bin(const size_t bin) const{
+	return bin<n_core_emission_bins() ? n_emit_core_per_bin : n_emit_zones_per_bin;
+}
 
-	const size_t ns = species_list.size();
-	const size_t ng = grid->nu_grid_axis.size();
-	const size_t n_emit = ns*ng*n_emit_core_per_bin;
-	size_t n_emit_this_rank = n_emit / MPI_nprocs;
-	if((int)(n_emit % MPI_nprocs) > MPI_myID) n_emit_this_rank++;
-	particles.resize(size_before + n_emit_this_rank);
+void Transport::balance_emission(){
+	const size_t nbins = n_core_emission_bins() + n_zone_emission_bins();
 
-	size_t n_created = 0;
-	#pragma omp parallel for schedule(guided) collapse(3) reduction(+:n_created)
-	for(size_t s=0; s<ns; s++){
-		for(size_t g=0; g<ng; g++){
-			for(int k=0; k<n_emit_core_per_bin; k++){
-				size_t global_id = k + n_emit_core_per_bin*g + n_emit_core_per_bin*ng*s;
-				if((int)(global_id%MPI_nprocs) == MPI_myID){
-					size_t local_index = size_before + global_id/MPI_nprocs;
-					particles[local_index] = create_surface_particle(weight,s,g);
-					if(particles[local_index].fate == moving) n_created++;
-				}
-			}
+	// predict this step's cost from the last one.
+	// Before anything is measured every particle costs the same.
+	double imbalance_before = NaN;
+	if(emission_cost.size() != nbins){
+		emission_cost.resize(nbins);
+		predicted_cost.resize(nbins);
+		for(size_t b=0; b<nbins; b++) predicted_cost[b] = n_emit_per_bin(b);
+	}
+	else{
+		double my_cost = 0;
+		for(size_t b=0; b<nbins; b++){
+			predicted_cost[b] = emission_cost[b];
+			my_cost += predicted_cost[b];
 		}
+		MPI_Allreduce(MPI_IN_PLACE, &predicted_cost.front(), nbins, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+		double max_cost, total_cost;
+		MPI_Allreduce(&my_cost, &max_cost,   1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+		MPI_Allreduce(&my_cost, &total_cost, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+		if(total_cost>0) imbalance_before = max_cost / (total_cost/MPI_nprocs);
 	}
+	for(size_t b=0; b<nbins; b++) emission_cost[b] = 0;
 
-	if(verbose) cout << "#   emit_inner_source_by_bin() created = " << n_created << " particles on rank 0 ("
-			<< n_emit_this_rank-n_created << " rouletted during emission)" << endl;
-}
+	// split the bins into contiguous ranges of equal predicted cost
+	double total_cost = 0;
+	for(size_t b=0; b<nbins; b++) total_cost += predicted_cost[b];
+	vector<size_t> bin_end(MPI_nprocs);
+	vector<double> rank_cost(MPI_nprocs,0);
+	size_t b = 0;
+	double running_cost = 0;
+	for(int p=0; p<MPI_nprocs; p++){
+		const double target = total_cost * (p+1) / MPI_nprocs;
+		while(b<nbins and (p==MPI_nprocs-1 or running_cost + 0.5*predicted_cost[b] <= target)){
+			running_cost += predicted_cost[b];
+			rank_cost[p] += predicted_cost[b];
+			b++;
+		}
+		bin_end[p] = b;
+	}
+	PRINT_ASSERT(bin_end[MPI_nprocs-1],==,nbins);
+	const double imbalance_after = total_cost>0 ? *max_element(rank_cost.begin(), rank_cost.end()) / (total_cost/MPI_nprocs) : NaN;
 
+	// order each rank's bins most expensive first
+	// every rank keeps every rank's order so it can steal their particles
+	emission_bin_end = bin_end;
+	emission_bin_order.resize(nbins);
+	iota(emission_bin_order.begin(), emission_bin_order.end(), 0);
+	const vector<double>& cost = predicted_cost;
+	for(int p=0; p<MPI_nprocs; p++)
+		stable_sort(emission_bin_order.begin() + (p==0 ? 0 : bin_end[p-1]), emission_bin_order.begin() + bin_end[p],
+				[&cost](const size_t a, const size_t b){return cost[a]>cost[b];});
+	emission_offsets.resize(nbins+1);
+	emission_offsets[0] = 0;
+	for(size_t i=0; i<nbins; i++)
+		emission_offsets[i+1] = emission_offsets[i] + n_emit_per_bin(emission_bin_order[i]);
 
-//--------------------------------------------------------------------------
-// emit particles
-//--------------------------------------------------------------------------
-void Transport::emit_zones_by_bin(){
-	int size_before = particles.size();
-	double weight = 1./((double)n_emit_zones_per_bin);
+	if(verbose) cout << "#   Emission load imbalance (max/mean cost per rank): " << imbalance_before
+			<< " last step, " << imbalance_after << " predicted after rebalancing" << endl;
+}
 
+//------------------------------------------------------------
+// create the particle with the given local ID on the given rank
+// directly into eh so it can be propagated immediately without
+// being stored
+//------------------------------------------------------------
+size_t Transport::emit_particle(const size_t local_id, EinsteinHelper* eh, const int rank){
 	const size_t ns = species_list.size();
 	const size_t ng = grid->nu_grid_axis.size();
-	const size_t nz = grid->rho.size();
-	const size_t n_emit = ns*ng*nz*n_emit_zones_per_bin;
-	size_t n_emit_this_rank = n_emit / MPI_nprocs;
-	if((int)(n_emit % MPI_nprocs) > MPI_myID) n_emit_this_rank++;
-	particles.resize(size_before + n_emit_this_rank);
+	const size_t n_core_bins = n_core_emission_bins();
+
+	// find the global ID of the particle
+	bool core;
+	size_t global_id;
+	if(load_balance){
+		const size_t bin_start = (rank==0 ? 0 : emission_bin_end[rank-1]);
+		const size_t pos = emission_offsets[bin_start] + local_id;
+		const size_t i = upper_bound(emission_offsets.begin()+bin_start, emission_offsets.begin()+emission_bin_end[rank]+1, pos) - emission_offsets.begin() - 1;
+		PRINT_ASSERT(i,<,emission_bin_end[rank]);
+		const size_t bin = emission_bin_order[i];
+		const size_t j = pos - emission_offsets[i];
+		core = bin < n_core_bins;
+		global_id = core ? bin*n_emit_core_per_bin + j : (bin-n_core_bins)*n_emit_zones_per_bin + j;
+	}
+	else{
+		const size_t n_core_local = n_emit_core_on_rank(rank);
+		core = local_id < n_core_local;
+		if(core) global_id = rank + local_id*MPI_nprocs;
+		else{
+			const size_t zone_local_id = local_id - n_core_local;
+			if(zone_ownership){
+				PRINT_ASSERT(rank,==,MPI_myID);
+				global_id = my_zone_start()*n_emit_zones_per_bin*ng*ns + zone_local_id;
+			}
+			else global_id = rank + zone_local_id*MPI_nprocs;
+		}
+	}
 
-	size_t n_created = 0;
-	#pragma omp parallel for reduction(+:n_created) schedule(guided) collapse(4)
-	for (size_t z_ind=0; z_ind<nz; z_ind++){
-		for(size_t s=0; s<ns; s++){
-			for(size_t g=0; g<ng; g++){
-				for(int k=0; k<n_emit_zones_per_bin; k++){
+	// inject particles from a central luminous source
+	if(core){
+		const size_t g = (global_id / n_emit_core_per_bin) % ng;
+		const size_t s =  global_id / (n_emit_core_per_bin*ng);
+		PRINT_ASSERT(s,<,ns);
+		if(reproducible) rangen.set_stream(global_id, n_emission_passes);
+		create_surface_particle(eh, 1./((double)n_emit_core_per_bin), s, g);
+	}
 
-					size_t global_id = k + n_emit_zones_per_bin*g + n_emit_zones_per_bin*ng*s + n_emit_zones_per_bin*ng*ns*z_ind;
-					if((int)(global_id%MPI_nprocs) == MPI_myID){
-						size_t local_index = size_before + global_id/MPI_nprocs;
-						particles[local_index] = create_thermal_particle(z_ind,weight,s,g);
-						if(particles[local_index].fate == moving){
-							n_created++;
-							for(size_t d=0; d<4; d++) PRINT_ASSERT(particles[local_index].xup[d],==,particles[local_index].xup[d]);
-						}
-					}
+	// emit thermally from the zones
+	else{
+		const size_t g     = (global_id / n_emit_zones_per_bin) % ng;
+		const size_t s     = (global_id / (n_emit_zones_per_bin*ng)) % ns;
+		const size_t z_ind =  global_id / (n_emit_zones_per_bin*ng*ns);
+		PRINT_ASSERT(z_ind,<,grid->rho.size());
+		if(reproducible) rangen.set_stream(global_id | (1ULL<<63), n_emission_passes); // separate from core IDs
+		create_thermal_particle(eh, z_ind, 1./((double)n_emit_zones_per_bin), s, g);
+	}
 
-				}
-			}
+	// sanity checks
+	if(eh->fate==moving){
+		for(size_t j=0; j<4; j++){
+			PRINT_ASSERT(eh->xup[j],==,eh->xup[j]);
+			PRINT_ASSERT(eh->kup[j],==,eh->kup[j]);
 		}
+		PRINT_ASSERT(eh->N,==,eh->N);
 	}
-	  
-	double total_neutrinos = 0;
-	for(size_t i=0; i<species_list.size(); i++) total_neutrinos += N_net_emit[i];
-	if(verbose) cout << "#   emit_zones_by_bin() created " << n_created << " particles on rank 0 ("
-			<< total_neutrinos << " neutrinos) ("
-			<< n_emit_this_rank-n_created << " rouletted immediately)" << endl;
+
+	return core ? global_id/n_emit_core_per_bin : n_core_bins + global_id/n_emit_zones_per_bin;
 }
 
 
@@ -143,26 +235,25 @@ void Transport::emit_zones_by_bin(){
 // Useful for thermal radiation emitted all througout
 // the grid
 //------------------------------------------------------------
-Particle Transport::create_thermal_particle(const int z_ind,const double weight, const size_t s, const size_t g)
+void Transport::create_thermal_particle(EinsteinHelper* eh, const int z_ind,const double weight, const size_t s, const size_t g)
 {
 	PRINT_ASSERT(z_ind,>=,0);
 	PRINT_ASSERT(z_ind,<,(int)grid->rho.size());
 	PRINT_ASSERT(s,<,species_list.size());
 	
-	EinsteinHelper eh;
-	eh.fate = moving;
-	eh.s = s;
+	*eh = EinsteinHelper();
+	eh->fate = moving;
+	eh->s = s;
 
 	// random sample position in zone
-	eh.xup = grid->sample_in_zone(z_ind,&rangen);
-	eh.xup[3] = 0;
-	update_eh_background(&eh);
-	if(eh.z_ind<0 || radius(eh.xup)<r_core){
-		Particle output;
-		output.kup[3] = 0;
-		output.N = 0;
-		output.fate = rouletted;
-		return output;
+	eh->xup = grid->sample_in_zone(z_ind,&rangen);
+	eh->xup[3] = 0;
+	update_eh_background(eh);
+	if(eh->z_ind<0 || radius(eh->xup)<r_core){
+		eh->kup[3] = 0;
+		eh->N = 0;
+		eh->fate = rouletted;
+		return;
 	}
 
 	// sample the frequency
@@ -178,32 +269,29 @@ Particle Transport::create_thermal_particle(const int z_ind,const double weight,
 	Tuple<double,4> kup_tet;
 	kup_tet[3] = nu * pc::h;
 	isotropic_kup_tet(kup_tet,&rangen);
-	eh.set_kup_tet(kup_tet);
-	update_eh_k_opac(&eh);
+	eh->set_kup_tet(kup_tet);
+	update_eh_k_opac(eh);
 
 	// set the particle number
-	double T = grid->T.interpolate(eh.icube_vol);
-	double mu = grid->munue.interpolate(eh.icube_vol) * species_list[s]->lepton_number;
-	eh.N = number_blackbody(T,mu,nu) * eh.absopac * species_list[s]->weight; // #/s/cm^3/sr/(Hz^3/3)
-	eh.N *= eh.zone_fourvolume;// frame-independent four-volume
-	eh.N *= weight * 4.*pc::pi/*sr*/ * grid->nu_grid_axis.delta3(g)/3.0/*Hz^3/3*/;
-	PRINT_ASSERT(eh.N,>=,0);
-	PRINT_ASSERT(eh.N,<,1e99);
-	eh.N0 = eh.N;
+	double T = grid->T.interpolate(eh->icube_vol);
+	double mu = grid->munue.interpolate(eh->icube_vol) * species_list[s]->lepton_number;
+	eh->N = number_blackbody(T,mu,nu) * eh->absopac * species_list[s]->weight; // #/s/cm^3/sr/(Hz^3/3)
+	eh->N *= eh->zone_fourvolume;// frame-independent four-volume
+	eh->N *= weight * 4.*pc::pi/*sr*/ * grid->nu_grid_axis.delta3(g)/3.0/*Hz^3/3*/;
+	PRINT_ASSERT(eh->N,>=,0);
+	PRINT_ASSERT(eh->N,<,1e99);
+	eh->N0 = eh->N;
 
-	// add to particle vector
-	window(&eh);
-	if(eh.fate == moving){
-		PRINT_ASSERT(eh.N,>,0);
+	// roulette if the particle starts out with too low a weight
+	window(eh);
+	if(eh->fate == moving){
+		PRINT_ASSERT(eh->N,>,0);
 
 		// count up the emitted energy in each zone
-		N_net_emit[eh.s] += eh.N;
-		grid->l_emit[z_ind] -= eh.N * species_list[eh.s]->lepton_number / eh.zone_fourvolume;
-		for(size_t i=0; i<4; i++){
-			grid->fourforce_emit[z_ind][i] -= eh.N * kup_tet[i] / eh.zone_fourvolume;
-		}
+		tally_scalar(N_net_emit_tally, eh->s, eh->N);
+		grid->l_emit_tally.add(grid->l_emit, z_ind, -eh->N * species_list[eh->s]->lepton_number / eh->zone_fourvolume);
+		grid->fourforce_emit_tally.add(grid->fourforce_emit, z_ind, kup_tet * (-eh->N / eh->zone_fourvolume));
 	}
-	return eh.get_Particle();
 }
 
 
@@ -211,20 +299,20 @@ Particle Transport::create_thermal_particle(const int z_ind,const double weight,
 // General function to create a particle on the surface
 // emitted isotropically outward in the comoving frame. 
 //------------------------------------------------------------
-Particle Transport::create_surface_particle(const double weight, const size_t s, const size_t g)
+void Transport::create_surface_particle(EinsteinHelper* eh, const double weight, const size_t s, const size_t g)
 {
 	PRINT_ASSERT(weight,>,0);
 	PRINT_ASSERT(weight,!=,INFINITY);
 	PRINT_ASSERT(s,<,species_list.size());
 
-	EinsteinHelper eh;
-	eh.fate = moving;
-	eh.s = s;
+	*eh = EinsteinHelper();
+	eh->fate = moving;
+	eh->s = s;
 
 	// pick initial position on photosphere
-	random_core_x(eh.xup);
-	eh.xup[3] = 0;
-	update_eh_background(&eh);
+	random_core_x(eh->xup);
+	eh->xup[3] = 0;
+	update_eh_background(eh);
 
 	// sample the frequency
 	double nu=0;
@@ -240,30 +328,29 @@ Particle Transport::create_surface_particle(const double weight, const size_t s,
 	double costheta;
 	do{
 		isotropic_kup_tet(kup_tet,&rangen);
-		eh.set_kup_tet(kup_tet);
-		costheta = eh.g.dot<3>(eh.xup, eh.kup) / sqrt(eh.g.dot<3>(eh.kup, eh.kup) * eh.g.dot<3>(eh.xup, eh.xup));
+		eh->set_kup_tet(kup_tet);
+		costheta = eh->g.dot<3>(eh->xup, eh->kup) / sqrt(eh->g.dot<3>(eh->kup, eh->kup) * eh->g.dot<3>(eh->xup, eh->xup));
 	} while(r_core>0 and reject_direction(costheta, 2.)); // 2. makes pdf = costheta
-	update_eh_k_opac(&eh);
+	update_eh_k_opac(eh);
 
 	//get the number of neutrinos in the particle
 	double T = species_list[s]->T_core;
 	double mu = species_list[s]->mu_core;
 	double multiplier = species_list[s]->core_lum_multiplier * species_list[s]->weight;
 	PRINT_ASSERT(nu,>,0);
-	eh.N = number_blackbody(T,mu,nu)   // #/s/cm^2/sr/(Hz^3/3)
+	eh->N = number_blackbody(T,mu,nu)   // #/s/cm^2/sr/(Hz^3/3)
 			* 1                          //   s
 			* (4.0*pc::pi*r_core*r_core) //     cm^2
 			* pc::pi                     //          sr (including factor of 1/2 for integrating over cos(theta)
 			* grid->nu_grid_axis.delta3(g)/3.0 //        Hz^3/3
 			* multiplier                 // overall scaling
-			* (DO_GR ? eh.g.alpha : 1.)  // time lapse (s)
+			* (DO_GR ? eh->g.alpha : 1.)  // time lapse (s)
 			* weight;                    // 1/number of samples
-	eh.N0 = eh.N;
+	eh->N0 = eh->N;
 
-	// add to particle vector
-	window(&eh);
-	if(eh.fate == moving){
-		N_core_emit[eh.s] += eh.N;
+	// roulette if the particle starts out with too low a weight
+	window(eh);
+	if(eh->fate == moving){
+		tally_scalar(N_core_emit_tally, eh->s, eh->N);
 	}
-	return eh.get_Particle();
 }
@@ -0,0 +1,316 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+
+#include <mpi.h>
+#include <omp.h>
+#include <algorithm>
+#include <type_traits>
+#include "global_options.h"
+#include "Transport.h"
+#include "Grid.h"
+#include "EinsteinHelper.h"
+
+using namespace std;
+
+//===========================================================//
+// ZONE OWNERSHIP                                            //
+// Rank p owns the contiguous block of zones ending at       //
+// my_zone_end[p]. Zone particles are emitted by the owner   //
+// of their zone, and a particle that leaves the owned block //
+// is buffered and sent to the new zone's owner. Each rank   //
+// stores the zone-major fluid, opacity, distribution and    //
+// tally arrays only for its block plus ghost layers (see    //
+// ZonePartition), so their memory per rank falls as         //
+// 1/nranks. A particle scatters in the zone it steps into,  //
+// one layer out, and the interpolation there reaches one    //
+// more layer, hence at least two ghost layers. Tallies in   //
+// ghost zones are folded onto their owners, and fblock is   //
+// copied from the owners into the ghost zones. The fluid    //
+// velocity, metric and zone geometry stay replicated (about //
+// 20 values per zone) because core particles start          //
+// anywhere.                                                 //
+//===========================================================//
+
+//----------------------------------------------------------
+// split the zones between the ranks and set the ranges of
+// zones with stored and usable data
+//----------------------------------------------------------
+void Transport::init_zone_ownership(){
+	// figure out which zones are in this processors work load
+	// a processor will do work in range [start,end)
+	// ranges are whole slabs of the first grid axis so each rank's
+	// zones are a contiguous hyperslab of the output arrays.
+	// Round up so the first ranks get work if there are more ranks than slabs.
+	my_zone_end.resize(MPI_nprocs);
+	const size_t nslabs = (NDIMS>0 ? grid->rho.axes[0].size() : 1);
+	const size_t zones_per_slab = grid->rho.size() / nslabs;
+	for(int proc=0; proc<MPI_nprocs; proc++)
+		my_zone_end[proc] = zones_per_slab * (((proc+1)*nslabs + MPI_nprocs-1) / MPI_nprocs);
+	PRINT_ASSERT(my_zone_end[MPI_nprocs-1],==,grid->rho.size());
+
+	opacity_zone_start = interp_zone_start = 0;
+	opacity_zone_end = interp_zone_end = grid->rho.size();
+	if(not zone_ownership) return;
+
+	// one layer in every direction (including corners) is
+	// at most the sum of the strides away in linear index
+	size_t layer = 0;
+#if NDIMS>0
+	for(size_t d=0; d<NDIMS; d++) layer += grid->rho.stride[d];
+#endif
+	zone_partition.zone_end = my_zone_end;
+	zone_partition.ghost = ownership_ghost_layers * layer;
+	zone_partition.rank = MPI_myID;
+	opacity_zone_start = zone_partition.stored_start(MPI_myID);
+	opacity_zone_end = zone_partition.stored_end(MPI_myID);
+
+	// the outermost stored layer is only usable at the edges of the grid
+	interp_zone_start = (opacity_zone_start>0 ? opacity_zone_start+layer : 0);
+	interp_zone_end = (opacity_zone_end<grid->rho.size() ? opacity_zone_end-layer : opacity_zone_end);
+
+	if(verbose) cout << "#   Zone ownership: rank 0 owns zones [0," << my_zone_end[0]
+			<< ") and stores zones [" << opacity_zone_start << "," << opacity_zone_end << ")" << endl;
+}
+
+size_t Transport::my_zone_start() const{
+	return (MPI_myID==0 ? 0 : my_zone_end[MPI_myID-1]);
+}
+int Transport::zone_owner(const int z_ind) const{
+	PRINT_ASSERT(z_ind,>=,0);
+	PRINT_ASSERT(z_ind,<,(int)grid->rho.size());
+	return upper_bound(my_zone_end.begin(), my_zone_end.end(), (size_t)z_ind) - my_zone_end.begin();
+}
+bool Transport::owns_zone(const int z_ind) const{
+	return z_ind>=(int)my_zone_start() and z_ind<(int)my_zone_end[MPI_myID];
+}
+bool Transport::has_opacities(const int z_ind) const{
+	return z_ind>=(int)interp_zone_start and z_ind<(int)interp_zone_end;
+}
+
+//----------------------------------------------------------
+// A random walk step is not limited to the next zone, so it
+// can overshoot the ghost zones, where nothing is stored.
+// Stop rather than tally into memory this rank does not have.
+//----------------------------------------------------------
+void Transport::check_ghost_reach(const EinsteinHelper* eh) const{
+	if(not zone_ownership or eh->fate!=moving or has_opacities(eh->z_ind)) return;
+	cout << "ERROR: a random walk step on rank " << MPI_myID << " reached zone " << eh->z_ind
+			<< ", beyond its ghost zones. Increase ownership_ghost_layers." << endl;
+	exit(5);
+}
+
+//----------------------------------------------------------
+// Migrants travel while the pass runs. Each thread hands a
+// particle that leaves the owned zones to its destination's
+// buffer, and on every pass through the history loop the
+// master sends the buffers with non-blocking point-to-point
+// messages, so only the ranks particles actually move to
+// (the slab neighbors, plus the core's owner for core
+// particles) are ever messaged. Arrivals are drained with
+// Iprobe and joined to the work the threads take from.
+//
+// Termination is detected without blocking: the ranks keep
+// one MPI_Iallreduce of (particles sent, particles received,
+// busy) in flight, starting the next as soon as the last
+// completes. A rank is busy while it has particles left to
+// emit, migrants waiting, or threads following either. The
+// pass ends after two consecutive waves in which no rank was
+// busy and the same number of particles were sent and
+// received (the four-counter method), so no particle can
+// still be in flight.
+//----------------------------------------------------------
+void Transport::start_migration(MigrationState* m){
+	m->outgoing.assign(MPI_nprocs, vector<MigratingParticle>());
+	m->arrived.clear();
+	m->n_finished = 0;
+	m->all_done = false;
+	m->sends.clear();
+	m->n_sent = m->n_received = 0;
+	m->wave_active = false;
+	m->last_wave_quiet = false;
+	m->last_wave_sent = -1;
+	m->n_waves = 0;
+
+	static_assert(is_trivially_copyable<MigratingParticle>::value, "MigratingParticle is sent as raw bytes");
+	MPI_Type_contiguous(sizeof(MigratingParticle), MPI_BYTE, &m->particle_type);
+	MPI_Type_commit(&m->particle_type);
+}
+
+//----------------------------------------------------------
+// Send, receive, and check for termination. Master thread
+// only (MPI_THREAD_FUNNELED).
+//----------------------------------------------------------
+void Transport::progress_migration(MigrationState* m, const WorkPool& pool){
+	if(omp_get_thread_num()!=0 or m->all_done) return;
+	const int tag = 1;
+
+	// take the handed-off particles and the finished count together, so
+	// if every particle taken so far is finished none is left to hand off
+	const size_t first_new_send = m->sends.size();
+	size_t n_finished;
+	#pragma omp critical(migration)
+	{
+		for(int p=0; p<MPI_nprocs; p++){
+			if(m->outgoing[p].empty()) continue;
+			m->sends.push_back(MigrationSend());
+			m->sends.back().particles.swap(m->outgoing[p]);
+			m->sends.back().request = MPI_REQUEST_NULL;
+			m->sends.back().rank = p;
+		}
+		n_finished = m->n_finished;
+	}
+	for(size_t i=first_new_send; i<m->sends.size(); i++){
+		MigrationSend& send = m->sends[i];
+		PRINT_ASSERT(send.rank,!=,MPI_myID);
+		MPI_Isend(&send.particles.front(), send.particles.size(), m->particle_type, send.rank, tag, MPI_COMM_WORLD, &send.request);
+		m->n_sent += send.particles.size();
+	}
+
+	// drain whatever has arrived
+	int flag;
+	MPI_Status status;
+	MPI_Iprobe(MPI_ANY_SOURCE, tag, MPI_COMM_WORLD, &flag, &status);
+	while(flag){
+		int count;
+		MPI_Get_count(&status, m->particle_type, &count);
+		vector<MigratingParticle> incoming(count);
+		MPI_Recv(&incoming.front(), count, m->particle_type, status.MPI_SOURCE, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		#pragma omp critical(migration)
+		m->arrived.insert(m->arrived.end(), incoming.begin(), incoming.end());
+		m->n_received += count;
+		MPI_Iprobe(MPI_ANY_SOURCE, tag, MPI_COMM_WORLD, &flag, &status);
+	}
+
+	// forget the sends that have completed
+	for(size_t i=0; i<m->sends.size(); ){
+		MPI_Test(&m->sends[i].request, &flag, MPI_STATUS_IGNORE);
+		if(flag){
+			swap(m->sends[i], m->sends.back());
+			m->sends.pop_back();
+		}
+		else i++;
+	}
+
+	// finish the termination wave in flight and start the next
+	if(m->wave_active){
+		MPI_Test(&m->wave_request, &flag, MPI_STATUS_IGNORE);
+		if(not flag) return;
+		m->wave_active = false;
+		m->n_waves++;
+		const bool quiet = (m->wave_global[2]==0 and m->wave_global[0]==m->wave_global[1]);
+		if(quiet and m->last_wave_quiet and m->wave_global[0]==m->last_wave_sent){
+			#pragma omp critical(migration)
+			m->all_done = true;
+			return;
+		}
+		m->last_wave_quiet = quiet;
+		m->last_wave_sent = m->wave_global[0];
+	}
+	const bool busy = not pool.empty or n_finished < pool.n_claimed + (size_t)m->n_received;
+	m->wave_local[0] = m->n_sent;
+	m->wave_local[1] = m->n_received;
+	m->wave_local[2] = busy;
+	MPI_Iallreduce(m->wave_local, m->wave_global, 3, MPI_LONG, MPI_SUM, MPI_COMM_WORLD, &m->wave_request);
+	m->wave_active = true;
+}
+
+//----------------------------------------------------------
+// Take the next migrant to arrive and rebuild it. Returns
+// false if there is none, and then sets done once no
+// particle is left on any rank.
+//----------------------------------------------------------
+bool Transport::take_migrant(MigrationState* m, EinsteinHelper* eh, bool* done){
+	bool have_migrant = false;
+	MigratingParticle p;
+	#pragma omp critical(migration)
+	{
+		if(not m->arrived.empty()){
+			p = m->arrived.front();
+			m->arrived.pop_front();
+			have_migrant = true;
+		}
+		*done = m->all_done;
+	}
+	if(not have_migrant) return false;
+
+	eh->xup = p.xup;
+	eh->kup = p.kup;
+	eh->kup_tet = p.kup_tet;
+	eh->N = p.N;
+	eh->N0 = p.N0;
+	eh->s = p.s;
+	eh->fate = moving;
+	update_eh_background(eh);
+	PRINT_ASSERT(eh->fate,==,moving);
+	PRINT_ASSERT(owns_zone(eh->z_ind),==,true);
+	update_eh_k_opac(eh, p.renormalize);
+	if(reproducible) rangen.thread_stream() = p.rng;
+	return true;
+}
+
+//----------------------------------------------------------
+// Count a particle or migrant as done with on this rank,
+// buffering it for the owner of its zone if it is still
+// moving (thread safe)
+//----------------------------------------------------------
+void Transport::finish_particle(MigrationState* m, const EinsteinHelper& eh){
+	MigratingParticle p;
+	int owner = -1;
+	if(eh.fate == moving){
+		PRINT_ASSERT(owns_zone(eh.z_ind),==,false);
+		p.xup = eh.xup;
+		p.kup = eh.kup;
+		p.kup_tet = eh.kup_tet;
+		p.renormalize = (eh.absopac != eh.absopac); // no opacities here
+		p.N = eh.N;
+		p.N0 = eh.N0;
+		p.s = eh.s;
+		if(reproducible) p.rng = rangen.thread_stream();
+		owner = zone_owner(eh.z_ind);
+	}
+	#pragma omp critical(migration)
+	{
+		if(owner >= 0) m->outgoing[owner].push_back(p);
+		m->n_finished++;
+	}
+}
+
+//----------------------------------------------------------
+// Clean up once no particle is left anywhere
+//----------------------------------------------------------
+void Transport::stop_migration(MigrationState* m){
+	PRINT_ASSERT(m->all_done,==,true);
+	PRINT_ASSERT(m->arrived.size(),==,0);
+	for(size_t i=0; i<m->sends.size(); i++) MPI_Wait(&m->sends[i].request, MPI_STATUS_IGNORE);
+	m->sends.clear();
+	MPI_Type_free(&m->particle_type);
+
+	long nmigrations = m->n_sent;
+	MPI_Reduce(&m->n_sent, &nmigrations, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+	if(verbose) cout << "#   " << nmigrations << " particle migrations, " << m->n_waves << " termination checks" << endl;
+}
@@ -29,132 +29,281 @@
 #include "Transport.h"
 #include "Species.h"
 #include "Grid.h"
+#include "Grid0DIsotropic.h"
+#include "Grid1DSphere.h"
+#include "Grid2DSphere.h"
+#include "Grid3DCart.h"
+#include "GridGR1D.h"
+#include "PolarSpectrumArray.h"
+#include "MomentSpectrumArray.h"
+#include "RadialMomentSpectrumArray.h"
+#include "GR1DSpectrumArray.h"
 #include <cstring>
+#include <typeinfo>
+#include <omp.h>
 #include "EinsteinHelper.h"
 
 using namespace std;
 namespace pc = physical_constants;
 
-void Transport::propagate_particles()
+//--------------------------------------------------------
+// Emit and propagate this rank's particles in a single
+// pass. Each particle is created directly into its
+// EinsteinHelper and propagated immediately, so only one
+// particle per thread exists at a time.
+//--------------------------------------------------------
+void Transport::emit_and_propagate()
 {
-	if(verbose) cout << "# Propagating particles..." << endl;
+	if(verbose) cout << "# Emitting and propagating particles..." << endl;
 
 	size_t ndone=0;
 	size_t last_percent = 0;
-	const size_t nparticles = particles.size();
-
-	//--- MOVE THE PARTICLES AROUND ---
-	#pragma omp parallel for schedule(dynamic)
-	for(size_t i=0; i<nparticles; i++){
-		if(particles[i].fate != moving){
-			#pragma omp atomic
-			ndone++;
-			continue;
-		}
+	size_t n_created = 0;
+	start_tallies();
+	start_work_queue();
+
+	//--- CREATE AND MOVE THE PARTICLES AROUND ---
+	// All threads stay in one parallel region and take particles one at a
+	// time from the chunks claimed so far. Without work stealing the
+	// first claim is this rank's whole queue. With zone ownership the
+	// threads also take migrants from other ranks, first, and the pass
+	// only ends once no particle is left on any rank.
+	WorkPool pool;
+	MigrationState migration;
+	if(zone_ownership) start_migration(&migration);
+	const size_t low_water = omp_get_max_threads();
+	#pragma omp parallel reduction(+:n_created)
+	{
+		while(true){
+			top_up_work(&pool, low_water);
+			if(zone_ownership) progress_migration(&migration, pool);
+
+			// take a migrant or the next particle, or wait for more
+			EinsteinHelper eh;
+			bool migrant = false;
+			bool all_done = false;
+			if(zone_ownership) migrant = take_migrant(&migration, &eh, &all_done);
+			size_t bin = 0;
+			if(not migrant){
+				int rank;
+				size_t i;
+				bool done;
+				if(not take_work(&pool, &rank, &i, &done)){
+					if(zone_ownership ? all_done : done) break;
+					continue;
+				}
+				bin = emit_particle(i, &eh, rank);
+				if(eh.fate == moving){
+					n_created++;
+					n_active[eh.s]++;
+				}
+			}
 
-		// propagate each particle with an EinsteinHelper
-		EinsteinHelper eh;
-		eh.set_Particle(particles[i]);
-		eh.N0 = eh.N;
-		update_eh_background(&eh);
-		update_eh_k_opac(&eh);
-		propagate(&eh);
-
-		if(verbose){
-			#pragma omp atomic
-			ndone++;
-			size_t this_percent = (double)ndone/(double)nparticles*100.;
-			if(this_percent > last_percent){
-				last_percent = this_percent;
-				#pragma omp critical
-				cout << "\r"<<ndone<<"/"<<nparticles << " (" << last_percent<<"%)" << flush;
+			if(eh.fate == moving){
+				const size_t nevents = propagate(&eh);
+				if(load_balance and not migrant) emission_cost[bin] += nevents; // cost is counted in events
+			}
+			if(zone_ownership) finish_particle(&migration, eh); // hands it off if it left this rank's zones
+			progress_work_queue();
+
+			// progress out of the particles this rank has claimed so far
+			if(verbose and not migrant){
+				size_t my_ndone, my_nclaimed;
+				#pragma omp atomic capture
+				my_ndone = ++ndone;
+				#pragma omp atomic read
+				my_nclaimed = pool.n_claimed;
+				size_t this_percent = (double)my_ndone/(double)my_nclaimed*100.;
+				if(this_percent != last_percent){
+					#pragma omp critical
+					{
+						last_percent = this_percent;
+						cout << "\r"<<my_ndone<<"/"<<my_nclaimed << " (" << this_percent<<"%)" << flush;
+					}
+				}
 			}
 		}
-		PRINT_ASSERT(eh.fate, !=, moving);
-		particles[i] = eh.get_Particle();
-	} //#pragma omp parallel for
+	} //#pragma omp parallel
 	if(verbose) cout << endl;
+	if(zone_ownership) stop_migration(&migration);
+	stop_work_queue();
+	stop_tallies();
+
+	if(verbose) cout << "#   created " << n_created << " particles on rank 0 ("
+			<< pool.n_claimed-n_created << " rouletted immediately)" << endl;
+}
+
+//--------------------------------------------------------
+// Pick the propagation kernels (history and event) for
+// this run's grid and distribution types. The specialized
+// kernels see the concrete (final) classes, so the per-step
+// grid and tally calls are direct and can be inlined.
+// Anything else, and runs whose species use different
+// distribution types, fall back on the virtual interface.
+//--------------------------------------------------------
+template<class GridT, class SpectrumT>
+void Transport::use_kernels(){
+	propagate_kernel = &Transport::propagate<GridT,SpectrumT>;
+	event_kernel = &Transport::event_round<GridT,SpectrumT>;
+}
+template<class GridT>
+void Transport::select_propagate_kernel(){
+	const SpectrumArray& d = *grid->distribution[0];
+	for(size_t s=1; s<grid->distribution.size(); s++)
+		if(typeid(*grid->distribution[s]) != typeid(d)){
+			use_kernels<Grid,SpectrumArray>();
+			return;
+		}
 
-	// remove the dead particles, erase the memory
-	particles.resize(0);
+	if     (typeid(d) == typeid(PolarSpectrumArray<NDIMS>))        use_kernels<GridT, PolarSpectrumArray<NDIMS> >();
+	else if(typeid(d) == typeid(MomentSpectrumArray<NDIMS>))       use_kernels<GridT, MomentSpectrumArray<NDIMS> >();
+	else if(typeid(d) == typeid(RadialMomentSpectrumArray<NDIMS>)) use_kernels<GridT, RadialMomentSpectrumArray<NDIMS> >();
+	else if(typeid(d) == typeid(GR1DSpectrumArray))                use_kernels<GridT, GR1DSpectrumArray>();
+	else use_kernels<Grid,SpectrumArray>();
+}
+void Transport::select_propagate_kernel(){
+	PRINT_ASSERT(grid->distribution.size(),>,0);
+	const Grid& g = *grid;
+	if     (typeid(g) == typeid(Grid0DIsotropic)) select_propagate_kernel<Grid0DIsotropic>();
+	else if(typeid(g) == typeid(Grid1DSphere))    select_propagate_kernel<Grid1DSphere>();
+	else if(typeid(g) == typeid(Grid2DSphere))    select_propagate_kernel<Grid2DSphere>();
+	else if(typeid(g) == typeid(Grid3DCart))      select_propagate_kernel<Grid3DCart>();
+	else if(typeid(g) == typeid(GridGR1D))        select_propagate_kernel<GridGR1D>();
+	else use_kernels<Grid,SpectrumArray>();
+
+	if(verbose) cout << "#   Using " << (propagate_kernel==&Transport::propagate<Grid,SpectrumArray> ? "generic" : "specialized")
+			<< " propagation kernel" << endl;
 }
 
 //--------------------------------------------------------
 // Decide what happens to the particle
 //--------------------------------------------------------
 void Transport::which_event(const EinsteinHelper *eh, ParticleEvent *event, double* ds_com) const{
+	which_event<Grid>(eh, event, ds_com);
+}
+template<class GridT>
+void Transport::which_event(const EinsteinHelper *eh, ParticleEvent *event, double* ds_com) const{
+	const GridT* grid = static_cast<const GridT*>(this->grid);
 	PRINT_ASSERT(eh->N, >, 0);
 	PRINT_ASSERT(eh->z_ind,>=,0);
 	*event = nothing;
 
 	// FIND D_ZONE= ====================================================================
-	double d_zone = grid->zone_min_length(eh->z_ind) / sqrt(Metric::dot_Minkowski<3>(eh->kup,eh->kup)) * eh->kup_tet[3];
-	d_zone = min(max(d_zone, d_zone*min_step_size), d_zone*max_step_size);
+	const double d_zone = zone_step(grid->zone_min_length(eh->z_ind), sqrt(Metric::dot_Minkowski<3>(eh->kup,eh->kup)), eh->kup_tet[3], min_step_size, max_step_size);
 	PRINT_ASSERT(d_zone, >, 0);
 
 	// FIND D_BOUNDARY
-	double d_boundary = grid->d_boundary(*eh) * (1.0+TINY);
-	d_boundary = max(d_boundary, d_zone*(1.0+TINY));
-	*ds_com = min(d_boundary, d_zone);
-	PRINT_ASSERT(d_boundary, >, 0);
+	*ds_com = boundary_step(grid->d_boundary(*eh), d_zone);
+	PRINT_ASSERT(*ds_com, >, 0);
 
 	// FIND D_RANDOMWALK
-	double d_randomwalk = INFINITY;
 	if(do_randomwalk && eh->scatopac*(*ds_com)>randomwalk_min_optical_depth){ // coarse check
-		double D = pc::c / (3. * eh->scatopac);
-		d_randomwalk = min(grid->d_randomwalk(*eh), d_zone*max_step_size);
-		if(r_core>0){
-			// get a null test vector
-			Tuple<double,4> ktest = -eh->xup;
-			ktest[3] = 0;
-			eh->g.normalize_null_changeupt(ktest);
-
-			// limit d_randomwalk expecting movement towards core
-			double r = radius(eh->xup);
-			double kr = r;
-			double kup_tet_t = -eh->g.dot<4>(ktest,eh->u);
-			double ur = Metric::dot_Minkowski<3>(ktest,eh->u)/r;
-			d_randomwalk = min(d_randomwalk, R_randomwalk(kr/kup_tet_t, ur, r-r_core, D));
-		}
-		if(d_randomwalk == INFINITY) d_randomwalk = 1.1*randomwalk_min_optical_depth / eh->scatopac;
-		PRINT_ASSERT(d_randomwalk,>=,0);
+		const double d_randomwalk = randomwalk_distance<GridT>(eh, d_zone);
 		if(eh->scatopac * d_randomwalk > randomwalk_min_optical_depth){ // real check
 			*ds_com = d_randomwalk;
 			*event = randomwalk;
 		}
 	}
 
-	// FIND D_ELASTIC_SCATTER =================================================================
-	double d_interact = INFINITY;
-	if(*event!=randomwalk && eh->scatopac>0){
-		double tau;
-		do{
-			tau = -log(rangen.uniform());
-		} while(tau >= INFINITY);
-		d_interact = tau / eh->scatopac;
-		if(d_interact < *ds_com){
-			*ds_com = d_interact;
-			*event = elastic_scatter;
+	// FIND D_ELASTIC_SCATTER AND D_INELASTIC_SCATTER ==================================
+	// sample both optical depths at once
+	if(*event!=randomwalk){
+		double tau[2];
+		rangen.exponential(tau,2);
+		choose_interaction(tau[0]/eh->scatopac, tau[1]/eh->inelastic_scatopac, eh->scatopac, eh->inelastic_scatopac, ds_com, event);
+	}
+	PRINT_ASSERT(*ds_com, >=, 0);
+	PRINT_ASSERT(*ds_com, <, INFINITY);
+}
+
+//--------------------------------------------------------
+// How far a random walk step may go. Only called once the
+// coarse check in which_event() has passed.
+//--------------------------------------------------------
+template<class GridT>
+double Transport::randomwalk_distance(const EinsteinHelper *eh, const double d_zone) const{
+	const GridT* grid = static_cast<const GridT*>(this->grid);
+	double D = pc::c / (3. * eh->scatopac);
+	double d_randomwalk = min(grid->d_randomwalk(*eh), d_zone*max_step_size);
+	if(r_core>0){
+		// get a null test vector
+		Tuple<double,4> ktest = -eh->xup;
+		ktest[3] = 0;
+		eh->g.normalize_null_changeupt(ktest);
+
+		// limit d_randomwalk expecting movement towards core
+		double r = radius(eh->xup);
+		double kr = r;
+		double kup_tet_t = -eh->g.dot<4>(ktest,eh->u);
+		double ur = Metric::dot_Minkowski<3>(ktest,eh->u)/r;
+		d_randomwalk = min(d_randomwalk, R_randomwalk(kr/kup_tet_t, ur, r-r_core, D));
+	}
+	if(d_randomwalk == INFINITY) d_randomwalk = 1.1*randomwalk_min_optical_depth / eh->scatopac;
+	PRINT_ASSERT(d_randomwalk,>=,0);
+	return d_randomwalk;
+}
+
+//--------------------------------------------------------
+// Set everything that depends only on particle position
+//--------------------------------------------------------
+void Transport::update_eh_background(EinsteinHelper* eh) const{
+	update_eh_background<Grid>(eh);
+}
+template<class GridT>
+void Transport::update_eh_background(EinsteinHelper* eh) const{
+	const GridT* grid = static_cast<const GridT*>(this->grid);
+
+	// zone index. Look next to the zone the particle came from first,
+	// and only search the whole grid if it isn't there.
+	const bool advanced = grid->template advance_zone<GridT>(eh);
+	if(not advanced) eh->z_ind = grid->zone_index(eh->xup);
+
+	// boundary conditions
+	if(r_core>0 && radius(eh->xup)<r_core){
+	  eh->fate = absorbed;
+	  return;
+	}
+	else if(eh->z_ind<0){
+		grid->symmetry_boundaries(eh);
+		eh->z_ind = grid->zone_index(eh->xup);
+		if(eh->z_ind < 0){
+			eh->fate = escaped;
+			return;
 		}
 	}
 
-	// FIND D_INELASTIC_SCATTER =================================================================
-	double d_inelastic_scatter = INFINITY;
-	if(*event!=randomwalk && eh->inelastic_scatopac>0){
-		double tau;
-		do{
-			tau = -log(rangen.uniform());
-		} while(tau >= INFINITY);
-		d_inelastic_scatter = tau / eh->inelastic_scatopac;
-		if(d_inelastic_scatter < *ds_com){
-			*ds_com = d_inelastic_scatter;
-			*event = inelastic_scatter;
+	// spatial indices
+	if(not advanced){
+		grid->grid_coordinates(eh->xup,eh->grid_coords);
+		grid->rho.indices(eh->z_ind, eh->dir_ind);
+	}
+	for(size_t i=0; i<NDIMS; i++)	PRINT_ASSERT(eh->dir_ind[i],<,grid->rho.axes[i].size());
+	grid->rho.set_InterpolationCube(&(eh->icube_vol),eh->grid_coords,eh->dir_ind);
+	eh->icube_vol.set_slope_weights(eh->grid_coords);
+
+	// metric and its derivatives
+	if(DO_GR){
+		grid->template interpolate_metric<GridT>(eh);
+		if(eh->g.gtt >= 0){
+			eh->z_ind = -1;
+			eh->fate = absorbed;
+			return;
 		}
 	}
-	PRINT_ASSERT(*ds_com, >=, 0);
-	PRINT_ASSERT(*ds_com, <, INFINITY);
+	eh->zone_fourvolume = grid->zone_coord_volume(eh->z_ind) * (DO_GR ? eh->g.alpha*grid->interpolate_sqrtdetg3(*eh) : 1.); // ccm*s, assumes dt=1s.
+ 
+	// four-velocity
+	eh->v = grid->interpolate_fluid_velocity(*eh);
+	eh->set_fourvel();
+
+	// set tetrad
+	eh->set_tetrad_basis(grid->tetrad_rotation);
 }
 
+void Transport::move(EinsteinHelper *eh, bool do_absorption) const{
+	move<Grid,SpectrumArray>(eh, do_absorption);
+}
+template<class GridT, class SpectrumT>
 void Transport::move(EinsteinHelper *eh, bool do_absorption) const{
 	PRINT_ASSERT(eh->ds_com,>=,0);
 	PRINT_ASSERT(eh->N,>,0);
@@ -166,11 +315,20 @@ void Transport::move(EinsteinHelper *eh, bool do_absorption) const{
 
 	// kick 1
 	if(DO_GR) eh->kup += eh->dk_dlambda() * 0.5*dlambda;
-	const EinsteinHelper eh_old = *eh;
+	const StepStart start(*eh);
 
 	// drift
 	eh->xup += eh->kup * dlambda;
-	update_eh_background(eh);
+	end_move<GridT,SpectrumT>(eh, start, dlambda, do_absorption);
+}
+
+//--------------------------------------------------------
+// Everything in move() after the drift. The event engine
+// drifts a whole batch at once and then calls this.
+//--------------------------------------------------------
+template<class GridT, class SpectrumT>
+void Transport::end_move(EinsteinHelper *eh, const StepStart& eh_old, const double dlambda, bool do_absorption) const{
+	update_eh_background<GridT>(eh);
 
 	// kick2
 	if(eh->fate==moving){
@@ -190,35 +348,44 @@ void Transport::move(EinsteinHelper *eh, bool do_absorption) const{
 		window(eh);
 
 		// store absorbed energy rate in *comoving* frame
-		grid->fourforce_abs[eh_old.z_ind] += eh_old.kup_tet * dN/eh_old.zone_fourvolume;
+		grid->fourforce_abs_tally.add(grid->fourforce_abs, eh_old.z_ind, eh_old.kup_tet * dN/eh_old.zone_fourvolume);
 
 		// store absorbed lepton number (same in both frames, except for the
 		// factor of this_d which is divided out later
 		if(species_list[eh->s]->lepton_number != 0){
-			grid->l_abs[eh_old.z_ind] += dN * species_list[eh->s]->lepton_number / eh_old.zone_fourvolume;
+			grid->l_abs_tally.add(grid->l_abs, eh_old.z_ind, dN * species_list[eh->s]->lepton_number / eh_old.zone_fourvolume);
 		}
 	}
 
 	// tally in contribution to zone's distribution function (lab frame)
 	// use old coordinates/directions to avoid problems with boundaries
 	double avg_N = (tau>TINY ? dN/tau : (eh->N+eh_old.N)/2.);
-	grid->distribution[eh_old.s]->count_single(eh_old.kup_tet, eh_old.dir_ind, avg_N*eh_old.ds_com*eh_old.kup_tet[3] / (eh_old.zone_fourvolume*pc::c));
+	static_cast<SpectrumT*>(grid->distribution[eh_old.s])->count_single(eh_old.kup_tet, eh_old.dir_ind, avg_N*eh_old.ds_com*eh_old.kup_tet[3] / (eh_old.zone_fourvolume*pc::c));
 	
 }
 
 
 //--------------------------------------------------------
 // Propagate a single monte carlo particle until
-// it  escapes, is absorbed, or the time step ends
+// it  escapes, is absorbed, or the time step ends.
+// With zone ownership, also stop (still moving)
+// when it enters a zone owned by another rank.
 //--------------------------------------------------------
-void Transport::propagate(EinsteinHelper *eh){
+size_t Transport::propagate(EinsteinHelper *eh){
+	PRINT_ASSERT(propagate_kernel,!=,NULL);
+	return (this->*propagate_kernel)(eh);
+}
+template<class GridT, class SpectrumT>
+size_t Transport::propagate(EinsteinHelper *eh){
 	ParticleEvent event;
+	size_t nevents = 0;
 
 	PRINT_ASSERT(eh->fate, ==, moving);
-	n_active[eh->s]++;
 
 	while (eh->fate == moving)
 	{
+		if(zone_ownership and not owns_zone(eh->z_ind)) return nevents;
+
 		PRINT_ASSERT(eh->z_ind,>=,0);
 		PRINT_ASSERT(eh->N,>,0);
 		PRINT_ASSERT(eh->N,<,1e99);
@@ -229,16 +396,17 @@ void Transport::propagate(EinsteinHelper *eh){
 
 		// decide which event happens
 		double ds_com;
-		which_event(eh,&event, &ds_com);
+		which_event<GridT>(eh,&event, &ds_com);
+		nevents++;
 		eh->ds_com = ds_com;
 		PRINT_ASSERT(eh->ds_com ,>, 0);
 		PRINT_ASSERT(eh->N,>,0);
 		if(event==randomwalk)
-		  random_walk(eh);
+		  random_walk<GridT,SpectrumT>(eh);
 		else{
-		  move(eh);
+		  move<GridT,SpectrumT>(eh);
 		  if(eh->z_ind>=0 and (event==elastic_scatter or event==inelastic_scatter))
-		    scatter(eh, event);
+		    scatter<GridT,SpectrumT>(eh, event);
 		}
 
 		if(eh->fate==moving) window(eh);
@@ -247,21 +415,39 @@ void Transport::propagate(EinsteinHelper *eh){
 		PRINT_ASSERT(eh->N,<,1e99);
 	}
 
+	tally_fate(eh);
+	return nevents;
+}
+
+//--------------------------------------------------------
+// Tally global quantities for a particle that has
+// escaped, been absorbed by the core, or been rouletted
+//--------------------------------------------------------
+void Transport::tally_fate(const EinsteinHelper *eh){
 	PRINT_ASSERT(eh->fate,!=,moving);
 	double e = eh->N * eh->kup[3];
 	if(eh->fate==escaped){
 		PRINT_ASSERT(e,>=,0);
-		particle_escape_energy += e;
+		tally_scalar(escape_energy_tally, 0, e);
 		n_escape[eh->s]++;
-		L_net_esc[eh->s] += e;
-		N_net_esc[eh->s] += eh->N;
+		tally_scalar(L_net_esc_tally, eh->s, e);
+		tally_scalar(N_net_esc_tally, eh->s, eh->N);
 		Tuple<double,4> kup_write = eh->kup;
 		Metric::normalize_null_Minkowski(kup_write);
 		grid->spectrum[eh->s].count_single(kup_write, eh->dir_ind, e);
 	}
 	else if(eh->fate==absorbed)
-		particle_core_abs_energy += e;
+		tally_scalar(core_abs_energy_tally, 0, e);
 	else if(eh->fate==rouletted)
-		particle_rouletted_energy += e;
+		tally_scalar(rouletted_energy_tally, 0, e);
 	else assert(0);
 }
+
+#define INSTANTIATE_MOVE_KERNELS(GridT,SpectrumT) \
+	template void Transport::move<GridT,SpectrumT>(EinsteinHelper *eh, bool do_absorption) const; \
+	template void Transport::end_move<GridT,SpectrumT>(EinsteinHelper *eh, const StepStart& start, const double dlambda, bool do_absorption) const;
+TRANSPORT_KERNEL_TYPES(INSTANTIATE_MOVE_KERNELS)
+
+#define INSTANTIATE_EVENT_DISTANCES(GridT) \
+	template double Transport::randomwalk_distance<GridT>(const EinsteinHelper *eh, const double d_zone) const;
+TRANSPORT_KERNEL_GRIDS(INSTANTIATE_EVENT_DISTANCES)
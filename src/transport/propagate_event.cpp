@@ -0,0 +1,423 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+#include <omp.h>
+#include "global_options.h"
+#include "Transport.h"
+#include "Species.h"
+#include "Grid.h"
+#include "Grid0DIsotropic.h"
+#include "Grid1DSphere.h"
+#include "Grid2DSphere.h"
+#include "Grid3DCart.h"
+#include "GridGR1D.h"
+#include "PolarSpectrumArray.h"
+#include "MomentSpectrumArray.h"
+#include "RadialMomentSpectrumArray.h"
+#include "GR1DSpectrumArray.h"
+#include "EinsteinHelper.h"
+
+using namespace std;
+
+//===========================================================//
+// EVENT-BASED TRANSPORT                                     //
+// Rather than following one particle from birth to death,   //
+// each thread keeps a batch of particles in flight and      //
+// advances all of them one event per round. The particle    //
+// state is stored one array per component, and the steps    //
+// that need no grid lookups (step sizes, event selection,   //
+// the drift) are loops over whole arrays that the compiler  //
+// vectorizes. The rest runs the same specialized kernels as //
+// propagate() over per-event queues of the batch, so the    //
+// results are statistically identical to the history-based  //
+// loop. In reproducible mode each particle carries its own  //
+// random number stream, so each particle takes the same     //
+// path it would in the history-based loop.                  //
+//===========================================================//
+
+//----------------------------------------------------------
+// One thread's particles in flight. A slot is refilled with
+// a new particle as soon as its particle dies, so nothing
+// is ever compacted.
+//----------------------------------------------------------
+class EventBatch{
+public:
+	// particle state, one array per component
+	vector<double>        xup[4], kup[4], kup_tet[4];
+	vector<double>        N;
+	vector<int>           z_ind;
+	vector<ParticleEvent> event;  // next event
+	vector<double>        ds_com; // comoving distance to the next event
+	vector<char>          active; // slot holds a moving particle
+	vector<size_t>        bin;    // emission bin the particle came from (load balancing)
+	vector<size_t>        nevents;
+	vector<PhiloxStream>  rng;    // each particle's random number stream (reproducible mode only)
+	bool keep_rng;
+
+	// Everything that depends only on the particle's position
+	// (metric, tetrad, interpolation cubes, opacities). It is kept
+	// per slot, since a particle's background only changes when it
+	// moves and is then rebuilt by the kernel that moved it. The
+	// state fields are copied in and out around the scalar kernels.
+	vector<EinsteinHelper> background;
+
+	// per-round scratch
+	vector<double> zone_min_length, d_boundary, d_zone, dlambda;
+	vector<double> scatopac, inelastic_scatopac;
+	vector<double> d_elastic, d_inelastic; // sampled optical depths, then distances
+	vector<StepStart> start;
+	vector<size_t> active_queue, randomwalk_queue, move_queue;
+	size_t n_active, n_finished;
+
+	EventBatch(const size_t n, const bool keep_rng_in) : keep_rng(keep_rng_in), n_active(0), n_finished(0){
+		for(size_t d=0; d<4; d++){
+			xup[d].assign(n,0);
+			kup[d].assign(n,0);
+			kup_tet[d].assign(n,0);
+		}
+		N.assign(n,0);
+		z_ind.assign(n,-1);
+		event.assign(n,nothing);
+		ds_com.assign(n,0);
+		active.assign(n,0);
+		bin.assign(n,0);
+		nevents.assign(n,0);
+		if(keep_rng) rng.resize(n);
+		background.resize(n);
+		zone_min_length.assign(n,0);
+		d_boundary.assign(n,0);
+		d_zone.assign(n,0);
+		dlambda.assign(n,0);
+		scatopac.assign(n,0);
+		inelastic_scatopac.assign(n,0);
+		d_elastic.assign(n,0);
+		d_inelastic.assign(n,0);
+		start.resize(n);
+		active_queue.reserve(n);
+		randomwalk_queue.reserve(n);
+		move_queue.reserve(n);
+	}
+	size_t size() const {return active.size();}
+
+	// copy slot i's state between the arrays and its background
+	void load(const size_t i){
+		EinsteinHelper& eh = background[i];
+		for(size_t d=0; d<4; d++){
+			eh.xup[d]     = xup[d][i];
+			eh.kup[d]     = kup[d][i];
+			eh.kup_tet[d] = kup_tet[d][i];
+		}
+		eh.N      = N[i];
+		eh.z_ind  = z_ind[i];
+		eh.ds_com = ds_com[i];
+	}
+	void store(const size_t i){
+		const EinsteinHelper& eh = background[i];
+		for(size_t d=0; d<4; d++){
+			xup[d][i]     = eh.xup[d];
+			kup[d][i]     = eh.kup[d];
+			kup_tet[d][i] = eh.kup_tet[d];
+		}
+		N[i]     = eh.N;
+		z_ind[i] = eh.z_ind;
+	}
+
+	// hand particle i's stream to the calling thread and take it back
+	void load_rng(ThreadRNG& rangen, const size_t i) const{
+		if(keep_rng) rangen.thread_stream() = rng[i];
+	}
+	void save_rng(ThreadRNG& rangen, const size_t i){
+		if(keep_rng) rng[i] = rangen.thread_stream();
+	}
+};
+
+
+void Transport::emit_and_propagate_event()
+{
+	if(verbose) cout << "# Emitting and propagating particles (event-based)..." << endl;
+	PRINT_ASSERT(event_kernel,!=,NULL);
+
+	const size_t batch_size = event_bank_size;
+	size_t ndone = 0;
+	size_t n_created = 0;
+	size_t last_percent = 0;
+	start_tallies();
+	start_work_queue();
+
+	// Threads refill their batches from a shared pool as in emit_and_propagate(),
+	// so a slow batch never holds up the others.
+	WorkPool pool;
+	const size_t low_water = omp_get_max_threads() * batch_size;
+	#pragma omp parallel reduction(+:n_created)
+	{
+		EventBatch batch(batch_size, reproducible);
+		while(true){
+			top_up_work(&pool, low_water);
+
+			//--- EMIT NEW PARTICLES INTO FREE SLOTS ---
+			// from this rank's queue, then other ranks' if work stealing
+			bool done = false;
+			size_t n_finished = 0;
+			for(size_t i=0; i<batch.size() and batch.n_active<batch.size(); i++){
+				if(batch.active[i]) continue;
+				int rank;
+				size_t id;
+				if(not take_work(&pool, &rank, &id, &done)) break;
+				EinsteinHelper* eh = &batch.background[i];
+				batch.bin[i] = emit_particle(id, eh, rank);
+				if(eh->fate == moving){
+					n_created++;
+					n_active[eh->s]++;
+					batch.store(i);
+					batch.save_rng(rangen, i);
+					batch.nevents[i] = 0;
+					batch.active[i] = 1;
+					batch.n_active++;
+				}
+				else n_finished++;
+			}
+			if(batch.n_active==0 and done) break;
+
+			//--- ONE EVENT FOR EVERY PARTICLE IN THE BATCH ---
+			if(batch.n_active>0){
+				(this->*event_kernel)(&batch);
+				n_finished += batch.n_finished;
+			}
+			progress_work_queue();
+
+			// progress out of the particles this rank has claimed so far
+			size_t my_ndone;
+			#pragma omp atomic capture
+			my_ndone = ndone += n_finished;
+			if(verbose and n_finished>0){
+				size_t my_nclaimed;
+				#pragma omp atomic read
+				my_nclaimed = pool.n_claimed;
+				size_t this_percent = (double)my_ndone/(double)my_nclaimed*100.;
+				if(this_percent != last_percent){
+					#pragma omp critical
+					{
+						last_percent = this_percent;
+						cout << "\r"<<my_ndone<<"/"<<my_nclaimed << " (" << this_percent<<"%)" << flush;
+					}
+				}
+			}
+		}
+	} //#pragma omp parallel
+	if(verbose) cout << endl;
+	PRINT_ASSERT(ndone,==,pool.n_claimed);
+	stop_work_queue();
+	stop_tallies();
+
+	if(verbose) cout << "#   created " << n_created << " particles on rank 0 ("
+			<< pool.n_claimed-n_created << " rouletted immediately)" << endl;
+}
+
+//----------------------------------------------------------
+// Advance every particle in the batch by one event. Does the
+// same as one pass through the loop in propagate(), stage by
+// stage over the whole batch. The array loops run over every
+// slot, empty or not, so they have no branches to stop them
+// vectorizing. What they compute for empty slots is never used.
+//----------------------------------------------------------
+template<class GridT, class SpectrumT>
+void Transport::event_round(EventBatch* b){
+	const GridT* grid = static_cast<const GridT*>(this->grid);
+	const size_t n = b->size();
+	const double min_step = min_step_size, max_step = max_step_size;
+	b->n_finished = 0;
+
+	b->active_queue.resize(0);
+	for(size_t i=0; i<n; i++) if(b->active[i]) b->active_queue.push_back(i);
+
+	//--- FIND NEXT EVENT ---
+	// zone size and distance to the zone boundary need the grid
+	for(size_t j=0; j<b->active_queue.size(); j++){
+		const size_t i = b->active_queue[j];
+		const EinsteinHelper* eh = &b->background[i];
+		PRINT_ASSERT(eh->fate, ==, moving);
+		PRINT_ASSERT(b->z_ind[i],>=,0);
+		PRINT_ASSERT(b->N[i],>,0);
+		PRINT_ASSERT(b->N[i],<,1e99);
+		PRINT_ASSERT(b->kup[3][i],>,0);
+		PRINT_ASSERT(b->kup_tet[3][i],>,0);
+		b->zone_min_length[i] = grid->zone_min_length(b->z_ind[i]);
+		b->d_boundary[i] = grid->d_boundary(*eh);
+		b->scatopac[i] = eh->scatopac;
+		b->inelastic_scatopac[i] = eh->inelastic_scatopac;
+		b->nevents[i]++;
+	}
+
+	// step size limits
+	{
+		const double* kx = &b->kup[0][0];
+		const double* ky = &b->kup[1][0];
+		const double* kz = &b->kup[2][0];
+		const double* kt_tet = &b->kup_tet[3][0];
+		const double* zmin = &b->zone_min_length[0];
+		const double* dbound = &b->d_boundary[0];
+		double* d_zone = &b->d_zone[0];
+		double* ds_com = &b->ds_com[0];
+		for(size_t i=0; i<n; i++) // vectorized if sqrt need not set errno (e.g. -ffast-math)
+			d_zone[i] = zone_step(zmin[i], sqrt(kx[i]*kx[i] + ky[i]*ky[i] + kz[i]*kz[i]), kt_tet[i], min_step, max_step);
+		for(size_t i=0; i<n; i++)
+			ds_com[i] = boundary_step(dbound[i], d_zone[i]);
+	}
+
+	// random walk steps, and the optical depths to the next interaction
+	for(size_t j=0; j<b->active_queue.size(); j++){
+		const size_t i = b->active_queue[j];
+		const EinsteinHelper* eh = &b->background[i];
+		b->event[i] = nothing;
+		if(do_randomwalk && b->scatopac[i]*b->ds_com[i]>randomwalk_min_optical_depth){ // coarse check
+			const double d_randomwalk = randomwalk_distance<GridT>(eh, b->d_zone[i]);
+			if(b->scatopac[i] * d_randomwalk > randomwalk_min_optical_depth){ // real check
+				b->ds_com[i] = d_randomwalk;
+				b->event[i] = randomwalk;
+			}
+		}
+		if(b->event[i]==randomwalk) b->d_elastic[i] = b->d_inelastic[i] = INFINITY;
+		else{
+			double tau[2];
+			b->load_rng(rangen, i);
+			rangen.exponential(tau,2);
+			b->save_rng(rangen, i);
+			b->d_elastic[i] = tau[0];
+			b->d_inelastic[i] = tau[1];
+		}
+	}
+
+	// elastic and inelastic scattering distances. The division has
+	// its own loop so the selection loop has nothing that can trap.
+	{
+		const double* scatopac = &b->scatopac[0];
+		const double* inelastic_scatopac = &b->inelastic_scatopac[0];
+		double* d_el = &b->d_elastic[0];
+		double* d_inel = &b->d_inelastic[0];
+		double* ds_com = &b->ds_com[0];
+		ParticleEvent* event = &b->event[0];
+		for(size_t i=0; i<n; i++){
+			d_el[i]   /= scatopac[i];
+			d_inel[i] /= inelastic_scatopac[i];
+		}
+		for(size_t i=0; i<n; i++){
+			double ds = ds_com[i];
+			ParticleEvent ev = event[i];
+			choose_interaction(d_el[i], d_inel[i], scatopac[i], inelastic_scatopac[i], &ds, &ev);
+			ds_com[i] = ds;
+			event[i] = ev;
+		}
+	}
+
+	b->randomwalk_queue.resize(0);
+	b->move_queue.resize(0);
+	for(size_t j=0; j<b->active_queue.size(); j++){
+		const size_t i = b->active_queue[j];
+		PRINT_ASSERT(b->ds_com[i],>,0);
+		PRINT_ASSERT(b->ds_com[i],<,INFINITY);
+		if(b->event[i]==randomwalk) b->randomwalk_queue.push_back(i);
+		else b->move_queue.push_back(i);
+	}
+
+	//--- RANDOM WALK ---
+	for(size_t j=0; j<b->randomwalk_queue.size(); j++){
+		const size_t i = b->randomwalk_queue[j];
+		EinsteinHelper* eh = &b->background[i];
+		b->load(i);
+		b->load_rng(rangen, i);
+		random_walk<GridT,SpectrumT>(eh);
+		if(eh->fate==moving) window(eh);
+		b->save_rng(rangen, i);
+		b->store(i);
+		b->ds_com[i] = 0; // so the drift below leaves it where it is
+	}
+
+	//--- MOVE ---
+	// affine parameter of each step
+	{
+		const double* ds_com = &b->ds_com[0];
+		const double* kt_tet = &b->kup_tet[3][0];
+		double* dlambda = &b->dlambda[0];
+		for(size_t i=0; i<n; i++) dlambda[i] = ds_com[i] / kt_tet[i];
+	}
+
+	// first kick, then record what the end of the step tallies with
+	for(size_t j=0; j<b->move_queue.size(); j++){
+		const size_t i = b->move_queue[j];
+		EinsteinHelper* eh = &b->background[i];
+		b->load(i);
+		PRINT_ASSERT(abs(eh->g.dot<4>(eh->kup,eh->kup)) / (eh->kup[3]*eh->kup[3]), <=, TINY);
+		PRINT_ASSERT(b->dlambda[i],>=,0);
+		if(DO_GR){
+			eh->kup += eh->dk_dlambda() * 0.5*b->dlambda[i];
+			for(size_t d=0; d<4; d++) b->kup[d][i] = eh->kup[d];
+		}
+		b->start[i] = StepStart(*eh);
+	}
+
+	// drift
+	for(size_t d=0; d<4; d++){
+		double* x = &b->xup[d][0];
+		const double* k = &b->kup[d][0];
+		const double* dlambda = &b->dlambda[0];
+		for(size_t i=0; i<n; i++) x[i] += k[i] * dlambda[i];
+	}
+
+	// rebuild the background at the new position, absorb, tally, and scatter
+	for(size_t j=0; j<b->move_queue.size(); j++){
+		const size_t i = b->move_queue[j];
+		EinsteinHelper* eh = &b->background[i];
+		for(size_t d=0; d<4; d++) eh->xup[d] = b->xup[d][i];
+		b->load_rng(rangen, i);
+		end_move<GridT,SpectrumT>(eh, b->start[i], b->dlambda[i]);
+		if(eh->z_ind>=0 and (b->event[i]==elastic_scatter or b->event[i]==inelastic_scatter))
+			scatter<GridT,SpectrumT>(eh, b->event[i]);
+		if(eh->fate==moving) window(eh);
+		b->save_rng(rangen, i);
+		b->store(i);
+	}
+
+	//--- TALLY THE PARTICLES THAT DIED ---
+	// each particle's cost is added once, when it dies
+	for(size_t j=0; j<b->active_queue.size(); j++){
+		const size_t i = b->active_queue[j];
+		const EinsteinHelper* eh = &b->background[i];
+		if(eh->fate==moving){
+			PRINT_ASSERT(abs(eh->g.dot<4>(eh->kup,eh->kup)) / (eh->kup[3]*eh->kup[3]), <=, TINY);
+			continue;
+		}
+		tally_fate(eh);
+		if(load_balance) emission_cost[b->bin[i]] += b->nevents[i]; // cost is counted in events
+		b->active[i] = 0;
+		b->n_active--;
+		b->n_finished++;
+	}
+}
+
+#define INSTANTIATE_EVENT_KERNELS(GridT,SpectrumT) \
+	template void Transport::event_round<GridT,SpectrumT>(EventBatch* batch);
+TRANSPORT_KERNEL_TYPES(INSTANTIATE_EVENT_KERNELS)
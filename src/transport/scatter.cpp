@@ -28,6 +28,15 @@
 #include "Species.h"
 #include "Transport.h"
 #include "Grid.h"
+#include "Grid0DIsotropic.h"
+#include "Grid1DSphere.h"
+#include "Grid2DSphere.h"
+#include "Grid3DCart.h"
+#include "GridGR1D.h"
+#include "PolarSpectrumArray.h"
+#include "MomentSpectrumArray.h"
+#include "RadialMomentSpectrumArray.h"
+#include "GR1DSpectrumArray.h"
 #include "global_options.h"
 using namespace std;
 namespace pc = physical_constants;
@@ -54,6 +63,11 @@ void Transport::window(EinsteinHelper *eh) const{
 
 // choose which type of scattering event to do
 void Transport::scatter(EinsteinHelper *eh, const ParticleEvent event) const{
+	scatter<Grid,SpectrumArray>(eh, event);
+}
+template<class GridT, class SpectrumT>
+void Transport::scatter(EinsteinHelper *eh, const ParticleEvent event) const{
+	GridT* grid = static_cast<GridT*>(this->grid);
 	assert(event==elastic_scatter or event==inelastic_scatter);
 
 	// store the old direction
@@ -75,7 +89,7 @@ void Transport::scatter(EinsteinHelper *eh, const ParticleEvent event) const{
 		}
 	}
 
-	grid->fourforce_abs[eh->z_ind] += (kup_tet_old - eh->kup_tet) * eh->N / eh->zone_fourvolume;
+	grid->fourforce_abs_tally.add(grid->fourforce_abs, eh->z_ind, (kup_tet_old - eh->kup_tet) * eh->N / eh->zone_fourvolume);
 }
 
 double Pescape(double x, int sumN){
@@ -102,9 +116,13 @@ void Transport::init_randomwalk_cdf(Lua* lua){
 	randomwalk_diffusion_time.interpolation_order = 1;
 	randomwalk_xaxis = Axis(0,randomwalk_max_x,npoints);
 
+	// set() clears the search tree, so only compute the values in parallel
+	vector<double> P(npoints+1);
 	#pragma omp parallel for
 	for(int i=1; i<=npoints; i++)
-	  randomwalk_diffusion_time.set(i,Pescape(randomwalk_xaxis.top[i], randomwalk_sumN));
+	  P[i] = Pescape(randomwalk_xaxis.top[i], randomwalk_sumN);
+	for(int i=1; i<=npoints; i++)
+	  randomwalk_diffusion_time.set(i,P[i]);
 	randomwalk_diffusion_time.normalize();
 }
 
@@ -112,6 +130,11 @@ void Transport::init_randomwalk_cdf(Lua* lua){
 // Do a random walk step
 //----------------------
 void Transport::random_walk(EinsteinHelper *eh) const{
+	random_walk<Grid,SpectrumArray>(eh);
+}
+template<class GridT, class SpectrumT>
+void Transport::random_walk(EinsteinHelper *eh) const{
+	GridT* grid = static_cast<GridT*>(this->grid);
 	PRINT_ASSERT(eh->scatopac,>,0);
 	PRINT_ASSERT(eh->absopac,>=,0);
 	PRINT_ASSERT(eh->N,>=,0);
@@ -183,9 +206,9 @@ void Transport::random_walk(EinsteinHelper *eh) const{
 	  
 	  // contribute isotropically
 	  double Eiso = eh->kup_tet[3] * Naverage * ds_iso / (eh->zone_fourvolume*pc::c);
-	  grid->distribution[eh->s]->add_isotropic_single(eh->dir_ind, Eiso);
-	  grid->l_abs[eh->z_ind] += (Nold - Nfinal) * species_list[eh->s]->lepton_number / eh->zone_fourvolume;
-	  grid->fourforce_abs[eh->z_ind] += eh->kup_tet * (Nold - Nfinal) / eh->zone_fourvolume;
+	  static_cast<SpectrumT*>(grid->distribution[eh->s])->add_isotropic_single(eh->dir_ind, Eiso);
+	  grid->l_abs_tally.add(grid->l_abs, eh->z_ind, (Nold - Nfinal) * species_list[eh->s]->lepton_number / eh->zone_fourvolume);
+	  grid->fourforce_abs_tally.add(grid->fourforce_abs, eh->z_ind, eh->kup_tet * (Nold - Nfinal) / eh->zone_fourvolume);
 	  
 	  // move neutrino forward in time
 	  eh->xup[3] += ds_iso * eh->u[3];
@@ -208,11 +231,12 @@ void Transport::random_walk(EinsteinHelper *eh) const{
 	  PRINT_ASSERT(abs(kup_tet_old[3]-eh->kup_tet[3])/kup_tet_old[3],<,TINY);
 
 	  // account for change in the fluid
-	  grid->fourforce_abs[eh->z_ind] += (kup_tet_old - eh->kup_tet) * eh->N / eh->zone_fourvolume;
+	  grid->fourforce_abs_tally.add(grid->fourforce_abs, eh->z_ind, (kup_tet_old - eh->kup_tet) * eh->N / eh->zone_fourvolume);
 	  
 	  // move for the small timestep
 	  eh->ds_com = ds_adv;
-	  move(eh);
+	  move<GridT,SpectrumT>(eh);
+	  check_ghost_reach(eh);
 	}
 
 	//=====================//
@@ -226,12 +250,13 @@ void Transport::random_walk(EinsteinHelper *eh) const{
 	  eh->set_kup_tet(kup_tet);
 
 	  // account for change in the fluid
-	  grid->fourforce_abs[eh->z_ind] += (kup_tet_old - eh->kup_tet) * eh->N / eh->zone_fourvolume;
+	  grid->fourforce_abs_tally.add(grid->fourforce_abs, eh->z_ind, (kup_tet_old - eh->kup_tet) * eh->N / eh->zone_fourvolume);
 
 	  // move forward
 	  eh->ds_com = ds_free;
-	  move(eh);
+	  move<GridT,SpectrumT>(eh);
 	  if(eh->fate!=moving) return;
+	  check_ghost_reach(eh);
 
 	  // select a random outward direction. Use delta=2 to make pdf=costheta
 	  kup_tet_old = eh->kup_tet;
@@ -242,7 +267,7 @@ void Transport::random_walk(EinsteinHelper *eh) const{
 	  eh->set_kup_tet(kup_tet);
 	
 	  // account for change in the fluid
-	  grid->fourforce_abs[eh->z_ind] += (kup_tet_old - eh->kup_tet) * eh->N / eh->zone_fourvolume;
+	  grid->fourforce_abs_tally.add(grid->fourforce_abs, eh->z_ind, (kup_tet_old - eh->kup_tet) * eh->N / eh->zone_fourvolume);
 	}
 }
 
@@ -251,21 +276,44 @@ void Transport::sample_scattering_final_state(EinsteinHelper *eh, const Tuple<do
 	PRINT_ASSERT(grid->scattering_delta[eh->s].size(),>,0);
 	PRINT_ASSERT(kup_tet_old[3],==,eh->kup_tet[3]);
 
-	// rejection sampling to get outgoing frequency bin.
+	// Sample the outgoing frequency bin. The interpolated kernel is a
+	// weighted sum of the kernels at the corners of icube_spec, so pick
+	// a corner with probability weight*inelastic opacity (which sum to
+	// inelastic_scatopac) and then sample that corner's alias table
+	// (or its compressed kernel).
+	// This gives exactly the distribution of the interpolated kernel.
+	const InterpolationCube<NDIMS+1>& icube = eh->icube_spec;
+	double U[2];
+	rangen.uniform(U,2);
+	const double target = U[0] * eh->inelastic_scatopac;
+	double cumulative = 0;
+	size_t corner = icube.ncorners;
+	for(size_t c=0; c<icube.ncorners; c++){
+		const double P = grid->opac[eh->s][icube.indices[c]][OPAC_INELASTIC] * icube.weights[c];
+		if(P<=0) continue;
+		corner = c;
+		cumulative += P;
+		if(target < cumulative) break;
+	}
+	PRINT_ASSERT(corner,<,icube.ncorners);
+	const size_t row = icube.indices[corner];
 	size_t igout;
-	double P;
-	do{
-		igout = rangen.uniform_discrete(0, grid->nu_grid_axis.size()-1);
-		P = grid->partial_scat_opac[eh->s][igout].interpolate(eh->icube_spec) / eh->inelastic_scatopac;
-		PRINT_ASSERT(P-1.0,<=,TINY);
-		PRINT_ASSERT(P,>=,0.0);
-	} while(rangen.uniform() > P);
+	double delta;
+	if(grid->inelastic_rank>0){
+		// use the chosen corner's own anisotropy, kept inside |delta|<3
+		igout = grid->inelastic_kernel0[eh->s].sample(row, U[1]);
+		const double phi0 = grid->inelastic_kernel0[eh->s].evaluate_positive(row, igout);
+		const double phi1 = grid->inelastic_kernel1[eh->s].evaluate(row, igout);
+		delta = min(2.99, max(-2.99, phi1/phi0));
+	}
+	else{
+		igout = grid->inelastic_alias[eh->s].sample(row, U[1]);
+		// interpolate the kernel anisotropy
+		delta = grid->scattering_delta[eh->s][igout].interpolate(eh->icube_spec);
+	}
 
 	// Scatter to the center of the new bin.
 	double outnu = grid->nu_grid_axis.mid[igout];
-	//cout<<"inelastic"<<endl;
-	// interpolate the kernel anisotropy
-	double delta = grid->scattering_delta[eh->s][igout].interpolate(eh->icube_spec);
 	PRINT_ASSERT(fabs(delta),<,3.0);
 
 	// rejection sample the new direction, but only if not absurdly forward/backward peaked
@@ -295,3 +343,7 @@ void Transport::sample_scattering_final_state(EinsteinHelper *eh, const Tuple<do
 	PRINT_ASSERT(eh->N,<,1e99);
 }
 
+#define INSTANTIATE_SCATTER_KERNELS(GridT,SpectrumT) \
+	template void Transport::scatter<GridT,SpectrumT>(EinsteinHelper *eh, const ParticleEvent event) const; \
+	template void Transport::random_walk<GridT,SpectrumT>(EinsteinHelper *eh) const;
+TRANSPORT_KERNEL_TYPES(INSTANTIATE_SCATTER_KERNELS)
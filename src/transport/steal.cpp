@@ -0,0 +1,185 @@
+/*
+//  Copyright (c) 2015, California Institute of Technology and the Regents
+//  of the University of California, based on research sponsored by the
+//  United States Department of Energy. All rights reserved.
+//
+//  This file is part of Sedonu.
+//
+//  Sedonu is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  Neither the name of the California Institute of Technology (Caltech)
+//  nor the University of California nor the names of its contributors
+//  may be used to endorse or promote products derived from this software
+//  without specific prior written permission.
+//
+//  Sedonu is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with Sedonu.  If not, see <http://www.gnu.org/licenses/>.
+//
+*/
+
+
+#include <mpi.h>
+#include <omp.h>
+#include <algorithm>
+#include "global_options.h"
+#include "Transport.h"
+
+using namespace std;
+
+//===========================================================//
+// CROSS-RANK WORK STEALING                                  //
+// Every rank exposes the next unclaimed local particle ID   //
+// of its emission queue in an MPI window. Ranks claim       //
+// chunks of their own queue with MPI_Fetch_and_op, and when //
+// it runs dry they claim chunks of the other ranks' queues  //
+// the same way. The grid is replicated and any rank can     //
+// create any other rank's particles (see emission.cpp), so  //
+// a claimed chunk is all a thief needs. Particles keep      //
+// their global IDs, so reproducible mode is unaffected.     //
+//===========================================================//
+
+//----------------------------------------------------------
+// open the queues for one emission pass (collective)
+//----------------------------------------------------------
+void Transport::start_work_queue(){
+	work_queue_size.resize(MPI_nprocs);
+	work_known_next.assign(MPI_nprocs, 0);
+	for(int p=0; p<MPI_nprocs; p++) work_queue_size[p] = n_emit_this_pass(p);
+	work_victim_offset = 0;
+	if(not work_stealing or MPI_nprocs==1) return;
+
+	work_next = 0;
+	MPI_Win_create(&work_next, sizeof(long), sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &work_window);
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, work_window);
+}
+
+//----------------------------------------------------------
+// Claim up to max_n particles. Returns false when every
+// queue is empty. Called by the master thread only.
+//----------------------------------------------------------
+bool Transport::claim_work(const size_t max_n, int* rank, size_t* start, size_t* n){
+	PRINT_ASSERT(max_n,>,0);
+
+	// without stealing, hand out this rank's queue in order
+	if(not work_stealing or MPI_nprocs==1){
+		const size_t total = work_queue_size[MPI_myID];
+		const size_t next = work_known_next[MPI_myID];
+		if(next >= total) return false;
+		*rank = MPI_myID;
+		*start = next;
+		*n = min(max_n, total-next);
+		work_known_next[MPI_myID] += *n;
+		return true;
+	}
+
+	// own queue first, then the others in turn. Own chunks shrink as
+	// the queue empties so the last one can't leave a long tail.
+	while(work_victim_offset < MPI_nprocs){
+		const int victim = (MPI_myID + work_victim_offset) % MPI_nprocs;
+		const size_t total = work_queue_size[victim];
+		if(work_known_next[victim] < total){
+			const size_t remaining = total - work_known_next[victim];
+			size_t chunk = (victim==MPI_myID ? max((size_t)work_steal_chunk, remaining/4) : work_steal_chunk);
+			chunk = min(chunk, max_n);
+			long add = chunk, old;
+			MPI_Fetch_and_op(&add, &old, MPI_LONG, victim, 0, MPI_SUM, work_window);
+			MPI_Win_flush(victim, work_window);
+			work_known_next[victim] = old + chunk;
+			if((size_t)old < total){
+				*rank = victim;
+				*start = old;
+				*n = min(chunk, total-old);
+				if(victim != MPI_myID) n_stolen += *n;
+				return true;
+			}
+		}
+		work_victim_offset++;
+	}
+	return false;
+}
+
+//----------------------------------------------------------
+// Claim another chunk into the threads' shared pool if it is
+// running low. Does nothing on threads other than the master.
+//----------------------------------------------------------
+void Transport::top_up_work(WorkPool* pool, const size_t low_water){
+	if(omp_get_thread_num()!=0 or pool->empty) return;
+	bool top_up;
+	#pragma omp critical(work_pool)
+	top_up = (pool->left < low_water);
+	if(not top_up) return;
+
+	WorkChunk chunk;
+	size_t n;
+	const bool claimed = claim_work(work_queue_size[MPI_myID]+1, &chunk.rank, &chunk.next, &n);
+	chunk.end = chunk.next + n;
+	#pragma omp critical(work_pool)
+	{
+		if(claimed){
+			pool->chunks.push_back(chunk);
+			pool->left += n;
+			#pragma omp atomic
+			pool->n_claimed += n;
+		}
+		else pool->empty = true;
+	}
+}
+
+//----------------------------------------------------------
+// Take the next particle out of the pool. Returns false if
+// the pool is empty, and then sets done if nothing is left
+// to claim either.
+//----------------------------------------------------------
+bool Transport::take_work(WorkPool* pool, int* rank, size_t* local_id, bool* done){
+	bool have_particle = false;
+	*done = false;
+	#pragma omp critical(work_pool)
+	{
+		if(pool->left>0){
+			*rank = pool->chunks.front().rank;
+			*local_id = pool->chunks.front().next++;
+			if(pool->chunks.front().next == pool->chunks.front().end) pool->chunks.pop_front();
+			pool->left--;
+			have_particle = true;
+		}
+		else *done = pool->empty;
+	}
+	return have_particle;
+}
+
+//----------------------------------------------------------
+// Close the queues (collective with work stealing, otherwise
+// nothing to do). The time spent freeing the window is how
+// long this rank sat idle waiting for the slowest rank.
+//----------------------------------------------------------
+void Transport::stop_work_queue(){
+	if(not work_stealing or MPI_nprocs==1) return;
+	const double idle_start = MPI_Wtime();
+	MPI_Win_unlock_all(work_window);
+	MPI_Win_free(&work_window);
+	double idle[2] = {MPI_Wtime() - idle_start, (double)n_stolen};
+	double max_idle, sum[2];
+	MPI_Reduce(&idle[0], &max_idle, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+	MPI_Reduce(idle,     sum,       2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+	if(verbose) cout << "#   Tail idle time: " << max_idle << " seconds max, " << sum[0]/MPI_nprocs
+			<< " mean (" << (size_t)sum[1] << " particles stolen)" << endl;
+	n_stolen = 0;
+}
+
+//----------------------------------------------------------
+// Let MPI progress other ranks' claims on this rank's queue
+// while the threads are busy. Only the master thread may call MPI.
+//----------------------------------------------------------
+void Transport::progress_work_queue() const{
+	if(not work_progress or omp_get_thread_num()!=0) return;
+	int flag;
+	MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
+}
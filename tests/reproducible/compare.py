@@ -0,0 +1,50 @@
+import h5py
+import numpy as np
+import re
+
+def identical(base_name, run):
+    base = h5py.File("fluid_"+base_name+".h5","r")
+    f = h5py.File("fluid_"+run+".h5","r")
+    run_passing = True
+    for key in base.keys():
+        if not isinstance(base[key], h5py.Dataset):
+            continue
+        same = np.array_equal(np.array(base[key]), np.array(f[key]))
+        if not same:
+            print(run, key, "DIFFERS")
+        run_passing = run_passing and same
+    print(run, "bitwise identical to", base_name+":", run_passing)
+    return run_passing
+
+# every reproducible run must match the single-thread, single-rank run bit for bit
+passing = True
+for run in ["1x4","3x1","event","ownership","multistep_1"]:
+    passing = identical("1x1", run) and passing
+
+# load balancing only uses measured costs from the second step on,
+# so every step of the balanced run must match the unbalanced one
+text = open("log_balance.txt").read()
+measured = [float(x) for x in re.findall(r"Emission load imbalance \(max/mean cost per rank\): ([0-9.eE+-]+) last step", text)]
+print("measured emission imbalance before each rebalance:", measured)
+passing = passing and len(measured)>0
+for step in ["1","2","3"]:
+    passing = identical("multistep_"+step, "balance_"+step) and passing
+
+# event mode must also match history mode when roulette fires
+def rouletted_energy(filename):
+    text = open("log_"+filename+".txt").read()
+    return sum([float(e) for e in re.findall(r"([0-9.eE+-]+) ERG/S TOTAL ROULETTED PARTICLE ENERGY", text)])
+e_roulette = rouletted_energy("roulette")
+print("rouletted energy:", e_roulette, "erg/s")
+passing = passing and e_roulette>0
+passing = identical("roulette", "roulette_event") and passing
+
+# overhead relative to the same generator without exact tallies
+def propagate_time(filename):
+    text = open("log_"+filename+".txt").read()
+    return sum([float(t) for t in re.findall(r"Emission and propagation took ([0-9.eE+-]+) seconds", text)])
+t_repro = propagate_time("1x4")
+t_ref = propagate_time("reference")
+print("propagation time (4 threads): reproducible", t_repro, "s, reference", t_ref, "s, overhead", (t_repro/t_ref-1.)*100., "%")
+
+assert(passing)
@@ -0,0 +1,6 @@
+dofile("param_multistep.lua")
+
+-- Load Balancing
+
+load_balance = 1
+work_stealing = 1
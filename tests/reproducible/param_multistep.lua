@@ -0,0 +1,5 @@
+dofile("param.lua")
+
+-- General Controls
+
+max_n_iter = 3
@@ -0,0 +1,5 @@
+dofile("param.lua")
+
+-- Zone Ownership
+
+zone_ownership = 1
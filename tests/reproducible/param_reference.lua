@@ -0,0 +1,7 @@
+dofile("param.lua")
+
+-- Reproducibility (off, for the overhead reference)
+
+reproducible = 0
+rng_seed = nil
+rng_backend = "philox"
@@ -0,0 +1,7 @@
+dofile("param.lua")
+
+-- Biasing
+
+-- high enough that many packets are rouletted, so the random numbers
+-- drawn by window() after each move must come from the right stream
+min_packet_weight = 0.5
@@ -0,0 +1,6 @@
+dofile("param_roulette.lua")
+
+-- Event-Based Transport
+
+transport_mode = "event"
+event_bank_size = 1000
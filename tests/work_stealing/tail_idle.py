@@ -0,0 +1,23 @@
+import re
+import sys
+
+# tail idle time (ranks waiting for the slowest rank at the end of
+# propagation) with work stealing, summed over iterations. Without
+# stealing no idle time is measured, so compare propagation times.
+def tail_idle(filename):
+    text = open(filename).read()
+    idle = re.findall(r"Tail idle time: ([0-9.eE+-]+) seconds max, ([0-9.eE+-]+) mean \(([0-9]+) particles stolen\)", text)
+    prop = re.findall(r"Emission and propagation took ([0-9.eE+-]+) seconds", text)
+    max_idle  = sum([float(i[0]) for i in idle])
+    mean_idle = sum([float(i[1]) for i in idle])
+    stolen    = sum([int(i[2]) for i in idle])
+    return sum([float(p) for p in prop]), max_idle, mean_idle, stolen
+
+print("%6s %8s %12s %12s %12s %10s" % ("nprocs", "mode", "propagate(s)", "max idle(s)", "mean idle(s)", "stolen"))
+for n in sys.argv[1:]:
+    for mode in ["static", "steal"]:
+        t, max_idle, mean_idle, stolen = tail_idle("log_"+mode+"_"+n+".txt")
+        if mode=="static":
+            print("%6s %8s %12.3f %12s %12s %10s" % (n, mode, t, "-", "-", "-"))
+        else:
+            print("%6s %8s %12.3f %12.3f %12.3f %10d" % (n, mode, t, max_idle, mean_idle, stolen))
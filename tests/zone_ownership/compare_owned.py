@@ -0,0 +1,49 @@
+import h5py
+import numpy as np
+import sys
+
+# zone tallies that each rank owns after the reduce-scatter
+def zone_keys(f):
+    keys = ["four-force[abs](erg|ccm|s,tet)", "four-force[emit](erg|ccm|s,tet)",
+            "l_abs(1|s|ccm,tet)", "l_emit(1|s|ccm,tet)"]
+    keys += [key for key in f.keys() if key.startswith("distribution")]
+    return keys
+
+# zones [start,end) owned by each rank: whole slabs of the first
+# axis, rounded up as in Transport::init_zone_ownership
+def owned_ranges(nzones, nslabs, nprocs):
+    zones_per_slab = nzones // nslabs
+    ends = [zones_per_slab * (((p+1)*nslabs + nprocs-1) // nprocs) for p in range(nprocs)]
+    return [(0 if p==0 else ends[p-1], ends[p]) for p in range(nprocs)]
+
+# reproducible runs: every rank's owned zones must match the
+# replicated run bit for bit
+passing = True
+base = h5py.File("fluid_replicated.h5","r")
+nzones = base["rho(g|ccm,tet)"].size
+nslabs = base["rho(g|ccm,tet)"].shape[0]
+for n in [int(n) for n in sys.argv[1:]]:
+    f = h5py.File("fluid_owned_"+str(n)+".h5","r")
+    for rank, (start, end) in enumerate(owned_ranges(nzones, nslabs, n)):
+        rank_passing = True
+        for key in zone_keys(base):
+            a = np.array(base[key]).reshape(nzones, -1)[start:end]
+            b = np.array(f[key]).reshape(nzones, -1)[start:end]
+            same = np.array_equal(a, b)
+            if not same:
+                print("  nprocs", n, "rank", rank, key, "DIFFERS")
+            rank_passing = rank_passing and same
+        print("nprocs", n, "rank", rank, "zones", "["+str(start)+","+str(end)+")", "bitwise identical:", rank_passing)
+        passing = passing and rank_passing
+
+# independent random streams: zone-integrated tallies must agree statistically
+base = h5py.File("fluid_replicated_random.h5","r")
+f = h5py.File("fluid_owned_random.h5","r")
+for key in zone_keys(base):
+    a = np.sum(np.array(base[key]))
+    b = np.sum(np.array(f[key]))
+    relerr = abs(a-b) / max(abs(a), abs(b), 1e-300)
+    print("random streams", key, "total relative difference", relerr)
+    passing = passing and relerr < 0.02
+
+assert(passing)